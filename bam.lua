@@ -216,6 +216,7 @@ function build(settings)
 	
 	versionserver = Compile(settings, Collect("src/versionsrv/*.cpp"))
 	masterserver = Compile(settings, Collect("src/mastersrv/*.cpp"))
+	benchmarks = Compile(settings, Collect("src/benchmarks/*.cpp"))
 	game_shared = Compile(settings, Collect("src/game/*.cpp"), nethash, network_source)
 	game_client = Compile(settings, CollectRecursive("src/game/client/*.cpp"), client_content_source)
 	game_server = Compile(settings, CollectRecursive("src/game/server/*.cpp"), server_content_source)
@@ -234,7 +235,7 @@ function build(settings)
 	tools = {}
 	for i,v in ipairs(tools_src) do
 		toolname = PathFilename(PathBase(v))
-		tools[i] = Link(settings, toolname, Compile(settings, v), engine, zlib, pnglite)
+		tools[i] = Link(settings, toolname, Compile(settings, v), engine, game_shared, zlib, pnglite)
 	end
 	
 	-- build client, server, version server and master server
@@ -256,6 +257,10 @@ function build(settings)
 	masterserver_exe = Link(server_settings, "mastersrv", masterserver,
 		engine, zlib)
 
+	-- the game server without the network, not part of the default targets
+	benchmarks_exe = Link(server_settings, "benchmarks", benchmarks,
+		engine, game_shared, game_server, zlib)
+
 	-- make targets
 	c = PseudoTarget("client".."_"..settings.config_name, client_exe, client_depends)
 	s = PseudoTarget("server".."_"..settings.config_name, server_exe, serverlaunch)
@@ -264,6 +269,7 @@ function build(settings)
 	v = PseudoTarget("versionserver".."_"..settings.config_name, versionserver_exe)
 	m = PseudoTarget("masterserver".."_"..settings.config_name, masterserver_exe)
 	t = PseudoTarget("tools".."_"..settings.config_name, tools)
+	b = PseudoTarget("benchmarks".."_"..settings.config_name, benchmarks_exe)
 
 	all = PseudoTarget(settings.config_name, c, s, v, m, t)
 	return all
@@ -325,8 +331,14 @@ if platform == "macosx"  and arch == "ia32" then
 	PseudoTarget("server_debug", "server_debug_x86", "server_debug_ppc")
 	PseudoTarget("client_release", "client_release_x86", "client_release_ppc")
 	PseudoTarget("client_debug", "client_debug_x86", "client_debug_ppc")
+
+	-- timings are only comparable between optimized builds
+	PseudoTarget("benchmarks", "benchmarks_release_x86")
 else
 	build(debug_settings)
 	build(release_settings)
 	DefaultTarget("game_debug")
+
+	-- timings are only comparable between optimized builds
+	PseudoTarget("benchmarks", "benchmarks_release")
 end
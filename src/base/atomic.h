@@ -0,0 +1,344 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+
+/*
+	Title: Atomics
+*/
+
+#ifndef BASE_ATOMIC_H
+#define BASE_ATOMIC_H
+
+#include "detect.h"
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	#define ATOMIC_INLINE static __inline
+#else
+	#define ATOMIC_INLINE static __inline__
+#endif
+
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+	#define CONF_ATOMIC_BUILTINS 1
+#elif defined(__GNUC__)
+	#define CONF_ATOMIC_SYNC 1
+#elif defined(_MSC_VER)
+	#define CONF_ATOMIC_MSVC 1
+#else
+	#error not implemented on this platform
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+	Group: Atomics
+		Operations on values that are shared between threads without
+		a lock. The functions are inlined, they are meant for the hot
+		paths of queues and counters.
+
+		Every operation takes a memory order:
+
+		ATOMIC_RELAXED - Only the operation itself is atomic.
+		ATOMIC_ACQUIRE - Reads and writes after a load stay after it.
+		ATOMIC_RELEASE - Reads and writes before a store stay before it.
+		ATOMIC_ACQ_REL - Both, for read-modify-write operations.
+		ATOMIC_SEQ_CST - A single total order over all such operations.
+
+	Remarks:
+		- A store with release that is read by a load with acquire
+		makes everything written before the store visible after the
+		load.
+		- Compilers without the __atomic builtins only get full
+		barriers, the order is then always sequentially consistent.
+*/
+enum
+{
+	/* same values as the __ATOMIC_* constants */
+	ATOMIC_RELAXED=0,
+	ATOMIC_ACQUIRE=2,
+	ATOMIC_RELEASE=3,
+	ATOMIC_ACQ_REL=4,
+	ATOMIC_SEQ_CST=5
+};
+
+typedef struct
+{
+	volatile int value;
+} ATOMIC_INT;
+
+/* for counters that can pass 2^31, also on 32 bit platforms */
+typedef struct
+{
+	volatile long long value;
+} ATOMIC_INT64;
+
+typedef struct
+{
+	void * volatile value;
+} ATOMIC_PTR;
+
+#if defined(CONF_ATOMIC_BUILTINS)
+/* the failure order of a compare exchange can't contain a release */
+#define ATOMIC_FAILURE_ORDER(order) ((order) == ATOMIC_RELEASE ? ATOMIC_RELAXED : (order) == ATOMIC_ACQ_REL ? ATOMIC_ACQUIRE : (order))
+#endif
+
+/*
+	Function: atomic_int_load
+		Reads the value.
+*/
+ATOMIC_INLINE int atomic_int_load(const ATOMIC_INT *a, int order)
+{
+#if defined(CONF_ATOMIC_BUILTINS)
+	return __atomic_load_n(&a->value, order);
+#elif defined(CONF_ATOMIC_SYNC)
+	int value;
+	(void)order;
+	__sync_synchronize();
+	value = a->value;
+	__sync_synchronize();
+	return value;
+#else
+	int value;
+	(void)order;
+	_ReadWriteBarrier();
+	value = a->value;
+	_ReadWriteBarrier();
+	return value;
+#endif
+}
+
+/*
+	Function: atomic_int_store
+		Writes the value.
+*/
+ATOMIC_INLINE void atomic_int_store(ATOMIC_INT *a, int value, int order)
+{
+#if defined(CONF_ATOMIC_BUILTINS)
+	__atomic_store_n(&a->value, value, order);
+#elif defined(CONF_ATOMIC_SYNC)
+	(void)order;
+	__sync_synchronize();
+	a->value = value;
+	__sync_synchronize();
+#else
+	(void)order;
+	_InterlockedExchange((volatile long *)&a->value, value);
+#endif
+}
+
+/*
+	Function: atomic_int_exchange
+		Writes the value.
+
+	Returns:
+		The value before the write.
+*/
+ATOMIC_INLINE int atomic_int_exchange(ATOMIC_INT *a, int value, int order)
+{
+#if defined(CONF_ATOMIC_BUILTINS)
+	return __atomic_exchange_n(&a->value, value, order);
+#elif defined(CONF_ATOMIC_SYNC)
+	int old;
+	(void)order;
+	do
+		old = a->value;
+	while(!__sync_bool_compare_and_swap(&a->value, old, value));
+	return old;
+#else
+	(void)order;
+	return _InterlockedExchange((volatile long *)&a->value, value);
+#endif
+}
+
+/*
+	Function: atomic_int_compare_exchange
+		Writes desired if the value equals *expected.
+
+	Returns:
+		1 if the value was written. Otherwise 0 and *expected is set
+		to the current value.
+*/
+ATOMIC_INLINE int atomic_int_compare_exchange(ATOMIC_INT *a, int *expected, int desired, int order)
+{
+#if defined(CONF_ATOMIC_BUILTINS)
+	return __atomic_compare_exchange_n(&a->value, expected, desired, 0, order, ATOMIC_FAILURE_ORDER(order));
+#elif defined(CONF_ATOMIC_SYNC)
+	int old = __sync_val_compare_and_swap(&a->value, *expected, desired);
+	(void)order;
+	if(old == *expected)
+		return 1;
+	*expected = old;
+	return 0;
+#else
+	int old = _InterlockedCompareExchange((volatile long *)&a->value, desired, *expected);
+	(void)order;
+	if(old == *expected)
+		return 1;
+	*expected = old;
+	return 0;
+#endif
+}
+
+/*
+	Function: atomic_int_fetch_add
+		Adds to the value.
+
+	Returns:
+		The value before the addition.
+*/
+ATOMIC_INLINE int atomic_int_fetch_add(ATOMIC_INT *a, int value, int order)
+{
+#if defined(CONF_ATOMIC_BUILTINS)
+	return __atomic_fetch_add(&a->value, value, order);
+#elif defined(CONF_ATOMIC_SYNC)
+	(void)order;
+	return __sync_fetch_and_add(&a->value, value);
+#else
+	(void)order;
+	return _InterlockedExchangeAdd((volatile long *)&a->value, value);
+#endif
+}
+
+/*
+	Function: atomic_int64_load
+		Reads the value.
+*/
+ATOMIC_INLINE long long atomic_int64_load(const ATOMIC_INT64 *a, int order)
+{
+#if defined(CONF_ATOMIC_BUILTINS)
+	return __atomic_load_n(&a->value, order);
+#elif defined(CONF_ATOMIC_SYNC)
+	/* a plain read can tear on 32 bit platforms */
+	(void)order;
+	return __sync_val_compare_and_swap((volatile long long *)&a->value, 0, 0);
+#else
+	(void)order;
+	return _InterlockedCompareExchange64((volatile long long *)&a->value, 0, 0);
+#endif
+}
+
+/*
+	Function: atomic_int64_store
+		Writes the value.
+*/
+ATOMIC_INLINE void atomic_int64_store(ATOMIC_INT64 *a, long long value, int order)
+{
+#if defined(CONF_ATOMIC_BUILTINS)
+	__atomic_store_n(&a->value, value, order);
+#elif defined(CONF_ATOMIC_SYNC)
+	long long old;
+	(void)order;
+	do
+		old = a->value;
+	while(!__sync_bool_compare_and_swap(&a->value, old, value));
+#else
+	long long old;
+	(void)order;
+	do
+		old = a->value;
+	while(_InterlockedCompareExchange64(&a->value, value, old) != old);
+#endif
+}
+
+/*
+	Function: atomic_int64_fetch_add
+		Adds to the value.
+
+	Returns:
+		The value before the addition.
+*/
+ATOMIC_INLINE long long atomic_int64_fetch_add(ATOMIC_INT64 *a, long long value, int order)
+{
+#if defined(CONF_ATOMIC_BUILTINS)
+	return __atomic_fetch_add(&a->value, value, order);
+#elif defined(CONF_ATOMIC_SYNC)
+	(void)order;
+	return __sync_fetch_and_add(&a->value, value);
+#else
+	(void)order;
+	return _InterlockedExchangeAdd64(&a->value, value);
+#endif
+}
+
+/*
+	Function: atomic_ptr_load
+		Reads the pointer.
+*/
+ATOMIC_INLINE void *atomic_ptr_load(const ATOMIC_PTR *a, int order)
+{
+#if defined(CONF_ATOMIC_BUILTINS)
+	return __atomic_load_n(&a->value, order);
+#elif defined(CONF_ATOMIC_SYNC)
+	void *value;
+	(void)order;
+	__sync_synchronize();
+	value = a->value;
+	__sync_synchronize();
+	return value;
+#else
+	void *value;
+	(void)order;
+	_ReadWriteBarrier();
+	value = a->value;
+	_ReadWriteBarrier();
+	return value;
+#endif
+}
+
+/*
+	Function: atomic_ptr_store
+		Writes the pointer.
+*/
+ATOMIC_INLINE void atomic_ptr_store(ATOMIC_PTR *a, void *value, int order)
+{
+#if defined(CONF_ATOMIC_BUILTINS)
+	__atomic_store_n(&a->value, value, order);
+#elif defined(CONF_ATOMIC_SYNC)
+	(void)order;
+	__sync_synchronize();
+	a->value = value;
+	__sync_synchronize();
+#elif defined(CONF_PLATFORM_WIN64)
+	(void)order;
+	_InterlockedExchangePointer(&a->value, value);
+#else
+	(void)order;
+	_InterlockedExchange((volatile long *)&a->value, (long)value);
+#endif
+}
+
+/*
+	Function: atomic_ptr_compare_exchange
+		Writes desired if the pointer equals *expected.
+
+	Returns:
+		1 if the pointer was written. Otherwise 0 and *expected is set
+		to the current pointer.
+*/
+ATOMIC_INLINE int atomic_ptr_compare_exchange(ATOMIC_PTR *a, void **expected, void *desired, int order)
+{
+#if defined(CONF_ATOMIC_BUILTINS)
+	return __atomic_compare_exchange_n(&a->value, expected, desired, 0, order, ATOMIC_FAILURE_ORDER(order));
+#else
+	void *old;
+	(void)order;
+#if defined(CONF_ATOMIC_SYNC)
+	old = __sync_val_compare_and_swap(&a->value, *expected, desired);
+#elif defined(CONF_PLATFORM_WIN64)
+	old = _InterlockedCompareExchangePointer(&a->value, desired, *expected);
+#else
+	old = (void *)_InterlockedCompareExchange((volatile long *)&a->value, (long)desired, (long)*expected);
+#endif
+	if(old == *expected)
+		return 1;
+	*expected = old;
+	return 0;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,283 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include "perf.h"
+
+/*
+	durations are stored in log-linear buckets: values below
+	PERF_LINEAR_LIMIT get a bucket each, above that every power of
+	two is split into PERF_SUB_BUCKETS buckets. this keeps the error
+	below 12.5% while the histogram stays small enough to be updated
+	on every sample.
+*/
+enum
+{
+	PERF_LINEAR_BITS = 4,
+	PERF_LINEAR_LIMIT = 1<<PERF_LINEAR_BITS,
+	PERF_SUB_BITS = 3,
+	PERF_SUB_BUCKETS = 1<<PERF_SUB_BITS,
+	PERF_NUM_BUCKETS = PERF_LINEAR_LIMIT + (31-PERF_LINEAR_BITS+1)*PERF_SUB_BUCKETS
+};
+
+typedef struct
+{
+	const char *name;
+	int current; /* active window */
+	int max[2];
+	int64 sum[2];
+	int64 count[2];
+	int64 total;
+	unsigned buckets[2][PERF_NUM_BUCKETS];
+} PERF_ZONE;
+
+typedef struct
+{
+	int zone;
+	int64 start;
+	int64 duration;
+} PERF_TRACE_EVENT;
+
+static PERF_ZONE zones[PERF_MAX_ZONES];
+static int num_zones = 0;
+static int enabled = 1;
+static int window_ticks = 0;
+static int64 freq = 0;
+
+static PERF_TRACE_EVENT *trace_events = 0;
+static int trace_num_events = 0;
+static int trace_dropped = 0;
+static int trace_ticks_left = 0;
+static int64 trace_start = 0;
+
+static int perf_bucket(unsigned value)
+{
+	int msb = 0;
+	if(value < PERF_LINEAR_LIMIT)
+		return value;
+	while(value>>(msb+1))
+		msb++;
+	return PERF_LINEAR_LIMIT + (msb-PERF_LINEAR_BITS)*PERF_SUB_BUCKETS + ((value>>(msb-PERF_SUB_BITS))&(PERF_SUB_BUCKETS-1));
+}
+
+static int perf_bucket_value(int bucket)
+{
+	int msb;
+	if(bucket < PERF_LINEAR_LIMIT)
+		return bucket;
+	bucket -= PERF_LINEAR_LIMIT;
+	msb = bucket/PERF_SUB_BUCKETS + PERF_LINEAR_BITS;
+	/* report the middle of the bucket */
+	return ((PERF_SUB_BUCKETS + bucket%PERF_SUB_BUCKETS)<<(msb-PERF_SUB_BITS)) + (1<<(msb-PERF_SUB_BITS))/2;
+}
+
+int perf_zone(const char *name)
+{
+	int i;
+	for(i = 0; i < num_zones; i++)
+		if(str_comp(zones[i].name, name) == 0)
+			return i;
+
+	if(num_zones == PERF_MAX_ZONES)
+	{
+		dbg_msg("perf", "too many zones, ignoring '%s'", name);
+		return -1;
+	}
+
+	mem_zero(&zones[num_zones], sizeof(PERF_ZONE));
+	zones[num_zones].name = name;
+	return num_zones++;
+}
+
+int64 perf_begin(int zone)
+{
+	if(!enabled || zone < 0)
+		return 0;
+	return time_get();
+}
+
+void perf_end(int zone, int64 start)
+{
+	PERF_ZONE *z;
+	int64 now, duration;
+	unsigned micros;
+	int w;
+
+	if(!start)
+		return;
+
+	if(!freq)
+		freq = time_freq();
+
+	now = time_get();
+	duration = now-start;
+	micros = (unsigned)((duration*1000000)/freq);
+	z = &zones[zone];
+	w = z->current;
+
+	z->buckets[w][perf_bucket(micros)]++;
+	z->sum[w] += micros;
+	z->count[w]++;
+	z->total++;
+	if((int)micros > z->max[w])
+		z->max[w] = (int)micros;
+
+	if(trace_ticks_left)
+	{
+		if(trace_num_events < PERF_MAX_TRACE_EVENTS)
+		{
+			trace_events[trace_num_events].zone = zone;
+			trace_events[trace_num_events].start = start;
+			trace_events[trace_num_events].duration = duration;
+			trace_num_events++;
+		}
+		else
+			trace_dropped++;
+	}
+}
+
+void perf_tick()
+{
+	int i;
+
+	if(trace_ticks_left)
+		trace_ticks_left--;
+
+	if(++window_ticks < PERF_WINDOW_TICKS)
+		return;
+
+	/* drop the oldest window and start filling it again */
+	window_ticks = 0;
+	for(i = 0; i < num_zones; i++)
+	{
+		int w = zones[i].current^1;
+		mem_zero(zones[i].buckets[w], sizeof(zones[i].buckets[w]));
+		zones[i].max[w] = 0;
+		zones[i].sum[w] = 0;
+		zones[i].count[w] = 0;
+		zones[i].current = w;
+	}
+}
+
+void perf_enable(int enable)
+{
+	enabled = enable;
+}
+
+void perf_reset()
+{
+	int i;
+	for(i = 0; i < num_zones; i++)
+	{
+		const char *name = zones[i].name;
+		mem_zero(&zones[i], sizeof(PERF_ZONE));
+		zones[i].name = name;
+	}
+	window_ticks = 0;
+}
+
+int perf_num_zones()
+{
+	return num_zones;
+}
+
+void perf_zone_stats(int zone, PERF_ZONE_STATS *stats)
+{
+	PERF_ZONE *z = &zones[zone];
+	int64 count, sum, seen, targets[3];
+	int i, t, results[3];
+
+	mem_zero(stats, sizeof(*stats));
+	stats->name = z->name;
+	stats->total = z->total;
+
+	count = z->count[0] + z->count[1];
+	sum = z->sum[0] + z->sum[1];
+	stats->count = count;
+	if(!count)
+		return;
+
+	stats->avg = (int)(sum/count);
+	stats->max = z->max[0] > z->max[1] ? z->max[0] : z->max[1];
+
+	/* walk both windows at once to find the percentiles */
+	targets[0] = (count*50+99)/100;
+	targets[1] = (count*90+99)/100;
+	targets[2] = (count*99+99)/100;
+	seen = 0;
+	t = 0;
+	for(i = 0; i < PERF_NUM_BUCKETS && t < 3; i++)
+	{
+		seen += z->buckets[0][i] + z->buckets[1][i];
+		while(t < 3 && seen >= targets[t])
+			results[t++] = perf_bucket_value(i);
+	}
+	while(t < 3)
+		results[t++] = stats->max;
+
+	/* the bucket middle may lie above the largest sample */
+	for(t = 0; t < 3; t++)
+		if(results[t] > stats->max)
+			results[t] = stats->max;
+
+	stats->p50 = results[0];
+	stats->p90 = results[1];
+	stats->p99 = results[2];
+}
+
+int perf_trace_start(int ticks)
+{
+	if(trace_ticks_left || trace_events || ticks <= 0)
+		return -1;
+
+	trace_events = (PERF_TRACE_EVENT *)mem_alloc(sizeof(PERF_TRACE_EVENT)*PERF_MAX_TRACE_EVENTS, 1);
+	if(!trace_events)
+		return -1;
+
+	trace_num_events = 0;
+	trace_dropped = 0;
+	trace_ticks_left = ticks;
+	trace_start = time_get();
+	return 0;
+}
+
+int perf_trace_ready()
+{
+	return trace_events && !trace_ticks_left;
+}
+
+int perf_trace_write(IOHANDLE io)
+{
+	char buf[256];
+	int i, num;
+
+	if(!perf_trace_ready())
+		return 0;
+
+	if(!freq)
+		freq = time_freq();
+
+	num = 0;
+	if(io)
+	{
+		str_format(buf, sizeof(buf), "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%d},\"traceEvents\":[\n", trace_dropped);
+		io_write(io, buf, str_length(buf));
+
+		for(i = 0; i < trace_num_events; i++)
+		{
+			PERF_TRACE_EVENT *e = &trace_events[i];
+			/* chrome expects microseconds, keep the sub microsecond part for short zones */
+			double ts = (double)(e->start-trace_start)*1000000.0/(double)freq;
+			double dur = (double)e->duration*1000000.0/(double)freq;
+			str_format(buf, sizeof(buf), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}\n",
+				i ? "," : "", zones[e->zone].name, ts, dur);
+			io_write(io, buf, str_length(buf));
+		}
+
+		io_write(io, "]}\n", 3);
+		num = trace_num_events;
+	}
+
+	mem_free(trace_events);
+	trace_events = 0;
+	trace_num_events = 0;
+	return num;
+}
@@ -0,0 +1,156 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+
+/*
+	Title: Performance zones
+*/
+
+#ifndef BASE_PERF_H
+#define BASE_PERF_H
+
+#include "system.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum
+{
+	PERF_MAX_ZONES = 64,
+	PERF_MAX_TRACE_EVENTS = 256*1024,
+
+	/* the histograms are rotated every PERF_WINDOW_TICKS calls to <perf_tick> */
+	PERF_WINDOW_TICKS = 50*30
+};
+
+typedef struct
+{
+	const char *name;
+	int64 count; /* samples in the current window */
+	int64 total; /* samples since the last reset */
+	int p50; /* all durations are in microseconds */
+	int p90;
+	int p99;
+	int max;
+	int avg;
+} PERF_ZONE_STATS;
+
+/*
+	Function: perf_zone
+		Registers a named zone or looks up an already registered one.
+
+	Parameters:
+		name - Name of the zone. The string is not copied, so it must
+			stay valid for the lifetime of the program.
+
+	Returns:
+		Returns the zone id or -1 if there is no free zone left.
+
+	Remarks:
+		- The profiler is not thread safe. Zones must only be entered
+		and left from the main thread.
+		- Cache the result, this does a linear search.
+*/
+int perf_zone(const char *name);
+
+/*
+	Function: perf_begin
+		Enters a zone.
+
+	Returns:
+		Returns the start time that has to be passed to <perf_end>, or 0 if
+		the profiler is disabled.
+*/
+int64 perf_begin(int zone);
+
+/*
+	Function: perf_end
+		Leaves a zone and records the time spent in it.
+
+	Parameters:
+		zone - Zone id returned by <perf_zone>.
+		start - Value returned by the matching <perf_begin>.
+*/
+void perf_end(int zone, int64 start);
+
+/*
+	Function: perf_tick
+		Marks the end of a tick. Rotates the rolling histograms and
+		counts down a running trace capture.
+*/
+void perf_tick();
+
+/*
+	Function: perf_enable
+		Enables or disables sampling. Disabled zones cost a single branch.
+*/
+void perf_enable(int enabled);
+
+/*
+	Function: perf_reset
+		Clears the histograms of all zones.
+*/
+void perf_reset();
+
+/*
+	Function: perf_num_zones
+		Returns the number of registered zones.
+*/
+int perf_num_zones();
+
+/*
+	Function: perf_zone_stats
+		Fetches the percentiles of a zone over the last one to two
+		histogram windows.
+*/
+void perf_zone_stats(int zone, PERF_ZONE_STATS *stats);
+
+/*
+	Function: perf_trace_start
+		Starts recording every zone sample for a number of ticks.
+
+	Returns:
+		Returns 0 on success, -1 if a capture is already running or
+		the trace buffer couldn't be allocated.
+*/
+int perf_trace_start(int ticks);
+
+/*
+	Function: perf_trace_ready
+		Returns 1 if a finished capture is waiting to be written.
+*/
+int perf_trace_ready();
+
+/*
+	Function: perf_trace_write
+		Writes the finished capture as Chrome trace event JSON
+		(chrome://tracing) and releases the trace buffer.
+
+	Parameters:
+		io - File to write to, or 0 to drop the capture. The handle
+			is not closed.
+
+	Returns:
+		Returns the number of events written.
+*/
+int perf_trace_write(IOHANDLE io);
+
+#ifdef __cplusplus
+}
+
+/*
+	Class: CPerfScope
+		Records the time between construction and destruction
+		into a zone.
+*/
+class CPerfScope
+{
+	int m_Zone;
+	int64 m_Start;
+public:
+	CPerfScope(int Zone) : m_Zone(Zone) { m_Start = perf_begin(Zone); }
+	~CPerfScope() { perf_end(m_Zone, m_Start); }
+};
+#endif
+
+#endif
@@ -9,6 +9,7 @@
 
 /*#include "detect.h"*/
 #include "system.h"
+#include "atomic.h"
 /*#include "e_console.h"*/
 
 #if defined(CONF_FAMILY_UNIX)
@@ -26,8 +27,13 @@
 	#include <fcntl.h>
 	#include <pthread.h>
 	#include <arpa/inet.h>
+	#include <sys/mman.h>
 
 	#include <dirent.h>
+
+	#if defined(CONF_PLATFORM_LINUX)
+		#include <sys/inotify.h>
+	#endif
 	
 	#if defined(CONF_PLATFORM_MACOSX)
 		#include <Carbon/Carbon.h>
@@ -42,6 +48,7 @@
 	#include <fcntl.h>
 	#include <direct.h>
 	#include <errno.h>
+	#include <io.h>
 
 	#ifndef EWOULDBLOCK
 		#define EWOULDBLOCK WSAEWOULDBLOCK
@@ -144,15 +151,55 @@ void dbg_logger_file(const char *filename)
 }
 /* */
 
-int memory_alloced = 0;
+/* allocations are counted per call site, sites with the same folder share a tag */
+enum
+{
+	MEM_MAX_SITES=1024, /* a power of two */
+	MEM_MAX_TAGS=64
+};
 
-typedef struct MEMHEADER
+typedef struct
 {
-	const char *filename;
+	ATOMIC_INT live_bytes;
+	ATOMIC_INT live_allocations;
+	ATOMIC_INT peak_bytes;
+	ATOMIC_INT64 allocations; /* since mem_profile_reset, can pass 2^31 between resets */
+	ATOMIC_INT64 allocated_bytes;
+} MEMCOUNTERS;
+
+typedef struct
+{
+	char name[48];
+	MEMCOUNTERS counters;
+} MEMTAG;
+
+typedef struct
+{
+	ATOMIC_PTR filename; /* set last, the site is in use once it is set */
 	int line;
+	MEMTAG *tag;
+	MEMCOUNTERS counters;
+} MEMSITE;
+
+static MEMSITE mem_sites[MEM_MAX_SITES];
+static MEMSITE mem_overflow_site; /* takes everything once the table is full */
+static MEMTAG mem_tags[MEM_MAX_TAGS];
+static int mem_num_tags = 0;
+static ATOMIC_INT mem_sites_lock; /* only taken to add sites, lock_create allocates */
+
+static ATOMIC_INT mem_allocated;
+static ATOMIC_INT mem_active_allocations;
+static ATOMIC_INT mem_total_allocations;
+
+typedef struct MEMHEADER
+{
+	MEMSITE *site;
 	int size;
+#if defined(CONF_DEBUG)
+	/* the list of all blocks is only kept for mem_check */
 	struct MEMHEADER *prev;
 	struct MEMHEADER *next;
+#endif
 } MEMHEADER;
 
 typedef struct MEMTAIL
@@ -160,30 +207,163 @@ typedef struct MEMTAIL
 	int guard;
 } MEMTAIL;
 
+#if defined(CONF_DEBUG)
 static struct MEMHEADER *first = 0;
+#endif
 static const int MEM_GUARD_VAL = 0xbaadc0de;
 
+static void mem_sites_lock_wait()
+{
+	int expected = 0;
+	while(!atomic_int_compare_exchange(&mem_sites_lock, &expected, 1, ATOMIC_ACQUIRE))
+	{
+		expected = 0;
+		thread_yield();
+	}
+}
+
+static void mem_sites_lock_release()
+{
+	atomic_int_store(&mem_sites_lock, 0, ATOMIC_RELEASE);
+}
+
+static MEMTAG *mem_find_tag(const char *filename)
+{
+	/* the tag is the folder of the file below src/ */
+	char name[sizeof(mem_tags[0].name)];
+	const char *start = filename;
+	const char *end = 0;
+	const char *c;
+	int i;
+
+	for(c = filename; *c; c++)
+	{
+		if((*c == '/' || *c == '\\') && c-filename >= 3 && str_comp_num(c-3, "src", 3) == 0 && (c-filename == 3 || c[-4] == '/' || c[-4] == '\\'))
+			start = c+1;
+	}
+	for(c = start; *c; c++)
+	{
+		if(*c == '/' || *c == '\\')
+			end = c;
+	}
+	if(end)
+		str_copy(name, start, end-start+1 < (int)sizeof(name) ? end-start+1 : (int)sizeof(name));
+	else
+		str_copy(name, "other", sizeof(name));
+
+	for(i = 0; i < mem_num_tags; i++)
+	{
+		if(str_comp(mem_tags[i].name, name) == 0)
+			return &mem_tags[i];
+	}
+	if(mem_num_tags == MEM_MAX_TAGS)
+		return &mem_tags[MEM_MAX_TAGS-1];
+	str_copy(mem_tags[mem_num_tags].name, name, sizeof(mem_tags[0].name));
+	return &mem_tags[mem_num_tags++];
+}
+
+static MEMSITE *mem_find_site(const char *filename, int line)
+{
+	/* sites are never removed, so the lookup doesn't need the lock */
+	unsigned hash = (unsigned)(((size_t)filename>>3)^(unsigned)line*2654435761u);
+	int locked = 0;
+	int i;
+
+	for(i = 0; i < MEM_MAX_SITES; i++)
+	{
+		MEMSITE *site = &mem_sites[(hash+i)&(MEM_MAX_SITES-1)];
+		const char *site_filename = (const char *)atomic_ptr_load(&site->filename, ATOMIC_ACQUIRE);
+		if(site_filename == filename && site->line == line)
+		{
+			if(locked)
+				mem_sites_lock_release();
+			return site;
+		}
+		if(site_filename)
+			continue;
+
+		/* free slot, check again with the lock held */
+		if(!locked)
+		{
+			mem_sites_lock_wait();
+			locked = 1;
+			i--;
+			continue;
+		}
+
+		site->line = line;
+		site->tag = mem_find_tag(filename);
+		atomic_ptr_store(&site->filename, (void *)filename, ATOMIC_RELEASE);
+		mem_sites_lock_release();
+		return site;
+	}
+
+	if(locked)
+		mem_sites_lock_release();
+	return &mem_overflow_site;
+}
+
+static void mem_count_alloc(MEMCOUNTERS *counters, int size)
+{
+	int live = atomic_int_fetch_add(&counters->live_bytes, size, ATOMIC_RELAXED)+size;
+	int peak = atomic_int_load(&counters->peak_bytes, ATOMIC_RELAXED);
+	while(live > peak && !atomic_int_compare_exchange(&counters->peak_bytes, &peak, live, ATOMIC_RELAXED))
+		;
+	atomic_int_fetch_add(&counters->live_allocations, 1, ATOMIC_RELAXED);
+	atomic_int64_fetch_add(&counters->allocations, 1, ATOMIC_RELAXED);
+	atomic_int64_fetch_add(&counters->allocated_bytes, size, ATOMIC_RELAXED);
+}
+
+static void mem_count_free(MEMCOUNTERS *counters, int size)
+{
+	atomic_int_fetch_add(&counters->live_bytes, -size, ATOMIC_RELAXED);
+	atomic_int_fetch_add(&counters->live_allocations, -1, ATOMIC_RELAXED);
+}
+
+static void mem_read_counters(MEM_PROFILE_STATS *stats, const MEMCOUNTERS *counters)
+{
+	stats->live_bytes = atomic_int_load(&counters->live_bytes, ATOMIC_RELAXED);
+	stats->live_allocations = atomic_int_load(&counters->live_allocations, ATOMIC_RELAXED);
+	stats->peak_bytes = atomic_int_load(&counters->peak_bytes, ATOMIC_RELAXED);
+	stats->allocations = atomic_int64_load(&counters->allocations, ATOMIC_RELAXED);
+	stats->allocated_bytes = atomic_int64_load(&counters->allocated_bytes, ATOMIC_RELAXED);
+}
+
+static void mem_reset_counters(MEMCOUNTERS *counters)
+{
+	atomic_int64_store(&counters->allocations, 0, ATOMIC_RELAXED);
+	atomic_int64_store(&counters->allocated_bytes, 0, ATOMIC_RELAXED);
+	atomic_int_store(&counters->peak_bytes, atomic_int_load(&counters->live_bytes, ATOMIC_RELAXED), ATOMIC_RELAXED);
+}
+
 void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment)
 {
 	/* TODO: fix alignment */
-	/* TODO: add debugging */
 	MEMHEADER *header = (struct MEMHEADER *)malloc(size+sizeof(MEMHEADER)+sizeof(MEMTAIL));
 	MEMTAIL *tail = (struct MEMTAIL *)(((char*)(header+1))+size);
+	MEMSITE *site = mem_find_site(filename, line);
 	header->size = size;
-	header->filename = filename;
-	header->line = line;
+	header->site = site;
+
+	atomic_int_fetch_add(&mem_allocated, size, ATOMIC_RELAXED);
+	atomic_int_fetch_add(&mem_total_allocations, 1, ATOMIC_RELAXED);
+	atomic_int_fetch_add(&mem_active_allocations, 1, ATOMIC_RELAXED);
 
-	memory_stats.allocated += header->size;
-	memory_stats.total_allocations++;
-	memory_stats.active_allocations++;
+	mem_count_alloc(&site->counters, size);
+	if(site->tag)
+		mem_count_alloc(&site->tag->counters, size);
 	
 	tail->guard = MEM_GUARD_VAL;
 
+#if defined(CONF_DEBUG)
+	mem_sites_lock_wait();
 	header->prev = (MEMHEADER *)0;
 	header->next = first;
 	if(first)
 		first->prev = header;
 	first = header;
+	mem_sites_lock_release();
+#endif
 	
 	/*dbg_msg("mem", "++ %p", header+1); */
 	return header+1;
@@ -195,38 +375,121 @@ void mem_free(void *p)
 	{
 		MEMHEADER *header = (MEMHEADER *)p - 1;
 		MEMTAIL *tail = (MEMTAIL *)(((char*)(header+1))+header->size);
+		MEMSITE *site = header->site;
 		
 		if(tail->guard != MEM_GUARD_VAL)
 			dbg_msg("mem", "!! %p", p);
 		/* dbg_msg("mem", "-- %p", p); */
-		memory_stats.allocated -= header->size;
-		memory_stats.active_allocations--;
+		atomic_int_fetch_add(&mem_allocated, -header->size, ATOMIC_RELAXED);
+		atomic_int_fetch_add(&mem_active_allocations, -1, ATOMIC_RELAXED);
+
+		mem_count_free(&site->counters, header->size);
+		if(site->tag)
+			mem_count_free(&site->tag->counters, header->size);
 		
+#if defined(CONF_DEBUG)
+		mem_sites_lock_wait();
 		if(header->prev)
 			header->prev->next = header->next;
 		else
 			first = header->next;
 		if(header->next)
 			header->next->prev = header->prev;
+		mem_sites_lock_release();
+#endif
 		
 		free(header);
 	}
 }
 
+int mem_profile_tags(MEM_PROFILE_STATS *stats, int max_stats)
+{
+	int num, i;
+	mem_sites_lock_wait();
+	num = mem_num_tags < max_stats ? mem_num_tags : max_stats;
+	for(i = 0; i < num; i++)
+	{
+		stats[i].tag = mem_tags[i].name;
+		stats[i].filename = 0;
+		stats[i].line = 0;
+		mem_read_counters(&stats[i], &mem_tags[i].counters);
+	}
+	mem_sites_lock_release();
+	return num;
+}
+
+int mem_profile_sites(MEM_PROFILE_STATS *stats, int max_stats)
+{
+	MEM_PROFILE_STATS site_stats;
+	int num = 0;
+	int i, k;
+
+	for(i = 0; i <= MEM_MAX_SITES; i++)
+	{
+		MEMSITE *site = i < MEM_MAX_SITES ? &mem_sites[i] : &mem_overflow_site;
+		const char *filename = (const char *)atomic_ptr_load(&site->filename, ATOMIC_ACQUIRE);
+		if(i == MEM_MAX_SITES)
+			filename = "other";
+		else if(!filename)
+			continue;
+
+		site_stats.filename = filename;
+		site_stats.line = site->line;
+		site_stats.tag = site->tag ? site->tag->name : "other";
+		mem_read_counters(&site_stats, &site->counters);
+		if(!site_stats.allocations && !site_stats.live_allocations)
+			continue;
+
+		/* code in headers has a site per translation unit, merge them */
+		for(k = 0; k < num; k++)
+		{
+			if(stats[k].line == site_stats.line && str_comp(stats[k].filename, site_stats.filename) == 0)
+				break;
+		}
+		if(k < num)
+		{
+			stats[k].live_bytes += site_stats.live_bytes;
+			stats[k].live_allocations += site_stats.live_allocations;
+			stats[k].peak_bytes += site_stats.peak_bytes;
+			stats[k].allocations += site_stats.allocations;
+			stats[k].allocated_bytes += site_stats.allocated_bytes;
+		}
+		else if(num < max_stats)
+			stats[num++] = site_stats;
+	}
+	return num;
+}
+
+void mem_profile_reset()
+{
+	int i;
+	for(i = 0; i < MEM_MAX_SITES; i++)
+		mem_reset_counters(&mem_sites[i].counters);
+	mem_reset_counters(&mem_overflow_site.counters);
+	mem_sites_lock_wait();
+	for(i = 0; i < mem_num_tags; i++)
+		mem_reset_counters(&mem_tags[i].counters);
+	mem_sites_lock_release();
+}
+
 void mem_debug_dump(IOHANDLE file)
 {
+	/* live blocks per call site */
+	static MEM_PROFILE_STATS stats[MEM_MAX_SITES+1];
 	char buf[1024];
-	MEMHEADER *header = first;
+	int num, i;
 	if(!file)
 		file = io_open("memory.txt", IOFLAG_WRITE);
 	
 	if(file)
 	{
-		while(header)
+		num = mem_profile_sites(stats, MEM_MAX_SITES+1);
+		for(i = 0; i < num; i++)
 		{
-			str_format(buf, sizeof(buf), "%s(%d): %d\n", header->filename, header->line, header->size);
+			if(!stats[i].live_allocations)
+				continue;
+			str_format(buf, sizeof(buf), "%s(%d): %d in %d blocks\n", stats[i].filename, stats[i].line, stats[i].live_bytes, stats[i].live_allocations);
 			io_write(file, buf, strlen(buf));
-			header = header->next;
 		}
 	
 		io_close(file);
@@ -251,18 +514,21 @@ void mem_zero(void *block,unsigned size)
 
 int mem_check_imp()
 {
-	MEMHEADER *header = first;
-	while(header)
+#if defined(CONF_DEBUG)
+	MEMHEADER *header;
+	mem_sites_lock_wait();
+	for(header = first; header; header = header->next)
 	{
 		MEMTAIL *tail = (MEMTAIL *)(((char*)(header+1))+header->size);
 		if(tail->guard != MEM_GUARD_VAL)
 		{
-			dbg_msg("mem", "Memory check failed at %s(%d): %d", header->filename, header->line, header->size);
+			dbg_msg("mem", "Memory check failed at %s(%d): %d", (const char *)atomic_ptr_load(&header->site->filename, ATOMIC_RELAXED), header->site->line, header->size);
+			mem_sites_lock_release();
 			return 0;
 		}
-		header = header->next;
 	}
-
+	mem_sites_lock_release();
+#endif
 	return 1;
 }
 
@@ -352,6 +618,53 @@ int io_flush(IOHANDLE io)
 	return 0;
 }
 
+void *io_map(IOHANDLE io, unsigned *size)
+{
+	long int length;
+	void *data;
+
+	*size = 0;
+	length = io_length(io);
+	if(length <= 0)
+		return 0x0;
+
+#if defined(CONF_FAMILY_UNIX)
+	data = mmap(0, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno((FILE*)io), 0);
+	if(data == MAP_FAILED)
+		return 0x0;
+#elif defined(CONF_FAMILY_WINDOWS)
+	{
+		HANDLE file = (HANDLE)_get_osfhandle(_fileno((FILE*)io));
+		HANDLE mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if(!mapping)
+			return 0x0;
+		data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, length);
+		/* the view keeps the mapping alive */
+		CloseHandle(mapping);
+		if(!data)
+			return 0x0;
+	}
+#else
+	#error not implemented
+#endif
+
+	*size = (unsigned)length;
+	return data;
+}
+
+void io_unmap(void *data, unsigned size)
+{
+	if(!data)
+		return;
+#if defined(CONF_FAMILY_UNIX)
+	munmap(data, size);
+#elif defined(CONF_FAMILY_WINDOWS)
+	UnmapViewOfFile(data);
+#else
+	#error not implemented
+#endif
+}
+
 void *thread_create(void (*threadfunc)(void *), void *u)
 {
 #if defined(CONF_FAMILY_UNIX)
@@ -408,6 +721,20 @@ void thread_sleep(int milliseconds)
 #endif
 }
 
+int thread_num_cpus()
+{
+#if defined(CONF_FAMILY_UNIX)
+	long num = sysconf(_SC_NPROCESSORS_ONLN);
+	return num > 0 ? (int)num : 1;
+#elif defined(CONF_FAMILY_WINDOWS)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+	#error not implemented
+#endif
+}
+
 
 
 
@@ -478,6 +805,75 @@ void lock_release(LOCK lock)
 #endif
 }
 
+#if defined(CONF_FAMILY_UNIX)
+typedef struct
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int count;
+} SEMAPHOREINTERNAL;
+#endif
+
+SEMAPHORE semaphore_create()
+{
+#if defined(CONF_FAMILY_UNIX)
+	SEMAPHOREINTERNAL *sem = (SEMAPHOREINTERNAL*)mem_alloc(sizeof(SEMAPHOREINTERNAL), 4);
+	pthread_mutex_init(&sem->mutex, 0x0);
+	pthread_cond_init(&sem->cond, 0x0);
+	sem->count = 0;
+	return (SEMAPHORE)sem;
+#elif defined(CONF_FAMILY_WINDOWS)
+	return (SEMAPHORE)CreateSemaphore(0, 0, 0x7fffffff, 0);
+#else
+	#error not implemented on this platform
+#endif
+}
+
+void semaphore_destroy(SEMAPHORE sem)
+{
+#if defined(CONF_FAMILY_UNIX)
+	SEMAPHOREINTERNAL *s = (SEMAPHOREINTERNAL *)sem;
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->mutex);
+	mem_free(s);
+#elif defined(CONF_FAMILY_WINDOWS)
+	CloseHandle((HANDLE)sem);
+#else
+	#error not implemented on this platform
+#endif
+}
+
+void semaphore_wait(SEMAPHORE sem)
+{
+#if defined(CONF_FAMILY_UNIX)
+	SEMAPHOREINTERNAL *s = (SEMAPHOREINTERNAL *)sem;
+	pthread_mutex_lock(&s->mutex);
+	while(s->count == 0)
+		pthread_cond_wait(&s->cond, &s->mutex);
+	s->count--;
+	pthread_mutex_unlock(&s->mutex);
+#elif defined(CONF_FAMILY_WINDOWS)
+	WaitForSingleObject((HANDLE)sem, INFINITE);
+#else
+	#error not implemented on this platform
+#endif
+}
+
+void semaphore_signal(SEMAPHORE sem)
+{
+#if defined(CONF_FAMILY_UNIX)
+	SEMAPHOREINTERNAL *s = (SEMAPHOREINTERNAL *)sem;
+	pthread_mutex_lock(&s->mutex);
+	s->count++;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+#elif defined(CONF_FAMILY_WINDOWS)
+	ReleaseSemaphore((HANDLE)sem, 1, 0);
+#else
+	#error not implemented on this platform
+#endif
+}
+
 /* -----  time ----- */
 int64 time_get()
 {
@@ -1349,6 +1745,79 @@ int fs_rename(const char *oldname, const char *newname)
 	return 0;
 }
 
+int io_stat(IOHANDLE io, int64 *size, int64 *modified)
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	struct _stati64 info;
+	if(_fstati64(_fileno((FILE*)io), &info) != 0)
+		return 1;
+#else
+	struct stat info;
+	if(fstat(fileno((FILE*)io), &info) != 0)
+		return 1;
+#endif
+	if(size)
+		*size = info.st_size;
+	if(modified)
+	{
+#if defined(CONF_PLATFORM_LINUX)
+		*modified = (int64)info.st_mtim.tv_sec*1000000000 + info.st_mtim.tv_nsec;
+#else
+		*modified = (int64)info.st_mtime;
+#endif
+	}
+	return 0;
+}
+
+void *fs_watch_create()
+{
+#if defined(CONF_PLATFORM_LINUX)
+	int fd = inotify_init();
+	int *watch;
+	if(fd < 0)
+		return 0;
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	watch = (int *)mem_alloc(sizeof(int), 1);
+	*watch = fd;
+	return watch;
+#else
+	return 0;
+#endif
+}
+
+int fs_watch_add(void *watch, const char *path)
+{
+#if defined(CONF_PLATFORM_LINUX)
+	if(inotify_add_watch(*(int *)watch, path, IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF) < 0)
+		return 1;
+	return 0;
+#else
+	return 1;
+#endif
+}
+
+int fs_watch_changed(void *watch)
+{
+#if defined(CONF_PLATFORM_LINUX)
+	/* drain all pending events, only whether there were any matters */
+	char buffer[4096];
+	int changed = 0;
+	while(read(*(int *)watch, buffer, sizeof(buffer)) > 0)
+		changed = 1;
+	return changed;
+#else
+	return 0;
+#endif
+}
+
+void fs_watch_destroy(void *watch)
+{
+#if defined(CONF_PLATFORM_LINUX)
+	close(*(int *)watch);
+	mem_free(watch);
+#endif
+}
+
 void swap_endian(void *data, unsigned elem_size, unsigned num)
 {
 	char *src = (char*) data;
@@ -1522,6 +1991,15 @@ int str_comp_nocase(const char *a, const char *b)
 #endif
 }
 
+int str_comp_nocase_num(const char *a, const char *b, const int num)
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	return _strnicmp(a, b, num);
+#else
+	return strncasecmp(a, b, num);
+#endif
+}
+
 int str_comp(const char *a, const char *b)
 {
 	return strcmp(a, b);
@@ -1634,6 +2112,9 @@ int mem_comp(const void *a, const void *b, int size)
 
 const MEMSTATS *mem_stats()
 {
+	memory_stats.allocated = atomic_int_load(&mem_allocated, ATOMIC_RELAXED);
+	memory_stats.active_allocations = atomic_int_load(&mem_active_allocations, ATOMIC_RELAXED);
+	memory_stats.total_allocations = atomic_int_load(&mem_total_allocations, ATOMIC_RELAXED);
 	return &memory_stats;
 }
 
@@ -166,6 +166,10 @@ int mem_comp(const void *a, const void *b, int size);
 	Function: mem_check
 		Validates the heap
 		Will trigger a assert if memory has failed.
+
+	Remarks:
+		- Only debug builds keep a list of all blocks, release builds
+		check a block when it is freed.
 */
 int mem_check_imp();
 #define mem_check() dbg_assert_imp(__FILE__, __LINE__, mem_check_imp(),  "Memory check failed")
@@ -301,6 +305,37 @@ int io_close(IOHANDLE io);
 */
 int io_flush(IOHANDLE io);
 
+/*
+	Function: io_map
+		Maps the whole file into memory for reading.
+
+	Parameters:
+		io - Handle to the file, opened with IOFLAG_READ.
+		size - Pointer to a variable that will receive the size of the mapping.
+
+	Returns:
+		Returns a pointer to the start of the file on success and 0 on
+		failure or if the file is empty.
+
+	Remarks:
+		- The file position is reset to the beginning.
+		- The mapping stays valid after the file is closed, it has to be
+		released with <io_unmap>.
+		- The memory can be written to, changes are private to the process
+		and never end up in the file.
+*/
+void *io_map(IOHANDLE io, unsigned *size);
+
+/*
+	Function: io_unmap
+		Releases a mapping created with <io_map>.
+
+	Parameters:
+		data - Pointer returned by <io_map>.
+		size - Size of the mapping.
+*/
+void io_unmap(void *data, unsigned size);
+
 
 /*
 	Function: io_stdin
@@ -367,6 +402,12 @@ void thread_destroy(void *thread);
 */
 void thread_yield();
 
+/*
+	Function: thread_num_cpus
+		Returns the number of processors the threads can run on, at least 1.
+*/
+int thread_num_cpus();
+
 
 /* Group: Locks */
 typedef void* LOCK;
@@ -378,6 +419,28 @@ int lock_try(LOCK lock);
 void lock_wait(LOCK lock);
 void lock_release(LOCK lock);
 
+/* Group: Semaphores */
+typedef void* SEMAPHORE;
+
+/*
+	Function: semaphore_create
+		Creates a counting semaphore with a count of zero.
+*/
+SEMAPHORE semaphore_create();
+void semaphore_destroy(SEMAPHORE sem);
+
+/*
+	Function: semaphore_wait
+		Blocks until the count is above zero and decrements it.
+*/
+void semaphore_wait(SEMAPHORE sem);
+
+/*
+	Function: semaphore_signal
+		Increments the count, waking up one waiting thread.
+*/
+void semaphore_signal(SEMAPHORE sem);
+
 /* Group: Timer */
 #ifdef __GNUC__
 /* if compiled with -pedantic-errors it will complain about long
@@ -815,6 +878,26 @@ char *str_skip_whitespaces(char *str);
 */
 int str_comp_nocase(const char *a, const char *b);
 
+/*
+	Function: str_comp_nocase_num
+		Compares up to num characters of two strings case insensitive.
+	
+	Parameters:
+		a - String to compare.
+		b - String to compare.
+		num - Maximum characters to compare
+	
+	Returns:	
+		<0 - String a is lesser then string b
+		0 - String a is equal to string b
+		>0 - String a is greater then string b
+
+	Remarks:
+		- Only garanted to work with a-z/A-Z.
+		- The strings are treated as zero-termineted strings.
+*/
+int str_comp_nocase_num(const char *a, const char *b, const int num);
+
 
 /*
 	Function: str_comp
@@ -1055,6 +1138,56 @@ int fs_remove(const char *filename);
 */
 int fs_rename(const char *oldname, const char *newname);
 
+/*
+	Function: io_stat
+		Gets the size and the time of the last modification of an
+		opened file.
+
+	Parameters:
+		io - Handle to the file.
+		size - Pointer that receives the size, can be 0.
+		modified - Pointer that receives the modification time, can
+			be 0. Only meant to be compared to another one of the same
+			file, it has sub second precision where possible.
+
+	Returns:
+		Returns 0 on success, 1 on failure.
+*/
+int io_stat(IOHANDLE io, int64 *size, int64 *modified);
+
+/*
+	Function: fs_watch_create
+		Creates a watcher that notices when entries are created,
+		deleted or renamed in the directories that are added to it.
+
+	Returns:
+		The watcher, or 0 if the platform has no support for it.
+
+	Remarks:
+		- Only linux (inotify) is supported for now.
+*/
+void *fs_watch_create();
+
+/*
+	Function: fs_watch_add
+		Adds a directory to a watcher, subdirectories are not included.
+
+	Returns:
+		Returns 0 on success, 1 on failure.
+*/
+int fs_watch_add(void *watch, const char *path);
+
+/*
+	Function: fs_watch_changed
+		Checks for changes since the last call, without blocking.
+
+	Returns:
+		Returns 1 if anything changed, 0 otherwise.
+*/
+int fs_watch_changed(void *watch);
+
+void fs_watch_destroy(void *watch);
+
 /*
 	Group: Undocumented
 */
@@ -1137,6 +1270,51 @@ typedef struct
 
 const MEMSTATS *mem_stats();
 
+/*
+	Group: Allocation profile
+		<mem_alloc> counts every block for its call site and for the tag
+		of the site. The tag is the source folder of the call, like
+		"engine/shared" or "game/server/entities". Counting is lock free,
+		only the first allocation of a new call site takes a lock.
+*/
+typedef struct
+{
+	const char *tag;
+	const char *filename; /* 0 for tags */
+	int line;
+	int live_bytes;
+	int live_allocations;
+	int peak_bytes; /* most live bytes since the last reset */
+	int64 allocations; /* since the last reset */
+	int64 allocated_bytes;
+} MEM_PROFILE_STATS;
+
+/*
+	Function: mem_profile_tags
+		Fetches the counters of all tags.
+
+	Returns:
+		Number of tags written to stats.
+*/
+int mem_profile_tags(MEM_PROFILE_STATS *stats, int max_stats);
+
+/*
+	Function: mem_profile_sites
+		Fetches the counters of all call sites that allocated since the
+		last reset or still hold memory.
+
+	Returns:
+		Number of sites written to stats.
+*/
+int mem_profile_sites(MEM_PROFILE_STATS *stats, int max_stats);
+
+/*
+	Function: mem_profile_reset
+		Clears the allocation counts and sets the peaks to the live
+		bytes, starting a new window for rates.
+*/
+void mem_profile_reset();
+
 typedef struct
 {
 	int sent_packets;
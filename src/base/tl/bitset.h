@@ -0,0 +1,173 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef TL_FILE_BITSET_HPP
+#define TL_FILE_BITSET_HPP
+
+#include "base.h"
+
+/*
+	Class: bitset
+		Fixed size set of bits.
+
+	Remarks:
+		- Stored as 32 bit words, operations are done a word at a time
+		- Use first() and next() to walk the set bits without testing
+		every single one
+*/
+template <int N>
+class bitset
+{
+	enum
+	{
+		WORD_BITS = 32,
+		NUM_WORDS = (N+WORD_BITS-1)/WORD_BITS
+	};
+
+	unsigned words[NUM_WORDS];
+
+	static int lowest_bit(unsigned word)
+	{
+		int bit = 0;
+		while(!(word&1))
+		{
+			word >>= 1;
+			bit++;
+		}
+		return bit;
+	}
+
+public:
+	/*
+		Function: bitset constructor
+			Creates an empty set.
+	*/
+	bitset()
+	{
+		clear();
+	}
+
+	/*
+		Function: clear
+			Unsets all bits.
+	*/
+	void clear()
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			words[i] = 0;
+	}
+
+	/*
+		Function: fill
+			Sets all N bits.
+	*/
+	void fill()
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			words[i] = ~0u;
+		if(N%WORD_BITS)
+			words[NUM_WORDS-1] = (1u<<(N%WORD_BITS))-1;
+	}
+
+	void set(int index)
+	{
+		assert(index >= 0 && index < N);
+		words[index/WORD_BITS] |= 1u<<(index%WORD_BITS);
+	}
+
+	void unset(int index)
+	{
+		assert(index >= 0 && index < N);
+		words[index/WORD_BITS] &= ~(1u<<(index%WORD_BITS));
+	}
+
+	bool test(int index) const
+	{
+		if(index < 0 || index >= N)
+			return false;
+		return (words[index/WORD_BITS]&(1u<<(index%WORD_BITS))) != 0;
+	}
+
+	/*
+		Function: empty
+			Returns true if no bit is set.
+	*/
+	bool empty() const
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			if(words[i])
+				return false;
+		return true;
+	}
+
+	/*
+		Function: count
+			Returns the number of set bits.
+	*/
+	int count() const
+	{
+		int num = 0;
+		for(int i = 0; i < NUM_WORDS; i++)
+			for(unsigned word = words[i]; word; word &= word-1)
+				num++;
+		return num;
+	}
+
+	/*
+		Function: next
+			Returns the first set bit after index, or -1 if there is none.
+	*/
+	int next(int index) const
+	{
+		index++;
+		if(index >= N)
+			return -1;
+
+		int w = index/WORD_BITS;
+		unsigned word = words[w] & (~0u<<(index%WORD_BITS));
+		while(!word)
+		{
+			if(++w == NUM_WORDS)
+				return -1;
+			word = words[w];
+		}
+		return w*WORD_BITS + lowest_bit(word);
+	}
+
+	/*
+		Function: first
+			Returns the lowest set bit, or -1 if the set is empty.
+	*/
+	int first() const
+	{
+		return next(-1);
+	}
+
+	bitset &operator |=(const bitset &other)
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			words[i] |= other.words[i];
+		return *this;
+	}
+
+	bitset &operator &=(const bitset &other)
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			words[i] &= other.words[i];
+		return *this;
+	}
+
+	bool operator ==(const bitset &other) const
+	{
+		for(int i = 0; i < NUM_WORDS; i++)
+			if(words[i] != other.words[i])
+				return false;
+		return true;
+	}
+
+	bool operator !=(const bitset &other) const
+	{
+		return !(*this == other);
+	}
+};
+
+#endif // TL_FILE_BITSET_HPP
@@ -0,0 +1,139 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef TL_FILE_MPMC_QUEUE_HPP
+#define TL_FILE_MPMC_QUEUE_HPP
+
+#include "base.h"
+#include <base/atomic.h>
+
+/*
+	Class: mpmc_queue
+		Bounded queue for any number of producer and consumer threads,
+		without locks.
+
+	Remarks:
+		- N has to be a power of two
+		- Every slot carries a sequence number. A producer claims a
+		position with a compare exchange and publishes the item by
+		bumping the sequence of its slot, a consumer does the same on
+		the other end and hands the slot back to the next lap
+		- Positions wrap around, they are only ever compared by their
+		difference
+*/
+template <class T, int N>
+class mpmc_queue
+{
+	enum
+	{
+		MASK = N-1
+	};
+
+	typedef char size_must_be_a_power_of_two[(N > 0 && (N&(N-1)) == 0) ? 1 : -1];
+
+	struct slot
+	{
+		ATOMIC_INT sequence;
+		T item;
+	};
+
+	static int next(int pos, int add) { return (int)((unsigned)pos+(unsigned)add); }
+	static int diff(int a, int b) { return (int)((unsigned)a-(unsigned)b); }
+
+	ATOMIC_INT push_pos;
+	char pad0[64];
+	ATOMIC_INT pop_pos;
+	char pad1[64];
+	slot slots[N];
+
+public:
+	/*
+		Function: mpmc_queue constructor
+			Creates an empty queue.
+	*/
+	mpmc_queue()
+	{
+		for(int i = 0; i < N; i++)
+			atomic_int_store(&slots[i].sequence, i, ATOMIC_RELAXED);
+		atomic_int_store(&push_pos, 0, ATOMIC_RELAXED);
+		atomic_int_store(&pop_pos, 0, ATOMIC_RELAXED);
+	}
+
+	/*
+		Function: push
+			Adds an item at the end.
+
+		Returns:
+			False if the queue is full.
+	*/
+	bool push(const T &item)
+	{
+		slot *s;
+		int pos = atomic_int_load(&push_pos, ATOMIC_RELAXED);
+		while(1)
+		{
+			s = &slots[pos&MASK];
+			int d = diff(atomic_int_load(&s->sequence, ATOMIC_ACQUIRE), pos);
+			if(d == 0)
+			{
+				// the slot is free in this lap, try to claim it
+				if(atomic_int_compare_exchange(&push_pos, &pos, next(pos, 1), ATOMIC_RELAXED))
+					break;
+			}
+			else if(d < 0)
+				return false; // still holds an item from the last lap
+			else
+				pos = atomic_int_load(&push_pos, ATOMIC_RELAXED);
+		}
+
+		s->item = item;
+		atomic_int_store(&s->sequence, next(pos, 1), ATOMIC_RELEASE);
+		return true;
+	}
+
+	/*
+		Function: pop
+			Takes the item at the front.
+
+		Returns:
+			False if the queue is empty, item isn't touched then.
+	*/
+	bool pop(T *item)
+	{
+		slot *s;
+		int pos = atomic_int_load(&pop_pos, ATOMIC_RELAXED);
+		while(1)
+		{
+			s = &slots[pos&MASK];
+			int d = diff(atomic_int_load(&s->sequence, ATOMIC_ACQUIRE), next(pos, 1));
+			if(d == 0)
+			{
+				if(atomic_int_compare_exchange(&pop_pos, &pos, next(pos, 1), ATOMIC_RELAXED))
+					break;
+			}
+			else if(d < 0)
+				return false; // nothing published yet
+			else
+				pos = atomic_int_load(&pop_pos, ATOMIC_RELAXED);
+		}
+
+		*item = s->item;
+		atomic_int_store(&s->sequence, next(pos, N), ATOMIC_RELEASE);
+		return true;
+	}
+
+	/*
+		Function: size
+			Number of queued items, including ones that are still being
+			written. Only a snapshot while other threads are busy.
+	*/
+	int size() const
+	{
+		int d = diff(atomic_int_load(&push_pos, ATOMIC_ACQUIRE), atomic_int_load(&pop_pos, ATOMIC_ACQUIRE));
+		return d < 0 ? 0 : d > N ? N : d;
+	}
+
+	bool empty() const { return size() == 0; }
+	int capacity() const { return N; }
+};
+
+#endif
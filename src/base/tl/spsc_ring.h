@@ -0,0 +1,99 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef TL_FILE_SPSC_RING_HPP
+#define TL_FILE_SPSC_RING_HPP
+
+#include "base.h"
+#include <base/atomic.h>
+
+/*
+	Class: spsc_ring
+		Bounded queue for exactly one producer and one consumer thread,
+		without locks.
+
+	Remarks:
+		- N has to be a power of two
+		- push() must only be called from the producer and pop() only
+		from the consumer, the two can run at the same time
+		- The positions run over twice the size so a full ring can be
+		told apart from an empty one
+*/
+template <class T, int N>
+class spsc_ring
+{
+	enum
+	{
+		MASK = N-1,
+		WRAP = 2*N-1
+	};
+
+	typedef char size_must_be_a_power_of_two[(N > 0 && (N&(N-1)) == 0) ? 1 : -1];
+
+	ATOMIC_INT read; /* written by the consumer */
+	char pad0[64];
+	ATOMIC_INT write; /* written by the producer */
+	char pad1[64];
+	T items[N];
+
+public:
+	/*
+		Function: spsc_ring constructor
+			Creates an empty ring.
+	*/
+	spsc_ring()
+	{
+		atomic_int_store(&read, 0, ATOMIC_RELAXED);
+		atomic_int_store(&write, 0, ATOMIC_RELAXED);
+	}
+
+	/*
+		Function: push
+			Adds an item at the end.
+
+		Returns:
+			False if the ring is full.
+	*/
+	bool push(const T &item)
+	{
+		int w = atomic_int_load(&write, ATOMIC_RELAXED);
+		int r = atomic_int_load(&read, ATOMIC_ACQUIRE);
+		if(((w-r)&WRAP) == N)
+			return false;
+		items[w&MASK] = item;
+		atomic_int_store(&write, (w+1)&WRAP, ATOMIC_RELEASE);
+		return true;
+	}
+
+	/*
+		Function: pop
+			Takes the item at the front.
+
+		Returns:
+			False if the ring is empty, item isn't touched then.
+	*/
+	bool pop(T *item)
+	{
+		int r = atomic_int_load(&read, ATOMIC_RELAXED);
+		int w = atomic_int_load(&write, ATOMIC_ACQUIRE);
+		if(r == w)
+			return false;
+		*item = items[r&MASK];
+		atomic_int_store(&read, (r+1)&WRAP, ATOMIC_RELEASE);
+		return true;
+	}
+
+	/*
+		Function: size
+			Number of queued items. Only a snapshot when the other
+			thread is busy.
+	*/
+	int size() const
+	{
+		return (atomic_int_load(&write, ATOMIC_ACQUIRE)-atomic_int_load(&read, ATOMIC_ACQUIRE))&WRAP;
+	}
+
+	bool empty() const { return size() == 0; }
+	int capacity() const { return N; }
+};
+
+#endif
@@ -0,0 +1,175 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <engine/shared/linereader.h>
+#include <game/version.h>
+
+#include "bench.h"
+
+CBench::CBench()
+{
+	m_pFilter = "";
+	m_NumSamples = 50;
+	m_WarmupMs = 200;
+	m_SampleUs = 2000;
+}
+
+void CBench::SetSamples(int NumSamples)
+{
+	m_NumSamples = clamp(NumSamples, 1, (int)MAX_SAMPLES);
+}
+
+bool CBench::Enabled(const char *pPrefix) const
+{
+	// without a dot the filter can match a benchmark of any suite
+	if(!m_pFilter[0] || !str_find(m_pFilter, "."))
+		return true;
+	return str_comp_num(m_pFilter, pPrefix, str_length(pPrefix)) == 0 || str_find(pPrefix, m_pFilter);
+}
+
+double CBench::Percentile(const double *pSorted, int Num, int Percent)
+{
+	int Index = (Num*Percent+99)/100-1;
+	return pSorted[clamp(Index, 0, Num-1)];
+}
+
+void CBench::Run(const char *pName, FBenchFunc pfnFunc, void *pUser, int Bytes)
+{
+	if(m_pFilter[0] && !str_find(pName, m_pFilter))
+		return;
+
+	// warm up and find how many calls take a sample's time, the
+	// clock only has microseconds
+	int64 Freq = time_freq();
+	int Batch = 1;
+	int64 WarmupEnd = time_get() + Freq*m_WarmupMs/1000;
+	while(1)
+	{
+		int64 Start = time_get();
+		for(int i = 0; i < Batch; i++)
+			pfnFunc(pUser);
+		int64 Time = time_get()-Start;
+
+		if(Time*1000000 < Freq*m_SampleUs && Batch < (1<<24))
+			Batch *= 2;
+		else if(time_get() >= WarmupEnd)
+			break;
+	}
+
+	double Sum = 0;
+	for(int s = 0; s < m_NumSamples; s++)
+	{
+		int64 Start = time_get();
+		for(int i = 0; i < Batch; i++)
+			pfnFunc(pUser);
+		m_aSamples[s] = (time_get()-Start)*1000000000.0/Freq/Batch;
+		Sum += m_aSamples[s];
+	}
+
+	// insertion sort, there are only a few samples
+	for(int i = 1; i < m_NumSamples; i++)
+	{
+		double Sample = m_aSamples[i];
+		int j = i;
+		for(; j > 0 && m_aSamples[j-1] > Sample; j--)
+			m_aSamples[j] = m_aSamples[j-1];
+		m_aSamples[j] = Sample;
+	}
+
+	CResult Result;
+	str_copy(Result.m_aName, pName, sizeof(Result.m_aName));
+	Result.m_NumSamples = m_NumSamples;
+	Result.m_Batch = Batch;
+	Result.m_Bytes = Bytes;
+	Result.m_Min = m_aSamples[0];
+	Result.m_P50 = Percentile(m_aSamples, m_NumSamples, 50);
+	Result.m_P90 = Percentile(m_aSamples, m_NumSamples, 90);
+	Result.m_P99 = Percentile(m_aSamples, m_NumSamples, 99);
+	Result.m_Mean = Sum/m_NumSamples;
+	m_lResults.add(Result);
+
+	char aThroughput[32] = "";
+	if(Bytes)
+		str_format(aThroughput, sizeof(aThroughput), " %8.1f MB/s", Bytes/Result.m_P50*1000.0);
+	dbg_msg("bench", "%-28s p50 %12.1f ns  p90 %12.1f ns  p99 %12.1f ns  min %12.1f ns%s",
+		pName, Result.m_P50, Result.m_P90, Result.m_P99, Result.m_Min, aThroughput);
+}
+
+bool CBench::WriteJson(const char *pFilename, const char *pLabel) const
+{
+	IOHANDLE File = io_open(pFilename, IOFLAG_WRITE);
+	if(!File)
+		return false;
+
+	char aBuf[512];
+#if defined(CONF_DEBUG)
+	const char *pConfig = "debug";
+#else
+	const char *pConfig = "release";
+#endif
+	str_format(aBuf, sizeof(aBuf), "{\n\t\"label\": \"%s\",\n\t\"version\": \"%s\",\n\t\"config\": \"%s\",\n\t\"cpus\": %d,\n\t\"benchmarks\": [\n",
+		pLabel, GAME_VERSION, pConfig, thread_num_cpus());
+	io_write(File, aBuf, str_length(aBuf));
+
+	// one benchmark per line, Compare relies on it
+	for(int i = 0; i < m_lResults.size(); i++)
+	{
+		const CResult *pResult = &m_lResults[i];
+		str_format(aBuf, sizeof(aBuf), "\t\t{\"name\": \"%s\", \"samples\": %d, \"batch\": %d, \"bytes\": %d, "
+			"\"min_ns\": %.1f, \"p50_ns\": %.1f, \"p90_ns\": %.1f, \"p99_ns\": %.1f, \"mean_ns\": %.1f}%s\n",
+			pResult->m_aName, pResult->m_NumSamples, pResult->m_Batch, pResult->m_Bytes,
+			pResult->m_Min, pResult->m_P50, pResult->m_P90, pResult->m_P99, pResult->m_Mean,
+			i+1 < m_lResults.size() ? "," : "");
+		io_write(File, aBuf, str_length(aBuf));
+	}
+
+	str_copy(aBuf, "\t]\n}\n", sizeof(aBuf));
+	io_write(File, aBuf, str_length(aBuf));
+	io_close(File);
+	return true;
+}
+
+int CBench::Compare(const char *pFilename, float Threshold) const
+{
+	IOHANDLE File = io_open(pFilename, IOFLAG_READ);
+	if(!File)
+		return -1;
+
+	CLineReader Reader;
+	Reader.Init(File);
+	int NumRegressions = 0;
+	int NumCompared = 0;
+	while(char *pLine = Reader.Get())
+	{
+		const char *pName = str_find(pLine, "\"name\": \"");
+		const char *pMedian = str_find(pLine, "\"p50_ns\": ");
+		if(!pName || !pMedian)
+			continue;
+		pName += str_length("\"name\": \"");
+		pMedian += str_length("\"p50_ns\": ");
+
+		for(int i = 0; i < m_lResults.size(); i++)
+		{
+			const CResult *pResult = &m_lResults[i];
+			int NameLength = str_length(pResult->m_aName);
+			if(str_comp_num(pName, pResult->m_aName, NameLength) != 0 || pName[NameLength] != '"')
+				continue;
+
+			double Base = str_tofloat(pMedian);
+			if(Base <= 0.0)
+				break;
+
+			double Change = pResult->m_P50/Base-1.0;
+			bool Regression = Change > Threshold;
+			dbg_msg("bench", "%-28s %12.1f -> %12.1f ns  %+6.1f%%%s",
+				pResult->m_aName, Base, pResult->m_P50, Change*100.0, Regression ? "  REGRESSION" : "");
+			NumRegressions += Regression;
+			NumCompared++;
+			break;
+		}
+	}
+	io_close(File);
+
+	dbg_msg("bench", "compared %d benchmarks, %d regressions over %.0f%%", NumCompared, NumRegressions, Threshold*100.0f);
+	return NumRegressions;
+}
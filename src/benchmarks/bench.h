@@ -0,0 +1,112 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef BENCHMARKS_BENCH_H
+#define BENCHMARKS_BENCH_H
+
+#include <base/system.h>
+#include <base/tl/array.h>
+
+/*
+	Class: CBench
+		Times benchmark functions. A function is first run for the
+		warmup time, which also finds how many calls make up one
+		sample. Then the samples are taken and the time per call is
+		reported as min, percentiles and mean, so a few slow samples
+		from the system don't hide a real change.
+
+		The results can be written as json, one benchmark per line,
+		and compared against an earlier file.
+*/
+class CBench
+{
+public:
+	typedef void (*FBenchFunc)(void *pUser);
+
+	struct CResult
+	{
+		char m_aName[64];
+		int m_NumSamples;
+		int m_Batch; // calls per sample
+		int m_Bytes; // processed per call, 0 when it doesn't apply
+		double m_Min; // ns per call
+		double m_P50;
+		double m_P90;
+		double m_P99;
+		double m_Mean;
+	};
+
+private:
+	enum
+	{
+		MAX_SAMPLES=1000,
+	};
+
+	array<CResult> m_lResults;
+	const char *m_pFilter;
+	int m_NumSamples;
+	int m_WarmupMs;
+	int m_SampleUs;
+	double m_aSamples[MAX_SAMPLES];
+
+	static double Percentile(const double *pSorted, int Num, int Percent);
+
+public:
+	CBench();
+
+	// only benchmarks whose name contains the filter are run, a filter
+	// with a dot has to start with the suite name
+	void SetFilter(const char *pFilter) { m_pFilter = pFilter; }
+	void SetSamples(int NumSamples);
+	void SetWarmup(int WarmupMs) { m_WarmupMs = WarmupMs; }
+
+	/*
+		Function: Enabled
+			Tells if a benchmark would run, suites use it to skip their
+			setup when none of their benchmarks are wanted.
+
+		Arguments:
+			pPrefix - Name or the start of the names, e.g. "snapshot.".
+	*/
+	bool Enabled(const char *pPrefix) const;
+
+	/*
+		Function: Run
+			Runs and records one benchmark.
+
+		Arguments:
+			pName - "suite.benchmark".
+			pfnFunc - Does one operation.
+			pUser - Passed to the function.
+			Bytes - Bytes processed by one operation, for the throughput.
+	*/
+	void Run(const char *pName, FBenchFunc pfnFunc, void *pUser, int Bytes=0);
+
+	int NumResults() const { return m_lResults.size(); }
+	const CResult *GetResult(int Index) const { return &m_lResults[Index]; }
+
+	/*
+		Function: WriteJson
+			Writes the results and the build they were taken with.
+
+		Arguments:
+			pFilename - File to write, outside of the storage paths.
+			pLabel - Free text to tell runs apart, e.g. the commit.
+	*/
+	bool WriteJson(const char *pFilename, const char *pLabel) const;
+
+	/*
+		Function: Compare
+			Compares the median of every benchmark against a json file
+			written earlier.
+
+		Arguments:
+			pFilename - The earlier results.
+			Threshold - Slowdown that counts as a regression, 0.1 for 10%.
+
+		Returns:
+			The number of regressions, -1 if the file couldn't be read.
+	*/
+	int Compare(const char *pFilename, float Threshold) const;
+};
+
+#endif
@@ -0,0 +1,108 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+#include <base/vmath.h>
+#include <game/collision.h>
+#include <game/layers.h>
+
+#include "bench.h"
+#include "fixture.h"
+#include "suites.h"
+
+/*
+	Collision queries on the game layer of the loaded map, at random
+	but fixed positions. The lines are about as long as a laser, the
+	moves like the ones of characters and grenades in one tick.
+*/
+
+enum
+{
+	NUM_QUERIES=4096, // power of two
+	LINE_LENGTH=800,
+};
+
+struct CCollisionData
+{
+	CCollision *m_pCollision;
+	vec2 m_aPos[NUM_QUERIES];
+	vec2 m_aTarget[NUM_QUERIES];
+	vec2 m_aVel[NUM_QUERIES];
+	int m_Next;
+	int m_Hits;
+};
+
+static void CollisionCheckPoint(void *pUser)
+{
+	CCollisionData *pData = (CCollisionData *)pUser;
+	int i = pData->m_Next++&(NUM_QUERIES-1);
+	pData->m_Hits += pData->m_pCollision->CheckPoint(pData->m_aPos[i]);
+}
+
+static void CollisionIntersectLine(void *pUser)
+{
+	CCollisionData *pData = (CCollisionData *)pUser;
+	int i = pData->m_Next++&(NUM_QUERIES-1);
+	vec2 At, Before;
+	pData->m_Hits += pData->m_pCollision->IntersectLine(pData->m_aPos[i], pData->m_aTarget[i], &At, &Before) != 0;
+}
+
+static void CollisionTestBox(void *pUser)
+{
+	CCollisionData *pData = (CCollisionData *)pUser;
+	int i = pData->m_Next++&(NUM_QUERIES-1);
+	pData->m_Hits += pData->m_pCollision->TestBox(pData->m_aPos[i], vec2(28.0f, 28.0f));
+}
+
+static void CollisionMovePoint(void *pUser)
+{
+	CCollisionData *pData = (CCollisionData *)pUser;
+	int i = pData->m_Next++&(NUM_QUERIES-1);
+	vec2 Pos = pData->m_aPos[i];
+	vec2 Vel = pData->m_aVel[i];
+	int Bounces = 0;
+	pData->m_pCollision->MovePoint(&Pos, &Vel, 0.5f, &Bounces);
+	pData->m_Hits += Bounces;
+}
+
+static void CollisionMoveBox(void *pUser)
+{
+	CCollisionData *pData = (CCollisionData *)pUser;
+	int i = pData->m_Next++&(NUM_QUERIES-1);
+	vec2 Pos = pData->m_aPos[i];
+	vec2 Vel = pData->m_aVel[i];
+	pData->m_pCollision->MoveBox(&Pos, &Vel, vec2(28.0f, 28.0f), 0.0f);
+}
+
+void BenchCollision(CBench *pBench, CBenchFixture *pFixture)
+{
+	if(!pBench->Enabled("collision."))
+		return;
+
+	CLayers Layers;
+	Layers.Init(pFixture->Kernel());
+	static CCollision s_Collision;
+	s_Collision.Init(&Layers);
+
+	static CCollisionData s_Data;
+	s_Data.m_pCollision = &s_Collision;
+	s_Data.m_Next = 0;
+	s_Data.m_Hits = 0;
+
+	unsigned Seed = 1;
+	float Width = s_Collision.GetWidth()*32.0f;
+	float Height = s_Collision.GetHeight()*32.0f;
+	for(int i = 0; i < NUM_QUERIES; i++)
+	{
+		s_Data.m_aPos[i] = vec2(BenchRandom(&Seed)/32767.0f*Width, BenchRandom(&Seed)/32767.0f*Height);
+		float Angle = BenchRandom(&Seed)/32767.0f*2*pi;
+		s_Data.m_aTarget[i] = s_Data.m_aPos[i] + vec2(cosf(Angle), sinf(Angle))*LINE_LENGTH;
+		s_Data.m_aVel[i] = vec2(cosf(Angle), sinf(Angle))*(BenchRandom(&Seed)%20+1);
+	}
+
+	pBench->Run("collision.check_point", CollisionCheckPoint, &s_Data);
+	pBench->Run("collision.intersect_line", CollisionIntersectLine, &s_Data);
+	pBench->Run("collision.test_box", CollisionTestBox, &s_Data);
+	pBench->Run("collision.move_point", CollisionMovePoint, &s_Data);
+	pBench->Run("collision.move_box", CollisionMoveBox, &s_Data);
+}
@@ -0,0 +1,76 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include <engine/storage.h>
+#include <engine/shared/datafile.h>
+#include <engine/shared/jobs.h>
+
+#include "bench.h"
+#include "fixture.h"
+#include "suites.h"
+
+/*
+	Opening the map file, once with the data loaded on demand like the
+	tools do and once unpacked up front like the server loads its maps,
+	alone and on the job pool.
+*/
+
+struct CDatafileData
+{
+	IStorage *m_pStorage;
+	char m_aFilename[256];
+	CJobPool *m_pJobPool;
+	int m_NumData;
+};
+
+static void DatafileOpen(void *pUser)
+{
+	CDatafileData *pData = (CDatafileData *)pUser;
+	CDataFileReader Reader;
+	if(Reader.Open(pData->m_pStorage, pData->m_aFilename, IStorage::TYPE_ALL))
+		pData->m_NumData = Reader.NumData();
+}
+
+static void DatafilePreload(void *pUser)
+{
+	CDatafileData *pData = (CDatafileData *)pUser;
+	CDataFileReader Reader;
+	if(Reader.Open(pData->m_pStorage, pData->m_aFilename, IStorage::TYPE_ALL, CDataFileReader::OPENFLAG_PRELOAD))
+		pData->m_NumData = Reader.NumData();
+}
+
+static void DatafilePreloadJobs(void *pUser)
+{
+	CDatafileData *pData = (CDatafileData *)pUser;
+	CDataFileReader Reader;
+	if(Reader.Open(pData->m_pStorage, pData->m_aFilename, IStorage::TYPE_ALL, CDataFileReader::OPENFLAG_PRELOAD, pData->m_pJobPool))
+		pData->m_NumData = Reader.NumData();
+}
+
+void BenchDatafile(CBench *pBench, CBenchFixture *pFixture)
+{
+	if(!pBench->Enabled("datafile."))
+		return;
+
+	CDatafileData Data;
+	Data.m_pStorage = pFixture->Storage();
+	str_format(Data.m_aFilename, sizeof(Data.m_aFilename), "maps/%s.map", pFixture->MapName());
+	Data.m_NumData = 0;
+
+	IOHANDLE File = Data.m_pStorage->OpenFile(Data.m_aFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+	{
+		dbg_msg("bench", "datafile: couldn't open '%s'", Data.m_aFilename);
+		return;
+	}
+	int Size = (int)io_length(File);
+	io_close(File);
+
+	CJobPool JobPool;
+	JobPool.Init(thread_num_cpus());
+	Data.m_pJobPool = &JobPool;
+
+	pBench->Run("datafile.open", DatafileOpen, &Data, Size);
+	pBench->Run("datafile.preload", DatafilePreload, &Data, Size);
+	pBench->Run("datafile.preload_jobs", DatafilePreloadJobs, &Data, Size);
+}
@@ -0,0 +1,144 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include <engine/console.h>
+#include <engine/map.h>
+#include <engine/storage.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/snapshot.h>
+
+#include "bench.h"
+#include "fixture.h"
+#include "suites.h"
+
+/*
+	Decoding a demo as fast as possible, like the demo tools do. The
+	demo is recorded from the scripted game first, so every run
+	decodes the same demo without one having to be shipped.
+*/
+
+enum
+{
+	DEMO_TICKS=50*60, // one minute
+	QUEUE_LIMIT=256*1024, // let the writer catch up, dropped frames would change the demo
+};
+
+static const char s_aDemoFilename[] = "demos/bench.demo";
+
+class CDemoListener : public CDemoPlayer::IListner
+{
+public:
+	int m_NumSnapshots;
+	int m_NumItems;
+
+	virtual void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		m_NumSnapshots++;
+		m_NumItems += ((CSnapshot *)pData)->NumItems();
+	}
+
+	virtual void OnDemoPlayerMessage(void *pData, int Size) {}
+};
+
+struct CDemoData
+{
+	CBenchFixture *m_pFixture;
+	CDemoPlayer *m_pPlayer;
+	CDemoListener m_Listener;
+};
+
+static void DemoDecode(void *pUser)
+{
+	CDemoData *pData = (CDemoData *)pUser;
+	CDemoPlayer *pPlayer = pData->m_pPlayer;
+	if(pPlayer->Load(pData->m_pFixture->Storage(), pData->m_pFixture->Console(), s_aDemoFilename, IStorage::TYPE_SAVE))
+		return;
+
+	while(pPlayer->IsPlaying() && !pPlayer->BaseInfo()->m_Paused)
+		pPlayer->NextFrame();
+	pPlayer->Stop();
+}
+
+static bool RecordDemo(CBenchFixture *pFixture)
+{
+	CDemoRecorder *pRecorder = new CDemoRecorder(&pFixture->Server()->m_SnapshotDelta);
+	if(pRecorder->Start(pFixture->Storage(), pFixture->Console(), s_aDemoFilename, pFixture->GameServer()->NetVersion(),
+		pFixture->MapName(), pFixture->EngineMap()->Crc(), "server") != 0)
+	{
+		delete pRecorder;
+		return false;
+	}
+
+	CSnapshot *pSnap = (CSnapshot *)mem_alloc(CSnapshot::MAX_SIZE, sizeof(int));
+	pFixture->StartGame();
+	for(int i = 0; i < DEMO_TICKS; i++)
+	{
+		pFixture->Tick();
+
+		// the server records every second tick
+		if(i&1)
+		{
+			int Size = pFixture->Snap(-1, pSnap);
+			pRecorder->RecordSnapshot(pFixture->Server()->Tick(), pSnap, Size);
+			pFixture->EndFrame();
+
+			CDemoRecorder::CQueueStats Stats;
+			for(pRecorder->GetQueueStats(&Stats); Stats.m_Bytes > QUEUE_LIMIT; pRecorder->GetQueueStats(&Stats))
+				thread_sleep(1);
+		}
+	}
+	mem_free(pSnap);
+
+	CDemoRecorder::CQueueStats Stats;
+	pRecorder->GetQueueStats(&Stats);
+	pRecorder->Stop();
+	delete pRecorder;
+
+	if(Stats.m_Dropped)
+		dbg_msg("bench", "demo: %d frames dropped while recording", Stats.m_Dropped);
+	return true;
+}
+
+void BenchDemo(CBench *pBench, CBenchFixture *pFixture)
+{
+	if(!pBench->Enabled("demo."))
+		return;
+
+	IStorage *pStorage = pFixture->Storage();
+	if(!RecordDemo(pFixture))
+	{
+		dbg_msg("bench", "demo: couldn't record '%s'", s_aDemoFilename);
+		return;
+	}
+
+	int Size = 0;
+	IOHANDLE File = pStorage->OpenFile(s_aDemoFilename, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(File)
+	{
+		Size = (int)io_length(File);
+		io_close(File);
+	}
+
+	CDemoData Data;
+	Data.m_pFixture = pFixture;
+	Data.m_pPlayer = new CDemoPlayer(&pFixture->Server()->m_SnapshotDelta);
+	Data.m_pPlayer->SetListner(&Data.m_Listener);
+	Data.m_pPlayer->SetBuildIndex(false);
+
+	Data.m_Listener.m_NumSnapshots = 0;
+	Data.m_Listener.m_NumItems = 0;
+	DemoDecode(&Data);
+	dbg_msg("bench", "demo: %d bytes, %d snapshots, %d items", Size, Data.m_Listener.m_NumSnapshots, Data.m_Listener.m_NumItems);
+
+	char aName[64];
+	str_format(aName, sizeof(aName), "demo.decode/%d", pFixture->NumCharacters());
+	pBench->Run(aName, DemoDecode, &Data, Size);
+
+	delete Data.m_pPlayer;
+
+	// the recorder writes a seek index next to the demo
+	char aIndexFilename[256];
+	CDemoIndex::GetFilename(s_aDemoFilename, aIndexFilename, sizeof(aIndexFilename));
+	pStorage->RemoveFile(s_aDemoFilename, IStorage::TYPE_SAVE);
+	pStorage->RemoveFile(aIndexFilename, IStorage::TYPE_SAVE);
+}
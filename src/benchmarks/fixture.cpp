@@ -0,0 +1,243 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <stdlib.h>
+
+#include <base/math.h>
+#include <base/system.h>
+#include <engine/config.h>
+#include <engine/console.h>
+#include <engine/kernel.h>
+#include <engine/map.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+#include <game/generated/protocol.h>
+#include <game/server/gamecontext.h>
+
+#include "fixture.h"
+
+static char s_aaClientNames[MAX_CLIENTS][16];
+
+CBenchServer::CBenchServer()
+{
+	m_CurrentGameTick = 0;
+	m_TickSpeed = SERVER_TICK_SPEED;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		str_format(s_aaClientNames[i], sizeof(s_aaClientNames[i]), "bench%d", i);
+	ResetIDs();
+}
+
+void CBenchServer::ResetIDs()
+{
+	// the lowest ids come first like on the server
+	for(int i = 0; i < MAX_IDS; i++)
+		m_aFreeIDs[i] = MAX_IDS-1-i;
+	m_NumFreeIDs = MAX_IDS;
+}
+
+const char *CBenchServer::ClientName(int ClientID)
+{
+	if(ClientID < 0 || ClientID >= MAX_CLIENTS)
+		return "(invalid)";
+	return s_aaClientNames[ClientID];
+}
+
+int CBenchServer::GetClientInfo(int ClientID, CClientInfo *pInfo)
+{
+	if(!ClientIngame(ClientID))
+		return 0;
+	pInfo->m_pName = ClientName(ClientID);
+	pInfo->m_Latency = 0;
+	return 1;
+}
+
+void CBenchServer::GetClientAddr(int ClientID, char *pAddrStr, int Size)
+{
+	NETADDR Addr;
+	if(GetClientAddr(ClientID, &Addr))
+		net_addr_str(&Addr, pAddrStr, Size);
+}
+
+bool CBenchServer::GetClientAddr(int ClientID, NETADDR *pAddr)
+{
+	mem_zero(pAddr, sizeof(NETADDR));
+	if(!ClientIngame(ClientID))
+		return false;
+
+	// every client has its own address so the votes count them all
+	pAddr->type = NETTYPE_IPV4;
+	pAddr->ip[0] = 10;
+	pAddr->ip[3] = ClientID+1;
+	return true;
+}
+
+int CBenchServer::SnapNewID()
+{
+	dbg_assert(m_NumFreeIDs > 0, "out of snap ids");
+	return m_aFreeIDs[--m_NumFreeIDs];
+}
+
+void CBenchServer::SnapFreeID(int ID)
+{
+	dbg_assert(m_NumFreeIDs < MAX_IDS, "snap id freed twice");
+	m_aFreeIDs[m_NumFreeIDs++] = ID;
+}
+
+void *CBenchServer::SnapNewItem(int Type, int ID, int Size)
+{
+	dbg_assert(Type >= 0 && Type <=0xffff, "incorrect type");
+	dbg_assert(ID >= 0 && ID <=0xffff, "incorrect id");
+	return ID < 0 ? 0 : m_SnapshotBuilder.NewItem(Type, ID, Size);
+}
+
+void CBenchServer::SnapSetStaticsize(int ItemType, int Size)
+{
+	m_SnapshotDelta.SetStaticsize(ItemType, Size);
+}
+
+
+CBenchFixture::CBenchFixture()
+{
+	m_pKernel = 0;
+	m_pStorage = 0;
+	m_pConsole = 0;
+	m_pConfig = 0;
+	m_pEngineMap = 0;
+	m_pServer = 0;
+	m_pGameServer = 0;
+	m_GameRunning = false;
+	m_NumCharacters = 0;
+	m_aMapName[0] = 0;
+}
+
+CBenchFixture::~CBenchFixture()
+{
+	if(m_GameRunning)
+		m_pGameServer->OnShutdown();
+
+	delete m_pKernel;
+	delete m_pEngineMap;
+	delete m_pGameServer;
+	delete m_pServer;
+	delete m_pConsole;
+	delete m_pStorage;
+	delete m_pConfig;
+}
+
+bool CBenchFixture::Init(int NumArgs, const char **ppArguments, const char *pMapName)
+{
+	m_pKernel = IKernel::Create();
+	m_pStorage = CreateStorage("Teeworlds", NumArgs, ppArguments);
+	m_pConsole = CreateConsole(CFGFLAG_SERVER);
+	m_pConfig = CreateConfig();
+	m_pEngineMap = CreateEngineMap();
+	m_pServer = new CBenchServer;
+	m_pGameServer = CreateGameServer();
+	if(!m_pStorage)
+	{
+		dbg_msg("bench", "unable to initialize storage");
+		return false;
+	}
+
+	bool RegisterFail = false;
+	RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(static_cast<IServer*>(m_pServer));
+	RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(static_cast<IEngineMap*>(m_pEngineMap)); // register as both
+	RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(static_cast<IMap*>(m_pEngineMap));
+	RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(m_pGameServer);
+	RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(m_pConsole);
+	RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(m_pStorage);
+	RegisterFail = RegisterFail || !m_pKernel->RegisterInterface(m_pConfig);
+	if(RegisterFail)
+		return false;
+
+	m_pConfig->Init();
+
+	// all characters play and the round doesn't end
+	g_Config.m_SvMaxClients = MAX_CLIENTS;
+	g_Config.m_SvScorelimit = 0;
+	g_Config.m_SvTimelimit = 0;
+
+	m_pGameServer->OnConsoleInit();
+
+	str_copy(m_aMapName, pMapName, sizeof(m_aMapName));
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
+	if(!m_pEngineMap->Load(aBuf))
+	{
+		dbg_msg("bench", "couldn't load map '%s'", aBuf);
+		return false;
+	}
+	return true;
+}
+
+void CBenchFixture::SetNumCharacters(int NumCharacters)
+{
+	m_NumCharacters = clamp(NumCharacters, 0, (int)MAX_CLIENTS);
+}
+
+void CBenchFixture::StartGame()
+{
+	if(m_GameRunning)
+		m_pGameServer->OnShutdown();
+
+	m_pServer->ResetIDs();
+	m_pServer->SetTick(0);
+	m_pKernel->ReregisterInterface(m_pGameServer);
+	m_pGameServer->OnInit();
+	m_GameRunning = true;
+
+	// the controller seeds with the time
+	srand(1);
+
+	static const char *s_apRaces[] = {"/race orc", "/race elf", "/race undead", "/race human"};
+	CGameContext *pGameContext = (CGameContext *)m_pGameServer;
+	for(int i = 0; i < m_NumCharacters; i++)
+	{
+		m_pGameServer->OnClientConnected(i);
+		m_pGameServer->OnClientEnter(i);
+		pGameContext->m_ChatCommands.Execute(i, s_apRaces[i%4]);
+	}
+	EndFrame();
+}
+
+static void ScriptInput(int ClientID, int Tick, CNetObj_PlayerInput *pInput)
+{
+	// walk, jump, hook and shoot in patterns that differ between the clients
+	mem_zero(pInput, sizeof(*pInput));
+	float Angle = Tick*0.05f + ClientID;
+	pInput->m_Direction = (Tick/40 + ClientID)%3 - 1;
+	pInput->m_TargetX = (int)(cosf(Angle)*100.0f);
+	pInput->m_TargetY = (int)(sinf(Angle)*100.0f);
+	pInput->m_Jump = (Tick + ClientID*7)%50 < 2;
+	pInput->m_Fire = (Tick + ClientID*3)/5;
+	pInput->m_Hook = (Tick + ClientID*11)%90 < 30;
+	pInput->m_PlayerFlags = PLAYERFLAG_PLAYING;
+}
+
+void CBenchFixture::Tick()
+{
+	int Tick = m_pServer->Tick()+1;
+	m_pServer->SetTick(Tick);
+
+	for(int i = 0; i < m_NumCharacters; i++)
+	{
+		CNetObj_PlayerInput Input;
+		ScriptInput(i, Tick, &Input);
+		m_pGameServer->OnClientDirectInput(i, &Input);
+		m_pGameServer->OnClientPredictedInput(i, &Input);
+	}
+
+	m_pGameServer->OnTick();
+}
+
+int CBenchFixture::Snap(int ClientID, CSnapshot *pSnap)
+{
+	m_pServer->m_SnapshotBuilder.Init();
+	m_pGameServer->OnSnap(ClientID);
+	return m_pServer->m_SnapshotBuilder.Finish(pSnap);
+}
+
+void CBenchFixture::EndFrame()
+{
+	m_pGameServer->OnPostSnap();
+	m_pServer->m_FrameHeap.Rewind();
+}
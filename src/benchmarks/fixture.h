@@ -0,0 +1,132 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef BENCHMARKS_FIXTURE_H
+#define BENCHMARKS_FIXTURE_H
+
+#include <engine/server.h>
+#include <engine/shared/memheap.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+
+/*
+	Class: CBenchServer
+		Stands in for the engine server so the game server can run
+		without a network. Every client is ingame, messages are
+		dropped and the snapshot items go into a builder the
+		benchmarks can read.
+*/
+class CBenchServer : public IServer
+{
+	enum
+	{
+		MAX_IDS=16*1024,
+	};
+
+	int m_aFreeIDs[MAX_IDS];
+	int m_NumFreeIDs;
+
+public:
+	CSnapshotBuilder m_SnapshotBuilder;
+	CSnapshotDelta m_SnapshotDelta;
+	CHeap m_FrameHeap;
+
+	CBenchServer();
+
+	void SetTick(int Tick) { m_CurrentGameTick = Tick; }
+	void ResetIDs();
+
+	virtual const char *ClientName(int ClientID);
+	virtual const char *ClientClan(int ClientID) { return ""; }
+	virtual int ClientCountry(int ClientID) { return -1; }
+	virtual bool ClientIngame(int ClientID) { return ClientID >= 0 && ClientID < MAX_CLIENTS; }
+	virtual int GetClientInfo(int ClientID, CClientInfo *pInfo);
+	virtual void GetClientAddr(int ClientID, char *pAddrStr, int Size);
+	virtual bool GetClientAddr(int ClientID, NETADDR *pAddr);
+	virtual int *LatestInput(int ClientID, int *pSize) { return 0; }
+
+	virtual int SendMsg(CMsgPacker *pMsg, int Flags, int ClientID) { return 0; }
+
+	virtual void SetClientName(int ClientID, char const *pName) {}
+	virtual void SetClientClan(int ClientID, char const *pClan) {}
+	virtual void SetClientCountry(int ClientID, int Country) {}
+	virtual void SetClientScore(int ClientID, int Score) {}
+
+	virtual int SnapNewID();
+	virtual void SnapFreeID(int ID);
+	virtual void *SnapNewItem(int Type, int ID, int Size);
+	virtual void SnapSetStaticsize(int ItemType, int Size);
+
+	virtual bool IsAuthed(int ClientID) { return false; }
+	virtual void Kick(int ClientID, const char *pReason) {}
+	virtual void PreloadMap(const char *pMapName) {}
+	virtual CHeap *FrameHeap() { return &m_FrameHeap; }
+};
+
+/*
+	Class: CBenchFixture
+		The kernel, the map and the game server the suites share.
+		The game is driven by scripted input that only depends on the
+		tick and the client, and the random numbers are seeded, so
+		every run plays the same game.
+*/
+class CBenchFixture
+{
+	class IKernel *m_pKernel;
+	class IStorage *m_pStorage;
+	class IConsole *m_pConsole;
+	class IConfig *m_pConfig;
+	class IEngineMap *m_pEngineMap;
+	CBenchServer *m_pServer;
+	IGameServer *m_pGameServer;
+	bool m_GameRunning;
+	int m_NumCharacters;
+	char m_aMapName[128];
+
+public:
+	CBenchFixture();
+	~CBenchFixture();
+
+	/*
+		Function: Init
+			Creates the kernel and loads the map.
+
+		Arguments:
+			pMapName - Map in the storage, e.g. "ctf2".
+	*/
+	bool Init(int NumArgs, const char **ppArguments, const char *pMapName);
+
+	/*
+		Function: StartGame
+			(Re)starts the game with the characters in it, the same way
+			a map change does on the real server.
+	*/
+	void StartGame();
+
+	// applies the scripted input and ticks the game once
+	void Tick();
+
+	/*
+		Function: Snap
+			Builds the snapshot of a client like the server does, call
+			EndFrame once all clients of the tick are done.
+
+		Returns:
+			The size of the snapshot written to pSnap.
+	*/
+	int Snap(int ClientID, CSnapshot *pSnap);
+
+	// clears the events and frees what the frame took from the frame heap
+	void EndFrame();
+
+	void SetNumCharacters(int NumCharacters);
+	int NumCharacters() const { return m_NumCharacters; }
+	const char *MapName() const { return m_aMapName; }
+	class IStorage *Storage() { return m_pStorage; }
+	class IConsole *Console() { return m_pConsole; }
+	class IEngineMap *EngineMap() { return m_pEngineMap; }
+	class IKernel *Kernel() { return m_pKernel; }
+	CBenchServer *Server() { return m_pServer; }
+	IGameServer *GameServer() { return m_pGameServer; }
+};
+
+#endif
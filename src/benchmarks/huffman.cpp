@@ -0,0 +1,67 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include <engine/shared/network.h>
+
+#include "bench.h"
+#include "fixture.h"
+#include "suites.h"
+
+/*
+	The huffman coding of the network packets. The payload is made up
+	like packed snapshot deltas, mostly zeros and small ints, so it
+	compresses about as well as real traffic does.
+*/
+
+struct CHuffmanData
+{
+	unsigned char m_aPacket[NET_MAX_PAYLOAD];
+	int m_PacketSize;
+	unsigned char m_aCompressed[NET_MAX_PACKETSIZE];
+	int m_CompressedSize;
+	unsigned char m_aDecompressed[NET_MAX_PACKETSIZE];
+};
+
+static void HuffmanCompress(void *pUser)
+{
+	CHuffmanData *pData = (CHuffmanData *)pUser;
+	CNetBase::Compress(pData->m_aPacket, pData->m_PacketSize, pData->m_aCompressed, sizeof(pData->m_aCompressed));
+}
+
+static void HuffmanDecompress(void *pUser)
+{
+	CHuffmanData *pData = (CHuffmanData *)pUser;
+	CNetBase::Decompress(pData->m_aCompressed, pData->m_CompressedSize, pData->m_aDecompressed, sizeof(pData->m_aDecompressed));
+}
+
+void BenchHuffman(CBench *pBench, CBenchFixture *pFixture)
+{
+	if(!pBench->Enabled("huffman."))
+		return;
+
+	static CHuffmanData s_Data;
+	unsigned Seed = 1;
+	s_Data.m_PacketSize = NET_MAX_PAYLOAD-16;
+	for(int i = 0; i < s_Data.m_PacketSize; i++)
+	{
+		int Value = BenchRandom(&Seed)%100;
+		if(Value < 55)
+			s_Data.m_aPacket[i] = 0;
+		else if(Value < 90)
+			s_Data.m_aPacket[i] = BenchRandom(&Seed)%16;
+		else
+			s_Data.m_aPacket[i] = BenchRandom(&Seed)&0xff;
+	}
+
+	s_Data.m_CompressedSize = CNetBase::Compress(s_Data.m_aPacket, s_Data.m_PacketSize, s_Data.m_aCompressed, sizeof(s_Data.m_aCompressed));
+	int Size = CNetBase::Decompress(s_Data.m_aCompressed, s_Data.m_CompressedSize, s_Data.m_aDecompressed, sizeof(s_Data.m_aDecompressed));
+	if(Size != s_Data.m_PacketSize || mem_comp(s_Data.m_aPacket, s_Data.m_aDecompressed, Size) != 0)
+	{
+		dbg_msg("bench", "huffman: round trip failed");
+		return;
+	}
+	dbg_msg("bench", "huffman: %d bytes to %d bytes", s_Data.m_PacketSize, s_Data.m_CompressedSize);
+
+	pBench->Run("huffman.compress", HuffmanCompress, &s_Data, s_Data.m_PacketSize);
+	pBench->Run("huffman.decompress", HuffmanDecompress, &s_Data, s_Data.m_PacketSize);
+}
@@ -0,0 +1,155 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include <engine/shared/network.h>
+
+#include "bench.h"
+#include "fixture.h"
+#include "suites.h"
+
+/*
+	Benchmarks of the server hot paths. Everything runs on fixed data,
+	the map, scripted input and seeded random numbers, so the results
+	of two commits can be compared:
+
+		benchmarks -j base.json
+		(build the other commit)
+		benchmarks -b base.json
+
+	The second run prints the change of every median and exits with the
+	number of benchmarks that got slower than the threshold. Run it
+	from the directory with the data folder like the server.
+
+	"benchmarks -p ticks" runs no benchmarks, it checks that the two
+	phase core tick moves the cores like the classic one and exits with
+	the number of mismatches.
+*/
+
+static const struct
+{
+	const char *m_pName;
+	FBenchSuite m_pfnSuite;
+} s_aSuites[] = {
+	{"huffman", BenchHuffman},
+	{"snapshot", BenchSnapshot},
+	{"collision", BenchCollision},
+	{"world", BenchWorld},
+	{"datafile", BenchDatafile},
+	{"demo", BenchDemo},
+};
+
+// the game logs a lot while it plays, only the results are printed
+static void LoggerBench(const char *pLine)
+{
+	if(str_find(pLine, "][bench]: "))
+	{
+		io_write(io_stdout(), pLine, str_length(pLine));
+		io_write(io_stdout(), "\n", 1);
+	}
+}
+
+static void Usage()
+{
+	dbg_msg("bench", "usage: benchmarks [-f filter] [-j json output] [-b baseline json] [-t threshold %%]");
+	dbg_msg("bench", "                  [-s samples] [-w warmup ms] [-m map] [-n characters] [-c label] [-v]");
+	dbg_msg("bench", "       benchmarks -p ticks [-m map] [-n characters] [-v]");
+	for(unsigned i = 0; i < sizeof(s_aSuites)/sizeof(s_aSuites[0]); i++)
+		dbg_msg("bench", "suite: %s", s_aSuites[i].m_pName);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	const char *pFilter = "";
+	const char *pJson = 0;
+	const char *pBaseline = 0;
+	const char *pLabel = "";
+	const char *pMap = "ctf2";
+	int Threshold = 10;
+	int NumSamples = 50;
+	int WarmupMs = 200;
+	int NumCharacters = 16;
+	int ParityTicks = 0;
+
+	bool Verbose = false;
+	bool ArgsOk = true;
+
+	for(int i = 1; i < argc && ArgsOk; i++) // ignore_convention
+	{
+		const char *pArg = argv[i]; // ignore_convention
+		if(str_comp(pArg, "-v") == 0)
+		{
+			Verbose = true;
+			continue;
+		}
+
+		const char *pValue = i+1 < argc ? argv[i+1] : 0; // ignore_convention
+		if(!pValue || pArg[0] != '-' || pArg[1] == 0 || pArg[2] != 0)
+		{
+			ArgsOk = false;
+			break;
+		}
+
+		switch(pArg[1])
+		{
+		case 'f': pFilter = pValue; break;
+		case 'j': pJson = pValue; break;
+		case 'b': pBaseline = pValue; break;
+		case 'c': pLabel = pValue; break;
+		case 'm': pMap = pValue; break;
+		case 't': Threshold = str_toint(pValue); break;
+		case 's': NumSamples = str_toint(pValue); break;
+		case 'w': WarmupMs = str_toint(pValue); break;
+		case 'n': NumCharacters = str_toint(pValue); break;
+		case 'p': ParityTicks = str_toint(pValue); break;
+		default: ArgsOk = false;
+		}
+		i++;
+	}
+
+	if(Verbose)
+		dbg_logger_stdout();
+	else
+		dbg_logger(LoggerBench);
+
+	if(!ArgsOk)
+	{
+		Usage();
+		return -1;
+	}
+
+	CNetBase::Init();
+
+	// the storage only takes the binary path from the arguments
+	CBenchFixture Fixture;
+	if(!Fixture.Init(1, argv, pMap)) // ignore_convention
+		return -1;
+	Fixture.SetNumCharacters(NumCharacters);
+
+	if(ParityTicks > 0)
+		return CheckWorldParity(&Fixture, ParityTicks);
+
+	CBench Bench;
+	Bench.SetFilter(pFilter);
+	Bench.SetSamples(NumSamples);
+	Bench.SetWarmup(WarmupMs);
+
+	int64 StartTime = time_get();
+	for(unsigned i = 0; i < sizeof(s_aSuites)/sizeof(s_aSuites[0]); i++)
+		s_aSuites[i].m_pfnSuite(&Bench, &Fixture);
+	dbg_msg("bench", "%d benchmarks in %.1fs", Bench.NumResults(), (time_get()-StartTime)/(float)time_freq());
+
+	if(pJson && !Bench.WriteJson(pJson, pLabel))
+	{
+		dbg_msg("bench", "couldn't write '%s'", pJson);
+		return -1;
+	}
+
+	if(pBaseline)
+	{
+		int NumRegressions = Bench.Compare(pBaseline, Threshold/100.0f);
+		if(NumRegressions < 0)
+			dbg_msg("bench", "couldn't read '%s'", pBaseline);
+		return NumRegressions;
+	}
+	return 0;
+}
@@ -0,0 +1,133 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include <engine/shared/compression.h>
+#include <engine/shared/memheap.h>
+#include <engine/shared/snapshot.h>
+
+#include "bench.h"
+#include "fixture.h"
+#include "suites.h"
+
+/*
+	Snapshots of a running game, like the server sends them every
+	second tick: building the snapshot of a player, the delta against
+	the snapshot two ticks earlier, the int packing on top of it and
+	the way back on the client.
+*/
+
+enum
+{
+	WARMUP_TICKS=250,
+};
+
+struct CSnapshotData
+{
+	CBenchFixture *m_pFixture;
+	CSnapshotDelta *m_pDelta;
+	CSnapshot *m_pFrom;
+	CSnapshot *m_pTo;
+	CSnapshot *m_pOut;
+	char *m_pDeltaData;
+	int m_DeltaSize;
+	char *m_pCompData;
+	int m_CompSize;
+	char *m_pDecompData;
+};
+
+static void SnapshotBuild(void *pUser)
+{
+	CSnapshotData *pData = (CSnapshotData *)pUser;
+	CHeap::CScope Scope(&pData->m_pFixture->Server()->m_FrameHeap);
+	pData->m_pFixture->Snap(0, pData->m_pOut);
+}
+
+static void SnapshotCrc(void *pUser)
+{
+	CSnapshotData *pData = (CSnapshotData *)pUser;
+	pData->m_pTo->Crc();
+}
+
+static void SnapshotDelta(void *pUser)
+{
+	CSnapshotData *pData = (CSnapshotData *)pUser;
+	pData->m_pDelta->CreateDelta(pData->m_pFrom, pData->m_pTo, pData->m_pDeltaData);
+}
+
+static void SnapshotCompress(void *pUser)
+{
+	CSnapshotData *pData = (CSnapshotData *)pUser;
+	CVariableInt::Compress(pData->m_pDeltaData, pData->m_DeltaSize, pData->m_pCompData);
+}
+
+static void SnapshotDecompress(void *pUser)
+{
+	CSnapshotData *pData = (CSnapshotData *)pUser;
+	CVariableInt::Decompress(pData->m_pCompData, pData->m_CompSize, pData->m_pDecompData);
+}
+
+static void SnapshotUnpack(void *pUser)
+{
+	CSnapshotData *pData = (CSnapshotData *)pUser;
+	pData->m_pDelta->UnpackDelta(pData->m_pFrom, pData->m_pOut, pData->m_pDeltaData, pData->m_DeltaSize);
+}
+
+void BenchSnapshot(CBench *pBench, CBenchFixture *pFixture)
+{
+	if(!pBench->Enabled("snapshot."))
+		return;
+
+	CSnapshotData Data;
+	Data.m_pFixture = pFixture;
+	Data.m_pDelta = &pFixture->Server()->m_SnapshotDelta;
+	Data.m_pFrom = (CSnapshot *)mem_alloc(CSnapshot::MAX_SIZE, sizeof(int));
+	Data.m_pTo = (CSnapshot *)mem_alloc(CSnapshot::MAX_SIZE, sizeof(int));
+	Data.m_pOut = (CSnapshot *)mem_alloc(CSnapshot::MAX_SIZE, sizeof(int));
+	Data.m_pDeltaData = (char *)mem_alloc(CSnapshot::MAX_SIZE, sizeof(int));
+	Data.m_pCompData = (char *)mem_alloc(CSnapshot::MAX_SIZE, sizeof(int));
+	Data.m_pDecompData = (char *)mem_alloc(CSnapshot::MAX_SIZE, sizeof(int));
+
+	pFixture->StartGame();
+	for(int i = 0; i < WARMUP_TICKS; i++)
+	{
+		pFixture->Tick();
+		pFixture->EndFrame();
+	}
+
+	// two snapshots a snap interval apart
+	pFixture->Tick();
+	pFixture->Snap(0, Data.m_pFrom);
+	pFixture->EndFrame();
+	pFixture->Tick();
+	pFixture->EndFrame();
+	pFixture->Tick();
+	int ToSize = pFixture->Snap(0, Data.m_pTo);
+
+	Data.m_DeltaSize = Data.m_pDelta->CreateDelta(Data.m_pFrom, Data.m_pTo, Data.m_pDeltaData);
+	Data.m_CompSize = CVariableInt::Compress(Data.m_pDeltaData, Data.m_DeltaSize, Data.m_pCompData);
+	dbg_msg("bench", "snapshot: %d items, %d bytes, delta %d bytes, packed %d bytes",
+		Data.m_pTo->NumItems(), ToSize, Data.m_DeltaSize, Data.m_CompSize);
+
+	char aName[64];
+	int Characters = pFixture->NumCharacters();
+	str_format(aName, sizeof(aName), "snapshot.build/%d", Characters);
+	pBench->Run(aName, SnapshotBuild, &Data, ToSize);
+	str_format(aName, sizeof(aName), "snapshot.crc/%d", Characters);
+	pBench->Run(aName, SnapshotCrc, &Data, ToSize);
+	str_format(aName, sizeof(aName), "snapshot.delta/%d", Characters);
+	pBench->Run(aName, SnapshotDelta, &Data, ToSize);
+	str_format(aName, sizeof(aName), "snapshot.compress/%d", Characters);
+	pBench->Run(aName, SnapshotCompress, &Data, Data.m_DeltaSize);
+	str_format(aName, sizeof(aName), "snapshot.decompress/%d", Characters);
+	pBench->Run(aName, SnapshotDecompress, &Data, Data.m_DeltaSize);
+	str_format(aName, sizeof(aName), "snapshot.unpack/%d", Characters);
+	pBench->Run(aName, SnapshotUnpack, &Data, ToSize);
+
+	pFixture->EndFrame();
+	mem_free(Data.m_pFrom);
+	mem_free(Data.m_pTo);
+	mem_free(Data.m_pOut);
+	mem_free(Data.m_pDeltaData);
+	mem_free(Data.m_pCompData);
+	mem_free(Data.m_pDecompData);
+}
@@ -0,0 +1,31 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef BENCHMARKS_SUITES_H
+#define BENCHMARKS_SUITES_H
+
+class CBench;
+class CBenchFixture;
+
+typedef void (*FBenchSuite)(CBench *pBench, CBenchFixture *pFixture);
+
+// the benchmarks of a suite are named "<suite>.<benchmark>", the ones
+// that depend on the number of characters end with "/<characters>"
+void BenchSnapshot(CBench *pBench, CBenchFixture *pFixture);
+void BenchHuffman(CBench *pBench, CBenchFixture *pFixture);
+void BenchCollision(CBench *pBench, CBenchFixture *pFixture);
+void BenchWorld(CBench *pBench, CBenchFixture *pFixture);
+void BenchDatafile(CBench *pBench, CBenchFixture *pFixture);
+void BenchDemo(CBench *pBench, CBenchFixture *pFixture);
+
+// not a benchmark, compares the classic and the two phase core tick,
+// returns the number of cores that differ
+int CheckWorldParity(CBenchFixture *pFixture, int NumTicks);
+
+// deterministic random numbers, the same on every platform
+inline unsigned BenchRandom(unsigned *pSeed)
+{
+	*pSeed = *pSeed*1103515245u + 12345u;
+	return (*pSeed>>16)&0x7fff;
+}
+
+#endif
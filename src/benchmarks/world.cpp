@@ -0,0 +1,165 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include <engine/shared/snapshot.h>
+#include <game/server/corephysics.h>
+#include <game/server/gamecontext.h>
+#include <game/server/entities/character.h>
+
+#include "bench.h"
+#include "fixture.h"
+#include "suites.h"
+
+/*
+	Game ticks with the characters playing. "world.tick" is the game
+	alone, "world.frame" also builds the snapshots for all players like
+	the server does on the ticks it snaps.
+
+	CheckWorldParity isn't timed, it plays the game with the classic
+	tick and after every tick moves copies of the cores once in the
+	classic order and once with the two phase tick of CCorePhysics.
+*/
+
+enum
+{
+	WARMUP_TICKS=250,
+};
+
+struct CWorldData
+{
+	CBenchFixture *m_pFixture;
+	CSnapshot *m_pSnap;
+};
+
+static void WorldTick(void *pUser)
+{
+	CWorldData *pData = (CWorldData *)pUser;
+	pData->m_pFixture->Tick();
+	pData->m_pFixture->EndFrame();
+}
+
+static void WorldFrame(void *pUser)
+{
+	CWorldData *pData = (CWorldData *)pUser;
+	pData->m_pFixture->Tick();
+	for(int i = 0; i < pData->m_pFixture->NumCharacters(); i++)
+		pData->m_pFixture->Snap(i, pData->m_pSnap);
+	pData->m_pFixture->EndFrame();
+}
+
+void BenchWorld(CBench *pBench, CBenchFixture *pFixture)
+{
+	if(!pBench->Enabled("world."))
+		return;
+
+	CWorldData Data;
+	Data.m_pFixture = pFixture;
+	Data.m_pSnap = (CSnapshot *)mem_alloc(CSnapshot::MAX_SIZE, sizeof(int));
+
+	// every benchmark starts from the same game
+	char aName[64];
+	int Characters = pFixture->NumCharacters();
+
+	pFixture->StartGame();
+	for(int i = 0; i < WARMUP_TICKS; i++)
+		WorldTick(&Data);
+	str_format(aName, sizeof(aName), "world.tick/%d", Characters);
+	pBench->Run(aName, WorldTick, &Data);
+
+	pFixture->StartGame();
+	for(int i = 0; i < WARMUP_TICKS; i++)
+		WorldTick(&Data);
+	str_format(aName, sizeof(aName), "world.frame/%d", Characters);
+	pBench->Run(aName, WorldFrame, &Data);
+
+	mem_free(Data.m_pSnap);
+}
+
+static bool CoresEqual(const CCharacterCore *pA, const CCharacterCore *pB)
+{
+	return pA->m_Pos == pB->m_Pos && pA->m_Vel == pB->m_Vel &&
+		pA->m_HookPos == pB->m_HookPos && pA->m_HookDir == pB->m_HookDir &&
+		pA->m_HookTick == pB->m_HookTick && pA->m_HookState == pB->m_HookState &&
+		pA->m_HookedPlayer == pB->m_HookedPlayer && pA->m_Jumped == pB->m_Jumped &&
+		pA->m_Direction == pB->m_Direction && pA->m_Angle == pB->m_Angle &&
+		pA->m_TriggeredEvents == pB->m_TriggeredEvents;
+}
+
+// copies the cores of a world, in the same slots
+static void CopyWorld(CWorldCore *pDest, CCharacterCore *pCores, const CWorldCore *pSrc, CCollision *pCollision)
+{
+	pDest->m_Tuning = pSrc->m_Tuning;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(pSrc->m_apCharacters[i])
+		{
+			pCores[i] = *pSrc->m_apCharacters[i];
+			pCores[i].Init(pDest, pCollision);
+			pDest->m_apCharacters[i] = &pCores[i];
+		}
+		else
+			pDest->m_apCharacters[i] = 0;
+	}
+}
+
+int CheckWorldParity(CBenchFixture *pFixture, int NumTicks)
+{
+	static const int s_aThreads[] = {1, 2, 4, CCorePhysics::MAX_THREADS};
+	static CCorePhysics s_Physics;
+	static CWorldCore s_Classic, s_TwoPhase;
+	static CCharacterCore s_aClassic[MAX_CLIENTS], s_aTwoPhase[MAX_CLIENTS];
+
+	CGameContext *pGameServer = (CGameContext *)pFixture->GameServer();
+	CGameWorld *pWorld = &pGameServer->m_World;
+	CCollision *pCollision = pGameServer->Collision();
+
+	int Mismatches = 0;
+	int HookedTicks = 0;
+	pFixture->StartGame();
+	for(int Tick = 0; Tick < NumTicks; Tick++)
+	{
+		pFixture->Tick();
+		pFixture->EndFrame();
+
+		// the order of the character list is the classic order, the
+		// cores still hold the input of the tick that just ran
+		int aOrder[MAX_CLIENTS];
+		int Num = 0;
+		bool Hooked = false;
+		for(CCharacter *pChr = (CCharacter *)pWorld->FindFirst(CGameWorld::ENTTYPE_CHARACTER); pChr && Num < MAX_CLIENTS; pChr = (CCharacter *)pChr->TypeNext())
+		{
+			aOrder[Num++] = pChr->GetPlayer()->GetCID();
+			if(pChr->m_Core.m_HookedPlayer >= 0)
+				Hooked = true;
+		}
+		if(Hooked)
+			HookedTicks++;
+
+		CopyWorld(&s_Classic, s_aClassic, &pWorld->m_Core, pCollision);
+		for(int i = 0; i < Num; i++)
+			s_aClassic[aOrder[i]].Tick(true);
+
+		for(unsigned t = 0; t < sizeof(s_aThreads)/sizeof(s_aThreads[0]); t++)
+		{
+			CopyWorld(&s_TwoPhase, s_aTwoPhase, &pWorld->m_Core, pCollision);
+			CCharacterCore *apCores[MAX_CLIENTS];
+			for(int i = 0; i < Num; i++)
+				apCores[i] = &s_aTwoPhase[aOrder[i]];
+
+			s_Physics.SetThreads(s_aThreads[t]);
+			s_Physics.Tick(&s_TwoPhase, pCollision, apCores, Num, false);
+
+			for(int i = 0; i < Num; i++)
+			{
+				if(CoresEqual(&s_aClassic[aOrder[i]], &s_aTwoPhase[aOrder[i]]))
+					continue;
+				dbg_msg("bench", "parity mismatch tick=%d threads=%d cid=%d", Tick, s_aThreads[t], aOrder[i]);
+				Mismatches++;
+			}
+		}
+	}
+	s_Physics.SetThreads(1);
+
+	dbg_msg("bench", "physics parity: %d ticks, %d with hooked players, %d mismatches", NumTicks, HookedTicks, Mismatches);
+	return Mismatches;
+}
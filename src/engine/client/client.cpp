@@ -458,6 +458,9 @@ CClient::CClient() : m_DemoPlayer(&m_SnapshotDelta), m_DemoRecorder(&m_SnapshotD
 	m_MapdownloadCrc = 0;
 	m_MapdownloadAmount = -1;
 	m_MapdownloadTotalsize = -1;
+	m_MapdownloadWindow = 0;
+	m_MapdownloadRequested = 0;
+	m_MapdownloadResync = -1;
 
 	m_CurrentServerInfoRequestTime = -1;
 
@@ -536,6 +539,35 @@ void CClient::SendReady()
 	SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
 }
 
+void CClient::RequestMapData()
+{
+	int Chunk = m_MapdownloadChunk;
+	int Window = 0;
+	if(m_MapdownloadWindow)
+	{
+		// once half of the window arrived, ask for enough chunks to fill it again
+		int NumChunks = (m_MapdownloadTotalsize+MAP_CHUNK_SIZE-1)/MAP_CHUNK_SIZE;
+		if(m_MapdownloadRequested >= NumChunks || m_MapdownloadRequested-m_MapdownloadChunk > m_MapdownloadWindow/2)
+			return;
+		Chunk = m_MapdownloadRequested;
+		Window = m_MapdownloadChunk+m_MapdownloadWindow-Chunk;
+		m_MapdownloadRequested = min(Chunk+Window, NumChunks);
+	}
+
+	CMsgPacker Msg(NETMSG_REQUEST_MAP_DATA);
+	Msg.AddInt(Chunk);
+	if(Window)
+		Msg.AddInt(Window);
+	SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
+
+	if(g_Config.m_Debug)
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "requested chunk %d window %d", Chunk, Window);
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client/network", aBuf);
+	}
+}
+
 bool CClient::RconAuthed()
 {
 	return m_RconAuthed;
@@ -947,6 +979,7 @@ const char *CClient::LoadMap(const char *pName, const char *pFilename, unsigned
 
 	SetState(IClient::STATE_LOADING);
 
+	int64 StartTime = time_get();
 	if(!m_pMap->Load(pFilename))
 	{
 		str_format(aErrorMsg, sizeof(aErrorMsg), "map '%s' not found", pFilename);
@@ -966,7 +999,8 @@ const char *CClient::LoadMap(const char *pName, const char *pFilename, unsigned
 	DemoRecorder_Stop();
 
 	char aBuf[256];
-	str_format(aBuf, sizeof(aBuf), "loaded map '%s'", pFilename);
+	str_format(aBuf, sizeof(aBuf), "loaded map '%s' in %.2fms, peak memory %d KiB", pFilename,
+		(time_get()-StartTime)*1000.0f/time_freq(), m_pMap->PeakMemoryUsage()/1024);
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "client", aBuf);
 	m_RecivedSnapshots = 0;
 
@@ -1197,6 +1231,11 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 			if(Unpacker.Error())
 				return;
 
+			// servers that stream the map send the window size they accept
+			int MapWindow = Unpacker.GetInt();
+			if(Unpacker.Error())
+				MapWindow = 0;
+
 			// check for valid standard map
 			if(!m_MapChecker.IsMapValid(pMap, MapCrc, MapSize))
 				pError = "invalid standard map";
@@ -1237,16 +1276,11 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 					m_MapdownloadCrc = MapCrc;
 					m_MapdownloadTotalsize = MapSize;
 					m_MapdownloadAmount = 0;
+					m_MapdownloadWindow = clamp(MapWindow, 0, (int)MAP_MAX_WINDOW);
+					m_MapdownloadRequested = 0;
+					m_MapdownloadResync = -1;
 
-					CMsgPacker Msg(NETMSG_REQUEST_MAP_DATA);
-					Msg.AddInt(m_MapdownloadChunk);
-					SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
-
-					if(g_Config.m_Debug)
-					{
-						str_format(aBuf, sizeof(aBuf), "requested chunk %d", m_MapdownloadChunk);
-						m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client/network", aBuf);
-					}
+					RequestMapData();
 				}
 			}
 		}
@@ -1259,8 +1293,20 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 			const unsigned char *pData = Unpacker.GetRaw(Size);
 
 			// check fior errors
-			if(Unpacker.Error() || Size <= 0 || MapCRC != m_MapdownloadCrc || Chunk != m_MapdownloadChunk || !m_MapdownloadFile)
+			if(Unpacker.Error() || Size <= 0 || MapCRC != m_MapdownloadCrc || !m_MapdownloadFile)
+				return;
+
+			if(Chunk != m_MapdownloadChunk)
+			{
+				// a chunk is missing, restart the stream at the gap once
+				if(m_MapdownloadWindow && Chunk > m_MapdownloadChunk && m_MapdownloadResync != m_MapdownloadChunk)
+				{
+					m_MapdownloadResync = m_MapdownloadChunk;
+					m_MapdownloadRequested = m_MapdownloadChunk;
+					RequestMapData();
+				}
 				return;
+			}
 
 			io_write(m_MapdownloadFile, pData, Size);
 
@@ -1289,19 +1335,9 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 			}
 			else
 			{
-				// request new chunk
+				// request new chunks
 				m_MapdownloadChunk++;
-
-				CMsgPacker Msg(NETMSG_REQUEST_MAP_DATA);
-				Msg.AddInt(m_MapdownloadChunk);
-				SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH);
-
-				if(g_Config.m_Debug)
-				{
-					char aBuf[256];
-					str_format(aBuf, sizeof(aBuf), "requested chunk %d", m_MapdownloadChunk);
-					m_pConsole->Print(IConsole::OUTPUT_LEVEL_DEBUG, "client/network", aBuf);
-				}
+				RequestMapData();
 			}
 		}
 		else if(Msg == NETMSG_CON_READY)
@@ -1378,6 +1414,9 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 				PartSize = Unpacker.GetInt();
 			}
 
+			if(Part < 0 || Part >= NumParts || NumParts > CSnapshot::MAX_PARTS || PartSize < 0 || PartSize > MAX_SNAPSHOT_PACKSIZE)
+				return;
+
 			pData = (const char *)Unpacker.GetRaw(PartSize);
 
 			if(Unpacker.Error())
@@ -1393,9 +1432,9 @@ void CClient::ProcessServerPacket(CNetChunk *pPacket)
 
 				// TODO: clean this up abit
 				mem_copy((char*)m_aSnapshotIncommingData + Part*MAX_SNAPSHOT_PACKSIZE, pData, PartSize);
-				m_SnapshotParts |= 1<<Part;
+				m_SnapshotParts |= 1u<<Part;
 
-				if(m_SnapshotParts == (unsigned)((1<<NumParts)-1))
+				if(m_SnapshotParts == (NumParts == CSnapshot::MAX_PARTS ? 0xffffffffu : (1u<<NumParts)-1))
 				{
 					static CSnapshot Emptysnap;
 					CSnapshot *pDeltaShot = &Emptysnap;
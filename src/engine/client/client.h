@@ -151,6 +151,9 @@ class CClient : public IClient, public CDemoPlayer::IListner
 	int m_MapdownloadCrc;
 	int m_MapdownloadAmount;
 	int m_MapdownloadTotalsize;
+	int m_MapdownloadWindow; // 0 for servers that send one chunk per request
+	int m_MapdownloadRequested;
+	int m_MapdownloadResync;
 
 	// time
 	CSmoothTime m_GameTime;
@@ -220,6 +223,7 @@ public:
 	void SendInfo();
 	void SendEnterGame();
 	void SendReady();
+	void RequestMapData();
 
 	virtual bool RconAuthed();
 	void RconAuth(const char *pName, const char *pPassword);
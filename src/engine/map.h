@@ -27,6 +27,16 @@ public:
 	virtual bool IsLoaded() = 0;
 	virtual void Unload() = 0;
 	virtual unsigned Crc() = 0;
+
+	// takes over an opened datafile, the old one is left in pDataFile
+	virtual void Replace(class CDataFileReader *pDataFile) = 0;
+
+	// the map file as it is on disk, valid while the map is loaded
+	virtual const unsigned char *FileData() = 0;
+	virtual unsigned FileSize() = 0;
+
+	// most heap memory the loaded map has taken up so far
+	virtual unsigned PeakMemoryUsage() = 0;
 };
 
 extern IEngineMap *CreateEngineMap();
@@ -31,6 +31,7 @@ public:
 	virtual bool ClientIngame(int ClientID) = 0;
 	virtual int GetClientInfo(int ClientID, CClientInfo *pInfo) = 0;
 	virtual void GetClientAddr(int ClientID, char *pAddrStr, int Size) = 0;
+	virtual bool GetClientAddr(int ClientID, NETADDR *pAddr) = 0; // without the port, false when not ingame
 	virtual int *LatestInput(int ClientID, int *pSize) = 0;
 	
 	virtual int SendMsg(CMsgPacker *pMsg, int Flags, int ClientID) = 0;
@@ -57,6 +58,12 @@ public:
 	
 	virtual bool IsAuthed(int ClientID) = 0;
 	virtual void Kick(int ClientID, const char *pReason) = 0;
+
+	// loads a map in the background so changing to it later is instant
+	virtual void PreloadMap(const char *pMapName) = 0;
+
+	// scratch memory for the main thread, rewound after every snapshot
+	virtual class CHeap *FrameHeap() = 0;
 };
 
 class IGameServer : public IInterface
@@ -0,0 +1,263 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include <engine/console.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+
+#include "mapcache.h"
+
+CMapCache::CMapCache()
+{
+	m_pStorage = 0;
+	m_pConsole = 0;
+	m_pFirst = 0;
+	m_pLast = 0;
+	m_Size = 0;
+	m_NumQueued = 0;
+	m_aLoading[0] = 0;
+	m_Lock = lock_create();
+	m_Work = semaphore_create();
+	m_pThread = 0;
+	m_Shutdown = false;
+}
+
+CMapCache::~CMapCache()
+{
+	if(m_pThread)
+	{
+		m_Shutdown = true;
+		semaphore_signal(m_Work);
+		thread_wait(m_pThread);
+	}
+	Clear();
+	semaphore_destroy(m_Work);
+	lock_destroy(m_Lock);
+}
+
+void CMapCache::Init(IStorage *pStorage, IConsole *pConsole)
+{
+	m_pStorage = pStorage;
+	m_pConsole = pConsole;
+	m_pThread = thread_create(LoaderThread, this);
+}
+
+CMapCache::CEntry *CMapCache::Find(const char *pName)
+{
+	for(CEntry *pEntry = m_pFirst; pEntry; pEntry = pEntry->m_pNext)
+	{
+		if(str_comp(pEntry->m_aName, pName) == 0)
+			return pEntry;
+	}
+	return 0;
+}
+
+void CMapCache::Link(CEntry *pEntry)
+{
+	pEntry->m_pPrev = 0;
+	pEntry->m_pNext = m_pFirst;
+	if(m_pFirst)
+		m_pFirst->m_pPrev = pEntry;
+	else
+		m_pLast = pEntry;
+	m_pFirst = pEntry;
+	m_Size += pEntry->m_DataFile.FileSize();
+}
+
+void CMapCache::Unlink(CEntry *pEntry)
+{
+	if(pEntry->m_pPrev)
+		pEntry->m_pPrev->m_pNext = pEntry->m_pNext;
+	else
+		m_pFirst = pEntry->m_pNext;
+	if(pEntry->m_pNext)
+		pEntry->m_pNext->m_pPrev = pEntry->m_pPrev;
+	else
+		m_pLast = pEntry->m_pPrev;
+	m_Size -= pEntry->m_DataFile.FileSize();
+}
+
+void CMapCache::Insert(CEntry *pEntry)
+{
+	// an older copy of the same map is replaced
+	CEntry *pOld = Find(pEntry->m_aName);
+	if(pOld)
+	{
+		Unlink(pOld);
+		delete pOld;
+	}
+
+	Link(pEntry);
+	Shrink((unsigned)g_Config.m_SvMapCacheSize*1024);
+}
+
+void CMapCache::Shrink(unsigned MaxSize)
+{
+	while(m_pLast && m_Size > MaxSize)
+	{
+		CEntry *pEntry = m_pLast;
+		Unlink(pEntry);
+		dbg_msg("mapcache", "dropped '%s'", pEntry->m_aName);
+		delete pEntry;
+	}
+}
+
+bool CMapCache::FileStat(const char *pMapName, int64 *pSize, int64 *pModified)
+{
+	char aBuf[512];
+	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
+	IOHANDLE File = m_pStorage->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+		return false;
+	bool Result = io_stat(File, pSize, pModified) == 0;
+	io_close(File);
+	return Result;
+}
+
+bool CMapCache::IsCurrent(CEntry *pEntry, int64 Size, int64 Modified)
+{
+	return Size == (int64)pEntry->m_DataFile.FileSize() && Modified == pEntry->m_DataFile.FileModified();
+}
+
+void CMapCache::LoaderThread(void *pUser)
+{
+	CMapCache *pThis = (CMapCache *)pUser;
+
+	while(1)
+	{
+		semaphore_wait(pThis->m_Work);
+		if(pThis->m_Shutdown)
+			break;
+
+		lock_wait(pThis->m_Lock);
+		if(!pThis->m_NumQueued)
+		{
+			lock_release(pThis->m_Lock);
+			continue;
+		}
+		str_copy(pThis->m_aLoading, pThis->m_aaQueue[0], sizeof(pThis->m_aLoading));
+		pThis->m_NumQueued--;
+		for(int i = 0; i < pThis->m_NumQueued; i++)
+			str_copy(pThis->m_aaQueue[i], pThis->m_aaQueue[i+1], sizeof(pThis->m_aaQueue[i]));
+		lock_release(pThis->m_Lock);
+
+		// open it outside of the lock, this is the slow part
+		char aBuf[512];
+		str_format(aBuf, sizeof(aBuf), "maps/%s.map", pThis->m_aLoading);
+		CEntry *pEntry = new CEntry;
+		str_copy(pEntry->m_aName, pThis->m_aLoading, sizeof(pEntry->m_aName));
+		int64 StartTime = time_get();
+		bool Loaded = pEntry->m_DataFile.Open(pThis->m_pStorage, aBuf, IStorage::TYPE_ALL);
+
+		lock_wait(pThis->m_Lock);
+		if(Loaded)
+		{
+			dbg_msg("mapcache", "preloaded '%s' size=%d crc=%08x in %.2fms", pEntry->m_aName, pEntry->m_DataFile.FileSize(),
+				pEntry->m_DataFile.Crc(), (time_get()-StartTime)*1000.0f/time_freq());
+			pThis->Insert(pEntry);
+		}
+		else
+		{
+			dbg_msg("mapcache", "couldn't preload '%s'", pEntry->m_aName);
+			delete pEntry;
+		}
+		pThis->m_aLoading[0] = 0;
+		lock_release(pThis->m_Lock);
+	}
+}
+
+void CMapCache::Preload(const char *pMapName)
+{
+	if(!g_Config.m_SvMapCacheSize || !m_pThread || !pMapName[0])
+		return;
+
+	// a map that changed on disk since it was cached is loaded again
+	int64 Size = 0, Modified = 0;
+	bool Exists = FileStat(pMapName, &Size, &Modified);
+
+	lock_wait(m_Lock);
+	CEntry *pEntry = Find(pMapName);
+	if(pEntry && (!Exists || !IsCurrent(pEntry, Size, Modified)))
+	{
+		Unlink(pEntry);
+		dbg_msg("mapcache", "'%s' changed on disk, dropped", pEntry->m_aName);
+		delete pEntry;
+		pEntry = 0;
+	}
+	bool Known = pEntry || str_comp(m_aLoading, pMapName) == 0;
+	for(int i = 0; i < m_NumQueued && !Known; i++)
+		Known = str_comp(m_aaQueue[i], pMapName) == 0;
+	bool Queued = false;
+	if(!Known && m_NumQueued < MAX_QUEUED)
+	{
+		str_copy(m_aaQueue[m_NumQueued++], pMapName, sizeof(m_aaQueue[0]));
+		Queued = true;
+	}
+	lock_release(m_Lock);
+
+	if(Queued)
+		semaphore_signal(m_Work);
+}
+
+bool CMapCache::Take(const char *pMapName, CDataFileReader *pDataFile)
+{
+	lock_wait(m_Lock);
+	CEntry *pEntry = Find(pMapName);
+	if(pEntry)
+		Unlink(pEntry);
+	lock_release(m_Lock);
+
+	if(!pEntry)
+		return false;
+
+	// the file may have been replaced since it was cached, the caller
+	// opens it again then
+	int64 Size = 0, Modified = 0;
+	if(!FileStat(pMapName, &Size, &Modified) || !IsCurrent(pEntry, Size, Modified))
+	{
+		dbg_msg("mapcache", "'%s' changed on disk, dropped", pEntry->m_aName);
+		delete pEntry;
+		return false;
+	}
+
+	pDataFile->Swap(&pEntry->m_DataFile);
+	delete pEntry;
+	return true;
+}
+
+void CMapCache::Add(const char *pMapName, CDataFileReader *pDataFile)
+{
+	if(!pDataFile->IsOpen() || !pMapName[0])
+		return;
+
+	CEntry *pEntry = new CEntry;
+	str_copy(pEntry->m_aName, pMapName, sizeof(pEntry->m_aName));
+	pEntry->m_DataFile.Swap(pDataFile);
+
+	lock_wait(m_Lock);
+	Insert(pEntry);
+	lock_release(m_Lock);
+}
+
+void CMapCache::Clear()
+{
+	lock_wait(m_Lock);
+	Shrink(0);
+	lock_release(m_Lock);
+}
+
+void CMapCache::Dump()
+{
+	char aBuf[256];
+	lock_wait(m_Lock);
+	for(CEntry *pEntry = m_pFirst; pEntry; pEntry = pEntry->m_pNext)
+	{
+		str_format(aBuf, sizeof(aBuf), "%s size=%d crc=%08x", pEntry->m_aName, pEntry->m_DataFile.FileSize(), pEntry->m_DataFile.Crc());
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapcache", aBuf);
+	}
+	str_format(aBuf, sizeof(aBuf), "%d/%d KiB used, %d queued%s%s", (m_Size+1023)/1024, g_Config.m_SvMapCacheSize,
+		m_NumQueued, m_aLoading[0] ? ", loading " : "", m_aLoading);
+	lock_release(m_Lock);
+	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapcache", aBuf);
+}
@@ -0,0 +1,106 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SERVER_MAPCACHE_H
+#define ENGINE_SERVER_MAPCACHE_H
+
+#include <base/system.h>
+#include <engine/shared/datafile.h>
+
+/*
+	Class: CMapCache
+		Keeps opened maps around so a map change doesn't have to touch
+		the disk. Maps are preloaded on a background thread: the file is
+		mapped, its CRC is taken, which also pages it in, and the
+		datafile is parsed. Taking a map out of the cache swaps the
+		datafile over, the map that was replaced can be put back.
+
+		The least recently used maps are dropped once the cache holds
+		more than sv_map_cache_size KiB of map files. A cached map whose
+		file changed size or modification time since it was opened is
+		dropped instead of being used.
+*/
+class CMapCache
+{
+	enum
+	{
+		MAX_QUEUED=8,
+	};
+
+	class CEntry
+	{
+	public:
+		char m_aName[128];
+		CDataFileReader m_DataFile;
+		CEntry *m_pPrev; // more recently used
+		CEntry *m_pNext;
+	};
+
+	class IStorage *m_pStorage;
+	class IConsole *m_pConsole;
+
+	// entries from the most to the least recently used
+	CEntry *m_pFirst;
+	CEntry *m_pLast;
+	unsigned m_Size;
+
+	// maps waiting for the loader
+	char m_aaQueue[MAX_QUEUED][128];
+	int m_NumQueued;
+	char m_aLoading[128];
+
+	LOCK m_Lock;
+	SEMAPHORE m_Work;
+	void *m_pThread;
+	volatile bool m_Shutdown;
+
+	CEntry *Find(const char *pName);
+	void Link(CEntry *pEntry);
+	void Unlink(CEntry *pEntry);
+	void Insert(CEntry *pEntry);
+	void Shrink(unsigned MaxSize);
+
+	// size and modification time of the map file, see io_stat
+	bool FileStat(const char *pMapName, int64 *pSize, int64 *pModified);
+	static bool IsCurrent(CEntry *pEntry, int64 Size, int64 Modified);
+
+	static void LoaderThread(void *pUser);
+
+public:
+	CMapCache();
+	~CMapCache();
+
+	void Init(class IStorage *pStorage, class IConsole *pConsole);
+
+	/*
+		Function: Preload
+			Queues a map for the loader thread. Does nothing if the map
+			is already cached or queued.
+
+		Arguments:
+			pMapName - Name of the map, without the maps/ folder and extension.
+	*/
+	void Preload(const char *pMapName);
+
+	/*
+		Function: Take
+			Moves a cached map into pDataFile and removes it from the cache.
+			The map file is checked against the cached one first.
+
+		Returns:
+			False if the map isn't ready or the file changed, pDataFile
+			isn't touched then.
+	*/
+	bool Take(const char *pMapName, CDataFileReader *pDataFile);
+
+	/*
+		Function: Add
+			Moves an opened map into the cache as the most recently used one.
+			pDataFile is left closed.
+	*/
+	void Add(const char *pMapName, CDataFileReader *pDataFile);
+
+	void Clear();
+	void Dump();
+};
+
+#endif
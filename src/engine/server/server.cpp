@@ -1,6 +1,8 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 
+#include <base/math.h>
+#include <base/perf.h>
 #include <base/system.h>
 
 #include <engine/config.h>
@@ -16,6 +18,8 @@
 #include <engine/shared/datafile.h>
 #include <engine/shared/demo.h>
 #include <engine/shared/mapchecker.h>
+#include <engine/shared/mapmanifest.h>
+#include <engine/shared/memheap.h>
 #include <engine/shared/network.h>
 #include <engine/shared/packer.h>
 #include <engine/shared/protocol.h>
@@ -23,6 +27,9 @@
 
 #include <mastersrv/mastersrv.h>
 
+#include <zlib.h>
+
+#include "mapcache.h"
 #include "register.h"
 #include "server.h"
 
@@ -164,6 +171,11 @@ void CServer::CClient::Reset()
 	m_LastInputTick = -1;
 	m_SnapRate = CClient::SNAPRATE_INIT;
 	m_Score = 0;
+
+	m_MapChunk = 0;
+	m_MapChunkEnd = 0;
+	m_MapBudget = 0;
+	m_MapBudgetTime = 0;
 }
 
 CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
@@ -171,6 +183,7 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 	m_TickSpeed = SERVER_TICK_SPEED;
 	
 	m_pGameServer = 0;
+	m_pStorage = 0;
 	
 	m_CurrentGameTick = 0;
 	m_RunServer = 1;
@@ -181,6 +194,7 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 	m_MapReload = 0;
 
 	m_RconClientID = -1;
+	m_MemProfileStart = time_get();
 
 	Init();
 }
@@ -209,7 +223,7 @@ int CServer::TrySetClientName(int ClientID, const char *pName)
 		return -1;
 	
 	// make sure that two clients doesn't have the same name
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = m_ActiveClients.first(); i >= 0; i = m_ActiveClients.next(i))
 		if(i != ClientID && m_aClients[i].m_State >= CClient::STATE_READY)
 		{
 			if(str_comp(pName, m_aClients[i].m_aName) == 0)
@@ -309,6 +323,7 @@ int CServer::Init()
 		m_aClients[i].m_Country = -1;
 		m_aClients[i].m_Snapshots.Init();
 	}
+	m_ActiveClients.clear();
 
 	m_CurrentGameTick = 0;
 
@@ -343,6 +358,15 @@ void CServer::GetClientAddr(int ClientID, char *pAddrStr, int Size)
 		net_addr_str(&Addr, pAddrStr, Size);
 	}
 }
+
+bool CServer::GetClientAddr(int ClientID, NETADDR *pAddr)
+{
+	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State != CClient::STATE_INGAME)
+		return false;
+	*pAddr = m_NetServer.ClientAddr(ClientID);
+	pAddr->port = 0;
+	return true;
+}
 	
 
 int *CServer::LatestInput(int ClientID, int *size)
@@ -424,8 +448,7 @@ int CServer::SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System)
 		if(ClientID == -1)
 		{
 			// broadcast
-			int i;
-			for(i = 0; i < MAX_CLIENTS; i++)
+			for(int i = m_ActiveClients.first(); i >= 0; i = m_ActiveClients.next(i))
 				if(m_aClients[i].m_State == CClient::STATE_INGAME)
 				{
 					Packet.m_ClientID = i;
@@ -445,20 +468,21 @@ void CServer::DoSnapshot()
 	// create snapshot for demo recording
 	if(m_DemoRecorder.IsRecording())
 	{
-		char aData[CSnapshot::MAX_SIZE];
+		CHeap::CScope Scope(&m_FrameHeap);
+		char *pData = (char *)m_FrameHeap.Allocate(CSnapshot::MAX_SIZE, sizeof(int));
 		int SnapshotSize;
 
 		// build snap and possibly add some messages
 		m_SnapshotBuilder.Init();
 		GameServer()->OnSnap(-1);
-		SnapshotSize = m_SnapshotBuilder.Finish(aData);
+		SnapshotSize = m_SnapshotBuilder.Finish(pData);
 		
 		// write snapshot
-		m_DemoRecorder.RecordSnapshot(Tick(), aData, SnapshotSize);
+		m_DemoRecorder.RecordSnapshot(Tick(), pData, SnapshotSize);
 	}
 
 	// create snapshots for all clients
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = m_ActiveClients.first(); i >= 0; i = m_ActiveClients.next(i))
 	{
 		// client must be ingame to recive snapshots
 		if(m_aClients[i].m_State != CClient::STATE_INGAME)
@@ -473,10 +497,11 @@ void CServer::DoSnapshot()
 			continue;
 			
 		{
-			char aData[CSnapshot::MAX_SIZE];
-			CSnapshot *pData = (CSnapshot*)aData;	// Fix compiler warning for strict-aliasing
-			char aDeltaData[CSnapshot::MAX_SIZE];
-			char aCompData[CSnapshot::MAX_SIZE];
+			// the buffers are reused for every client
+			CHeap::CScope Scope(&m_FrameHeap);
+			CSnapshot *pData = (CSnapshot *)m_FrameHeap.Allocate(CSnapshot::MAX_SIZE, sizeof(int));
+			char *pDeltaData = (char *)m_FrameHeap.Allocate(CSnapshot::MAX_SIZE, sizeof(int));
+			char *pCompData = (char *)m_FrameHeap.Allocate(CSnapshot::MAX_SIZE, sizeof(int));
 			int SnapshotSize;
 			int Crc;
 			static CSnapshot EmptySnap;
@@ -516,7 +541,7 @@ void CServer::DoSnapshot()
 			}
 			
 			// create delta
-			DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData);
+			DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, pDeltaData);
 			
 			if(DeltaSize)
 			{
@@ -525,7 +550,7 @@ void CServer::DoSnapshot()
 				const int MaxSize = MAX_SNAPSHOT_PACKSIZE;
 				int NumPackets;
 
-				SnapshotSize = CVariableInt::Compress(aDeltaData, DeltaSize, aCompData);
+				SnapshotSize = CVariableInt::Compress(pDeltaData, DeltaSize, pCompData);
 				NumPackets = (SnapshotSize+MaxSize-1)/MaxSize;
 				
 				for(int n = 0, Left = SnapshotSize; Left; n++)
@@ -540,7 +565,7 @@ void CServer::DoSnapshot()
 						Msg.AddInt(m_CurrentGameTick-DeltaTick);
 						Msg.AddInt(Crc);
 						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n*MaxSize], Chunk);
+						Msg.AddRaw(&pCompData[n*MaxSize], Chunk);
 						SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
 					}
 					else
@@ -552,7 +577,7 @@ void CServer::DoSnapshot()
 						Msg.AddInt(n);							
 						Msg.AddInt(Crc);
 						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n*MaxSize], Chunk);
+						Msg.AddRaw(&pCompData[n*MaxSize], Chunk);
 						SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
 					}
 				}
@@ -575,6 +600,7 @@ int CServer::NewClientCallback(int ClientID, void *pUser)
 {
 	CServer *pThis = (CServer *)pUser;
 	pThis->m_aClients[ClientID].m_State = CClient::STATE_AUTH;
+	pThis->m_ActiveClients.set(ClientID);
 	pThis->m_aClients[ClientID].m_aName[0] = 0;
 	pThis->m_aClients[ClientID].m_aClan[0] = 0;
 	pThis->m_aClients[ClientID].m_Country = -1;
@@ -600,6 +626,7 @@ int CServer::DelClientCallback(int ClientID, const char *pReason, void *pUser)
 		pThis->GameServer()->OnClientDrop(ClientID, pReason);
 	
 	pThis->m_aClients[ClientID].m_State = CClient::STATE_EMPTY;
+	pThis->m_ActiveClients.unset(ClientID);
 	pThis->m_aClients[ClientID].m_aName[0] = 0;
 	pThis->m_aClients[ClientID].m_aClan[0] = 0;
 	pThis->m_aClients[ClientID].m_Country = -1;
@@ -615,9 +642,72 @@ void CServer::SendMap(int ClientID)
 	Msg.AddString(GetMapName(), 0);
 	Msg.AddInt(m_CurrentMapCrc);
 	Msg.AddInt(m_CurrentMapSize);
+	Msg.AddInt(g_Config.m_SvMapWindow); // older clients ignore this and request one chunk at a time
 	SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, ClientID, true);
 }
 
+void CServer::SendMapData(int ClientID, int Chunk, int Flags)
+{
+	int ChunkSize = MAP_CHUNK_SIZE;
+	int Offset = Chunk * ChunkSize;
+	int Last = 0;
+
+	if(Offset+ChunkSize >= m_CurrentMapSize)
+	{
+		ChunkSize = m_CurrentMapSize-Offset;
+		if(ChunkSize < 0)
+			ChunkSize = 0;
+		Last = 1;
+	}
+
+	CMsgPacker Msg(NETMSG_MAP_DATA);
+	Msg.AddInt(Last);
+	Msg.AddInt(m_CurrentMapCrc);
+	Msg.AddInt(Chunk);
+	Msg.AddInt(ChunkSize);
+	Msg.AddRaw(&m_pCurrentMapData[Offset], ChunkSize);
+	SendMsgEx(&Msg, MSGFLAG_VITAL|Flags, ClientID, true);
+
+	if(g_Config.m_Debug)
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "sending chunk %d with size %d", Chunk, ChunkSize);
+		Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
+	}
+}
+
+void CServer::SendMapChunks()
+{
+	// vital chunks stay in the resend buffer of the connection until they
+	// are acked, only fill half of it so other messages still fit
+	const int MaxBuffered = NET_CONN_BUFFERSIZE/2;
+	const int ChunkCost = MAP_CHUNK_SIZE+64;
+	int64 Now = time_get();
+
+	for(int c = m_ActiveClients.first(); c >= 0; c = m_ActiveClients.next(c))
+	{
+		CClient *pClient = &m_aClients[c];
+		if(pClient->m_State != CClient::STATE_CONNECTING || pClient->m_MapChunk >= pClient->m_MapChunkEnd)
+			continue;
+
+		int Num = min(pClient->m_MapChunkEnd-pClient->m_MapChunk, (MaxBuffered-m_NetServer.ClientBufferedSize(c))/ChunkCost);
+
+		// pace the stream, allow bursts of up to 100ms
+		if(g_Config.m_SvMapDownloadSpeed)
+		{
+			int BytesPerSec = g_Config.m_SvMapDownloadSpeed*1024;
+			int64 Refill = min(Now-pClient->m_MapBudgetTime, time_freq())*BytesPerSec/time_freq();
+			pClient->m_MapBudget = (int)min((int64)pClient->m_MapBudget+Refill, (int64)max(BytesPerSec/10, (int)MAP_CHUNK_SIZE));
+			pClient->m_MapBudgetTime = Now;
+			Num = min(Num, pClient->m_MapBudget/MAP_CHUNK_SIZE);
+			pClient->m_MapBudget -= max(Num, 0)*MAP_CHUNK_SIZE;
+		}
+
+		for(int i = 0; i < Num; i++)
+			SendMapData(c, pClient->m_MapChunk++, i == Num-1 ? MSGFLAG_FLUSH : 0);
+	}
+}
+
 void CServer::SendConnectionReady(int ClientID)
 {
 	CMsgPacker Msg(NETMSG_CON_READY);
@@ -640,7 +730,7 @@ void CServer::SendRconLineAuthed(const char *pLine, void *pUser)
 	if(ReentryGuard) return;
 	ReentryGuard++;
 	
-	for(i = 0; i < MAX_CLIENTS; i++)
+	for(i = pThis->m_ActiveClients.first(); i >= 0; i = pThis->m_ActiveClients.next(i))
 	{
 		if(pThis->m_aClients[i].m_State != CClient::STATE_EMPTY && pThis->m_aClients[i].m_Authed)
 			pThis->SendRconLine(i, pLine);
@@ -696,36 +786,25 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 		else if(Msg == NETMSG_REQUEST_MAP_DATA)
 		{
 			int Chunk = Unpacker.GetInt();
-			int ChunkSize = 1024-128;
-			int Offset = Chunk * ChunkSize;
-			int Last = 0;
+			int NumChunks = max((m_CurrentMapSize+MAP_CHUNK_SIZE-1)/MAP_CHUNK_SIZE, 1);
 				
 			// drop faulty map data requests
-			if(Chunk < 0 || Offset > m_CurrentMapSize)
+			if(Chunk < 0 || Chunk >= NumChunks)
 				return;
-				
-			if(Offset+ChunkSize >= m_CurrentMapSize)
-			{
-				ChunkSize = m_CurrentMapSize-Offset;
-				if(ChunkSize < 0)
-					ChunkSize = 0;
-				Last = 1;
-			}
-				
-			CMsgPacker Msg(NETMSG_MAP_DATA);
-			Msg.AddInt(Last);
-			Msg.AddInt(m_CurrentMapCrc);
-			Msg.AddInt(Chunk);
-			Msg.AddInt(ChunkSize);
-			Msg.AddRaw(&m_pCurrentMapData[Offset], ChunkSize);
-			SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, ClientID, true);
-				
-			if(g_Config.m_Debug)
+
+			// newer clients ask for a window of chunks, those are streamed by SendMapChunks
+			int Window = Unpacker.GetInt();
+			if(Unpacker.Error() || Window <= 0 || g_Config.m_SvMapWindow == 0)
 			{
-				char aBuf[256];
-				str_format(aBuf, sizeof(aBuf), "sending chunk %d with size %d", Chunk, ChunkSize);
-				Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
+				SendMapData(ClientID, Chunk, MSGFLAG_FLUSH);
+				return;
 			}
+
+			// a request that doesn't continue the last window restarts the stream there
+			CClient *pClient = &m_aClients[ClientID];
+			if(Chunk != pClient->m_MapChunkEnd)
+				pClient->m_MapChunk = Chunk;
+			pClient->m_MapChunkEnd = min(Chunk+min(Window, g_Config.m_SvMapWindow), NumChunks);
 		}
 		else if(Msg == NETMSG_READY)
 		{
@@ -914,7 +993,7 @@ void CServer::SendServerInfo(NETADDR *pAddr, int Token)
 
 	// count the players
 	int PlayerCount = 0, ClientCount = 0;
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = m_ActiveClients.first(); i >= 0; i = m_ActiveClients.next(i))
 	{
 		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
 		{
@@ -950,8 +1029,12 @@ void CServer::SendServerInfo(NETADDR *pAddr, int Token)
 	str_format(aBuf, sizeof(aBuf), "%d", ClientCount); p.AddString(aBuf, 3);  // num clients
 	str_format(aBuf, sizeof(aBuf), "%d", m_NetServer.MaxClients()); p.AddString(aBuf, 3); // max clients
 
-	for(i = 0; i < MAX_CLIENTS; i++)
+	for(i = m_ActiveClients.first(); i >= 0; i = m_ActiveClients.next(i))
 	{
+		// with many clients the list doesn't fit into one packet, the counts above stay correct
+		if(p.Size() + MAX_NAME_LENGTH+MAX_CLAN_LENGTH+6+6+2 >= NET_MAX_PAYLOAD)
+			break;
+
 		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
 		{
 			p.AddString(ClientName(i), MAX_NAME_LENGTH);  // client name
@@ -972,7 +1055,7 @@ void CServer::SendServerInfo(NETADDR *pAddr, int Token)
 
 void CServer::UpdateServerInfo()
 {
-	for(int i = 0; i < MAX_CLIENTS; ++i)
+	for(int i = m_ActiveClients.first(); i >= 0; i = m_ActiveClients.next(i))
 	{
 		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
 		{
@@ -1051,15 +1134,46 @@ int CServer::LoadMap(const char *pMapName)
 	if(!df)
 		return 0;*/
 
+	// maps the manifest knows to be broken aren't even opened
+	const CMapManifest::CEntry *pManifestEntry = m_MapManifest.Find(pMapName);
+	if(pManifestEntry && !pManifestEntry->m_Valid)
+	{
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "map is marked invalid in the manifest");
+		return 0;
+	}
+
+	// the file is read once, the checks work on that copy.
+	// preloaded maps are already open
+	int64 StartTime = time_get();
+	CDataFileReader DataFile;
+	if(!m_MapCache.Take(pMapName, &DataFile) && !DataFile.Open(Storage(), aBuf, IStorage::TYPE_ALL))
+		return 0;
+
+	if(pManifestEntry && (pManifestEntry->m_Crc != DataFile.Crc() || pManifestEntry->m_Size != DataFile.FileSize()))
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "map differs from the manifest, it might be outdated");
+
 	// check for valid standard map
-	if(!m_MapChecker.ReadAndValidateMap(Storage(), aBuf, IStorage::TYPE_ALL))
+	if(!m_MapChecker.IsMapFileValid(aBuf, DataFile.Crc(), DataFile.FileSize()))
 	{
 		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapchecker", "invalid standard map");
 		return 0;
 	}
-		
-	if(!m_pMap->Load(aBuf))
+
+	// the download is served from a copy, the mapped file can be changed
+	// or truncated on disk while clients are still downloading it
+	unsigned MapSize = DataFile.FileSize();
+	unsigned char *pMapData = (unsigned char *)mem_alloc(max(MapSize, 1u), 1);
+	mem_copy(pMapData, DataFile.FileData(), MapSize);
+	if(crc32(0, pMapData, MapSize) != DataFile.Crc()) // ignore_convention
+	{
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "map changed on disk while it was loaded");
+		mem_free(pMapData);
 		return 0;
+	}
+
+	// keep the old map around in case it comes up again
+	m_pMap->Replace(&DataFile);
+	m_MapCache.Add(m_aCurrentMap, &DataFile);
 	
 	// stop recording when we change map
 	m_DemoRecorder.Stop();
@@ -1072,21 +1186,35 @@ int CServer::LoadMap(const char *pMapName)
 	char aBufMsg[256];
 	str_format(aBufMsg, sizeof(aBufMsg), "%s crc is %08x", aBuf, m_CurrentMapCrc);
 	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBufMsg);
+	str_format(aBufMsg, sizeof(aBufMsg), "%s loaded in %.2fms, peak memory %d KiB", aBuf,
+		(time_get()-StartTime)*1000.0f/time_freq(), m_pMap->PeakMemoryUsage()/1024);
+	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBufMsg);
 		
 	str_copy(m_aCurrentMap, pMapName, sizeof(m_aCurrentMap));
 	//map_set(df);
 	
-	// load compelate map into memory for download
+	mem_free(m_pCurrentMapData);
+	m_pCurrentMapData = pMapData;
+	m_CurrentMapSize = (int)MapSize;
+	return 1;
+}
+
+void CServer::LoadMapManifest()
+{
+	char aBuf[256];
+	if(!g_Config.m_SvMapManifest[0])
+		m_MapManifest.Clear();
+	else if(m_MapManifest.Load(Storage(), g_Config.m_SvMapManifest, IStorage::TYPE_ALL))
 	{
-		IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
-		m_CurrentMapSize = (int)io_length(File);
-		if(m_pCurrentMapData)
-			mem_free(m_pCurrentMapData);
-		m_pCurrentMapData = (unsigned char *)mem_alloc(m_CurrentMapSize, 1);
-		io_read(File, m_pCurrentMapData, m_CurrentMapSize);
-		io_close(File);
+		str_format(aBuf, sizeof(aBuf), "loaded map manifest '%s' with %d maps", g_Config.m_SvMapManifest, m_MapManifest.Num());
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+	}
+	else
+	{
+		m_MapManifest.Clear();
+		str_format(aBuf, sizeof(aBuf), "couldn't load map manifest '%s'", g_Config.m_SvMapManifest);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 	}
-	return 1;
 }
 
 void CServer::InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, IConsole *pConsole)
@@ -1099,6 +1227,9 @@ int CServer::Run()
 	m_pGameServer = Kernel()->RequestInterface<IGameServer>();
 	m_pMap = Kernel()->RequestInterface<IEngineMap>();
 	m_pStorage = Kernel()->RequestInterface<IStorage>();
+	m_MapCache.Init(m_pStorage, Console());
+	if(g_Config.m_SvMapManifest[0])
+		LoadMapManifest();
 
 	//
 	Console()->RegisterPrintCallback(SendRconLineAuthed, this);
@@ -1158,6 +1289,13 @@ int CServer::Run()
 			Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "server", aBuf);
 		}
 
+		perf_enable(g_Config.m_SvPerf);
+		int PerfTick = perf_zone("server.tick");
+		int PerfInput = perf_zone("server.input");
+		int PerfGameTick = perf_zone("server.gametick");
+		int PerfSnap = perf_zone("server.snap");
+		int PerfNetwork = perf_zone("server.network");
+
 		while(m_RunServer)
 		{
 			int64 t = time_get();
@@ -1174,7 +1312,7 @@ int CServer::Run()
 					// new map loaded
 					GameServer()->OnShutdown();
 					
-					for(int c = 0; c < MAX_CLIENTS; c++)
+					for(int c = m_ActiveClients.first(); c >= 0; c = m_ActiveClients.next(c))
 					{
 						if(m_aClients[c].m_State <= CClient::STATE_AUTH)
 							continue;
@@ -1200,61 +1338,66 @@ int CServer::Run()
 			
 			while(t > TickStartTime(m_CurrentGameTick+1))
 			{
+				int64 TickStart = perf_begin(PerfTick);
 				m_CurrentGameTick++;
 				NewTicks++;
 				
 				// apply new input
-				for(int c = 0; c < MAX_CLIENTS; c++)
 				{
-					if(m_aClients[c].m_State == CClient::STATE_EMPTY)
-						continue;
-					for(int i = 0; i < 200; i++)
+					CPerfScope Scope(PerfInput);
+					for(int c = m_ActiveClients.first(); c >= 0; c = m_ActiveClients.next(c))
 					{
-						if(m_aClients[c].m_aInputs[i].m_GameTick == Tick())
+						for(int i = 0; i < 200; i++)
 						{
-							if(m_aClients[c].m_State == CClient::STATE_INGAME)
-								GameServer()->OnClientPredictedInput(c, m_aClients[c].m_aInputs[i].m_aData);
-							break;
+							if(m_aClients[c].m_aInputs[i].m_GameTick == Tick())
+							{
+								if(m_aClients[c].m_State == CClient::STATE_INGAME)
+									GameServer()->OnClientPredictedInput(c, m_aClients[c].m_aInputs[i].m_aData);
+								break;
+							}
 						}
 					}
 				}
 
-				GameServer()->OnTick();
+				{
+					CPerfScope Scope(PerfGameTick);
+					GameServer()->OnTick();
+				}
+
+				perf_end(PerfTick, TickStart);
+				perf_tick();
 			}
 			
 			// snap game
 			if(NewTicks)
 			{
 				if(g_Config.m_SvHighBandwidth || (m_CurrentGameTick%2) == 0)
+				{
+					CPerfScope Scope(PerfSnap);
 					DoSnapshot();
+
+					// the events and scratch strings of the frame are sent
+					m_FrameHeap.Rewind();
+				}
 			}
 			
 			// master server stuff
 			m_Register.RegisterUpdate(BindAddr.type);
 	
-			PumpNetwork();
+			{
+				CPerfScope Scope(PerfNetwork);
+				PumpNetwork();
+				SendMapChunks();
+			}
+
+			// write a finished perf capture
+			if(perf_trace_ready())
+				WritePerfTrace();
 	
 			if(ReportTime < time_get())
 			{
-				if(g_Config.m_Debug)
-				{
-					/*
-					static NETSTATS prev_stats;
-					NETSTATS stats;
-					netserver_stats(net, &stats);
-					
-					perf_next();
-					
-					if(config.dbg_pref)
-						perf_dump(&rootscope);
-
-					dbg_msg("server", "send=%8d recv=%8d",
-						(stats.send_bytes - prev_stats.send_bytes)/reportinterval,
-						(stats.recv_bytes - prev_stats.recv_bytes)/reportinterval);
-						
-					prev_stats = stats;
-					*/
-				}
+				if(g_Config.m_DbgPref)
+					PrintPerfStats();
 	
 				ReportTime += time_freq()*ReportInterval;
 			}
@@ -1264,7 +1407,7 @@ int CServer::Run()
 		}
 	}
 	// disconnect all clients on shutdown
-	for(int i = 0; i < MAX_CLIENTS; ++i)
+	for(int i = m_ActiveClients.first(); i >= 0; i = m_ActiveClients.next(i))
 	{
 		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
 			m_NetServer.Drop(i, "Server shutdown");
@@ -1272,9 +1415,8 @@ int CServer::Run()
 
 	GameServer()->OnShutdown();
 	m_pMap->Unload();
-
-	if(m_pCurrentMapData)
-		mem_free(m_pCurrentMapData);
+	mem_free(m_pCurrentMapData);
+	m_pCurrentMapData = 0;
 	return 0;
 }
 
@@ -1416,7 +1558,7 @@ void CServer::ConStatus(IConsole::IResult *pResult, void *pUser)
 	char aAddrStr[NETADDR_MAXSTRSIZE];
 	CServer* pServer = (CServer *)pUser;
 
-	for(i = 0; i < MAX_CLIENTS; i++)
+	for(i = pServer->m_ActiveClients.first(); i >= 0; i = pServer->m_ActiveClients.next(i))
 	{
 		if(pServer->m_aClients[i].m_State != CClient::STATE_EMPTY)
 		{
@@ -1463,6 +1605,211 @@ void CServer::ConMapReload(IConsole::IResult *pResult, void *pUser)
 	((CServer *)pUser)->m_MapReload = 1;
 }
 
+void CServer::ConMapCache(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pThis = (CServer *)pUser;
+	if(pResult->NumArguments() && str_comp(pResult->GetString(0), "clear") == 0)
+		pThis->m_MapCache.Clear();
+	else if(pResult->NumArguments())
+		pThis->m_MapCache.Preload(pResult->GetString(0));
+	pThis->m_MapCache.Dump();
+}
+
+void CServer::PreloadMap(const char *pMapName)
+{
+	// the running map goes into the cache by itself when it's replaced.
+	// with a manifest, maps that wouldn't load are left alone
+	if(str_comp(pMapName, m_aCurrentMap) == 0)
+		return;
+	if(m_MapManifest.Num())
+	{
+		const CMapManifest::CEntry *pEntry = m_MapManifest.Find(pMapName);
+		if(!pEntry || !pEntry->m_Valid)
+			return;
+	}
+	m_MapCache.Preload(pMapName);
+}
+
+void CServer::PrintPerfStats()
+{
+	char aBuf[256];
+	for(int i = 0; i < perf_num_zones(); i++)
+	{
+		PERF_ZONE_STATS Stats;
+		perf_zone_stats(i, &Stats);
+		if(!Stats.total)
+			continue;
+		str_format(aBuf, sizeof(aBuf), "%-24s n=%-7d avg=%-6d p50=%-6d p90=%-6d p99=%-6d max=%d (us)",
+			Stats.name, (int)Stats.count, Stats.avg, Stats.p50, Stats.p90, Stats.p99, Stats.max);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+	}
+
+	str_format(aBuf, sizeof(aBuf), "frame heap: peak=%d KiB chunks=%d KiB", m_FrameHeap.PeakUsed()/1024, m_FrameHeap.Size()/1024);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+
+	if(m_DemoRecorder.IsRecording())
+	{
+		CDemoRecorder::CQueueStats Stats;
+		m_DemoRecorder.GetQueueStats(&Stats);
+		str_format(aBuf, sizeof(aBuf), "demo queue: frames=%d (max %d) bytes=%d written=%d dropped=%d",
+			Stats.m_Frames, Stats.m_MaxFrames, Stats.m_Bytes, Stats.m_Written, Stats.m_Dropped);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+	}
+}
+
+void CServer::WritePerfTrace()
+{
+	char aDate[20];
+	char aFilename[128];
+	str_timestamp(aDate, sizeof(aDate));
+	str_format(aFilename, sizeof(aFilename), "dumps/perf_%s.json", aDate);
+
+	char aBuf[256];
+	IOHANDLE File = Storage()->OpenFile(aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+	{
+		perf_trace_write(0);
+		str_format(aBuf, sizeof(aBuf), "failed to open '%s' for writing", aFilename);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+		return;
+	}
+
+	int NumEvents = perf_trace_write(File);
+	io_close(File);
+	str_format(aBuf, sizeof(aBuf), "wrote %d events to '%s'", NumEvents, aFilename);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+}
+
+void CServer::ConPerf(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pServer = (CServer *)pUser;
+	const char *pCmd = pResult->NumArguments() ? pResult->GetString(0) : "stats";
+
+	if(str_comp_nocase(pCmd, "stats") == 0)
+		pServer->PrintPerfStats();
+	else if(str_comp_nocase(pCmd, "reset") == 0)
+	{
+		perf_reset();
+		pServer->m_FrameHeap.ResetPeak();
+		pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", "histograms cleared");
+	}
+	else if(str_comp_nocase(pCmd, "trace") == 0)
+	{
+		int Ticks = pResult->NumArguments() > 1 ? pResult->GetInteger(1) : SERVER_TICK_SPEED;
+		if(perf_trace_start(Ticks) == 0)
+		{
+			char aBuf[128];
+			str_format(aBuf, sizeof(aBuf), "capturing %d ticks", Ticks);
+			pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", aBuf);
+		}
+		else
+			pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", "a capture is already running");
+	}
+	else
+		pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "perf", "usage: perf [stats|reset|trace <ticks>]");
+}
+
+void CServer::PrintMemProfile(bool Sites, int Num)
+{
+	static MEM_PROFILE_STATS s_aStats[2048];
+	int NumStats = Sites ? mem_profile_sites(s_aStats, 2048) : mem_profile_tags(s_aStats, 2048);
+
+	// the ones that churn the most first
+	for(int i = 1; i < NumStats; i++)
+	{
+		MEM_PROFILE_STATS Stats = s_aStats[i];
+		int j = i;
+		for(; j > 0 && s_aStats[j-1].allocations < Stats.allocations; j--)
+			s_aStats[j] = s_aStats[j-1];
+		s_aStats[j] = Stats;
+	}
+
+	char aBuf[256];
+	float Seconds = max((time_get()-m_MemProfileStart)/(float)time_freq(), 0.001f);
+	str_format(aBuf, sizeof(aBuf), "%d KiB in %d blocks, rates over the last %.1fs", mem_stats()->allocated/1024, mem_stats()->active_allocations, Seconds);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mem", aBuf);
+
+	for(int i = 0; i < min(NumStats, Num); i++)
+	{
+		const MEM_PROFILE_STATS *pStats = &s_aStats[i];
+		char aName[128];
+		if(Sites)
+			str_format(aName, sizeof(aName), "%s(%d)", pStats->filename, pStats->line);
+		else
+			str_copy(aName, pStats->tag, sizeof(aName));
+		str_format(aBuf, sizeof(aBuf), "%-32s live=%-6d blocks=%-6d peak=%-6d allocs/tick=%-8.2f KiB/s=%.1f",
+			aName, pStats->live_bytes/1024, pStats->live_allocations, pStats->peak_bytes/1024,
+			pStats->allocations/Seconds/SERVER_TICK_SPEED, pStats->allocated_bytes/Seconds/1024.0f);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mem", aBuf);
+	}
+}
+
+void CServer::ConMemProfile(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pServer = (CServer *)pUser;
+	const char *pCmd = pResult->NumArguments() ? pResult->GetString(0) : "tags";
+	int Num = pResult->NumArguments() > 1 ? pResult->GetInteger(1) : 20;
+
+	if(str_comp_nocase(pCmd, "tags") == 0)
+		pServer->PrintMemProfile(false, Num);
+	else if(str_comp_nocase(pCmd, "sites") == 0)
+		pServer->PrintMemProfile(true, Num);
+	else if(str_comp_nocase(pCmd, "reset") == 0)
+	{
+		mem_profile_reset();
+		pServer->m_MemProfileStart = time_get();
+		pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mem", "allocation counts cleared");
+	}
+	else
+		pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mem", "usage: mem_profile [tags|sites|reset] [num]");
+}
+
+void CServer::ConStorageIndex(IConsole::IResult *pResult, void *pUser)
+{
+	CServer *pServer = (CServer *)pUser;
+	IStorage *pStorage = pServer->Kernel()->RequestInterface<IStorage>();
+	const char *pCmd = pResult->NumArguments() ? pResult->GetString(0) : "";
+	if(!pStorage)
+		return;
+
+	if(str_comp_nocase(pCmd, "rebuild") == 0)
+		pStorage->RebuildIndex();
+	else if(str_comp_nocase(pCmd, "reset") == 0)
+		pStorage->ResetIndexStats();
+	else if(pCmd[0])
+	{
+		pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "storage", "usage: storage_index [rebuild|reset]");
+		return;
+	}
+
+	IStorage::CIndexStats Stats;
+	pStorage->GetIndexStats(&Stats);
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "%d files, %d/%d paths indexed, %s, %d rebuilds, last took %.2fms",
+		Stats.m_NumFiles, Stats.m_NumIndexedPaths, Stats.m_NumPaths, Stats.m_Watching ? "watching for changes" : "not watching",
+		Stats.m_NumRebuilds, Stats.m_BuildTime);
+	pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "storage", aBuf);
+	str_format(aBuf, sizeof(aBuf), "hits=%d misses=%d disk checks=%d skipped=%d stale=%d",
+		Stats.m_Hits, Stats.m_Misses, Stats.m_Probes, Stats.m_Skipped, Stats.m_Stale);
+	pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "storage", aBuf);
+}
+
+void CServer::ConchainMapManifestUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
+{
+	pfnCallback(pResult, pCallbackUserData);
+	// before the server runs the manifest gets loaded with the first map
+	CServer *pThis = (CServer *)pUserData;
+	if(pResult->NumArguments() && pThis->m_pStorage)
+		pThis->LoadMapManifest();
+}
+
+void CServer::ConchainPerfUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
+{
+	pfnCallback(pResult, pCallbackUserData);
+	if(pResult->NumArguments())
+		perf_enable(g_Config.m_SvPerf);
+}
+
 void CServer::ConchainSpecialInfoupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
 {
 	pfnCallback(pResult, pCallbackUserData);
@@ -1492,11 +1839,18 @@ void CServer::RegisterCommands()
 	Console()->Register("stoprecord", "", CFGFLAG_SERVER, ConStopRecord, this, "");
 	
 	Console()->Register("reload", "", CFGFLAG_SERVER, ConMapReload, this, "");
+	Console()->Register("map_cache", "?s", CFGFLAG_SERVER, ConMapCache, this, "Show the cached maps, preload a map or clear the cache");
+
+	Console()->Register("perf", "?s?i", CFGFLAG_SERVER, ConPerf, this, "Show tick timings, reset them or capture a trace");
+	Console()->Register("mem_profile", "?s?i", CFGFLAG_SERVER, ConMemProfile, this, "Show allocations per tag or call site, or reset the counts");
+	Console()->Register("storage_index", "?s", CFGFLAG_SERVER, ConStorageIndex, this, "Show the file index statistics, rebuild the index or reset the counts");
 
 	Console()->Chain("sv_name", ConchainSpecialInfoupdate, this);
 	Console()->Chain("password", ConchainSpecialInfoupdate, this);
 
 	Console()->Chain("sv_max_clients_per_ip", ConchainMaxclientsperipUpdate, this);
+	Console()->Chain("sv_perf", ConchainPerfUpdate, this);
+	Console()->Chain("sv_map_manifest", ConchainMapManifestUpdate, this);
 }	
 
 
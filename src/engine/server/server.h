@@ -3,6 +3,8 @@
 #ifndef ENGINE_SERVER_SERVER_H
 #define ENGINE_SERVER_SERVER_H
 
+#include <base/tl/bitset.h>
+
 #include <engine/server.h>
 
 class CSnapIDPool
@@ -92,20 +94,29 @@ public:
 		int m_Score;
 		int m_Authed;
 		int m_AuthTries;
+
+		// map chunks still to stream, [m_MapChunk, m_MapChunkEnd)
+		int m_MapChunk;
+		int m_MapChunkEnd;
+		int m_MapBudget;
+		int64 m_MapBudgetTime;
 		
 		void Reset();
 	};
 	
 	CClient m_aClients[MAX_CLIENTS];
+	bitset<MAX_CLIENTS> m_ActiveClients; // slots that aren't STATE_EMPTY
 
 	CSnapshotDelta m_SnapshotDelta;
 	CSnapshotBuilder m_SnapshotBuilder;
+	CHeap m_FrameHeap;
 	CSnapIDPool m_IDPool;
 	CNetServer m_NetServer;
 	
 	IEngineMap *m_pMap;
 
 	int64 m_GameStartTime;
+	int64 m_MemProfileStart; // the allocation rates are counted from here
 	//int m_CurrentGameTick;
 	int m_RunServer;
 	int m_MapReload;
@@ -122,6 +133,8 @@ public:
 	CDemoRecorder m_DemoRecorder;
 	CRegister m_Register;
 	CMapChecker m_MapChecker;
+	CMapCache m_MapCache;
+	CMapManifest m_MapManifest;
 	
 	CServer();
 	
@@ -133,6 +146,7 @@ public:
 	virtual void SetClientScore(int ClientID, int Score);
 
 	void Kick(int ClientID, const char *pReason);
+	virtual void PreloadMap(const char *pMapName);
 
 	//int Tick()
 	int64 TickStartTime(int Tick);
@@ -143,6 +157,7 @@ public:
 	bool IsAuthed(int ClientID);
 	int GetClientInfo(int ClientID, CClientInfo *pInfo);
 	void GetClientAddr(int ClientID, char *pAddrStr, int Size);
+	bool GetClientAddr(int ClientID, NETADDR *pAddr);
 	const char *ClientName(int ClientID);
 	const char *ClientClan(int ClientID);
 	int ClientCountry(int ClientID);
@@ -159,6 +174,8 @@ public:
 	static int DelClientCallback(int ClientID, const char *pReason, void *pUser);
 
 	void SendMap(int ClientID);
+	void SendMapData(int ClientID, int Chunk, int Flags);
+	void SendMapChunks();
 	void SendConnectionReady(int ClientID);
 	void SendRconLine(int ClientID, const char *pLine);
 	static void SendRconLineAuthed(const char *pLine, void *pUser);
@@ -176,6 +193,7 @@ public:
 
 	char *GetMapName();
 	int LoadMap(const char *pMapName);
+	void LoadMapManifest();
 
 	void InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, IConsole *pConsole);
 	int Run();
@@ -189,15 +207,26 @@ public:
 	static void ConRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConStopRecord(IConsole::IResult *pResult, void *pUser);
 	static void ConMapReload(IConsole::IResult *pResult, void *pUser);
+	static void ConMapCache(IConsole::IResult *pResult, void *pUser);
+	static void ConPerf(IConsole::IResult *pResult, void *pUser);
+	static void ConMemProfile(IConsole::IResult *pResult, void *pUser);
+	static void ConStorageIndex(IConsole::IResult *pResult, void *pUser);
+	static void ConchainMapManifestUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
+	static void ConchainPerfUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainSpecialInfoupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainMaxclientsperipUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 
+	void PrintPerfStats();
+	void WritePerfTrace();
+	void PrintMemProfile(bool Sites, int Num);
+
 	void RegisterCommands();
 	
 	
 	virtual int SnapNewID();
 	virtual void SnapFreeID(int ID);
 	virtual void *SnapNewItem(int Type, int ID, int Size);
+	virtual CHeap *FrameHeap() { return &m_FrameHeap; }
 	void SnapSetStaticsize(int ItemType, int Size);
 };
 
@@ -76,11 +76,16 @@ MACRO_CONFIG_INT(SvExternalPort, sv_external_port, 0, 0, 0, CFGFLAG_SERVER, "Ext
 MACRO_CONFIG_STR(SvMap, sv_map, 128, "dm1", CFGFLAG_SERVER, "Map to use on the server")
 MACRO_CONFIG_INT(SvMaxClients, sv_max_clients, 8, 1, MAX_CLIENTS, CFGFLAG_SERVER, "Maximum number of clients that are allowed on a server")
 MACRO_CONFIG_INT(SvMaxClientsPerIP, sv_max_clients_per_ip, 4, 1, MAX_CLIENTS, CFGFLAG_SERVER, "Maximum number of clients with the same IP that can connect to the server")
+MACRO_CONFIG_INT(SvMapWindow, sv_map_window, 16, 0, 16, CFGFLAG_SERVER, "Number of map chunks clients may request at once (0 for one chunk per request)")
+MACRO_CONFIG_INT(SvMapDownloadSpeed, sv_map_download_speed, 0, 0, 100000, CFGFLAG_SERVER, "Map download speed limit per client in KiB/s (0 for no limit)")
+MACRO_CONFIG_INT(SvMapCacheSize, sv_map_cache_size, 16384, 0, 1048576, CFGFLAG_SERVER, "KiB of map files to keep preloaded for map changes (0 to disable)")
+MACRO_CONFIG_STR(SvMapManifest, sv_map_manifest, 128, "", CFGFLAG_SERVER, "Map manifest written by map_batch, maps it marks invalid are refused")
 MACRO_CONFIG_INT(SvHighBandwidth, sv_high_bandwidth, 0, 0, 1, CFGFLAG_SERVER, "Use high bandwidth mode. Doubles the bandwidth required for the server. LAN use only")
 MACRO_CONFIG_INT(SvRegister, sv_register, 1, 0, 1, CFGFLAG_SERVER, "Register server with master server for public listing")
 MACRO_CONFIG_STR(SvRconPassword, sv_rcon_password, 32, "", CFGFLAG_SERVER, "Remote console password")
 MACRO_CONFIG_INT(SvRconMaxTries, sv_rcon_max_tries, 3, 0, 100, CFGFLAG_SERVER, "Maximum number of tries for remote console authentication")
 MACRO_CONFIG_INT(SvRconBantime, sv_rcon_bantime, 5, 0, 1440, CFGFLAG_SERVER, "The time a client gets banned if remote console authentication fails. 0 makes it just use kick")
+MACRO_CONFIG_INT(SvPerf, sv_perf, 1, 0, 1, CFGFLAG_SERVER, "Record tick phase timings (see the perf command)")
 
 MACRO_CONFIG_INT(Debug, debug, 0, 0, 1, CFGFLAG_CLIENT|CFGFLAG_SERVER, "Debug mode")
 MACRO_CONFIG_INT(DbgStress, dbg_stress, 0, 0, 0, CFGFLAG_CLIENT|CFGFLAG_SERVER, "Stress systems")
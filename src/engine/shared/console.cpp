@@ -1,6 +1,7 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <new>
+#include <base/math.h>
 #include <base/system.h>
 #include <engine/shared/protocol.h>
 #include <engine/storage.h>
@@ -31,6 +32,51 @@ float CConsole::CResult::GetFloat(unsigned Index)
 
 // the maximum number of tokens occurs in a string of length CONSOLE_MAX_STR_LENGTH with tokens size 1 separated by single spaces
 
+// command names are looked up case insensitive
+static unsigned CommandHash(const char *pName)
+{
+	unsigned Hash = 5381;
+	for(; *pName; pName++)
+	{
+		char c = *pName;
+		if(c >= 'A' && c <= 'Z')
+			c += 'a'-'A';
+		Hash = ((Hash << 5) + Hash) + c;
+	}
+	return Hash;
+}
+
+// finds the end of the first command in the line and where the next one starts
+static const char *SplitLine(const char *pStr, const char **ppNextPart)
+{
+	const char *pEnd = pStr;
+	int InString = 0;
+
+	*ppNextPart = 0;
+	while(*pEnd)
+	{
+		if(*pEnd == '"')
+			InString ^= 1;
+		else if(*pEnd == '\\') // escape sequences
+		{
+			if(pEnd[1] == '"')
+				pEnd++;
+		}
+		else if(!InString)
+		{
+			if(*pEnd == ';')  // command separator
+			{
+				*ppNextPart = pEnd+1;
+				break;
+			}
+			else if(*pEnd == '#')  // comment, no need to do anything more
+				break;
+		}
+
+		pEnd++;
+	}
+	return pEnd;
+}
 
 int CConsole::ParseStart(CResult *pResult, const char *pString, int Length)
 {
@@ -39,7 +85,7 @@ int CConsole::ParseStart(CResult *pResult, const char *pString, int Length)
 	if(Length < Len)
 		Len = Length;
 		
-	str_copy(pResult->m_aStringStorage, pString, Length);
+	str_copy(pResult->m_aStringStorage, pString, Len);
 	pStr = pResult->m_aStringStorage;
 	
 	// get command
@@ -171,32 +217,8 @@ bool CConsole::LineIsValid(const char *pStr)
 	do
 	{
 		CResult Result;
-		const char *pEnd = pStr;
-		const char *pNextPart = 0;
-		int InString = 0;
-		
-		while(*pEnd)
-		{
-			if(*pEnd == '"')
-				InString ^= 1;
-			else if(*pEnd == '\\') // escape sequences
-			{
-				if(pEnd[1] == '"')
-					pEnd++;
-			}
-			else if(!InString)
-			{
-				if(*pEnd == ';')  // command separator
-				{
-					pNextPart = pEnd+1;
-					break;
-				}
-				else if(*pEnd == '#')  // comment, no need to do anything more
-					break;
-			}
-			
-			pEnd++;
-		}
+		const char *pNextPart;
+		const char *pEnd = SplitLine(pStr, &pNextPart);
 		
 		if(ParseStart(&Result, pStr, (pEnd-pStr) + 1) != 0)
 			return false;
@@ -217,32 +239,8 @@ void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
 	while(pStr && *pStr)
 	{
 		CResult Result;
-		const char *pEnd = pStr;
-		const char *pNextPart = 0;
-		int InString = 0;
-		
-		while(*pEnd)
-		{
-			if(*pEnd == '"')
-				InString ^= 1;
-			else if(*pEnd == '\\') // escape sequences
-			{
-				if(pEnd[1] == '"')
-					pEnd++;
-			}
-			else if(!InString)
-			{
-				if(*pEnd == ';')  // command separator
-				{
-					pNextPart = pEnd+1;
-					break;
-				}
-				else if(*pEnd == '#')  // comment, no need to do anything more
-					break;
-			}
-			
-			pEnd++;
-		}
+		const char *pNextPart;
+		const char *pEnd = SplitLine(pStr, &pNextPart);
 		
 		if(ParseStart(&Result, pStr, (pEnd-pStr) + 1) != 0)
 			return;
@@ -267,15 +265,8 @@ void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
 					str_format(aBuf, sizeof(aBuf), "Invalid arguments... Usage: %s %s", pCommand->m_pName, pCommand->m_pParams);
 					Print(OUTPUT_LEVEL_STANDARD, "Console", aBuf);
 				}
-				else if(m_StoreCommands && pCommand->m_Flags&CFGFLAG_STORE)
-				{
-					m_ExecutionQueue.AddEntry();
-					m_ExecutionQueue.m_pLast->m_pfnCommandCallback = pCommand->m_pfnCallback;
-					m_ExecutionQueue.m_pLast->m_pCommandUserData = pCommand->m_pUserData;
-					m_ExecutionQueue.m_pLast->m_Result = Result;
-				}
 				else
-					pCommand->m_pfnCallback(&Result, pCommand->m_pUserData);
+					ExecuteCommand(pCommand, &Result);
 			}
 		}
 		else if(Stroke)
@@ -289,23 +280,49 @@ void CConsole::ExecuteLineStroked(int Stroke, const char *pStr)
 	}
 }
 
+void CConsole::ExecuteCommand(CCommand *pCommand, CResult *pResult)
+{
+	if(m_StoreCommands && pCommand->m_Flags&CFGFLAG_STORE)
+	{
+		m_ExecutionQueue.AddEntry();
+		m_ExecutionQueue.m_pLast->m_pfnCommandCallback = pCommand->m_pfnCallback;
+		m_ExecutionQueue.m_pLast->m_pCommandUserData = pCommand->m_pUserData;
+		m_ExecutionQueue.m_pLast->m_Result = *pResult;
+	}
+	else
+		pCommand->m_pfnCallback(pResult, pCommand->m_pUserData);
+}
+
 void CConsole::PossibleCommands(const char *pStr, int FlagMask, FPossibleCallback pfnCallback, void *pUser)
 {
-	CCommand *pCommand;
-	for(pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	// find the first name that isn't smaller than the prefix, all
+	// names that start with it follow in a row
+	int Length = str_length(pStr);
+	int Low = 0;
+	int High = m_CommandIndex.size();
+	while(Low < High)
 	{
-		if(pCommand->m_Flags&FlagMask)
-		{
-			if(str_find_nocase(pCommand->m_pName, pStr))
-				pfnCallback(pCommand->m_pName, pUser);
-		}
-	}	
+		int Mid = (Low+High)/2;
+		if(str_comp_nocase(m_CommandIndex[Mid].m_pName, pStr) < 0)
+			Low = Mid+1;
+		else
+			High = Mid;
+	}
+
+	for(int i = Low; i < m_CommandIndex.size(); i++)
+	{
+		const CCommandRef &Ref = m_CommandIndex[i];
+		if(str_comp_nocase_num(Ref.m_pName, pStr, Length) != 0)
+			break;
+		if(Ref.m_pCommand->m_Flags&FlagMask)
+			pfnCallback(Ref.m_pName, pUser);
+	}
 }
 
 CConsole::CCommand *CConsole::FindCommand(const char *pName, int FlagMask)
 {
 	CCommand *pCommand;
-	for (pCommand = m_pFirstCommand; pCommand; pCommand = pCommand->m_pNext)
+	for(pCommand = m_apCommandHash[CommandHash(pName)%COMMAND_HASH_SIZE]; pCommand; pCommand = pCommand->m_pNextHash)
 	{
 		if(pCommand->m_Flags&FlagMask)
 		{
@@ -317,10 +334,108 @@ CConsole::CCommand *CConsole::FindCommand(const char *pName, int FlagMask)
 	return 0x0;
 }
 
+void CConsole::ClearLineCache()
+{
+	m_LineCacheHeap.Rewind();
+	mem_zero(m_apLineCache, sizeof(m_apLineCache));
+	m_NumCachedLines = 0;
+	m_LineCacheDirty = false;
+}
+
+CConsole::CCachedLine *CConsole::CacheLine(const char *pStr)
+{
+	unsigned Hash = str_quickhash(pStr);
+	CCachedLine **ppBucket = &m_apLineCache[Hash%LINE_CACHE_HASH_SIZE];
+	for(CCachedLine *pLine = *ppBucket; pLine; pLine = pLine->m_pNext)
+	{
+		if(pLine->m_Hash == Hash && str_comp(pLine->m_pLine, pStr) == 0)
+			return pLine;
+	}
+
+	if(m_NumCachedLines >= MAX_CACHED_LINES)
+		ClearLineCache();
+
+	CHeap::CMarker Marker = m_LineCacheHeap.Marker();
+	CCachedLine *pLine = (CCachedLine *)m_LineCacheHeap.Allocate(sizeof(CCachedLine), sizeof(void*));
+	CCachedLine::CPart **ppLastPart = &pLine->m_pFirstPart;
+	const char *pLineStart = pStr;
+
+	do
+	{
+		CResult Result;
+		const char *pNextPart;
+		const char *pEnd = SplitLine(pStr, &pNextPart);
+		ParseStart(&Result, pStr, (pEnd-pStr) + 1);
+
+		// leave everything that could print an error or needs the stroke to the normal way
+		CCommand *pCommand = FindCommand(Result.m_pCommand, m_FlagMask);
+		if(!pCommand || Result.m_pCommand[0] == '+' || ParseArgs(&Result, pCommand->m_pParams))
+		{
+			m_LineCacheHeap.Rewind(Marker);
+			return 0;
+		}
+
+		CCachedLine::CPart *pPart = (CCachedLine::CPart *)m_LineCacheHeap.Allocate(sizeof(CCachedLine::CPart), sizeof(void*));
+		pPart->m_pCommand = pCommand;
+		pPart->m_StorageSize = min((int)(pEnd-pStr) + 1, (int)sizeof(Result.m_aStringStorage));
+		pPart->m_pStorage = (char *)m_LineCacheHeap.Allocate(pPart->m_StorageSize);
+		mem_copy(pPart->m_pStorage, Result.m_aStringStorage, pPart->m_StorageSize);
+		pPart->m_CommandOffset = Result.m_pCommand-Result.m_aStringStorage;
+		pPart->m_NumArgs = Result.NumArguments();
+		pPart->m_pArgOffsets = (int *)m_LineCacheHeap.Allocate(pPart->m_NumArgs*sizeof(int), sizeof(int));
+		for(int i = 0; i < pPart->m_NumArgs; i++)
+			pPart->m_pArgOffsets[i] = Result.m_apArgs[i]-Result.m_aStringStorage;
+		pPart->m_pNext = 0;
+		*ppLastPart = pPart;
+		ppLastPart = &pPart->m_pNext;
+
+		pStr = pNextPart;
+	}
+	while(pStr && *pStr);
+
+	int Length = str_length(pLineStart)+1;
+	pLine->m_pLine = (char *)m_LineCacheHeap.Allocate(Length);
+	mem_copy(pLine->m_pLine, pLineStart, Length);
+	pLine->m_Hash = Hash;
+	pLine->m_pNext = *ppBucket;
+	*ppBucket = pLine;
+	m_NumCachedLines++;
+	return pLine;
+}
+
 void CConsole::ExecuteLine(const char *pStr)
 {
-	CConsole::ExecuteLineStroked(1, pStr); // press it
-	CConsole::ExecuteLineStroked(0, pStr); // then release it
+	// lines that are run from within a command don't use the cache, so
+	// it is never cleared while a cached line is still being executed
+	CCachedLine *pLine = 0;
+	if(m_ExecDepth == 0)
+	{
+		if(m_LineCacheDirty)
+			ClearLineCache();
+		pLine = CacheLine(pStr);
+	}
+
+	m_ExecDepth++;
+	if(pLine)
+	{
+		// cached lines have no stroke commands, so there is nothing to release
+		for(CCachedLine::CPart *pPart = pLine->m_pFirstPart; pPart; pPart = pPart->m_pNext)
+		{
+			CResult Result;
+			mem_copy(Result.m_aStringStorage, pPart->m_pStorage, pPart->m_StorageSize);
+			Result.m_pCommand = Result.m_aStringStorage + pPart->m_CommandOffset;
+			Result.m_pArgsStart = Result.m_aStringStorage + pPart->m_StorageSize-1;
+			for(int i = 0; i < pPart->m_NumArgs; i++)
+				Result.AddArgument(Result.m_aStringStorage + pPart->m_pArgOffsets[i]);
+			ExecuteCommand(pPart->m_pCommand, &Result);
+		}
+	}
+	else
+	{
+		CConsole::ExecuteLineStroked(1, pStr); // press it
+		CConsole::ExecuteLineStroked(0, pStr); // then release it
+	}
+	m_ExecDepth--;
 }
 
 
@@ -356,8 +471,11 @@ void CConsole::ExecuteFile(const char *pFilename)
 		Print(IConsole::OUTPUT_LEVEL_STANDARD, "console", aBuf);
 		lr.Init(File);
 
+		// config files are run once, keep them out of the line cache
+		m_ExecDepth++;
 		while((pLine = lr.Get()))
 			ExecuteLine(pLine);
+		m_ExecDepth--;
 
 		io_close(File);
 	}
@@ -465,7 +583,12 @@ CConsole::CConsole(int FlagMask)
 	m_paStrokeStr[1] = "1";
 	m_ExecutionQueue.Reset();
 	m_pFirstCommand = 0;
+	mem_zero(m_apCommandHash, sizeof(m_apCommandHash));
 	m_pFirstExec = 0;
+	mem_zero(m_apLineCache, sizeof(m_apLineCache));
+	m_NumCachedLines = 0;
+	m_LineCacheDirty = false;
+	m_ExecDepth = 0;
 	m_pPrintCallbackUserdata = 0;
 	m_pfnPrintCallback = 0;
 	
@@ -532,6 +655,19 @@ void CConsole::Register(const char *pName, const char *pParams,
 	
 	pCommand->m_pNext = m_pFirstCommand;
 	m_pFirstCommand = pCommand;
+
+	// newer commands shadow older ones with the same name
+	unsigned Bucket = CommandHash(pName)%COMMAND_HASH_SIZE;
+	pCommand->m_pNextHash = m_apCommandHash[Bucket];
+	m_apCommandHash[Bucket] = pCommand;
+
+	CCommandRef Ref;
+	Ref.m_pCommand = pCommand;
+	Ref.m_pName = pName;
+	m_CommandIndex.add(Ref);
+
+	// cached lines might resolve to an older command
+	m_LineCacheDirty = true;
 }
 
 void CConsole::Con_Chain(IResult *pResult, void *pUserData)
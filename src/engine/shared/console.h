@@ -3,6 +3,7 @@
 #ifndef ENGINE_SHARED_CONSOLE_H
 #define ENGINE_SHARED_CONSOLE_H
 
+#include <base/tl/sorted_array.h>
 #include <engine/console.h>
 #include "memheap.h"
 
@@ -12,6 +13,7 @@ class CConsole : public IConsole
 	{
 	public:
 		CCommand *m_pNext;
+		CCommand *m_pNextHash;
 		int m_Flags;
 		FCommandCallback m_pfnCallback;
 		void *m_pUserData;
@@ -27,10 +29,27 @@ class CConsole : public IConsole
 		void *m_pUserData;
 	};	
 	
+	// entry of the name index that is used for completion
+	class CCommandRef
+	{
+	public:
+		CCommand *m_pCommand;
+		const char *m_pName;
+
+		bool operator<(const CCommandRef &Other) const { return str_comp_nocase(m_pName, Other.m_pName) < 0; }
+	};
+
+	enum
+	{
+		COMMAND_HASH_SIZE=512,
+	};
+
 	int m_FlagMask;
 	bool m_StoreCommands;
 	const char *m_paStrokeStr[2];
 	CCommand *m_pFirstCommand;
+	CCommand *m_apCommandHash[COMMAND_HASH_SIZE];
+	sorted_array<CCommandRef> m_CommandIndex;
 
 	class CExecFile
 	{
@@ -67,12 +86,22 @@ class CConsole : public IConsole
 		const char *m_pCommand;
 		const char *m_apArgs[MAX_PARTS];
 
+		// only the arguments below m_NumArgs are ever read, so there is
+		// no need to clear the whole storage for every executed line
 		CResult() : IResult()
 		{
-			mem_zero(m_aStringStorage, sizeof(m_aStringStorage));
-			m_pArgsStart = 0;
-			m_pCommand = 0;
-			mem_zero(m_apArgs, sizeof(m_apArgs));
+			m_aStringStorage[0] = 0;
+			m_pArgsStart = m_aStringStorage;
+			m_pCommand = m_aStringStorage;
+		}
+
+		// moves a pointer into the storage of other over to this one,
+		// pointers to constant strings like the stroke stay as they are
+		const char *Rebase(const CResult &Other, const char *pStr) const
+		{
+			if(pStr >= Other.m_aStringStorage && pStr < Other.m_aStringStorage+sizeof(Other.m_aStringStorage))
+				return m_aStringStorage + (pStr-Other.m_aStringStorage);
+			return pStr;
 		}
 
 		CResult &operator =(const CResult &Other)
@@ -80,12 +109,11 @@ class CConsole : public IConsole
 			if(this != &Other)
 			{
 				IResult::operator=(Other);
-				int Offset = m_aStringStorage - Other.m_aStringStorage;
 				mem_copy(m_aStringStorage, Other.m_aStringStorage, sizeof(m_aStringStorage));
-				m_pArgsStart = Other.m_pArgsStart + Offset;
-				m_pCommand = Other.m_pCommand + Offset;
+				m_pArgsStart = m_aStringStorage + (Other.m_pArgsStart-Other.m_aStringStorage);
+				m_pCommand = Rebase(Other, Other.m_pCommand);
 				for(unsigned i = 0; i < Other.m_NumArgs; ++i)
-					m_apArgs[i] = Other.m_apArgs[i] + Offset;
+					m_apArgs[i] = Rebase(Other, Other.m_apArgs[i]);
 			}
 			return *this;
 		}
@@ -134,6 +162,51 @@ class CConsole : public IConsole
 		}
 	} m_ExecutionQueue;
 
+	/*
+		Class: CCachedLine
+			A line that was split and parsed before, so running it again
+			only needs the stored results copied back. Only lines that
+			consist of known commands with valid arguments and without
+			stroke commands are cached, everything else takes the normal
+			way so errors are still reported.
+	*/
+	class CCachedLine
+	{
+	public:
+		class CPart
+		{
+		public:
+			CPart *m_pNext;
+			CCommand *m_pCommand;
+			char *m_pStorage; // the parsed string storage
+			int m_StorageSize;
+			int m_CommandOffset;
+			int m_NumArgs;
+			int *m_pArgOffsets;
+		};
+
+		CCachedLine *m_pNext;
+		unsigned m_Hash;
+		char *m_pLine;
+		CPart *m_pFirstPart;
+	};
+
+	enum
+	{
+		LINE_CACHE_HASH_SIZE=64,
+		MAX_CACHED_LINES=128,
+	};
+
+	CHeap m_LineCacheHeap;
+	CCachedLine *m_apLineCache[LINE_CACHE_HASH_SIZE];
+	int m_NumCachedLines;
+	bool m_LineCacheDirty;
+	int m_ExecDepth;
+
+	void ClearLineCache();
+	CCachedLine *CacheLine(const char *pStr);
+	void ExecuteCommand(CCommand *pCommand, CResult *pResult);
+
 	CCommand *FindCommand(const char *pName, int FlagMask);
 
 public:
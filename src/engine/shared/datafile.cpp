@@ -4,6 +4,7 @@
 #include <base/system.h>
 #include <engine/storage.h>
 #include "datafile.h"
+#include "jobs.h"
 #include <zlib.h>
 
 static const int DEBUG=0;
@@ -57,8 +58,15 @@ struct CDatafileInfo
 
 struct CDatafile
 {
-	IOHANDLE m_File;
+	// the whole file, mapped or read into memory
+	unsigned char *m_pFileData;
+	unsigned m_FileSize;
+	bool m_FileMapped;
+	int64 m_FileModified;
 	unsigned m_Crc;
+	int m_Flags;
+	unsigned m_MemoryUsage;
+	unsigned m_PeakMemoryUsage;
 	CDatafileInfo m_Info;
 	CDatafileHeader m_Header;
 	int m_DataStartOffset;
@@ -66,9 +74,145 @@ struct CDatafile
 	char *m_pData;
 };
 
-bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType)
+static void FreeFileData(unsigned char *pData, unsigned Size, bool Mapped)
+{
+	if(Mapped)
+		io_unmap(pData, Size);
+	else
+		mem_free(pData);
+}
+
+static void AddMemoryUsage(CDatafile *pDataFile, unsigned Size)
+{
+	pDataFile->m_MemoryUsage += Size;
+	pDataFile->m_PeakMemoryUsage = max(pDataFile->m_PeakMemoryUsage, pDataFile->m_MemoryUsage);
+}
+
+static int DataSize(const CDatafile *pDataFile, int Index)
+{
+	if(Index == pDataFile->m_Header.m_NumRawData-1)
+		return pDataFile->m_Header.m_DataSize-pDataFile->m_Info.m_pDataOffsets[Index];
+	return pDataFile->m_Info.m_pDataOffsets[Index+1]-pDataFile->m_Info.m_pDataOffsets[Index];
+}
+
+// data that points into the file memory isn't owned by the data pointers
+static bool IsFileData(const CDatafile *pDataFile, const char *pData)
+{
+	return (const unsigned char *)pData >= pDataFile->m_pFileData && (const unsigned char *)pData < pDataFile->m_pFileData+pDataFile->m_FileSize;
+}
+
+/*
+	Function: LoadData
+		Fills in the data pointer of one data item. Doesn't touch
+		anything shared between the items, so different items can be
+		loaded at the same time.
+
+	Returns:
+		The amount of heap memory the item takes, 0 if it points into the
+		file memory or couldn't be loaded.
+*/
+static unsigned LoadData(CDatafile *pDataFile, int Index)
+{
+	int Size = DataSize(pDataFile, Index);
+	unsigned Offset = pDataFile->m_DataStartOffset+pDataFile->m_Info.m_pDataOffsets[Index];
+	if(Size < 0 || Offset > pDataFile->m_FileSize || (unsigned)Size > pDataFile->m_FileSize-Offset)
+	{
+		dbg_msg("datafile", "data index=%d is outside of the file", Index);
+		return 0;
+	}
+	const unsigned char *pFileData = pDataFile->m_pFileData+Offset;
+
+	if(pDataFile->m_Header.m_Version == 4)
+	{
+		// v4 has compressed data
+		unsigned long UncompressedSize = pDataFile->m_Info.m_pDataSizes[Index];
+		pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(UncompressedSize, 1);
+
+		unsigned long s = UncompressedSize;
+		if(uncompress((Bytef*)pDataFile->m_ppDataPtrs[Index], &s, (const Bytef*)pFileData, Size) != Z_OK || s != UncompressedSize) // ignore_convention
+			dbg_msg("datafile", "data index=%d is corrupt", Index);
+		return UncompressedSize;
+	}
+
+	if(pDataFile->m_Flags&CDataFileReader::OPENFLAG_PRELOAD)
+	{
+		pDataFile->m_ppDataPtrs[Index] = (char *)pFileData;
+		return 0;
+	}
+
+	pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(Size, 1);
+	mem_copy(pDataFile->m_ppDataPtrs[Index], pFileData, Size);
+	return Size;
+}
+
+class CDataLoader
+{
+public:
+	CDatafile *m_pDataFile;
+	LOCK m_Lock;
+	int m_NextIndex;
+	unsigned m_MemoryUsage;
+
+	// takes the next data item until all are taken
+	static int Work(void *pUser)
+	{
+		CDataLoader *pSelf = (CDataLoader *)pUser;
+		while(1)
+		{
+			lock_wait(pSelf->m_Lock);
+			int Index = pSelf->m_NextIndex++;
+			lock_release(pSelf->m_Lock);
+			if(Index >= pSelf->m_pDataFile->m_Header.m_NumRawData)
+				break;
+
+			unsigned Size = LoadData(pSelf->m_pDataFile, Index);
+			lock_wait(pSelf->m_Lock);
+			pSelf->m_MemoryUsage += Size;
+			lock_release(pSelf->m_Lock);
+		}
+		return 0;
+	}
+};
+
+// loads all data items. the calling thread works through them as well, so
+// jobs that didn't get a worker in time find nothing left to do
+static void LoadAllData(CDatafile *pDataFile, CJobPool *pJobPool)
+{
+	enum
+	{
+		MAX_JOBS=16,
+	};
+
+	CDataLoader Loader;
+	Loader.m_pDataFile = pDataFile;
+	Loader.m_Lock = lock_create();
+	Loader.m_NextIndex = 0;
+	Loader.m_MemoryUsage = 0;
+
+	CJob aJobs[MAX_JOBS];
+	int NumJobs = 0;
+	if(pJobPool)
+		NumJobs = min(min(pJobPool->NumThreads(), (int)MAX_JOBS), pDataFile->m_Header.m_NumRawData-1);
+	for(int i = 0; i < NumJobs; i++)
+		pJobPool->Add(&aJobs[i], CDataLoader::Work, &Loader);
+
+	CDataLoader::Work(&Loader);
+
+	for(int i = 0; i < NumJobs; i++)
+		pJobPool->Wait(&aJobs[i]);
+
+	lock_destroy(Loader.m_Lock);
+	AddMemoryUsage(pDataFile, Loader.m_MemoryUsage);
+}
+
+bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType, int Flags, CJobPool *pJobPool)
 {
 	dbg_msg("datafile", "loading. filename='%s'", pFilename);
+	int64 StartTime = time_get();
+#if defined(CONF_ARCH_ENDIAN_BIG)
+	// the data has to be swapped when it's fetched
+	Flags &= ~OPENFLAG_PRELOAD;
+#endif
 
 	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_READ, StorageType);
 	if(!File)
@@ -77,37 +221,47 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 		return false;
 	}	
 	
-	
-	// take the CRC of the file and store it
-	unsigned Crc = 0;
+	// map the file, everything after this works on the memory. read it
+	// in one go if the file can't be mapped
+	unsigned FileSize = 0;
+	bool FileMapped = true;
+	unsigned char *pFileData = (unsigned char *)io_map(File, &FileSize);
+	if(!pFileData)
 	{
-		enum
-		{
-			BUFFER_SIZE = 64*1024
-		};
-		
-		unsigned char aBuffer[BUFFER_SIZE];
-		
-		while(1)
+		FileMapped = false;
+		FileSize = (unsigned)max(io_length(File), 0L);
+		pFileData = (unsigned char *)mem_alloc(max(FileSize, 1u), 1);
+		if(io_read(File, pFileData, FileSize) != FileSize)
 		{
-			unsigned Bytes = io_read(File, aBuffer, BUFFER_SIZE);
-			if(Bytes <= 0)
-				break;
-			Crc = crc32(Crc, aBuffer, Bytes); // ignore_convention
+			dbg_msg("datafile", "couldn't read '%s'", pFilename);
+			io_close(File);
+			mem_free(pFileData);
+			return false;
 		}
-		
-		io_seek(File, 0, IOSEEK_START);
 	}
+	int64 FileModified = 0;
+	io_stat(File, 0, &FileModified);
+	io_close(File);
 	
+	// take the CRC of the file and store it
+	unsigned Crc = crc32(0, pFileData, FileSize); // ignore_convention
 	
+	if(FileSize < sizeof(CDatafileHeader))
+	{
+		dbg_msg("datafile", "file too small. size=%d", FileSize);
+		FreeFileData(pFileData, FileSize, FileMapped);
+		return false;
+	}
+
 	// TODO: change this header
 	CDatafileHeader Header;
-	io_read(File, &Header, sizeof(Header));
+	mem_copy(&Header, pFileData, sizeof(Header));
 	if(Header.m_aID[0] != 'A' || Header.m_aID[1] != 'T' || Header.m_aID[2] != 'A' || Header.m_aID[3] != 'D')
 	{
 		if(Header.m_aID[0] != 'D' || Header.m_aID[1] != 'A' || Header.m_aID[2] != 'T' || Header.m_aID[3] != 'A')
 		{
 			dbg_msg("datafile", "wrong signature. %x %x %x %x", Header.m_aID[0], Header.m_aID[1], Header.m_aID[2], Header.m_aID[3]);
+			FreeFileData(pFileData, FileSize, FileMapped);
 			return 0;
 		}
 	}
@@ -118,6 +272,7 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	if(Header.m_Version != 3 && Header.m_Version != 4)
 	{
 		dbg_msg("datafile", "wrong version. version=%x", Header.m_Version);
+		FreeFileData(pFileData, FileSize, FileMapped);
 		return 0;
 	}
 	
@@ -138,17 +293,25 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	pTmpDataFile->m_DataStartOffset = sizeof(CDatafileHeader) + Size;
 	pTmpDataFile->m_ppDataPtrs = (char**)(pTmpDataFile+1);
 	pTmpDataFile->m_pData = (char *)(pTmpDataFile+1)+Header.m_NumRawData*sizeof(char *);
-	pTmpDataFile->m_File = File;
+	pTmpDataFile->m_pFileData = pFileData;
+	pTmpDataFile->m_FileSize = FileSize;
+	pTmpDataFile->m_FileMapped = FileMapped;
+	pTmpDataFile->m_FileModified = FileModified;
 	pTmpDataFile->m_Crc = Crc;
+	pTmpDataFile->m_Flags = Flags;
+	pTmpDataFile->m_MemoryUsage = 0;
+	pTmpDataFile->m_PeakMemoryUsage = 0;
+	AddMemoryUsage(pTmpDataFile, AllocSize + (FileMapped ? 0 : FileSize));
 	
 	// clear the data pointers
 	mem_zero(pTmpDataFile->m_ppDataPtrs, Header.m_NumRawData*sizeof(void*));
 	
 	// read types, offsets, sizes and item data
-	unsigned ReadSize = io_read(File, pTmpDataFile->m_pData, Size);
+	unsigned ReadSize = min(Size, FileSize-(unsigned)sizeof(CDatafileHeader));
+	mem_copy(pTmpDataFile->m_pData, pFileData+sizeof(CDatafileHeader), ReadSize);
 	if(ReadSize != Size)
 	{
-		io_close(pTmpDataFile->m_File);
+		FreeFileData(pFileData, FileSize, FileMapped);
 		mem_free(pTmpDataFile);
 		pTmpDataFile = 0;
 		dbg_msg("datafile", "couldn't load the whole thing, wanted=%d got=%d", Size, ReadSize);
@@ -181,7 +344,11 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 		m_pDataFile->m_Info.m_pItemStart = (char *)&m_pDataFile->m_Info.m_pDataOffsets[m_pDataFile->m_Header.m_NumRawData];
 	m_pDataFile->m_Info.m_pDataStart = m_pDataFile->m_Info.m_pItemStart + m_pDataFile->m_Header.m_ItemSize;
 
-	dbg_msg("datafile", "loading done. datafile='%s'", pFilename);
+	if(Flags&OPENFLAG_PRELOAD)
+		LoadAllData(m_pDataFile, pJobPool);
+
+	dbg_msg("datafile", "loading done. datafile='%s' time=%.2fms memory=%dKiB", pFilename,
+		(time_get()-StartTime)*1000.0f/time_freq(), m_pDataFile->m_MemoryUsage/1024);
 
 	if(DEBUG)
 	{
@@ -222,32 +389,6 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	return true;
 }
 
-bool CDataFileReader::GetCrcSize(class IStorage *pStorage, const char *pFilename, int StorageType, unsigned *pCrc, unsigned *pSize)
-{
-	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_READ, StorageType);
-	if(!File)
-		return false;
-	
-	// get crc and size
-	unsigned Crc = 0;
-	unsigned Size = 0;
-	unsigned char aBuffer[64*1024];
-	while(1)
-	{
-		unsigned Bytes = io_read(File, aBuffer, sizeof(aBuffer));
-		if(Bytes <= 0)
-			break;
-		Crc = crc32(Crc, aBuffer, Bytes); // ignore_convention
-		Size += Bytes;
-	}
-	
-	io_close(File);
-
-	*pCrc = Crc;
-	*pSize = Size;
-	return true;
-}
-
 int CDataFileReader::NumData()
 {
 	if(!m_pDataFile) { return 0; }
@@ -258,10 +399,16 @@ int CDataFileReader::NumData()
 int CDataFileReader::GetDataSize(int Index)
 {
 	if(!m_pDataFile) { return 0; }
-	
-	if(Index == m_pDataFile->m_Header.m_NumRawData-1)
-		return m_pDataFile->m_Header.m_DataSize-m_pDataFile->m_Info.m_pDataOffsets[Index];
-	return  m_pDataFile->m_Info.m_pDataOffsets[Index+1]-m_pDataFile->m_Info.m_pDataOffsets[Index];
+	return DataSize(m_pDataFile, Index);
+}
+
+// the size of the data once it's loaded
+int CDataFileReader::GetUncompressedDataSize(int Index)
+{
+	if(!m_pDataFile) { return 0; }
+	if(m_pDataFile->m_Header.m_Version == 4)
+		return m_pDataFile->m_Info.m_pDataSizes[Index];
+	return DataSize(m_pDataFile, Index);
 }
 
 void *CDataFileReader::GetDataImpl(int Index, int Swap)
@@ -271,44 +418,19 @@ void *CDataFileReader::GetDataImpl(int Index, int Swap)
 	// load it if needed
 	if(!m_pDataFile->m_ppDataPtrs[Index])
 	{
-		// fetch the data size
-		int DataSize = GetDataSize(Index);
-		int SwapSize = DataSize;
-		
 		if(m_pDataFile->m_Header.m_Version == 4)
-		{
-			// v4 has compressed data
-			void *pTemp = (char *)mem_alloc(DataSize, 1);
-			unsigned long UncompressedSize = m_pDataFile->m_Info.m_pDataSizes[Index];
-			unsigned long s;
-
-			dbg_msg("datafile", "loading data index=%d size=%d uncompressed=%d", Index, DataSize, UncompressedSize);
-			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(UncompressedSize, 1);
-			
-			// read the compressed data
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, pTemp, DataSize);
-
-			// decompress the data, TODO: check for errors
-			s = UncompressedSize;
-			uncompress((Bytef*)m_pDataFile->m_ppDataPtrs[Index], &s, (Bytef*)pTemp, DataSize); // ignore_convention
-			SwapSize = s;
-
-			// clean up the temporary buffers
-			mem_free(pTemp);
-		}
+			dbg_msg("datafile", "loading data index=%d size=%d uncompressed=%d", Index, GetDataSize(Index), m_pDataFile->m_Info.m_pDataSizes[Index]);
 		else
-		{
-			// load the data
-			dbg_msg("datafile", "loading data index=%d size=%d", Index, DataSize);
-			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(DataSize, 1);
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, m_pDataFile->m_ppDataPtrs[Index], DataSize);
-		}
+			dbg_msg("datafile", "loading data index=%d size=%d", Index, GetDataSize(Index));
+
+		unsigned Size = LoadData(m_pDataFile, Index);
+		AddMemoryUsage(m_pDataFile, Size);
+		if(!m_pDataFile->m_ppDataPtrs[Index])
+			return 0;
 
 #if defined(CONF_ARCH_ENDIAN_BIG)
-		if(Swap && SwapSize)
-			swap_endian(m_pDataFile->m_ppDataPtrs[Index], sizeof(int), SwapSize/sizeof(int));
+		if(Swap && Size)
+			swap_endian(m_pDataFile->m_ppDataPtrs[Index], sizeof(int), Size/sizeof(int));
 #endif
 	}
 	
@@ -327,10 +449,14 @@ void *CDataFileReader::GetDataSwapped(int Index)
 
 void CDataFileReader::UnloadData(int Index)
 {
-	if(Index < 0)
+	if(!m_pDataFile || Index < 0 || Index >= m_pDataFile->m_Header.m_NumRawData || !m_pDataFile->m_ppDataPtrs[Index])
 		return;
 		
-	//
+	// data in the file memory stays where it is
+	if(IsFileData(m_pDataFile, m_pDataFile->m_ppDataPtrs[Index]))
+		return;
+
+	m_pDataFile->m_MemoryUsage -= GetUncompressedDataSize(Index);
 	mem_free(m_pDataFile->m_ppDataPtrs[Index]);
 	m_pDataFile->m_ppDataPtrs[Index] = 0x0;
 }
@@ -338,9 +464,10 @@ void CDataFileReader::UnloadData(int Index)
 int CDataFileReader::GetItemSize(int Index)
 {
 	if(!m_pDataFile) { return 0; }
+	// the offsets include the item header
 	if(Index == m_pDataFile->m_Header.m_NumItems-1)
-		return m_pDataFile->m_Header.m_ItemSize-m_pDataFile->m_Info.m_pItemOffsets[Index];
-	return  m_pDataFile->m_Info.m_pItemOffsets[Index+1]-m_pDataFile->m_Info.m_pItemOffsets[Index];
+		return m_pDataFile->m_Header.m_ItemSize-m_pDataFile->m_Info.m_pItemOffsets[Index]-sizeof(CDatafileItem);
+	return  m_pDataFile->m_Info.m_pItemOffsets[Index+1]-m_pDataFile->m_Info.m_pItemOffsets[Index]-sizeof(CDatafileItem);
 }
 
 void *CDataFileReader::GetItem(int Index, int *pType, int *pID)
@@ -404,27 +531,100 @@ bool CDataFileReader::Close()
 	// free the data that is loaded
 	int i;
 	for(i = 0; i < m_pDataFile->m_Header.m_NumRawData; i++)
-		mem_free(m_pDataFile->m_ppDataPtrs[i]);
+	{
+		if(!IsFileData(m_pDataFile, m_pDataFile->m_ppDataPtrs[i]))
+			mem_free(m_pDataFile->m_ppDataPtrs[i]);
+	}
 	
-	io_close(m_pDataFile->m_File);
+	FreeFileData(m_pDataFile->m_pFileData, m_pDataFile->m_FileSize, m_pDataFile->m_FileMapped);
 	mem_free(m_pDataFile);
 	m_pDataFile = 0;
 	return true;
 }
 
+void CDataFileReader::Swap(CDataFileReader *pOther)
+{
+	CDatafile *pDataFile = m_pDataFile;
+	m_pDataFile = pOther->m_pDataFile;
+	pOther->m_pDataFile = pDataFile;
+}
+
+const unsigned char *CDataFileReader::FileData() const
+{
+	if(!m_pDataFile) return 0;
+	return m_pDataFile->m_pFileData;
+}
+
+unsigned CDataFileReader::FileSize() const
+{
+	if(!m_pDataFile) return 0;
+	return m_pDataFile->m_FileSize;
+}
+
+int64 CDataFileReader::FileModified() const
+{
+	if(!m_pDataFile) return 0;
+	return m_pDataFile->m_FileModified;
+}
+
+unsigned CDataFileReader::MemoryUsage() const
+{
+	if(!m_pDataFile) return 0;
+	return m_pDataFile->m_MemoryUsage;
+}
+
+unsigned CDataFileReader::PeakMemoryUsage() const
+{
+	if(!m_pDataFile) return 0;
+	return m_pDataFile->m_PeakMemoryUsage;
+}
+
 unsigned CDataFileReader::Crc()
 {
 	if(!m_pDataFile) return 0xFFFFFFFF;
 	return m_pDataFile->m_Crc;
 }
 
-bool CDataFileWriter::Open(class IStorage *pStorage, const char *pFilename)
+struct CDataFileWriter::CDataJob
+{
+	CJob m_Job;
+	int m_Index;
+	void *m_pData;
+	int m_Size;
+	void *m_pCompressedData;
+	unsigned long m_CompressedSize;
+	int m_Result;
+
+	static int Compress(void *pUser)
+	{
+		CDataJob *pSelf = (CDataJob *)pUser;
+		pSelf->m_CompressedSize = compressBound(pSelf->m_Size);
+		pSelf->m_pCompressedData = mem_alloc(pSelf->m_CompressedSize, 1);
+		pSelf->m_Result = compress((Bytef*)pSelf->m_pCompressedData, &pSelf->m_CompressedSize, (Bytef*)pSelf->m_pData, pSelf->m_Size); // ignore_convention
+		return 0;
+	}
+};
+
+bool CDataFileWriter::Open(class IStorage *pStorage, const char *pFilename, CJobPool *pJobPool)
 {
 	dbg_assert(!m_File, "a file already exists");
 	m_File = pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
 	if(!m_File)
 		return false;
+
+	// the compressed data waits here until the header is known
+	str_format(m_aDataFilename, sizeof(m_aDataFilename), "%s.tmp", pFilename);
+	m_DataFile = pStorage->OpenFile(m_aDataFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!m_DataFile)
+	{
+		dbg_msg("datafile", "couldn't open '%s'", m_aDataFilename);
+		io_close(m_File);
+		m_File = 0;
+		return false;
+	}
 	
+	m_pStorage = pStorage;
+	m_pJobPool = pJobPool;
 	m_NumItems = 0;
 	m_NumDatas = 0;
 	m_NumItemTypes = 0;
@@ -435,6 +635,10 @@ bool CDataFileWriter::Open(class IStorage *pStorage, const char *pFilename)
 		m_aItemTypes[i].m_First = -1;
 		m_aItemTypes[i].m_Last = -1;
 	}
+
+	m_FirstJob = 0;
+	m_NumJobs = 0;
+	m_PendingSize = 0;
 	
 	return true;
 }
@@ -475,28 +679,68 @@ int CDataFileWriter::AddItem(int Type, int ID, int Size, void *pData)
 	return m_NumItems-1;
 }
 
+void CDataFileWriter::WriteData(int Index, const void *pData, int Size)
+{
+	m_aDatas[Index].m_CompressedSize = Size;
+	io_write(m_DataFile, pData, Size);
+}
+
+void CDataFileWriter::FlushJob()
+{
+	CDataJob *pJob = m_apJobs[m_FirstJob];
+	m_FirstJob = (m_FirstJob+1)%MAX_JOBS;
+	m_NumJobs--;
+	m_PendingSize -= pJob->m_Size;
+
+	if(m_pJobPool)
+		m_pJobPool->Wait(&pJob->m_Job);
+	else
+		CDataJob::Compress(pJob);
+
+	if(pJob->m_Result != Z_OK)
+	{
+		dbg_msg("datafile", "compression error %d", pJob->m_Result);
+		dbg_assert(0, "zlib error");
+	}
+
+	WriteData(pJob->m_Index, pJob->m_pCompressedData, (int)pJob->m_CompressedSize);
+
+	if(m_pJobPool)
+		mem_free(pJob->m_pData);
+	mem_free(pJob->m_pCompressedData);
+	delete pJob;
+}
+
 int CDataFileWriter::AddData(int Size, void *pData)
 {
 	if(!m_File) return 0;
 
 	dbg_assert(m_NumDatas < 1024, "too much data");
 
-	CDataInfo *pInfo = &m_aDatas[m_NumDatas];
-	unsigned long s = compressBound(Size);
-	void *pCompData = mem_alloc(s, 1); // temporary buffer that we use during compression
+	// make room, this writes out the oldest data
+	while(m_NumJobs == MAX_JOBS || (m_NumJobs && m_PendingSize+Size > MAX_PENDING_SIZE))
+		FlushJob();
+
+	CDataJob *pJob = new CDataJob;
+	pJob->m_Index = m_NumDatas;
+	pJob->m_Size = Size;
+	m_apJobs[(m_FirstJob+m_NumJobs)%MAX_JOBS] = pJob;
+	m_NumJobs++;
+	m_PendingSize += Size;
+	m_aDatas[m_NumDatas].m_UncompressedSize = Size;
 
-	int Result = compress((Bytef*)pCompData, &s, (Bytef*)pData, Size); // ignore_convention
-	if(Result != Z_OK)
+	if(m_pJobPool)
 	{
-		dbg_msg("datafile", "compression error %d", Result);
-		dbg_assert(0, "zlib error");
+		// the caller's data can be gone before the job runs
+		pJob->m_pData = mem_alloc(max(Size, 1), 1);
+		mem_copy(pJob->m_pData, pData, Size);
+		m_pJobPool->Add(&pJob->m_Job, CDataJob::Compress, pJob);
+	}
+	else
+	{
+		pJob->m_pData = pData;
+		FlushJob();
 	}
-		
-	pInfo->m_UncompressedSize = Size;
-	pInfo->m_CompressedSize = (int)s;
-	pInfo->m_pCompressedData = mem_alloc(pInfo->m_CompressedSize, 1);
-	mem_copy(pInfo->m_pCompressedData, pCompData, pInfo->m_CompressedSize);
-	mem_free(pCompData);
 
 	m_NumDatas++;
 	return m_NumDatas-1;
@@ -528,6 +772,12 @@ int CDataFileWriter::Finish()
 	int DataSize = 0;
 	CDatafileHeader Header;
 
+	// the data sizes are known once everything is compressed
+	while(m_NumJobs)
+		FlushJob();
+	io_close(m_DataFile);
+	m_DataFile = 0;
+
 	// we should now write this file!
 	if(DEBUG)
 		dbg_msg("datafile", "writing");
@@ -563,6 +813,7 @@ int CDataFileWriter::Finish()
 		Header.m_aID[2] = 'T';
 		Header.m_aID[3] = 'A';
 		Header.m_Version = 4;
+		// always computed, the reader ignores them so old maps can have stale ones
 		Header.m_Size = FileSize - 16;
 		Header.m_Swaplen = SwapSize - 16;
 		Header.m_NumItemTypes = m_NumItemTypes;
@@ -677,19 +928,23 @@ int CDataFileWriter::Finish()
 		}
 	}
 	
-	// write data
-	for(int i = 0; i < m_NumDatas; i++)
+	// write data, it's already in order in the temporary file
+	IOHANDLE DataFile = m_pStorage->OpenFile(m_aDataFilename, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(DataFile)
 	{
-		if(DEBUG)
-			dbg_msg("datafile", "writing data id=%d size=%d", i, m_aDatas[i].m_CompressedSize);
-		io_write(m_File, m_aDatas[i].m_pCompressedData, m_aDatas[i].m_CompressedSize);
+		char aBuffer[64*1024];
+		unsigned Bytes;
+		while((Bytes = io_read(DataFile, aBuffer, sizeof(aBuffer))) > 0)
+			io_write(m_File, aBuffer, Bytes);
+		io_close(DataFile);
 	}
+	else
+		dbg_msg("datafile", "couldn't read back '%s'", m_aDataFilename);
+	m_pStorage->RemoveFile(m_aDataFilename, IStorage::TYPE_SAVE);
 
 	// free data
 	for(int i = 0; i < m_NumItems; i++)
 		mem_free(m_aItems[i].m_pData);
-	for(int i = 0; i < m_NumDatas; ++i)
-		mem_free(m_aDatas[i].m_pCompressedData);
 	
 	io_close(m_File);
 	m_File = 0;
@@ -12,16 +12,24 @@ public:
 	CDataFileReader() : m_pDataFile(0) {}
 	~CDataFileReader() { Close(); }
 	
+	enum
+	{
+		// uncompressed data points straight into the file memory and all
+		// compressed data is unpacked while opening, spread over the job
+		// pool if one is given
+		OPENFLAG_PRELOAD=1,
+	};
+
 	bool IsOpen() const { return m_pDataFile != 0; }
 	
-	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType);
+	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType, int Flags=0, class CJobPool *pJobPool=0);
 	bool Close();
-
-	static bool GetCrcSize(class IStorage *pStorage, const char *pFilename, int StorageType, unsigned *pCrc, unsigned *pSize);
+	void Swap(CDataFileReader *pOther);
 	
 	void *GetData(int Index);
 	void *GetDataSwapped(int Index); // makes sure that the data is 32bit LE ints when saved
 	int GetDataSize(int Index);
+	int GetUncompressedDataSize(int Index);
 	void UnloadData(int Index);
 	void *GetItem(int Index, int *pType, int *pID);
 	int GetItemSize(int Index);
@@ -32,16 +40,39 @@ public:
 	void Unload();
 	
 	unsigned Crc();
+
+	// the whole file as it is on disk
+	const unsigned char *FileData() const;
+	unsigned FileSize() const;
+	// modification time of the file when it was opened, see io_stat
+	int64 FileModified() const;
+
+	// heap memory held by the reader, the file mapping isn't counted
+	unsigned MemoryUsage() const;
+	unsigned PeakMemoryUsage() const;
 };
 
 // write access
+/*
+	Class: CDataFileWriter
+		Data is compressed as it is added, on the job pool if one is
+		given, and streamed in index order to a temporary file next to
+		the target. Finish writes the header and items and appends the
+		data from there. At most MAX_JOBS data items and MAX_PENDING_SIZE
+		bytes are held in memory at a time.
+*/
 class CDataFileWriter
 {
+	enum
+	{
+		MAX_JOBS=32,
+		MAX_PENDING_SIZE=16*1024*1024,
+	};
+
 	struct CDataInfo
 	{
 		int m_UncompressedSize;
 		int m_CompressedSize;
-		void *m_pCompressedData;
 	};
 
 	struct CItemInfo
@@ -60,18 +91,33 @@ class CDataFileWriter
 		int m_First;
 		int m_Last;
 	};
+
+	struct CDataJob;
 	
+	class IStorage *m_pStorage;
+	class CJobPool *m_pJobPool;
 	IOHANDLE m_File;
+	IOHANDLE m_DataFile;
+	char m_aDataFilename[512];
 	int m_NumItems;
 	int m_NumDatas;
 	int m_NumItemTypes;
 	CItemTypeInfo m_aItemTypes[0xffff];
 	CItemInfo m_aItems[1024];
-	CDataInfo m_aDatas[1024];	
+	CDataInfo m_aDatas[1024];
+
+	// data items in flight, oldest first
+	CDataJob *m_apJobs[MAX_JOBS];
+	int m_FirstJob;
+	int m_NumJobs;
+	int m_PendingSize;
+
+	void WriteData(int Index, const void *pData, int Size);
+	void FlushJob();
 	
 public:
-	CDataFileWriter() : m_File(0) {}
-	bool Open(class IStorage *pStorage, const char *Filename);
+	CDataFileWriter() : m_File(0), m_DataFile(0) {}
+	bool Open(class IStorage *pStorage, const char *Filename, class CJobPool *pJobPool=0);
 	int AddData(int Size, void *pData);
 	int AddDataSwapped(int Size, void *pData);
 	int AddItem(int Type, int ID, int Size, void *pData);
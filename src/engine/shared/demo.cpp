@@ -1,5 +1,6 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include <engine/console.h>
 #include <engine/storage.h>
@@ -12,13 +13,254 @@
 static const unsigned char gs_aHeaderMarker[7] = {'T', 'W', 'D', 'E', 'M', 'O', 0};
 static const unsigned char gs_ActVersion = 3;
 static const int gs_LengthOffset = 152;
+static const unsigned char gs_aIndexMarker[8] = {'T', 'W', 'D', 'I', 'D', 'X', 0, 0};
+static const int gs_IndexVersion = 1;
+
+struct CDemoIndexHeader
+{
+	unsigned char m_aMarker[8];
+	int m_Version;
+	int m_DemoSize;
+	char m_aMapName[64];
+	char m_aTimestamp[20];
+	int m_FirstTick;
+	int m_LastTick;
+	int m_NumKeyFrames;
+	int m_NumCheckpoints;
+	int m_DataSize;
+};
+
+CDemoIndex::CDemoIndex()
+{
+	m_pData = 0;
+	m_DataCapacity = 0;
+	Reset();
+}
+
+CDemoIndex::~CDemoIndex()
+{
+	mem_free(m_pData);
+}
+
+void CDemoIndex::Reset()
+{
+	m_lKeyFrames.clear();
+	m_lCheckpoints.clear();
+	m_DataSize = 0;
+	m_FirstTick = -1;
+	m_LastTick = -1;
+	m_Pending = false;
+}
+
+void CDemoIndex::AddKeyFrame(int Filepos, int Tick)
+{
+	CKeyFrame Frame;
+	Frame.m_Filepos = Filepos;
+	Frame.m_Tick = Tick;
+	m_lKeyFrames.add(Frame);
+}
+
+void CDemoIndex::AddCheckpoint(int Tick, const void *pSnapshot, int Size)
+{
+	// same encoding as the demo chunks
+	mem_copy(m_aBuffer2, pSnapshot, Size);
+	while(Size&3)
+		m_aBuffer2[Size++] = 0;
+	Size = CVariableInt::Compress(m_aBuffer2, Size, m_aBuffer);
+	Size = CNetBase::Compress(m_aBuffer, Size, m_aBuffer2, sizeof(m_aBuffer2));
+	if(Size < 0)
+		return;
+
+	if(m_DataSize+Size > m_DataCapacity)
+	{
+		int NewCapacity = max(m_DataCapacity*2, 64*1024);
+		while(NewCapacity < m_DataSize+Size)
+			NewCapacity *= 2;
+		unsigned char *pNewData = (unsigned char *)mem_alloc(NewCapacity, 1);
+		mem_copy(pNewData, m_pData, m_DataSize);
+		mem_free(m_pData);
+		m_pData = pNewData;
+		m_DataCapacity = NewCapacity;
+	}
+
+	CCheckpoint Checkpoint;
+	Checkpoint.m_Tick = Tick;
+	Checkpoint.m_NextTick = -1;
+	Checkpoint.m_Filepos = -1;
+	Checkpoint.m_DataOffset = m_DataSize;
+	Checkpoint.m_DataSize = Size;
+	m_lCheckpoints.add(Checkpoint);
+	mem_copy(m_pData+m_DataSize, m_aBuffer2, Size);
+	m_DataSize += Size;
+	m_Pending = true;
+}
+
+void CDemoIndex::FinishCheckpoint(int NextTick, int Filepos)
+{
+	if(!m_Pending)
+		return;
+	CCheckpoint *pCheckpoint = &m_lCheckpoints[m_lCheckpoints.size()-1];
+	pCheckpoint->m_NextTick = NextTick;
+	pCheckpoint->m_Filepos = Filepos;
+	m_Pending = false;
+}
+
+bool CDemoIndex::CheckpointPending() const
+{
+	return m_Pending;
+}
+
+int CDemoIndex::FindCheckpoint(int Tick) const
+{
+	// the last checkpoint is only finished by a following tick marker
+	int Num = m_lCheckpoints.size() - (m_Pending ? 1 : 0);
+	if(Num <= 0 || m_lCheckpoints[0].m_Tick > Tick)
+		return -1;
+
+	int Low = 0;
+	int High = Num-1;
+	while(Low < High)
+	{
+		int Mid = (Low+High+1)/2;
+		if(m_lCheckpoints[Mid].m_Tick <= Tick)
+			Low = Mid;
+		else
+			High = Mid-1;
+	}
+	return Low;
+}
+
+int CDemoIndex::GetCheckpointSnapshot(int Index, void *pSnapshot)
+{
+	const CCheckpoint *pCheckpoint = &m_lCheckpoints[Index];
+	int Size = CNetBase::Decompress(m_pData+pCheckpoint->m_DataOffset, pCheckpoint->m_DataSize, m_aBuffer, sizeof(m_aBuffer));
+	if(Size < 0)
+		return -1;
+	return CVariableInt::Decompress(m_aBuffer, Size, pSnapshot);
+}
+
+void CDemoIndex::GetFilename(const char *pDemoFilename, char *pBuf, int BufSize)
+{
+	str_format(pBuf, BufSize, "%s.idx", pDemoFilename);
+}
+
+bool CDemoIndex::Save(IStorage *pStorage, const char *pDemoFilename, const CDemoHeader *pHeader, int DemoSize, int FirstTick, int LastTick)
+{
+	// drop a checkpoint that never got its next tick
+	if(m_Pending)
+	{
+		m_lCheckpoints.remove_index(m_lCheckpoints.size()-1);
+		m_Pending = false;
+	}
+
+	char aFilename[512];
+	GetFilename(pDemoFilename, aFilename, sizeof(aFilename));
+	IOHANDLE File = pStorage->OpenFile(aFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+
+	CDemoIndexHeader Header;
+	mem_zero(&Header, sizeof(Header));
+	mem_copy(Header.m_aMarker, gs_aIndexMarker, sizeof(Header.m_aMarker));
+	Header.m_Version = gs_IndexVersion;
+	Header.m_DemoSize = DemoSize;
+	mem_copy(Header.m_aMapName, pHeader->m_aMapName, sizeof(Header.m_aMapName));
+	mem_copy(Header.m_aTimestamp, pHeader->m_aTimestamp, sizeof(Header.m_aTimestamp));
+	Header.m_FirstTick = FirstTick;
+	Header.m_LastTick = LastTick;
+	Header.m_NumKeyFrames = m_lKeyFrames.size();
+	Header.m_NumCheckpoints = m_lCheckpoints.size();
+	Header.m_DataSize = m_DataSize;
+
+	io_write(File, &Header, sizeof(Header));
+	io_write(File, m_lKeyFrames.base_ptr(), m_lKeyFrames.size()*sizeof(CKeyFrame));
+	io_write(File, m_lCheckpoints.base_ptr(), m_lCheckpoints.size()*sizeof(CCheckpoint));
+	io_write(File, m_pData, m_DataSize);
+	io_close(File);
+
+	m_FirstTick = FirstTick;
+	m_LastTick = LastTick;
+	return true;
+}
+
+bool CDemoIndex::Load(IStorage *pStorage, const char *pDemoFilename, const CDemoHeader *pHeader, int DemoSize)
+{
+	Reset();
+
+	char aFilename[512];
+	GetFilename(pDemoFilename, aFilename, sizeof(aFilename));
+	IOHANDLE File = pStorage->OpenFile(aFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+		return false;
+
+	// make sure the index belongs to this very demo
+	CDemoIndexHeader Header;
+	int FileSize = io_length(File);
+	if(io_read(File, &Header, sizeof(Header)) != sizeof(Header) ||
+		mem_comp(Header.m_aMarker, gs_aIndexMarker, sizeof(gs_aIndexMarker)) != 0 ||
+		Header.m_Version != gs_IndexVersion || Header.m_DemoSize != DemoSize ||
+		mem_comp(Header.m_aMapName, pHeader->m_aMapName, sizeof(Header.m_aMapName)) != 0 ||
+		mem_comp(Header.m_aTimestamp, pHeader->m_aTimestamp, sizeof(Header.m_aTimestamp)) != 0 ||
+		Header.m_NumKeyFrames <= 0 || Header.m_NumCheckpoints < 0 || Header.m_DataSize < 0 ||
+		FileSize != (int)sizeof(Header) + Header.m_NumKeyFrames*(int)sizeof(CKeyFrame) + Header.m_NumCheckpoints*(int)sizeof(CCheckpoint) + Header.m_DataSize)
+	{
+		io_close(File);
+		return false;
+	}
+
+	m_lKeyFrames.set_size(Header.m_NumKeyFrames);
+	m_lCheckpoints.set_size(Header.m_NumCheckpoints);
+	io_read(File, m_lKeyFrames.base_ptr(), Header.m_NumKeyFrames*sizeof(CKeyFrame));
+	io_read(File, m_lCheckpoints.base_ptr(), Header.m_NumCheckpoints*sizeof(CCheckpoint));
+	if(Header.m_DataSize > m_DataCapacity)
+	{
+		mem_free(m_pData);
+		m_pData = (unsigned char *)mem_alloc(Header.m_DataSize, 1);
+		m_DataCapacity = Header.m_DataSize;
+	}
+	io_read(File, m_pData, Header.m_DataSize);
+	io_close(File);
+
+	for(int i = 0; i < m_lCheckpoints.size(); i++)
+		if(m_lCheckpoints[i].m_DataOffset < 0 || m_lCheckpoints[i].m_DataSize < 0 ||
+			m_lCheckpoints[i].m_DataOffset+m_lCheckpoints[i].m_DataSize > Header.m_DataSize)
+		{
+			Reset();
+			return false;
+		}
+
+	m_DataSize = Header.m_DataSize;
+	m_FirstTick = Header.m_FirstTick;
+	m_LastTick = Header.m_LastTick;
+	return true;
+}
 
 
 CDemoRecorder::CDemoRecorder(class CSnapshotDelta *pSnapshotDelta)
 {
 	m_File = 0;
+	m_FirstTick = -1;
+	m_LastTick = -1;
 	m_LastTickMarker = -1;
 	m_pSnapshotDelta = pSnapshotDelta;
+
+	m_pWriterThread = 0;
+	m_QueueSignal = semaphore_create();
+	m_pQueue = 0;
+	m_QueueWrite = 0;
+	m_QueueRead = 0;
+	atomic_int_store(&m_QueueUsed, 0, ATOMIC_RELAXED);
+	atomic_int_store(&m_Written, 0, ATOMIC_RELAXED);
+	atomic_int_store(&m_Stopping, 0, ATOMIC_RELAXED);
+	m_Queued = 0;
+	m_MaxFrames = 0;
+	m_Dropped = 0;
+}
+
+CDemoRecorder::~CDemoRecorder()
+{
+	Stop();
+	semaphore_destroy(m_QueueSignal);
 }
 
 // Record
@@ -29,6 +271,7 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 		return -1;
 
 	m_pConsole = pConsole;
+	m_pStorage = pStorage;
 
 	// open mapfile
 	char aMapFilename[128];
@@ -99,14 +342,34 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 	}
 	io_close(MapFile);
 	
+	str_copy(m_aFilename, pFilename, sizeof(m_aFilename));
+	m_Header = Header;
+	m_Filepos = io_tell(DemoFile);
+	m_LastSnapshotSize = 0;
+	m_LastCheckpoint = -1;
+	m_Index.Reset();
+
 	m_LastKeyFrame = -1;
 	m_LastTickMarker = -1;
 	m_FirstTick = -1;
+	m_LastTick = -1;
+	m_OutputSize = 0;
+
+	m_pQueue = (unsigned char *)mem_alloc(QUEUE_SIZE, 4);
+	m_QueueWrite = 0;
+	m_QueueRead = 0;
+	atomic_int_store(&m_QueueUsed, 0, ATOMIC_RELAXED);
+	atomic_int_store(&m_Written, 0, ATOMIC_RELAXED);
+	atomic_int_store(&m_Stopping, 0, ATOMIC_RELAXED);
+	m_Queued = 0;
+	m_MaxFrames = 0;
+	m_Dropped = 0;
 	
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "Recording to '%s'", pFilename);
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
 	m_File = DemoFile;
+	m_pWriterThread = thread_create(WriterThread, this);
 
 	return 0;
 }
@@ -151,45 +414,42 @@ void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 		aChunk[4] = (Tick)&0xff;
 
 		if(Keyframe)
+		{
 			aChunk[0] |= CHUNKTICKFLAG_KEYFRAME;
+			m_Index.AddKeyFrame(m_Filepos, Tick);
+		}
 		
-		io_write(m_File, aChunk, sizeof(aChunk));
+		WriteOutput(aChunk, sizeof(aChunk));
 	}
 	else
 	{
 		unsigned char aChunk[1];
 		aChunk[0] = CHUNKTYPEFLAG_TICKMARKER | (Tick-m_LastTickMarker);
-		io_write(m_File, aChunk, sizeof(aChunk));
+		WriteOutput(aChunk, sizeof(aChunk));
 	}	
 
 	m_LastTickMarker = Tick;
-	if(m_FirstTick < 0)
-		m_FirstTick = Tick;
+	m_Index.FinishCheckpoint(Tick, m_Filepos);
 }
 
 void CDemoRecorder::Write(int Type, const void *pData, int Size)
 {
-	char aBuffer[64*1024];
-	char aBuffer2[64*1024];
 	unsigned char aChunk[3];
-	
-	if(!m_File)
-		return;
 
 	/* pad the data with 0 so we get an alignment of 4,
 	else the compression won't work and miss some bytes */
-	mem_copy(aBuffer2, pData, Size);
+	mem_copy(m_aBuffer2, pData, Size);
 	while(Size&3)
-		aBuffer2[Size++] = 0;
-	Size = CVariableInt::Compress(aBuffer2, Size, aBuffer); // buffer2 -> buffer
-	Size = CNetBase::Compress(aBuffer, Size, aBuffer2, sizeof(aBuffer2)); // buffer -> buffer2
+		m_aBuffer2[Size++] = 0;
+	Size = CVariableInt::Compress(m_aBuffer2, Size, m_aBuffer); // buffer2 -> buffer
+	Size = CNetBase::Compress(m_aBuffer, Size, m_aBuffer2, sizeof(m_aBuffer2)); // buffer -> buffer2
 	
 	
 	aChunk[0] = ((Type&0x3)<<5);
 	if(Size < 30)
 	{
 		aChunk[0] |= Size;
-		io_write(m_File, aChunk, 1);
+		WriteOutput(aChunk, 1);
 	}
 	else
 	{
@@ -197,22 +457,51 @@ void CDemoRecorder::Write(int Type, const void *pData, int Size)
 		{
 			aChunk[0] |= 30;
 			aChunk[1] = Size&0xff;
-			io_write(m_File, aChunk, 2);
+			WriteOutput(aChunk, 2);
 		}
 		else
 		{
 			aChunk[0] |= 31;
 			aChunk[1] = Size&0xff;
 			aChunk[2] = Size>>8;
-			io_write(m_File, aChunk, 3);
+			WriteOutput(aChunk, 3);
 		}
 	}
 	
-	io_write(m_File, aBuffer2, Size);
+	WriteOutput(m_aBuffer2, Size);
 }
 
-void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
+void CDemoRecorder::WriteOutput(const void *pData, int Size)
+{
+	m_Filepos += Size;
+	if(m_OutputSize+Size > OUTPUT_SIZE)
+		FlushOutput();
+	if(Size > OUTPUT_SIZE)
+	{
+		io_write(m_File, pData, Size);
+		return;
+	}
+	mem_copy(m_aOutput+m_OutputSize, pData, Size);
+	m_OutputSize += Size;
+}
+
+void CDemoRecorder::FlushOutput()
 {
+	if(m_OutputSize)
+		io_write(m_File, m_aOutput, m_OutputSize);
+	m_OutputSize = 0;
+}
+
+void CDemoRecorder::WriteFrame(const CQueueFrame *pFrame, const void *pData)
+{
+	if(pFrame->m_Type == CHUNKTYPE_MESSAGE)
+	{
+		Write(CHUNKTYPE_MESSAGE, pData, pFrame->m_Size);
+		return;
+	}
+
+	int Tick = pFrame->m_Tick;
+	int Size = pFrame->m_Size;
 	if(m_LastKeyFrame == -1 || (Tick-m_LastKeyFrame) > SERVER_TICK_SPEED*5)
 	{
 		// write full tickmarker
@@ -223,29 +512,133 @@ void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
 			
 		m_LastKeyFrame = Tick;
 		mem_copy(m_aLastSnapshotData, pData, Size);
+		m_LastSnapshotSize = Size;
 	}
 	else
 	{
-		// create delta, prepend tick
-		char aDeltaData[CSnapshot::MAX_SIZE+sizeof(int)];
-		int DeltaSize;
-
 		// write tickmarker
 		WriteTickMarker(Tick, 0);
 		
-		DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, &aDeltaData);
+		// create delta against the last snapshot that made it into the
+		// queue, dropped frames don't break the chain
+		int DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, &m_aDeltaData);
 		if(DeltaSize)
 		{
 			// record delta
-			Write(CHUNKTYPE_DELTA, aDeltaData, DeltaSize);
+			Write(CHUNKTYPE_DELTA, m_aDeltaData, DeltaSize);
 			mem_copy(m_aLastSnapshotData, pData, Size);
+			m_LastSnapshotSize = Size;
+		}
+	}
+
+	// the position is known once the next tick marker is written
+	if(m_LastCheckpoint == -1 || Tick-m_LastCheckpoint >= CDemoIndex::INTERVAL)
+	{
+		m_Index.AddCheckpoint(Tick, m_aLastSnapshotData, m_LastSnapshotSize);
+		m_LastCheckpoint = Tick;
+	}
+}
+
+void CDemoRecorder::WriterThread(void *pUser)
+{
+	CDemoRecorder *pSelf = (CDemoRecorder *)pUser;
+
+	// one signal per queued frame, and a last one on stop
+	while(1)
+	{
+		semaphore_wait(pSelf->m_QueueSignal);
+
+		// the fill level is raised once a frame is complete
+		if(!atomic_int_load(&pSelf->m_QueueUsed, ATOMIC_ACQUIRE))
+		{
+			if(atomic_int_load(&pSelf->m_Stopping, ATOMIC_ACQUIRE))
+				break;
+			continue;
 		}
+
+		// skip the padding at the end of the queue
+		int Left = QUEUE_SIZE-pSelf->m_QueueRead;
+		if(Left < (int)sizeof(CQueueFrame) || ((CQueueFrame *)(pSelf->m_pQueue+pSelf->m_QueueRead))->m_Type == -1)
+		{
+			pSelf->m_QueueRead = 0;
+			atomic_int_fetch_add(&pSelf->m_QueueUsed, -Left, ATOMIC_RELEASE);
+		}
+
+		// the game thread doesn't touch queued frames
+		const CQueueFrame *pFrame = (CQueueFrame *)(pSelf->m_pQueue+pSelf->m_QueueRead);
+		pSelf->WriteFrame(pFrame, pFrame+1);
+
+		int FrameSize = sizeof(CQueueFrame) + ((pFrame->m_Size+3)&~3);
+		pSelf->m_QueueRead += FrameSize;
+		atomic_int_fetch_add(&pSelf->m_Written, 1, ATOMIC_RELAXED);
+		atomic_int_fetch_add(&pSelf->m_QueueUsed, -FrameSize, ATOMIC_RELEASE);
+	}
+
+	pSelf->FlushOutput();
+}
+
+void CDemoRecorder::Queue(int Type, int Tick, const void *pData, int Size)
+{
+	if(!m_File)
+		return;
+
+	int FrameSize = sizeof(CQueueFrame) + ((Size+3)&~3);
+
+	// frames don't wrap, the rest of the queue is padding then
+	int Write = m_QueueWrite;
+	int Padding = 0;
+	if(QUEUE_SIZE-Write < FrameSize)
+		Padding = QUEUE_SIZE-Write;
+	if(atomic_int_load(&m_QueueUsed, ATOMIC_ACQUIRE)+Padding+FrameSize > QUEUE_SIZE)
+	{
+		// the writer can't keep up
+		m_Dropped++;
+		return;
 	}
+
+	// the writer doesn't look at the free part of the queue
+	if(Padding >= (int)sizeof(CQueueFrame))
+		((CQueueFrame *)(m_pQueue+Write))->m_Type = -1;
+	if(Padding)
+		Write = 0;
+	CQueueFrame *pFrame = (CQueueFrame *)(m_pQueue+Write);
+	pFrame->m_Type = Type;
+	pFrame->m_Tick = Tick;
+	pFrame->m_Size = Size;
+	mem_copy(pFrame+1, pData, Size);
+	m_QueueWrite = (Write+FrameSize)%QUEUE_SIZE;
+
+	atomic_int_fetch_add(&m_QueueUsed, Padding+FrameSize, ATOMIC_RELEASE);
+	m_Queued++;
+	m_MaxFrames = max(m_MaxFrames, m_Queued-atomic_int_load(&m_Written, ATOMIC_RELAXED));
+	semaphore_signal(m_QueueSignal);
+}
+
+void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
+{
+	if(!m_File)
+		return;
+
+	Queue(CHUNKTYPE_SNAPSHOT, Tick, pData, Size);
+
+	// the length counts dropped snapshots as well
+	m_LastTick = Tick;
+	if(m_FirstTick < 0)
+		m_FirstTick = Tick;
 }
 
 void CDemoRecorder::RecordMessage(const void *pData, int Size)
 {
-	Write(CHUNKTYPE_MESSAGE, pData, Size);
+	Queue(CHUNKTYPE_MESSAGE, -1, pData, Size);
+}
+
+void CDemoRecorder::GetQueueStats(CQueueStats *pStats)
+{
+	pStats->m_Written = atomic_int_load(&m_Written, ATOMIC_RELAXED);
+	pStats->m_Frames = m_Queued-pStats->m_Written;
+	pStats->m_MaxFrames = m_MaxFrames;
+	pStats->m_Bytes = atomic_int_load(&m_QueueUsed, ATOMIC_RELAXED);
+	pStats->m_Dropped = m_Dropped;
 }
 
 int CDemoRecorder::Stop()
@@ -253,6 +646,14 @@ int CDemoRecorder::Stop()
 	if(!m_File)
 		return -1;
 
+	// let the writer drain the queue
+	atomic_int_store(&m_Stopping, 1, ATOMIC_RELEASE);
+	semaphore_signal(m_QueueSignal);
+	thread_wait(m_pWriterThread);
+	m_pWriterThread = 0;
+	mem_free(m_pQueue);
+	m_pQueue = 0;
+
 	// add the demo length to the header
 	io_seek(m_File, gs_LengthOffset, IOSEEK_START);
 	int DemoLength = Length();
@@ -265,20 +666,91 @@ int CDemoRecorder::Stop()
 		
 	io_close(m_File);
 	m_File = 0;
-	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", "Stopped recording");
+
+	// write the seek index, it is matched to the demo by size and header
+	if(m_Index.NumKeyFrames())
+		m_Index.Save(m_pStorage, m_aFilename, &m_Header, m_Filepos, m_Index.GetKeyFrame(0)->m_Tick, m_LastTickMarker);
+	m_Index.Reset();
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "Stopped recording (%d frames written, %d dropped, max queue depth %d)", atomic_int_load(&m_Written, ATOMIC_RELAXED), m_Dropped, m_MaxFrames);
+	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
 
 	return 0;
 }
 
 
 
+CDemoPlayer::CDecodedTick::CDecodedTick()
+{
+	m_pData = 0;
+	m_DataCapacity = 0;
+	Clear();
+}
+
+CDemoPlayer::CDecodedTick::~CDecodedTick()
+{
+	mem_free(m_pData);
+}
+
+void CDemoPlayer::CDecodedTick::Clear()
+{
+	m_NextTick = -1;
+	m_Result = 0;
+	m_DataSize = 0;
+}
+
+char *CDemoPlayer::CDecodedTick::Reserve(int Size)
+{
+	int Needed = m_DataSize + sizeof(CEvent) + ((Size+3)&~3);
+	if(Needed > m_DataCapacity)
+	{
+		int NewCapacity = max(Needed, m_DataCapacity*2);
+		char *pNewData = (char *)mem_alloc(NewCapacity, 1);
+		if(m_DataSize)
+			mem_copy(pNewData, m_pData, m_DataSize);
+		mem_free(m_pData);
+		m_pData = pNewData;
+		m_DataCapacity = NewCapacity;
+	}
+	return m_pData + m_DataSize + sizeof(CEvent);
+}
+
+void CDemoPlayer::CDecodedTick::Add(int Type, int Size)
+{
+	// the caller reserved the space and wrote the data behind the event
+	CEvent *pEvent = (CEvent *)(m_pData + m_DataSize);
+	pEvent->m_Type = Type;
+	pEvent->m_Size = Size;
+	m_DataSize += sizeof(CEvent) + ((max(Size, 0)+3)&~3);
+}
+
+void CDemoPlayer::CDecodedTick::Add(int Type, const void *pData, int Size)
+{
+	mem_copy(Reserve(Size), pData, Size);
+	Add(Type, Size);
+}
+
 CDemoPlayer::CDemoPlayer(class CSnapshotDelta *pSnapshotDelta)
 {
 	m_File = 0;
+	m_pMapped = 0;
+	m_MappedSize = 0;
+	m_ReadPos = 0;
 	m_pKeyFrames = 0;
+	m_IndexLoaded = false;
+	m_BuildIndex = true;
+	m_pReadAheadThread = 0;
 
 	m_pSnapshotDelta = pSnapshotDelta;
 	m_LastSnapshotDataSize = -1;
+	m_DecodeTick = -1;
+}
+
+CDemoPlayer::~CDemoPlayer()
+{
+	StopReadAhead();
+	CloseFile();
 }
 
 void CDemoPlayer::SetListner(IListner *pListner)
@@ -286,6 +758,50 @@ void CDemoPlayer::SetListner(IListner *pListner)
 	m_pListner = pListner;
 }
 
+int CDemoPlayer::ReadData(void *pData, int Size)
+{
+	if(!m_pMapped)
+		return io_read(m_File, pData, Size);
+
+	Size = clamp(Size, 0, (int)(m_MappedSize-m_ReadPos));
+	mem_copy(pData, m_pMapped+m_ReadPos, Size);
+	m_ReadPos += Size;
+	return Size;
+}
+
+long CDemoPlayer::Tell() const
+{
+	if(!m_pMapped)
+		return io_tell(m_File);
+	return m_ReadPos;
+}
+
+void CDemoPlayer::Seek(long Pos)
+{
+	if(!m_pMapped)
+		io_seek(m_File, Pos, IOSEEK_START);
+	else
+		m_ReadPos = clamp(Pos, 0L, (long)m_MappedSize);
+}
+
+void CDemoPlayer::Skip(int Size)
+{
+	if(!m_pMapped)
+		io_skip(m_File, Size);
+	else
+		Seek(m_ReadPos+Size);
+}
+
+void CDemoPlayer::CloseFile()
+{
+	io_unmap(m_pMapped, m_MappedSize);
+	m_pMapped = 0;
+	m_MappedSize = 0;
+	m_ReadPos = 0;
+	if(m_File)
+		io_close(m_File);
+	m_File = 0;
+}
 
 int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 {
@@ -294,7 +810,7 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 	*pSize = 0;
 	*pType = 0;
 	
-	if(io_read(m_File, &Chunk, sizeof(Chunk)) != sizeof(Chunk))
+	if(ReadData(&Chunk, sizeof(Chunk)) != sizeof(Chunk))
 		return -1;
 		
 	if(Chunk&CHUNKTYPEFLAG_TICKMARKER)
@@ -306,7 +822,7 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 		if(Tickdelta == 0)
 		{
 			unsigned char aTickdata[4];
-			if(io_read(m_File, aTickdata, sizeof(aTickdata)) != sizeof(aTickdata))
+			if(ReadData(aTickdata, sizeof(aTickdata)) != sizeof(aTickdata))
 				return -1;
 			*pTick = (aTickdata[0]<<24) | (aTickdata[1]<<16) | (aTickdata[2]<<8) | aTickdata[3];
 		}
@@ -325,7 +841,7 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 		if(*pSize == 30)
 		{
 			unsigned char aSizedata[1];
-			if(io_read(m_File, aSizedata, sizeof(aSizedata)) != sizeof(aSizedata))
+			if(ReadData(aSizedata, sizeof(aSizedata)) != sizeof(aSizedata))
 				return -1;
 			*pSize = aSizedata[0];
 			
@@ -333,7 +849,7 @@ int CDemoPlayer::ReadChunkHeader(int *pType, int *pSize, int *pTick)
 		else if(*pSize == 31)
 		{
 			unsigned char aSizedata[2];
-			if(io_read(m_File, aSizedata, sizeof(aSizedata)) != sizeof(aSizedata))
+			if(ReadData(aSizedata, sizeof(aSizedata)) != sizeof(aSizedata))
 				return -1;
 			*pSize = (aSizedata[1]<<8) | aSizedata[0];
 		}
@@ -352,12 +868,12 @@ void CDemoPlayer::ScanFile()
 	int ChunkSize, ChunkType, ChunkTick = 0;
 	int i;
 
-	StartPos = io_tell(m_File);
+	StartPos = Tell();
 	m_Info.m_SeekablePoints = 0;
 
 	while(1)
 	{
-		long CurrentPos = io_tell(m_File);
+		long CurrentPos = Tell();
 		
 		if(ReadChunkHeader(&ChunkType, &ChunkSize, &ChunkTick))
 			break;
@@ -387,7 +903,7 @@ void CDemoPlayer::ScanFile()
 			m_Info.m_Info.m_LastTick = ChunkTick;
 		}
 		else if(ChunkSize)
-			io_skip(m_File, ChunkSize);
+			Skip(ChunkSize);
 			
 	}
 
@@ -397,92 +913,140 @@ void CDemoPlayer::ScanFile()
 		m_pKeyFrames[i] = pCurrentKey->m_Frame;
 		
 	// destroy the temporary heap and seek back to the start
-	io_seek(m_File, StartPos, IOSEEK_START);
+	Seek(StartPos);
 }
 
-void CDemoPlayer::DoTick()
+enum
+{
+	CHUNKERROR_READ=-1,
+	CHUNKERROR_NETWORK=-2,
+	CHUNKERROR_INTPACK=-3,
+};
+
+int CDemoPlayer::ReadChunkData(int Size, char *pData)
+{
+	const void *pCompressed = m_aCompressed;
+	if(m_pMapped)
+	{
+		// decompress straight from the mapping
+		if(Size > (int)(m_MappedSize-m_ReadPos))
+			return CHUNKERROR_READ;
+		pCompressed = m_pMapped+m_ReadPos;
+		m_ReadPos += Size;
+	}
+	else if(Size > (int)sizeof(m_aCompressed) || io_read(m_File, m_aCompressed, Size) != (unsigned)Size)
+		return CHUNKERROR_READ;
+
+	int DataSize = CNetBase::Decompress(pCompressed, Size, m_aDecompressed, sizeof(m_aDecompressed));
+	if(DataSize < 0)
+		return CHUNKERROR_NETWORK;
+
+	DataSize = CVariableInt::Decompress(m_aDecompressed, DataSize, pData);
+	if(DataSize < 0)
+		return CHUNKERROR_INTPACK;
+	return DataSize;
+}
+
+void CDemoPlayer::BuildIndex(IStorage *pStorage, int DemoSize)
+{
+	long StartPos = Tell();
+	int ChunkType, ChunkSize, ChunkTick = 0;
+	int LastSnapshotSize = -1;
+	int SnapshotTick = -1;
+	int LastCheckpoint = -1;
+
+	m_Index.Reset();
+	for(int i = 0; i < m_Info.m_SeekablePoints; i++)
+		m_Index.AddKeyFrame(m_pKeyFrames[i].m_Filepos, m_pKeyFrames[i].m_Tick);
+
+	// decode everything once, the same way DoTick does, and remember the
+	// state every CDemoIndex::INTERVAL ticks
+	while(!ReadChunkHeader(&ChunkType, &ChunkSize, &ChunkTick))
+	{
+		if(ChunkType&CHUNKTYPEFLAG_TICKMARKER)
+		{
+			m_Index.FinishCheckpoint(ChunkTick, Tell());
+			continue;
+		}
+
+		int DataSize = 0;
+		if(ChunkSize)
+		{
+			DataSize = ReadChunkData(ChunkSize, m_aChunkData);
+			if(DataSize < 0)
+				break;
+		}
+
+		if(ChunkType == CHUNKTYPE_DELTA)
+		{
+			DataSize = m_pSnapshotDelta->UnpackDeltaNoStats((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)m_aNewSnapshot, m_aChunkData, DataSize);
+			if(DataSize < 0)
+				continue;
+			mem_copy(m_aLastSnapshotData, m_aNewSnapshot, DataSize);
+		}
+		else if(ChunkType == CHUNKTYPE_SNAPSHOT)
+			mem_copy(m_aLastSnapshotData, m_aChunkData, DataSize);
+		else
+			continue;
+
+		LastSnapshotSize = DataSize;
+		SnapshotTick = ChunkTick;
+		if(LastCheckpoint == -1 || SnapshotTick-LastCheckpoint >= CDemoIndex::INTERVAL)
+		{
+			m_Index.AddCheckpoint(SnapshotTick, m_aLastSnapshotData, LastSnapshotSize);
+			LastCheckpoint = SnapshotTick;
+		}
+	}
+
+	m_Index.Save(pStorage, m_aFilename, &m_Info.m_Header, DemoSize, m_Info.m_Info.m_FirstTick, m_Info.m_Info.m_LastTick);
+	m_IndexLoaded = true;
+
+	Seek(StartPos);
+}
+
+void CDemoPlayer::DecodeTick(CDecodedTick *pTick)
 {
-	static char aCompresseddata[CSnapshot::MAX_SIZE];
-	static char aDecompressed[CSnapshot::MAX_SIZE];
-	static char aData[CSnapshot::MAX_SIZE];
-	int ChunkType, ChunkTick, ChunkSize;
+	int ChunkType, ChunkSize;
 	int DataSize = 0;
 	int GotSnapshot = 0;
 
-	// update ticks
-	m_Info.m_PreviousTick = m_Info.m_Info.m_CurrentTick;
-	m_Info.m_Info.m_CurrentTick = m_Info.m_NextTick;
-	ChunkTick = m_Info.m_Info.m_CurrentTick;
-
+	pTick->Clear();
 	while(1)
 	{
-		if(ReadChunkHeader(&ChunkType, &ChunkSize, &ChunkTick))
+		if(ReadChunkHeader(&ChunkType, &ChunkSize, &m_DecodeTick))
 		{
-			// stop on error or eof
-			m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "end of file");
-			if(m_Info.m_PreviousTick == -1)
-			{
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", "empty demo");
-				Stop();
-			}
-			else
-				Pause();
+			pTick->m_Result = DECODE_END;
 			break;
 		}
 		
 		// read the chunk
 		if(ChunkSize)
 		{
-			if(io_read(m_File, aCompresseddata, ChunkSize) != (unsigned)ChunkSize)
-			{
-				// stop on error or eof
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error reading chunk");
-				Stop();
-				break;
-			}
-			
-			DataSize = CNetBase::Decompress(aCompresseddata, ChunkSize, aDecompressed, sizeof(aDecompressed));
+			DataSize = ReadChunkData(ChunkSize, m_aChunkData);
 			if(DataSize < 0)
 			{
-				// stop on error or eof
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error during network decompression");
-				Stop();
-				break;
-			}
-			
-			DataSize = CVariableInt::Decompress(aDecompressed, DataSize, aData);
-
-			if(DataSize < 0)
-			{
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error during intpack decompression");
-				Stop();
+				pTick->m_Result = DataSize;
 				break;
 			}
 		}
 			
 		if(ChunkType == CHUNKTYPE_DELTA)
 		{
-			// process delta snapshot
-			static char aNewsnap[CSnapshot::MAX_SIZE];
+			// process delta snapshot, unpack it right into the tick
+			char *pNewsnap = pTick->Reserve(CSnapshot::MAX_SIZE);
 			
 			GotSnapshot = 1;
 			
-			DataSize = m_pSnapshotDelta->UnpackDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)aNewsnap, aData, DataSize);
+			DataSize = m_pSnapshotDelta->UnpackDeltaNoStats((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pNewsnap, m_aChunkData, DataSize);
 			
 			if(DataSize >= 0)
 			{
-				if(m_pListner)
-					m_pListner->OnDemoPlayerSnapshot(aNewsnap, DataSize);
-
 				m_LastSnapshotDataSize = DataSize;
-				mem_copy(m_aLastSnapshotData, aNewsnap, DataSize);
+				mem_copy(m_aLastSnapshotData, pNewsnap, DataSize);
+				pTick->Add(EVENT_SNAPSHOT, DataSize);
 			}
 			else
-			{
-				char aBuf[256];
-				str_format(aBuf, sizeof(aBuf), "error during unpacking of delta, err=%d", DataSize);
-				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", aBuf);
-			}
+				pTick->Add(EVENT_UNPACKERROR, DataSize);
 		}
 		else if(ChunkType == CHUNKTYPE_SNAPSHOT)
 		{
@@ -490,32 +1054,171 @@ void CDemoPlayer::DoTick()
 			GotSnapshot = 1;
 			
 			m_LastSnapshotDataSize = DataSize;
-			mem_copy(m_aLastSnapshotData, aData, DataSize);
-			if(m_pListner)
-				m_pListner->OnDemoPlayerSnapshot(aData, DataSize);
+			mem_copy(m_aLastSnapshotData, m_aChunkData, DataSize);
+			pTick->Add(EVENT_SNAPSHOT, m_aChunkData, DataSize);
 		}
 		else
 		{
 			// if there were no snapshots in this tick, replay the last one
-			if(!GotSnapshot && m_pListner && m_LastSnapshotDataSize != -1)
+			if(!GotSnapshot && m_LastSnapshotDataSize != -1)
 			{
 				GotSnapshot = 1;
-				m_pListner->OnDemoPlayerSnapshot(m_aLastSnapshotData, m_LastSnapshotDataSize);
+				pTick->Add(EVENT_SNAPSHOT, m_aLastSnapshotData, m_LastSnapshotDataSize);
 			}
 			
 			// check the remaining types
 			if(ChunkType&CHUNKTYPEFLAG_TICKMARKER)
 			{
-				m_Info.m_NextTick = ChunkTick;
+				pTick->m_NextTick = m_DecodeTick;
 				break;
 			}
 			else if(ChunkType == CHUNKTYPE_MESSAGE)
-			{
-				if(m_pListner)
-					m_pListner->OnDemoPlayerMessage(aData, DataSize);
-			}
+				pTick->Add(EVENT_MESSAGE, m_aChunkData, DataSize);
+		}
+	}
+}
+
+void CDemoPlayer::ReadAheadThread(void *pUser)
+{
+	CDemoPlayer *pThis = (CDemoPlayer *)pUser;
+
+	while(1)
+	{
+		semaphore_wait(pThis->m_ReadAheadFree);
+		if(atomic_int_load(&pThis->m_ReadAheadStop, ATOMIC_ACQUIRE))
+			break;
+
+		CDecodedTick *pTick = &pThis->m_aReadAhead[pThis->m_ReadAheadWrite];
+		pThis->DecodeTick(pTick);
+		int Result = pTick->m_Result;
+		pThis->m_ReadAheadWrite = (pThis->m_ReadAheadWrite+1)%READAHEAD_TICKS;
+		semaphore_signal(pThis->m_ReadAheadReady);
+
+		// nothing left to decode after the end of the file or an error
+		if(Result)
+			break;
+	}
+}
+
+void CDemoPlayer::StartReadAhead()
+{
+	if(m_pReadAheadThread || !IsPlaying())
+		return;
+
+	// continue decoding where DoTick would
+	m_DecodeTick = m_Info.m_NextTick;
+	atomic_int_store(&m_ReadAheadStop, 0, ATOMIC_RELAXED);
+	m_ReadAheadEnd = false;
+	m_ReadAheadRead = 0;
+	m_ReadAheadWrite = 0;
+	m_ReadAheadFree = semaphore_create();
+	m_ReadAheadReady = semaphore_create();
+	for(int i = 0; i < READAHEAD_TICKS; i++)
+		semaphore_signal(m_ReadAheadFree);
+	m_pReadAheadThread = thread_create(ReadAheadThread, this);
+}
+
+void CDemoPlayer::StopReadAhead()
+{
+	if(!m_pReadAheadThread)
+		return;
+
+	// the decoded ticks are dropped, the file position and the decoder
+	// state are ahead of the playback afterwards
+	atomic_int_store(&m_ReadAheadStop, 1, ATOMIC_RELEASE);
+	semaphore_signal(m_ReadAheadFree);
+	thread_wait(m_pReadAheadThread);
+	m_pReadAheadThread = 0;
+	semaphore_destroy(m_ReadAheadFree);
+	semaphore_destroy(m_ReadAheadReady);
+}
+
+CDemoPlayer::CDecodedTick *CDemoPlayer::NextReadAheadTick()
+{
+	if(m_ReadAheadEnd)
+	{
+		// the thread stopped at the end of the file, keep reporting that
+		m_DirectTick.Clear();
+		m_DirectTick.m_Result = DECODE_END;
+		return &m_DirectTick;
+	}
+
+	semaphore_wait(m_ReadAheadReady);
+	CDecodedTick *pTick = &m_aReadAhead[m_ReadAheadRead];
+	if(pTick->m_Result)
+		m_ReadAheadEnd = true;
+	return pTick;
+}
+
+void CDemoPlayer::DoTick()
+{
+	// update ticks
+	m_Info.m_PreviousTick = m_Info.m_Info.m_CurrentTick;
+	m_Info.m_Info.m_CurrentTick = m_Info.m_NextTick;
+
+	CDecodedTick *pTick;
+	if(m_pReadAheadThread)
+		pTick = NextReadAheadTick();
+	else
+	{
+		m_DecodeTick = m_Info.m_Info.m_CurrentTick;
+		DecodeTick(&m_DirectTick);
+		pTick = &m_DirectTick;
+	}
+
+	// hand the tick to the listener
+	for(int Offset = 0; Offset < pTick->m_DataSize; )
+	{
+		CDecodedTick::CEvent *pEvent = (CDecodedTick::CEvent *)(pTick->m_pData+Offset);
+		char *pData = (char *)(pEvent+1);
+		Offset += sizeof(CDecodedTick::CEvent) + ((max(pEvent->m_Size, 0)+3)&~3);
+
+		if(pEvent->m_Type == EVENT_UNPACKERROR)
+		{
+			char aBuf[256];
+			str_format(aBuf, sizeof(aBuf), "error during unpacking of delta, err=%d", pEvent->m_Size);
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", aBuf);
+		}
+		else if(m_pListner && pEvent->m_Type == EVENT_SNAPSHOT)
+			m_pListner->OnDemoPlayerSnapshot(pData, pEvent->m_Size);
+		else if(m_pListner && pEvent->m_Type == EVENT_MESSAGE)
+			m_pListner->OnDemoPlayerMessage(pData, pEvent->m_Size);
+	}
+
+	if(pTick->m_Result == 0)
+	{
+		m_Info.m_NextTick = pTick->m_NextTick;
+
+		// give the slot back to the read ahead thread
+		if(pTick != &m_DirectTick)
+		{
+			m_ReadAheadRead = (m_ReadAheadRead+1)%READAHEAD_TICKS;
+			semaphore_signal(m_ReadAheadFree);
 		}
 	}
+	else if(pTick->m_Result == DECODE_END)
+	{
+		// stop on error or eof
+		m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "end of file");
+		if(m_Info.m_PreviousTick == -1)
+		{
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", "empty demo");
+			Stop();
+		}
+		else
+			Pause();
+	}
+	else
+	{
+		// stop on error or eof
+		if(pTick->m_Result == CHUNKERROR_READ)
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error reading chunk");
+		else if(pTick->m_Result == CHUNKERROR_NETWORK)
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error during network decompression");
+		else
+			m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error during intpack decompression");
+		Stop();
+	}
 }
 
 void CDemoPlayer::Pause()
@@ -547,6 +1250,11 @@ int CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole, const
 	
 	// store the filename
 	str_copy(m_aFilename, pFilename, sizeof(m_aFilename));
+	int DemoSize = io_length(m_File);
+
+	// read straight from memory if the file can be mapped
+	m_pMapped = (unsigned char *)io_map(m_File, &m_MappedSize);
+	m_ReadPos = 0;
 
 	// clear the playback info
 	mem_zero(&m_Info, sizeof(m_Info));
@@ -560,14 +1268,13 @@ int CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole, const
 	m_LastSnapshotDataSize = -1;
 
 	// read the header
-	io_read(m_File, &m_Info.m_Header, sizeof(m_Info.m_Header));
+	ReadData(&m_Info.m_Header, sizeof(m_Info.m_Header));
 	if(mem_comp(m_Info.m_Header.m_aMarker, gs_aHeaderMarker, sizeof(gs_aHeaderMarker)) != 0)
 	{
 		char aBuf[256];
 		str_format(aBuf, sizeof(aBuf), "'%s' is not a demo file", pFilename);
 		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", aBuf);
-		io_close(m_File);
-		m_File = 0;
+		CloseFile();
 		return -1;
 	}
 
@@ -576,8 +1283,7 @@ int CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole, const
 		char aBuf[256];
 		str_format(aBuf, sizeof(aBuf), "demo version %d is not supported", m_Info.m_Header.m_Version);
 		m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", aBuf);
-		io_close(m_File);
-		m_File = 0;
+		CloseFile();
 		return -1;
 	}
 	
@@ -601,14 +1307,14 @@ int CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole, const
 		
 	if(MapFile)
 	{
-		io_skip(m_File, MapSize);
+		Skip(MapSize);
 		io_close(MapFile);
 	}
 	else if(MapSize > 0)
 	{
 		// get map data
 		unsigned char *pMapData = (unsigned char *)mem_alloc(MapSize, 1);
-		io_read(m_File, pMapData, MapSize);
+		ReadData(pMapData, MapSize);
 			
 		// save map
 		MapFile = pStorage->OpenFile(aMapFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
@@ -620,8 +1326,27 @@ int CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole, const
 	}
 	
 	
-	// scan the file for interessting points
-	ScanFile();
+	// use the seek index if there is an up to date one, otherwise scan
+	// the file for interessting points and write one for the next time
+	m_IndexLoaded = m_Index.Load(pStorage, pFilename, &m_Info.m_Header, DemoSize);
+	if(m_IndexLoaded)
+	{
+		m_Info.m_SeekablePoints = m_Index.NumKeyFrames();
+		m_pKeyFrames = (CKeyFrame*)mem_alloc(m_Info.m_SeekablePoints*sizeof(CKeyFrame), 1);
+		for(int i = 0; i < m_Info.m_SeekablePoints; i++)
+		{
+			m_pKeyFrames[i].m_Filepos = m_Index.GetKeyFrame(i)->m_Filepos;
+			m_pKeyFrames[i].m_Tick = m_Index.GetKeyFrame(i)->m_Tick;
+		}
+		m_Info.m_Info.m_FirstTick = m_Index.FirstTick();
+		m_Info.m_Info.m_LastTick = m_Index.LastTick();
+	}
+	else
+	{
+		ScanFile();
+		if(m_Info.m_SeekablePoints && m_BuildIndex)
+			BuildIndex(pStorage, DemoSize);
+	}
 	
 	// ready for playback
 	return 0;
@@ -644,6 +1369,9 @@ int CDemoPlayer::Play()
 	m_Info.start_time = time_get();*/
 	m_Info.m_CurrentTime = m_Info.m_PreviousTick*time_freq()/SERVER_TICK_SPEED;
 	m_Info.m_LastUpdate = time_get();
+
+	// decode the following ticks in the background
+	StartReadAhead();
 	return 0;
 }
 
@@ -653,6 +1381,9 @@ int CDemoPlayer::SetPos(float Percent)
 	int WantedTick;
 	if(!m_File)
 		return -1;
+
+	// the read ahead thread is past the current tick, restart it after seeking
+	StopReadAhead();
 	
 	// -5 because we have to have a current tick and previous tick when we do the playback
 	WantedTick = m_Info.m_Info.m_FirstTick + (int)((m_Info.m_Info.m_LastTick-m_Info.m_Info.m_FirstTick)*Percent) - 5;
@@ -670,13 +1401,35 @@ int CDemoPlayer::SetPos(float Percent)
 	while(Keyframe && m_pKeyFrames[Keyframe].m_Tick > WantedTick)
 		Keyframe--;
 	
-	// seek to the correct keyframe
-	io_seek(m_File, m_pKeyFrames[Keyframe].m_Filepos, IOSEEK_START);
+	// restore the closest indexed snapshot if it is newer than the
+	// keyframe, this saves replaying all the ticks in between
+	int Checkpoint = m_IndexLoaded ? m_Index.FindCheckpoint(WantedTick) : -1;
+	int SnapshotSize = -1;
+	if(Checkpoint != -1 && m_Index.GetCheckpoint(Checkpoint)->m_Tick > m_pKeyFrames[Keyframe].m_Tick)
+		SnapshotSize = m_Index.GetCheckpointSnapshot(Checkpoint, m_aLastSnapshotData);
 
-	//m_Info.start_tick = -1;
-	m_Info.m_NextTick = -1;
-	m_Info.m_Info.m_CurrentTick = -1;
-	m_Info.m_PreviousTick = -1;
+	if(SnapshotSize >= 0)
+	{
+		const CDemoIndex::CCheckpoint *pCheckpoint = m_Index.GetCheckpoint(Checkpoint);
+		Seek(pCheckpoint->m_Filepos);
+
+		m_LastSnapshotDataSize = SnapshotSize;
+		m_Info.m_NextTick = pCheckpoint->m_NextTick;
+		m_Info.m_Info.m_CurrentTick = pCheckpoint->m_Tick;
+		m_Info.m_PreviousTick = -1;
+		if(m_pListner)
+			m_pListner->OnDemoPlayerSnapshot(m_aLastSnapshotData, m_LastSnapshotDataSize);
+	}
+	else
+	{
+		// seek to the correct keyframe
+		Seek(m_pKeyFrames[Keyframe].m_Filepos);
+
+		//m_Info.start_tick = -1;
+		m_Info.m_NextTick = -1;
+		m_Info.m_Info.m_CurrentTick = -1;
+		m_Info.m_PreviousTick = -1;
+	}
 
 	// playback everything until we hit our tick
 	while(m_Info.m_PreviousTick < WantedTick)
@@ -752,10 +1505,12 @@ int CDemoPlayer::Stop()
 		return -1;
 		
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_player", "Stopped playback");
-	io_close(m_File);
-	m_File = 0;
+	StopReadAhead();
+	CloseFile();
 	mem_free(m_pKeyFrames);
 	m_pKeyFrames = 0;
+	m_Index.Reset();
+	m_IndexLoaded = false;
 	str_copy(m_aFilename, "", sizeof(m_aFilename));
 	return 0;
 }
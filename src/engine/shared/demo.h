@@ -3,26 +3,162 @@
 #ifndef ENGINE_SHARED_DEMO_H
 #define ENGINE_SHARED_DEMO_H
 
+#include <base/atomic.h>
+#include <base/tl/array.h>
+
 #include <engine/demo.h>
 #include <engine/shared/protocol.h>
 
 #include "snapshot.h"
 
+/*
+	Class: CDemoIndex
+		Seek index stored next to a demo as <demo>.idx. Holds the
+		keyframe positions and a decoded snapshot every INTERVAL ticks,
+		so loading a demo doesn't have to scan it and seeking doesn't
+		have to replay from the last keyframe.
+*/
+class CDemoIndex
+{
+public:
+	enum
+	{
+		INTERVAL=SERVER_TICK_SPEED,
+	};
+
+	struct CKeyFrame
+	{
+		int m_Filepos;
+		int m_Tick;
+	};
+
+	// playback state right after the snapshot of m_Tick was read
+	struct CCheckpoint
+	{
+		int m_Tick;
+		int m_NextTick;
+		int m_Filepos; // after the tick marker of m_NextTick
+		int m_DataOffset;
+		int m_DataSize;
+	};
+
+	CDemoIndex();
+	~CDemoIndex();
+
+	void Reset();
+	void AddKeyFrame(int Filepos, int Tick);
+	void AddCheckpoint(int Tick, const void *pSnapshot, int Size);
+	void FinishCheckpoint(int NextTick, int Filepos);
+	bool CheckpointPending() const;
+
+	// the index file that belongs to a demo, it has to be removed and
+	// renamed along with the demo
+	static void GetFilename(const char *pDemoFilename, char *pBuf, int BufSize);
+
+	bool Save(class IStorage *pStorage, const char *pDemoFilename, const CDemoHeader *pHeader, int DemoSize, int FirstTick, int LastTick);
+	bool Load(class IStorage *pStorage, const char *pDemoFilename, const CDemoHeader *pHeader, int DemoSize);
+
+	int FirstTick() const { return m_FirstTick; }
+	int LastTick() const { return m_LastTick; }
+	int NumKeyFrames() const { return m_lKeyFrames.size(); }
+	const CKeyFrame *GetKeyFrame(int Index) const { return &m_lKeyFrames[Index]; }
+
+	// returns the last checkpoint at or before Tick, or -1
+	int FindCheckpoint(int Tick) const;
+	const CCheckpoint *GetCheckpoint(int Index) const { return &m_lCheckpoints[Index]; }
+	// returns the snapshot size, or -1 if it couldn't be decoded
+	int GetCheckpointSnapshot(int Index, void *pSnapshot);
+
+private:
+	char m_aBuffer[CSnapshot::MAX_SIZE];
+	char m_aBuffer2[CSnapshot::MAX_SIZE];
+
+	array<CKeyFrame> m_lKeyFrames;
+	array<CCheckpoint> m_lCheckpoints;
+	unsigned char *m_pData;
+	int m_DataSize;
+	int m_DataCapacity;
+	int m_FirstTick;
+	int m_LastTick;
+	bool m_Pending;
+};
+
 class CDemoRecorder : public IDemoRecorder
 {
+public:
+	struct CQueueStats
+	{
+		int m_Frames; // frames waiting for the writer
+		int m_MaxFrames;
+		int m_Bytes;
+		int m_Written;
+		int m_Dropped;
+	};
+
+private:
+	enum
+	{
+		QUEUE_SIZE=1024*1024,
+		OUTPUT_SIZE=64*1024,
+	};
+
+	// frame in the queue, followed by the raw data padded to 4 bytes
+	struct CQueueFrame
+	{
+		int m_Type; // -1 pads to the end of the queue
+		int m_Tick;
+		int m_Size;
+	};
+
 	class IConsole *m_pConsole;
+	class IStorage *m_pStorage;
 	IOHANDLE m_File;
+	char m_aFilename[256];
+	CDemoHeader m_Header;
+	int m_FirstTick;
+	int m_LastTick;
+
+	// the writer thread does the deltas, compression and file io. the
+	// queue has one producer and one consumer, they only share the fill
+	// level and the number of written frames
+	void *m_pWriterThread;
+	SEMAPHORE m_QueueSignal;
+	unsigned char *m_pQueue;
+	int m_QueueWrite; // game thread
+	int m_QueueRead; // writer thread
+	ATOMIC_INT m_QueueUsed;
+	ATOMIC_INT m_Written;
+	ATOMIC_INT m_Stopping;
+	int m_Queued;
+	int m_MaxFrames;
+	int m_Dropped;
+
+	// only touched by the writer thread
 	int m_LastTickMarker;
 	int m_LastKeyFrame;
-	int m_FirstTick;
 	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
+	char m_aDeltaData[CSnapshot::MAX_SIZE+sizeof(int)];
+	char m_aBuffer[64*1024];
+	char m_aBuffer2[64*1024];
+	unsigned char m_aOutput[OUTPUT_SIZE];
+	int m_OutputSize;
+	int m_Filepos;
+	int m_LastSnapshotSize;
+	int m_LastCheckpoint;
+	CDemoIndex m_Index;
 	class CSnapshotDelta *m_pSnapshotDelta;
-	
+
+	void Queue(int Type, int Tick, const void *pData, int Size);
+	static void WriterThread(void *pUser);
+	void WriteFrame(const CQueueFrame *pFrame, const void *pData);
 	void WriteTickMarker(int Tick, int Keyframe);
 	void Write(int Type, const void *pData, int Size);
+	void WriteOutput(const void *pData, int Size);
+	void FlushOutput();
 public:
 	CDemoRecorder(class CSnapshotDelta *pSnapshotDelta);
-	
+	~CDemoRecorder();
+
 	int Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetversion, const char *pMap, unsigned MapCrc, const char *pType);
 	int Stop();
 
@@ -31,7 +167,9 @@ public:
 
 	bool IsRecording() const { return m_File != 0; }
 
-	int Length() const { return (m_LastTickMarker - m_FirstTick)/SERVER_TICK_SPEED; }
+	int Length() const { return (m_LastTick - m_FirstTick)/SERVER_TICK_SPEED; }
+
+	void GetQueueStats(CQueueStats *pStats);
 };
 
 class CDemoPlayer : public IDemoPlayer
@@ -80,25 +218,104 @@ private:
 		CKeyFrameSearch *m_pNext;
 	};	
 
+	/*
+		Class: CDecodedTick
+			Everything DoTick has to hand to the listener for one tick,
+			decoded ahead of time. The events are stored back to back as a
+			CEvent followed by the data padded to 4 bytes.
+	*/
+	class CDecodedTick
+	{
+	public:
+		struct CEvent
+		{
+			int m_Type;
+			int m_Size; // error code for EVENT_UNPACKERROR
+		};
+
+		int m_NextTick;
+		int m_Result;
+		char *m_pData;
+		int m_DataSize;
+		int m_DataCapacity;
+
+		CDecodedTick();
+		~CDecodedTick();
+
+		void Clear();
+		char *Reserve(int Size);
+		void Add(int Type, int Size);
+		void Add(int Type, const void *pData, int Size);
+	};
+
+	enum
+	{
+		READAHEAD_TICKS=64,
+
+		EVENT_SNAPSHOT=0,
+		EVENT_MESSAGE,
+		EVENT_UNPACKERROR,
+
+		DECODE_END=1,
+	};
+
 	class IConsole *m_pConsole;
 	IOHANDLE m_File;
+	unsigned char *m_pMapped;
+	unsigned m_MappedSize;
+	long m_ReadPos;
 	char m_aFilename[256];
 	CKeyFrame *m_pKeyFrames;
+	CDemoIndex m_Index;
+	bool m_IndexLoaded;
+	bool m_BuildIndex;
 
 	CPlaybackInfo m_Info;
 	int m_DemoType;
+	class CSnapshotDelta *m_pSnapshotDelta;
+
+	// decoder state, only used by the read ahead thread while it runs
 	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
 	int m_LastSnapshotDataSize;
-	class CSnapshotDelta *m_pSnapshotDelta;
+	int m_DecodeTick;
+	char m_aChunkData[CSnapshot::MAX_SIZE];
+	char m_aDecompressed[CSnapshot::MAX_SIZE];
+	char m_aCompressed[CSnapshot::MAX_SIZE];
+	char m_aNewSnapshot[CSnapshot::MAX_SIZE];
+
+	// ring of decoded ticks, filled by the read ahead thread
+	CDecodedTick m_aReadAhead[READAHEAD_TICKS];
+	CDecodedTick m_DirectTick;
+	void *m_pReadAheadThread;
+	SEMAPHORE m_ReadAheadFree;
+	SEMAPHORE m_ReadAheadReady;
+	ATOMIC_INT m_ReadAheadStop;
+	bool m_ReadAheadEnd;
+	int m_ReadAheadRead;
+	int m_ReadAheadWrite;
+
+	int ReadData(void *pData, int Size);
+	long Tell() const;
+	void Seek(long Pos);
+	void Skip(int Size);
+	void CloseFile();
 
 	int ReadChunkHeader(int *pType, int *pSize, int *pTick);
+	int ReadChunkData(int Size, char *pData);
+	void DecodeTick(CDecodedTick *pTick);
 	void DoTick();
 	void ScanFile();
-	int NextFrame();
+	void BuildIndex(class IStorage *pStorage, int DemoSize);
+
+	static void ReadAheadThread(void *pUser);
+	void StartReadAhead();
+	void StopReadAhead();
+	CDecodedTick *NextReadAheadTick();
 
 public:
 	
 	CDemoPlayer(class CSnapshotDelta *m_pSnapshotDelta);
+	~CDemoPlayer();
 	
 	void SetListner(IListner *pListner);
 		
@@ -115,6 +332,23 @@ public:
 	int GetDemoType() const;
 	
 	int Update();
+
+	/*
+		Function: NextFrame
+			Hands the next tick to the listener right away, for tools that
+			go through a demo as fast as possible instead of using Update.
+
+		Returns:
+			Non zero while the demo is still loaded.
+	*/
+	int NextFrame();
+
+	/*
+		Function: SetBuildIndex
+			Sets whether Load writes a seek index for demos that don't have
+			one yet. On by default.
+	*/
+	void SetBuildIndex(bool Build) { m_BuildIndex = Build; }
 	
 	const CPlaybackInfo *Info() const { return &m_Info; }
 	int IsPlaying() const { return m_File != 0; }
@@ -1,6 +1,7 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 
+#include <base/math.h>
 #include <base/system.h>
 
 #include <engine/console.h>
@@ -74,7 +75,8 @@ public:
 		net_init();
 		CNetBase::Init();
 	
-		m_JobPool.Init(1);
+		// one worker per spare cpu, maps get decompressed on these
+		m_JobPool.Init(max(thread_num_cpus()-1, 1));
 
 		m_Logging = false;
 	}
@@ -1,75 +1,315 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include "jobs.h"
 
 CJobPool::CJobPool()
 {
-	// empty the pool
+	// empty the pool, there is always one queue so jobs can be added
+	// and waited for without any workers
+	m_NumQueues = 1;
+	m_aQueues[0].m_Lock = lock_create();
+	m_aQueues[0].m_pFirst = 0;
+	m_aQueues[0].m_pLast = 0;
+	m_NumThreads = 0;
+
 	m_Lock = lock_create();
-	m_pFirstJob = 0;
-	m_pLastJob = 0;
+	m_Work = semaphore_create();
+	m_NextQueue = 0;
+	m_pFirstWaiter = 0;
+	atomic_int_store(&m_Shutdown, 0, ATOMIC_RELAXED);
 }
 
-void CJobPool::WorkerThread(void *pUser)
+CJobPool::~CJobPool()
 {
-	CJobPool *pPool = (CJobPool *)pUser;
-	
-	while(1)
+	// jobs that are still queued are dropped
+	atomic_int_store(&m_Shutdown, 1, ATOMIC_RELEASE);
+	for(int i = 0; i < m_NumThreads; i++)
+		semaphore_signal(m_Work);
+	for(int i = 0; i < m_NumThreads; i++)
+		thread_wait(m_aWorkers[i].m_pThread);
+
+	for(int i = 0; i < m_NumQueues; i++)
+		lock_destroy(m_aQueues[i].m_Lock);
+	lock_destroy(m_Lock);
+	semaphore_destroy(m_Work);
+}
+
+void CJobPool::Queue(CJob *pJob)
+{
+	lock_wait(m_Lock);
+	int Index = m_NextQueue;
+	m_NextQueue = (m_NextQueue+1)%m_NumQueues;
+	lock_release(m_Lock);
+
+	CQueue *pQueue = &m_aQueues[Index];
+	lock_wait(pQueue->m_Lock);
+	pJob->m_pPrev = pQueue->m_pLast;
+	pJob->m_pNext = 0;
+	if(pQueue->m_pLast)
+		pQueue->m_pLast->m_pNext = pJob;
+	else
+		pQueue->m_pFirst = pJob;
+	pQueue->m_pLast = pJob;
+	atomic_int_store(&pJob->m_Queue, Index, ATOMIC_RELAXED);
+	lock_release(pQueue->m_Lock);
+
+	semaphore_signal(m_Work);
+}
+
+bool CJobPool::Take(CJob *pJob)
+{
+	// the queue can change until its lock is held
+	int Index = atomic_int_load(&pJob->m_Queue, ATOMIC_RELAXED);
+	if(Index < 0)
+		return false;
+
+	CQueue *pQueue = &m_aQueues[Index];
+	lock_wait(pQueue->m_Lock);
+	bool Taken = atomic_int_load(&pJob->m_Queue, ATOMIC_RELAXED) == Index;
+	if(Taken)
+	{
+		if(pJob->m_pPrev)
+			pJob->m_pPrev->m_pNext = pJob->m_pNext;
+		else
+			pQueue->m_pFirst = pJob->m_pNext;
+		if(pJob->m_pNext)
+			pJob->m_pNext->m_pPrev = pJob->m_pPrev;
+		else
+			pQueue->m_pLast = pJob->m_pPrev;
+		atomic_int_store(&pJob->m_Queue, -1, ATOMIC_RELAXED);
+		atomic_int_store(&pJob->m_Status, CJob::STATE_RUNNING, ATOMIC_RELAXED);
+	}
+	lock_release(pQueue->m_Lock);
+	return Taken;
+}
+
+CJob *CJobPool::Fetch(int Queue)
+{
+	CJob *pJob = 0;
+
+	// oldest job of the own queue
+	CQueue *pQueue = &m_aQueues[Queue];
+	lock_wait(pQueue->m_Lock);
+	if(pQueue->m_pFirst)
 	{
-		CJob *pJob = 0;
-		
-		// fetch job from queue
-		lock_wait(pPool->m_Lock);
-		if(pPool->m_pFirstJob)
+		pJob = pQueue->m_pFirst;
+		pQueue->m_pFirst = pJob->m_pNext;
+		if(pQueue->m_pFirst)
+			pQueue->m_pFirst->m_pPrev = 0;
+		else
+			pQueue->m_pLast = 0;
+		atomic_int_store(&pJob->m_Queue, -1, ATOMIC_RELAXED);
+		atomic_int_store(&pJob->m_Status, CJob::STATE_RUNNING, ATOMIC_RELAXED);
+	}
+	lock_release(pQueue->m_Lock);
+	if(pJob)
+		return pJob;
+
+	// steal the newest one of another queue, starting with the next one
+	for(int i = 1; i < m_NumQueues && !pJob; i++)
+	{
+		CQueue *pVictim = &m_aQueues[(Queue+i)%m_NumQueues];
+		lock_wait(pVictim->m_Lock);
+		if(pVictim->m_pLast)
 		{
-			pJob = pPool->m_pFirstJob;
-			pPool->m_pFirstJob = pPool->m_pFirstJob->m_pNext;
-			if(pPool->m_pFirstJob)
-				pPool->m_pFirstJob->m_pPrev = 0;
+			pJob = pVictim->m_pLast;
+			pVictim->m_pLast = pJob->m_pPrev;
+			if(pVictim->m_pLast)
+				pVictim->m_pLast->m_pNext = 0;
 			else
-				pPool->m_pLastJob = 0;
+				pVictim->m_pFirst = 0;
+			atomic_int_store(&pJob->m_Queue, -1, ATOMIC_RELAXED);
+			atomic_int_store(&pJob->m_Status, CJob::STATE_RUNNING, ATOMIC_RELAXED);
 		}
-		lock_release(pPool->m_Lock);
-		
-		// do the job if we have one
-		if(pJob)
+		lock_release(pVictim->m_Lock);
+	}
+	return pJob;
+}
+
+CJob *CJobPool::FetchDependency(CJob *pJob)
+{
+	// a queued job is a dependency when its chain of continuations
+	// leads to the job, the jobs on the chain are all still pending
+	for(int i = 0; i < m_NumQueues; i++)
+	{
+		CQueue *pQueue = &m_aQueues[i];
+		lock_wait(pQueue->m_Lock);
+		for(CJob *pCandidate = pQueue->m_pFirst; pCandidate; pCandidate = pCandidate->m_pNext)
+		{
+			CJob *pContinuation = pCandidate->m_pContinuation;
+			while(pContinuation && pContinuation != pJob)
+				pContinuation = pContinuation->m_pContinuation;
+			if(!pContinuation)
+				continue;
+
+			if(pCandidate->m_pPrev)
+				pCandidate->m_pPrev->m_pNext = pCandidate->m_pNext;
+			else
+				pQueue->m_pFirst = pCandidate->m_pNext;
+			if(pCandidate->m_pNext)
+				pCandidate->m_pNext->m_pPrev = pCandidate->m_pPrev;
+			else
+				pQueue->m_pLast = pCandidate->m_pPrev;
+			atomic_int_store(&pCandidate->m_Queue, -1, ATOMIC_RELAXED);
+			atomic_int_store(&pCandidate->m_Status, CJob::STATE_RUNNING, ATOMIC_RELAXED);
+			lock_release(pQueue->m_Lock);
+			return pCandidate;
+		}
+		lock_release(pQueue->m_Lock);
+	}
+	return 0;
+}
+
+void CJobPool::Run(CJob *pJob)
+{
+	int Result = pJob->m_pfnFunc(pJob->m_pFuncData);
+
+	// the job can be gone as soon as it is marked as done
+	CJob *pContinuation = pJob->m_pContinuation;
+	bool Ready = false;
+
+	lock_wait(m_Lock);
+	pJob->m_Result = Result;
+	atomic_int_store(&pJob->m_Status, CJob::STATE_DONE, ATOMIC_RELEASE);
+	for(CWaiter **ppWaiter = &m_pFirstWaiter; *ppWaiter;)
+	{
+		CWaiter *pWaiter = *ppWaiter;
+		if(pWaiter->m_pJob == pJob)
 		{
-			pJob->m_Status = CJob::STATE_RUNNING;
-			pJob->m_Result = pJob->m_pfnFunc(pJob->m_pFuncData);
-			pJob->m_Status = CJob::STATE_DONE;
+			*ppWaiter = pWaiter->m_pNext;
+			semaphore_signal(pWaiter->m_Done);
 		}
 		else
-			thread_sleep(10);
+			ppWaiter = &pWaiter->m_pNext;
+	}
+	if(pContinuation)
+		Ready = --pContinuation->m_NumDependencies == 0;
+	lock_release(m_Lock);
+
+	if(Ready)
+		Queue(pContinuation);
+}
+
+void CJobPool::WorkerThread(void *pUser)
+{
+	CWorker *pWorker = (CWorker *)pUser;
+	CJobPool *pPool = pWorker->m_pPool;
+
+	while(!atomic_int_load(&pPool->m_Shutdown, ATOMIC_ACQUIRE))
+	{
+		CJob *pJob = pPool->Fetch(pWorker->m_Index);
+		if(pJob)
+			pPool->Run(pJob);
+		else
+			semaphore_wait(pPool->m_Work);
 	}
-	
 }
 
 int CJobPool::Init(int NumThreads)
 {
+	dbg_assert(m_NumThreads == 0, "job pool already started");
+	NumThreads = clamp(NumThreads, 0, (int)MAX_THREADS);
+
+	// one queue per worker
+	for(int i = m_NumQueues; i < NumThreads; i++)
+	{
+		m_aQueues[i].m_Lock = lock_create();
+		m_aQueues[i].m_pFirst = 0;
+		m_aQueues[i].m_pLast = 0;
+	}
+	m_NumQueues = max(NumThreads, 1);
+
 	// start threads
 	for(int i = 0; i < NumThreads; i++)
-		thread_create(WorkerThread, this);
+	{
+		m_aWorkers[i].m_pPool = this;
+		m_aWorkers[i].m_Index = i;
+		m_aWorkers[i].m_pThread = thread_create(WorkerThread, &m_aWorkers[i]);
+	}
+	m_NumThreads = NumThreads;
 	return 0;
 }
 
-int CJobPool::Add(CJob *pJob, JOBFUNC pfnFunc, void *pData)
+void CJobPool::Prepare(CJob *pJob, JOBFUNC pfnFunc, void *pData, CJob *pContinuation)
 {
 	mem_zero(pJob, sizeof(CJob));
+	pJob->m_pPool = this;
+	atomic_int_store(&pJob->m_Queue, -1, ATOMIC_RELAXED);
+	atomic_int_store(&pJob->m_Status, CJob::STATE_PENDING, ATOMIC_RELAXED);
 	pJob->m_pfnFunc = pfnFunc;
 	pJob->m_pFuncData = pData;
-	
+	pJob->m_NumDependencies = 1; // held until it is released
+	pJob->m_pContinuation = pContinuation;
+
+	if(pContinuation)
+	{
+		lock_wait(m_Lock);
+		dbg_assert(pContinuation->m_NumDependencies > 0, "continuation is already queued");
+		pContinuation->m_NumDependencies++;
+		lock_release(m_Lock);
+	}
+}
+
+void CJobPool::Release(CJob *pJob)
+{
 	lock_wait(m_Lock);
-	
-	// add job to queue
-	pJob->m_pPrev = m_pLastJob;
-	if(m_pLastJob)
-		m_pLastJob->m_pNext = pJob;
-	m_pLastJob = pJob;
-	if(!m_pFirstJob)
-		m_pFirstJob = pJob;
-	
+	bool Ready = --pJob->m_NumDependencies == 0;
 	lock_release(m_Lock);
+
+	if(Ready)
+		Queue(pJob);
+}
+
+int CJobPool::Add(CJob *pJob, JOBFUNC pfnFunc, void *pData, CJob *pContinuation)
+{
+	Prepare(pJob, pfnFunc, pData, pContinuation);
+	Release(pJob);
 	return 0;
 }
 
+int CJobPool::Wait(CJob *pJob)
+{
+	while(1)
+	{
+		// do it here if no worker got to it yet
+		if(Take(pJob))
+		{
+			Run(pJob);
+			return pJob->m_Result;
+		}
+
+		lock_wait(m_Lock);
+		if(atomic_int_load(&pJob->m_Status, ATOMIC_RELAXED) == CJob::STATE_DONE)
+		{
+			lock_release(m_Lock);
+			return pJob->m_Result;
+		}
+		lock_release(m_Lock);
+
+		// only the jobs it waits for, others can block for long (lookups, loading sounds)
+		CJob *pDependency = FetchDependency(pJob);
+		if(!pDependency)
+			break;
+		Run(pDependency);
+	}
+
+	lock_wait(m_Lock);
+	if(atomic_int_load(&pJob->m_Status, ATOMIC_RELAXED) == CJob::STATE_DONE)
+	{
+		lock_release(m_Lock);
+		return pJob->m_Result;
+	}
+
+	CWaiter Waiter;
+	Waiter.m_pJob = pJob;
+	Waiter.m_Done = semaphore_create();
+	Waiter.m_pNext = m_pFirstWaiter;
+	m_pFirstWaiter = &Waiter;
+	lock_release(m_Lock);
+
+	semaphore_wait(Waiter.m_Done);
+	semaphore_destroy(Waiter.m_Done);
+	return pJob->m_Result;
+}
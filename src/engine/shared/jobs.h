@@ -2,10 +2,18 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #ifndef ENGINE_SHARED_JOBS_H
 #define ENGINE_SHARED_JOBS_H
+#include <base/atomic.h>
+
 typedef int (*JOBFUNC)(void *pData);
 
 class CJobPool;
 
+/*
+	Class: CJob
+		A unit of work for the <CJobPool>. The job doubles as its own
+		future, <CJobPool::Wait> blocks until it is done and returns the
+		result. The memory has to stay valid until the job is done.
+*/
 class CJob
 {
 	friend class CJobPool;
@@ -13,16 +21,22 @@ class CJob
 	CJobPool *m_pPool;
 	CJob *m_pPrev;
 	CJob *m_pNext;
+	ATOMIC_INT m_Queue; // queue the job sits in, -1 if it isn't queued
 	
-	volatile int m_Status;
-	volatile int m_Result;
+	ATOMIC_INT m_Status; // the result is published by setting this to done
+	int m_Result;
 	
 	JOBFUNC m_pfnFunc;
 	void *m_pFuncData;
+
+	// the job gets queued once this reaches zero
+	int m_NumDependencies;
+	CJob *m_pContinuation;
 public:
 	CJob()
 	{
-		m_Status = STATE_DONE;
+		atomic_int_store(&m_Queue, -1, ATOMIC_RELAXED);
+		atomic_int_store(&m_Status, STATE_DONE, ATOMIC_RELAXED);
 		m_pFuncData = 0;
 	}
 	
@@ -33,22 +47,118 @@ public:
 		STATE_DONE
 	};
 	
-	int Status() const { return m_Status; }
+	int Status() const { return atomic_int_load(&m_Status, ATOMIC_ACQUIRE); }
 	int Result() const {return m_Result; }
 };
 
+/*
+	Class: CJobPool
+		Runs jobs on a set of worker threads. Every worker has its own
+		queue, new jobs are handed out to the queues in turn. A worker
+		takes the oldest job of its own queue and steals the newest one
+		of another queue once its own runs dry. Idle workers sleep on a
+		semaphore.
+
+		A job can have a continuation, a job that is queued once all the
+		jobs it continues are done:
+
+		(start code)
+		Pool.Prepare(&Merge, MergeFunc, pData);
+		Pool.Add(&aParts[0], PartFunc, &aData[0], &Merge);
+		Pool.Add(&aParts[1], PartFunc, &aData[1], &Merge);
+		Pool.Release(&Merge);
+		Pool.Wait(&Merge);
+		(end code)
+*/
 class CJobPool
 {
-	LOCK m_Lock;
-	CJob *m_pFirstJob;
-	CJob *m_pLastJob;
+	enum
+	{
+		MAX_THREADS=64,
+	};
+
+	struct CQueue
+	{
+		LOCK m_Lock;
+		CJob *m_pFirst;
+		CJob *m_pLast;
+	};
+
+	struct CWorker
+	{
+		CJobPool *m_pPool;
+		int m_Index;
+		void *m_pThread;
+	};
+
+	struct CWaiter
+	{
+		CJob *m_pJob;
+		SEMAPHORE m_Done;
+		CWaiter *m_pNext;
+	};
+
+	CQueue m_aQueues[MAX_THREADS];
+	int m_NumQueues;
+	CWorker m_aWorkers[MAX_THREADS];
+	int m_NumThreads;
+
+	LOCK m_Lock; // dependencies, waiters and the next queue
+	SEMAPHORE m_Work; // signaled for every job that is queued
+	int m_NextQueue;
+	CWaiter *m_pFirstWaiter;
+	ATOMIC_INT m_Shutdown;
 	
+	void Queue(CJob *pJob);
+	bool Take(CJob *pJob);
+	CJob *Fetch(int Queue);
+	CJob *FetchDependency(CJob *pJob);
+	void Run(CJob *pJob);
 	static void WorkerThread(void *pUser);
 	
 public:
 	CJobPool();
+	~CJobPool();
 	
 	int Init(int NumThreads);
-	int Add(CJob *pJob, JOBFUNC pfnFunc, void *pData);
+
+	/*
+		Function: Prepare
+			Sets up a job without queueing it. Jobs can be added with
+			this one as their continuation until it is released.
+
+		Arguments:
+			pJob - Job to set up.
+			pfnFunc - Function that does the work.
+			pData - Passed to the function.
+			pContinuation - Prepared job that waits for this one, or 0.
+	*/
+	void Prepare(CJob *pJob, JOBFUNC pfnFunc, void *pData, CJob *pContinuation=0);
+
+	/*
+		Function: Release
+			Queues a prepared job once all jobs it continues are done.
+	*/
+	void Release(CJob *pJob);
+
+	int Add(CJob *pJob, JOBFUNC pfnFunc, void *pData, CJob *pContinuation=0);
+
+	/*
+		Function: Wait
+			Waits until a job is done. A job that no worker took yet is
+			run on the calling thread, so are the queued jobs it waits
+			for through its continuations. Other jobs are left to the
+			workers, the thread blocks instead.
+
+		Returns:
+			The result of the job.
+
+		Remarks:
+			Jobs shouldn't wait for prepared jobs, use a continuation
+			instead. Every worker could end up waiting otherwise.
+	*/
+	int Wait(CJob *pJob);
+
+	int NumThreads() const { return m_NumThreads; }
 };
 #endif
@@ -1,6 +1,7 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <base/system.h>
+#include <engine/engine.h>
 #include <engine/map.h>
 #include <engine/storage.h>
 #include "datafile.h"
@@ -29,7 +30,9 @@ public:
 		IStorage *pStorage = Kernel()->RequestInterface<IStorage>();
 		if(!pStorage)
 			return false;
-		return m_DataFile.Open(pStorage, pMapName, IStorage::TYPE_ALL);
+		// everything gets used, so unpack it all up front
+		IEngine *pEngine = Kernel()->RequestInterface<IEngine>();
+		return m_DataFile.Open(pStorage, pMapName, IStorage::TYPE_ALL, CDataFileReader::OPENFLAG_PRELOAD, pEngine ? pEngine->JobPool() : 0);
 	}
 	
 	virtual bool IsLoaded()
@@ -41,6 +44,26 @@ public:
 	{
 		return m_DataFile.Crc();
 	}
+
+	virtual void Replace(CDataFileReader *pDataFile)
+	{
+		m_DataFile.Swap(pDataFile);
+	}
+
+	virtual const unsigned char *FileData()
+	{
+		return m_DataFile.FileData();
+	}
+
+	virtual unsigned FileSize()
+	{
+		return m_DataFile.FileSize();
+	}
+
+	virtual unsigned PeakMemoryUsage()
+	{
+		return m_DataFile.PeakMemoryUsage();
+	}
 };
 
 extern IEngineMap *CreateEngineMap() { return new CMap; }
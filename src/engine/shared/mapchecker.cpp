@@ -3,11 +3,8 @@
 #include <base/math.h>
 #include <base/system.h>
 
-#include <engine/storage.h>
-
 #include <versionsrv/versionsrv.h>
 
-#include "datafile.h"
 #include "memheap.h"
 #include "mapchecker.h"
 
@@ -62,13 +59,8 @@ bool CMapChecker::IsMapValid(const char *pMapName, unsigned MapCrc, unsigned Map
 	return StandardMap?false:true;
 }
 
-bool CMapChecker::ReadAndValidateMap(IStorage *pStorage, const char *pFilename, int StorageType)
+bool CMapChecker::IsMapFileValid(const char *pFilename, unsigned MapCrc, unsigned MapSize)
 {
-	bool LoadedMapInfo = false;
-	bool StandardMap = false;
-	unsigned MapCrc = 0;
-	unsigned MapSize = 0;
-
 	// extract map name
 	char aMapName[MAX_MAP_LENGTH];
 	const char *pExtractedName = pFilename;
@@ -86,21 +78,5 @@ bool CMapChecker::ReadAndValidateMap(IStorage *pStorage, const char *pFilename,
 	str_copy(aMapName, pExtractedName, min((int)MAX_MAP_LENGTH, (int)(pEnd-pExtractedName+1)));
 
 	// check for valid map
-	for(CWhitelistEntry *pCurrent = m_pFirst; pCurrent; pCurrent = pCurrent->m_pNext)
-	{
-		if(str_comp(pCurrent->m_aMapName, aMapName) == 0)
-		{
-			StandardMap = true;
-			if(!LoadedMapInfo)
-			{
-				if(!CDataFileReader::GetCrcSize(pStorage, pFilename, StorageType, &MapCrc, &MapSize))
-					return true;
-				LoadedMapInfo = true;
-			}
-
-			if(pCurrent->m_MapCrc == MapCrc && pCurrent->m_MapSize == MapSize)
-				return true;
-		}
-	}
-	return StandardMap?false:true;
+	return IsMapValid(aMapName, MapCrc, MapSize);
 }
@@ -32,7 +32,7 @@ public:
 	CMapChecker();
 	void AddMaplist(class CMapVersion *pMaplist, int Num);
 	bool IsMapValid(const char *pMapName, unsigned MapCrc, unsigned MapSize);
-	bool ReadAndValidateMap(class IStorage *pStorage, const char *pFilename, int StorageType);
+	bool IsMapFileValid(const char *pFilename, unsigned MapCrc, unsigned MapSize);
 };
 
 #endif
@@ -0,0 +1,96 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <stdio.h>	// sscanf
+
+#include <base/system.h>
+
+#include <engine/storage.h>
+
+#include "linereader.h"
+#include "mapmanifest.h"
+
+CMapManifest::CMapManifest()
+{
+	Clear();
+}
+
+void CMapManifest::Clear()
+{
+	m_Heap.Reset();
+	m_pFirst = 0;
+	m_pLast = 0;
+	m_Num = 0;
+}
+
+void CMapManifest::Add(const char *pName, unsigned Crc, unsigned Size, bool Valid)
+{
+	CEntry *pEntry = (CEntry *)m_Heap.Allocate(sizeof(CEntry));
+	str_copy(pEntry->m_aName, pName, sizeof(pEntry->m_aName));
+	pEntry->m_Crc = Crc;
+	pEntry->m_Size = Size;
+	pEntry->m_Valid = Valid;
+	pEntry->m_pNext = 0;
+
+	// keep the order of the file
+	if(m_pLast)
+		m_pLast->m_pNext = pEntry;
+	else
+		m_pFirst = pEntry;
+	m_pLast = pEntry;
+	m_Num++;
+}
+
+const CMapManifest::CEntry *CMapManifest::Find(const char *pName) const
+{
+	for(const CEntry *pEntry = m_pFirst; pEntry; pEntry = pEntry->m_pNext)
+	{
+		if(str_comp(pEntry->m_aName, pName) == 0)
+			return pEntry;
+	}
+	return 0;
+}
+
+bool CMapManifest::Load(IStorage *pStorage, const char *pFilename, int StorageType)
+{
+	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_READ, StorageType);
+	if(!File)
+		return false;
+
+	Clear();
+
+	CLineReader LineReader;
+	LineReader.Init(File);
+	while(const char *pLine = LineReader.Get())
+	{
+		if(pLine[0] == '#')
+			continue;
+
+		// the name is the rest of the line
+		unsigned Crc, Size;
+		int Valid, NameStart = 0;
+		if(sscanf(pLine, "%x %u %d %n", &Crc, &Size, &Valid, &NameStart) >= 3 && NameStart && pLine[NameStart])
+			Add(pLine+NameStart, Crc, Size, Valid != 0);
+	}
+
+	io_close(File);
+	return true;
+}
+
+bool CMapManifest::Save(IStorage *pStorage, const char *pFilename)
+{
+	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+
+	char aBuf[256];
+	str_copy(aBuf, "# crc size valid name\n", sizeof(aBuf));
+	io_write(File, aBuf, str_length(aBuf));
+	for(const CEntry *pEntry = m_pFirst; pEntry; pEntry = pEntry->m_pNext)
+	{
+		str_format(aBuf, sizeof(aBuf), "%08x %u %d %s\n", pEntry->m_Crc, pEntry->m_Size, pEntry->m_Valid, pEntry->m_aName);
+		io_write(File, aBuf, str_length(aBuf));
+	}
+
+	io_close(File);
+	return true;
+}
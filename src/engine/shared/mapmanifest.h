@@ -0,0 +1,49 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_MAPMANIFEST_H
+#define ENGINE_SHARED_MAPMANIFEST_H
+
+#include "memheap.h"
+
+/*
+	Class: CMapManifest
+		Name, CRC, size and validity of a folder of maps, as written by
+		the map_batch tool. Lets the server know about its maps without
+		opening them.
+
+		The file has one map per line, "<crc> <size> <valid> <name>"
+		with the CRC in hex. Lines starting with # are ignored.
+*/
+class CMapManifest
+{
+public:
+	class CEntry
+	{
+	public:
+		char m_aName[128];
+		unsigned m_Crc;
+		unsigned m_Size;
+		bool m_Valid;
+		CEntry *m_pNext;
+	};
+
+private:
+	class CHeap m_Heap;
+	CEntry *m_pFirst;
+	CEntry *m_pLast;
+	int m_Num;
+
+public:
+	CMapManifest();
+
+	void Clear();
+	void Add(const char *pName, unsigned Crc, unsigned Size, bool Valid);
+	const CEntry *Find(const char *pName) const;
+	const CEntry *First() const { return m_pFirst; }
+	int Num() const { return m_Num; }
+
+	bool Load(class IStorage *pStorage, const char *pFilename, int StorageType);
+	bool Save(class IStorage *pStorage, const char *pFilename);
+};
+
+#endif
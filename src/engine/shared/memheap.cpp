@@ -6,40 +6,64 @@
 static const int CHUNK_SIZE = 1024*64;
 
 // allocates a new chunk to be used
-void CHeap::NewChunk()
+void CHeap::NewChunk(unsigned MinSize)
 {
 	CChunk *pChunk;
 	char *pMem;
-	
+
+	// reuse a rewound chunk if one is large enough
+	for(CChunk **ppChunk = &m_pFree; *ppChunk; ppChunk = &(*ppChunk)->m_pNext)
+	{
+		pChunk = *ppChunk;
+		if((unsigned)(pChunk->m_pEnd-pChunk->m_pMemory) >= MinSize)
+		{
+			*ppChunk = pChunk->m_pNext;
+			pChunk->m_pCurrent = pChunk->m_pMemory;
+			pChunk->m_pNext = m_pCurrent;
+			m_pCurrent = pChunk;
+			return;
+		}
+	}
+
 	// allocate memory
-	pMem = (char*)mem_alloc(sizeof(CChunk)+CHUNK_SIZE, 1);
+	unsigned Size = MinSize > (unsigned)CHUNK_SIZE ? MinSize : (unsigned)CHUNK_SIZE;
+	pMem = (char*)mem_alloc(sizeof(CChunk)+Size, 1);
 	if(!pMem)
 		return;
+	m_Size += Size;
 
 	// the chunk structure is located in the begining of the chunk
 	// init it and return the chunk
 	pChunk = (CChunk*)pMem;
 	pChunk->m_pMemory = (char*)(pChunk+1);
 	pChunk->m_pCurrent = pChunk->m_pMemory;
-	pChunk->m_pEnd = pChunk->m_pMemory + CHUNK_SIZE;
+	pChunk->m_pEnd = pChunk->m_pMemory + Size;
 	pChunk->m_pNext = (CChunk *)0x0;
 
 	pChunk->m_pNext = m_pCurrent;
-	m_pCurrent = pChunk;	
+	m_pCurrent = pChunk;
 }
 
 //****************
-void *CHeap::AllocateFromChunk(unsigned int Size)
+void *CHeap::AllocateFromChunk(unsigned int Size, unsigned Alignment)
 {
 	char *pMem;
-	
-	// check if we need can fit the allocation
-	if(m_pCurrent->m_pCurrent + Size > m_pCurrent->m_pEnd)
+
+	if(!m_pCurrent)
+		return (void*)0x0;
+
+	// check if we need can fit the allocation, the chunk memory itself
+	// is aligned like any mem_alloc block
+	unsigned Offset = m_pCurrent->m_pCurrent-m_pCurrent->m_pMemory;
+	pMem = m_pCurrent->m_pMemory + ((Offset+Alignment-1)&~(Alignment-1));
+	if(pMem + Size > m_pCurrent->m_pEnd)
 		return (void*)0x0;
 
 	// get memory and move the pointer forward
-	pMem = m_pCurrent->m_pCurrent;
-	m_pCurrent->m_pCurrent += Size;
+	m_Used += (pMem+Size)-m_pCurrent->m_pCurrent;
+	if(m_Used > m_PeakUsed)
+		m_PeakUsed = m_Used;
+	m_pCurrent->m_pCurrent = pMem+Size;
 	return pMem;
 }
 
@@ -47,6 +71,10 @@ void *CHeap::AllocateFromChunk(unsigned int Size)
 CHeap::CHeap()
 {
 	m_pCurrent = 0x0;
+	m_pFree = 0x0;
+	m_Used = 0;
+	m_PeakUsed = 0;
+	m_Size = 0;
 	Reset();
 }
 
@@ -58,40 +86,91 @@ CHeap::~CHeap()
 void CHeap::Reset()
 {
 	Clear();
-	NewChunk();
+	NewChunk(CHUNK_SIZE);
 }
 
 // destroys the heap
 void CHeap::Clear()
 {
+	Rewind();
+
 	CChunk *pChunk = m_pCurrent;
 	CChunk *pNext;
-	
+
 	while(pChunk)
 	{
 		pNext = pChunk->m_pNext;
 		mem_free(pChunk);
 		pChunk = pNext;
 	}
-	
+	for(pChunk = m_pFree; pChunk; pChunk = pNext)
+	{
+		pNext = pChunk->m_pNext;
+		mem_free(pChunk);
+	}
+
 	m_pCurrent = 0x0;
+	m_pFree = 0x0;
+	m_Size = 0;
 }
 
 //
-void *CHeap::Allocate(unsigned Size)
+void *CHeap::Allocate(unsigned Size, unsigned Alignment)
 {
 	char *pMem;
 
 	// try to allocate from current chunk
-	pMem = (char *)AllocateFromChunk(Size);
+	pMem = (char *)AllocateFromChunk(Size, Alignment);
 	if(!pMem)
 	{
 		// allocate new chunk and add it to the heap
-		NewChunk();
-		
+		NewChunk(Size+Alignment-1);
+
 		// try to allocate again
-		pMem = (char *)AllocateFromChunk(Size);
+		pMem = (char *)AllocateFromChunk(Size, Alignment);
 	}
-	
+
 	return pMem;
 }
+
+CHeap::CMarker CHeap::Marker() const
+{
+	CMarker Marker;
+	Marker.m_pChunk = m_pCurrent;
+	Marker.m_pCurrent = m_pCurrent ? m_pCurrent->m_pCurrent : 0;
+	Marker.m_Used = m_Used;
+	return Marker;
+}
+
+void CHeap::Rewind(const CMarker &Marker)
+{
+	// chunks that were started after the marker go to the free list
+	while(m_pCurrent && m_pCurrent != Marker.m_pChunk)
+	{
+		CChunk *pChunk = m_pCurrent;
+		m_pCurrent = pChunk->m_pNext;
+		pChunk->m_pNext = m_pFree;
+		m_pFree = pChunk;
+	}
+
+	if(m_pCurrent)
+		m_pCurrent->m_pCurrent = Marker.m_pCurrent;
+	m_Used = Marker.m_Used;
+}
+
+void CHeap::Rewind()
+{
+	if(!m_pCurrent)
+		return;
+
+	// keep the first chunk in use
+	CChunk *pFirst = m_pCurrent;
+	while(pFirst->m_pNext)
+		pFirst = pFirst->m_pNext;
+
+	CMarker Marker;
+	Marker.m_pChunk = pFirst;
+	Marker.m_pCurrent = pFirst->m_pMemory;
+	Marker.m_Used = 0;
+	Rewind(Marker);
+}
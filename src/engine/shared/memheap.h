@@ -2,6 +2,15 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #ifndef ENGINE_SHARED_MEMHEAP_H
 #define ENGINE_SHARED_MEMHEAP_H
+
+/*
+	Class: CHeap
+		Linear allocator. Memory is taken from chunks front to back and
+		only given back all at once, or down to a marker. Chunks that
+		are rewound stay around for the next allocations, so a heap
+		that is rewound every frame stops allocating once it has seen
+		its largest frame.
+*/
 class CHeap
 {
 	struct CChunk
@@ -11,24 +20,79 @@ class CHeap
 		char *m_pEnd;
 		CChunk *m_pNext;
 	};
-	
+
 	enum
 	{
 		// how large each chunk should be
 		CHUNK_SIZE = 1025*64,
 	};
-	
+
 	CChunk *m_pCurrent;
-	
-	
+	CChunk *m_pFree; // rewound chunks
+	unsigned m_Used;
+	unsigned m_PeakUsed;
+	unsigned m_Size;
+
 	void Clear();
-	void NewChunk();
-	void *AllocateFromChunk(unsigned int Size);
-	
+	void NewChunk(unsigned MinSize);
+	void *AllocateFromChunk(unsigned int Size, unsigned Alignment);
+
 public:
+	class CMarker
+	{
+		friend class CHeap;
+		CChunk *m_pChunk;
+		char *m_pCurrent;
+		unsigned m_Used;
+	};
+
+	/*
+		Class: CHeap::CScope
+			Rewinds the heap to where it was when the scope was entered.
+	*/
+	class CScope
+	{
+		CHeap *m_pHeap;
+		CMarker m_Marker;
+	public:
+		CScope(CHeap *pHeap) : m_pHeap(pHeap), m_Marker(pHeap->Marker()) {}
+		~CScope() { m_pHeap->Rewind(m_Marker); }
+	};
+
 	CHeap();
 	~CHeap();
+
+	/*
+		Function: Reset
+			Frees all memory, the chunks included.
+	*/
 	void Reset();
-	void *Allocate(unsigned Size);
+
+	/*
+		Function: Allocate
+			Allocates a block. Blocks larger than a chunk get a chunk
+			of their own.
+
+		Arguments:
+			Size - Size of the block.
+			Alignment - Alignment of the block, a power of two up to 8.
+	*/
+	void *Allocate(unsigned Size, unsigned Alignment=1);
+
+	CMarker Marker() const;
+
+	/*
+		Function: Rewind
+			Frees everything that was allocated after the marker was
+			taken. Without a marker everything is freed. The chunks are
+			kept for later allocations.
+	*/
+	void Rewind(const CMarker &Marker);
+	void Rewind();
+
+	unsigned Used() const { return m_Used; }
+	unsigned PeakUsed() const { return m_PeakUsed; }
+	unsigned Size() const { return m_Size; } // all chunks, the rewound ones included
+	void ResetPeak() { m_PeakUsed = m_Used; }
 };
 #endif
@@ -5,6 +5,7 @@
 
 #include "ringbuffer.h"
 #include "huffman.h"
+#include "protocol.h"
 
 /*
 
@@ -48,7 +49,7 @@ enum
 	NET_MAX_PAYLOAD = NET_MAX_PACKETSIZE-6,
 	NET_MAX_CHUNKHEADERSIZE = 5,
 	NET_PACKETHEADERSIZE = 3,
-	NET_MAX_CLIENTS = 16,
+	NET_MAX_CLIENTS = MAX_CLIENTS,
 	NET_MAX_SEQUENCE = 1<<10,
 	NET_SEQUENCE_MASK = NET_MAX_SEQUENCE-1,
 
@@ -143,6 +144,7 @@ private:
 	int m_RemoteClosed;
 	
 	TStaticRingBuffer<CNetChunkResend, NET_CONN_BUFFERSIZE> m_Buffer;
+	int m_BufferedSize; // bytes in m_Buffer waiting for an ack
 	
 	int64 m_LastUpdateTime;
 	int64 m_LastRecvTime;
@@ -190,6 +192,7 @@ public:
 	int64 LastRecvTime() const { return m_LastRecvTime; }
 	
 	int AckSequence() const { return m_Ack; }
+	int BufferedSize() const { return m_BufferedSize; }
 };
 
 struct CNetRecvUnpacker
@@ -284,6 +287,7 @@ public:
 
 	// status requests
 	NETADDR ClientAddr(int ClientID) const { return m_aSlots[ClientID].m_Connection.PeerAddress(); }
+	int ClientBufferedSize(int ClientID) const { return m_aSlots[ClientID].m_Connection.BufferedSize(); }
 	NETSOCKET Socket() const { return m_Socket; }
 	int MaxClients() const { return m_MaxClients; }
 
@@ -323,6 +327,8 @@ public:
 	int State();
 	int GotProblems();
 	const char *ErrorString();
+
+	NETSOCKET Socket() const { return m_Socket; }
 };
 
 
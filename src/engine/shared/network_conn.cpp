@@ -23,6 +23,7 @@ void CNetConnection::Reset()
 	mem_zero(&m_PeerAddr, sizeof(m_PeerAddr));
 	
 	m_Buffer.Init();
+	m_BufferedSize = 0;
 	
 	mem_zero(&m_Construct, sizeof(m_Construct));
 }
@@ -55,7 +56,10 @@ void CNetConnection::AckChunks(int Ack)
 			break;
 		
 		if(CNetBase::IsSeqInBackroom(pResend->m_Sequence, Ack))
+		{
+			m_BufferedSize -= sizeof(CNetChunkResend)+pResend->m_DataSize;
 			m_Buffer.PopFirst();
+		}
 		else
 			break;
 	}
@@ -121,6 +125,7 @@ int CNetConnection::QueueChunkEx(int Flags, int DataSize, const void *pData, int
 			pResend->m_FirstSendTime = time_get();
 			pResend->m_LastSendTime = pResend->m_FirstSendTime;
 			mem_copy(pResend->m_pData, pData, DataSize);
+			m_BufferedSize += sizeof(CNetChunkResend)+DataSize;
 		}
 		else
 		{
@@ -13,6 +13,13 @@
 		
 	Client <- MAP <- Server
 		Contains current map.
+		
+	Client -> REQUEST_MAP_DATA -> Server
+		Only if the client doesn't have the map. Asks for one chunk,
+		or for a window of chunks if the server sent a window size
+		with the map. The server streams windows as fast as the
+		connection allows and the client asks for the next window
+		before the current one is done.
 	
 	Client -> READY -> Server
 		The client has loaded the map and is ready to go,
@@ -79,6 +86,12 @@ enum
 	MAX_INPUT_SIZE=128,
 	MAX_SNAPSHOT_PACKSIZE=900,
 
+	// map download, a window is the number of chunks a client has
+	// requested but not received yet. a full window has to fit into
+	// half of the resend buffer of the connection
+	MAP_CHUNK_SIZE=1024-128,
+	MAP_MAX_WINDOW=16,
+
 	MAX_NAME_LENGTH=16,
 	MAX_CLAN_LENGTH=12,
 
@@ -117,19 +117,22 @@ static int DiffItem(int *pPast, int *pCurrent, int *pOut, int Size)
 	return Needed;
 }
 
-void CSnapshotDelta::UndiffItem(int *pPast, int *pDiff, int *pOut, int Size)
+void CSnapshotDelta::UndiffItem(int *pPast, int *pDiff, int *pOut, int Size, int *pDataRate)
 {
 	while(Size)
 	{
 		*pOut = *pPast+*pDiff;
 		
-		if(*pDiff == 0)
-			m_aSnapshotDataRate[m_SnapshotCurrent] += 1;
-		else
+		if(pDataRate)
 		{
-			unsigned char aBuf[16];
-			unsigned char *pEnd = CVariableInt::Pack(aBuf,  *pDiff);
-			m_aSnapshotDataRate[m_SnapshotCurrent] += (int)(pEnd - (unsigned char*)aBuf) * 8;
+			if(*pDiff == 0)
+				*pDataRate += 1;
+			else
+			{
+				unsigned char aBuf[16];
+				unsigned char *pEnd = CVariableInt::Pack(aBuf,  *pDiff);
+				*pDataRate += (int)(pEnd - (unsigned char*)aBuf) * 8;
+			}
 		}
 		
 		pOut++;
@@ -276,6 +279,16 @@ static int RangeCheck(void *pEnd, void *pPtr, int Size)
 }
 
 int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData, int DataSize)
+{
+	return Unpack(pFrom, pTo, pSrcData, DataSize, true);
+}
+
+int CSnapshotDelta::UnpackDeltaNoStats(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData, int DataSize)
+{
+	return Unpack(pFrom, pTo, pSrcData, DataSize, false);
+}
+
+int CSnapshotDelta::Unpack(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData, int DataSize, bool CountStats)
 {
 	CSnapshotBuilder Builder;
 	CData *pDelta = (CData *)pSrcData;
@@ -338,7 +351,8 @@ int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData
 				return -2;
 			ItemSize = (*pData++) * 4;
 		}
-		m_SnapshotCurrent = Type;
+		if(CountStats)
+			m_SnapshotCurrent = Type;
 		
 		if(RangeCheck(pEnd, pData, ItemSize) || ItemSize < 0) return -3;
 		
@@ -355,14 +369,19 @@ int CSnapshotDelta::UnpackDelta(CSnapshot *pFrom, CSnapshot *pTo, void *pSrcData
 		if(FromIndex != -1)
 		{
 			// we got an update so we need pTo apply the diff
-			UndiffItem((int *)pFrom->GetItem(FromIndex)->Data(), pData, pNewData, ItemSize/4);
-			m_aSnapshotDataUpdates[m_SnapshotCurrent]++;
+			UndiffItem((int *)pFrom->GetItem(FromIndex)->Data(), pData, pNewData, ItemSize/4,
+				CountStats ? &m_aSnapshotDataRate[Type] : 0);
+			if(CountStats)
+				m_aSnapshotDataUpdates[Type]++;
 		}
 		else // no previous, just copy the pData
 		{
 			mem_copy(pNewData, pData, ItemSize);
-			m_aSnapshotDataRate[m_SnapshotCurrent] += ItemSize*8;
-			m_aSnapshotDataUpdates[m_SnapshotCurrent]++;
+			if(CountStats)
+			{
+				m_aSnapshotDataRate[Type] += ItemSize*8;
+				m_aSnapshotDataUpdates[Type]++;
+			}
 		}
 			
 		pData += ItemSize/4;
@@ -31,7 +31,8 @@ class CSnapshot
 public:
 	enum
 	{
-		MAX_SIZE=64*1024
+		MAX_SIZE=64*1024,
+		MAX_PARTS=32, // the received parts of a snapshot are tracked in a 32 bit mask
 	};
 
 	void Clear() { m_DataSize = 0; m_NumItems = 0; }
@@ -67,7 +68,8 @@ private:
 	int m_SnapshotCurrent;
 	CData m_Empty;
 
-	void UndiffItem(int *pPast, int *pDiff, int *pOut, int Size);
+	void UndiffItem(int *pPast, int *pDiff, int *pOut, int Size, int *pDataRate);
+	int Unpack(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData, int DataSize, bool CountStats);
 
 public:
 	CSnapshotDelta();
@@ -77,6 +79,9 @@ public:
 	CData *EmptyDelta();
 	int CreateDelta(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData);
 	int UnpackDelta(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData, int DataSize);
+	// doesn't count the data rates, only reads the item sizes so it can
+	// run on another thread than the owner of the delta
+	int UnpackDeltaNoStats(class CSnapshot *pFrom, class CSnapshot *pTo, void *pData, int DataSize);
 };
 
 
@@ -3,6 +3,7 @@
 #include <base/system.h>
 #include <engine/storage.h>
 #include "linereader.h"
+#include "memheap.h"
 
 // compiled-in data-dir path
 #define DATA_DIR "data"
@@ -21,6 +22,69 @@ public:
 	char m_aDatadir[MAX_PATH_LENGTH];
 	char m_aUserdir[MAX_PATH_LENGTH];
 	char m_aCurrentdir[MAX_PATH_LENGTH];
+
+	// index of the files below the search paths
+	class CIndexEntry
+	{
+	public:
+		CIndexEntry *m_pNextPath;
+		CIndexEntry *m_pNextName;
+		unsigned m_PathHash;
+		unsigned m_NameHash;
+		int m_TypeMask; // search paths that have the file
+		char *m_pPath; // relative to the search path
+		const char *m_pName; // file name part of m_pPath
+	};
+
+	enum
+	{
+		INDEX_HASH_SIZE = 4096,
+		MAX_INDEX_FILES = 32768,
+		MAX_INDEX_DEPTH = 8,
+		INDEX_REBUILD_DELAY = 5, // seconds, changes on disk are batched
+	};
+
+	class CIndex
+	{
+	public:
+		CHeap m_Heap;
+		CIndexEntry *m_apPaths[INDEX_HASH_SIZE];
+		CIndexEntry *m_apNames[INDEX_HASH_SIZE];
+		int m_NumFiles;
+		int m_IndexedMask; // search paths that were listed completely
+		int m_DeepMask; // search paths with folders below MAX_INDEX_DEPTH
+		void *m_pWatch; // 0 if changes can't be noticed
+
+		CIndex()
+		{
+			mem_zero(m_apPaths, sizeof(m_apPaths));
+			mem_zero(m_apNames, sizeof(m_apNames));
+			m_NumFiles = 0;
+			m_IndexedMask = 0;
+			m_DeepMask = 0;
+			m_pWatch = fs_watch_create();
+		}
+
+		~CIndex()
+		{
+			if(m_pWatch)
+				fs_watch_destroy(m_pWatch);
+		}
+
+		CIndexEntry *Find(const char *pPath);
+		bool Add(const char *pPath, int Type);
+		void Remove(const char *pPath, int Type);
+	};
+
+	// the index is rebuilt on a thread and swapped in when it's done,
+	// lookups don't trust it until then
+	LOCK m_IndexLock;
+	CIndex *m_pIndex;
+	bool m_IndexDirty;
+	int64 m_IndexBuildTime;
+	void *m_pIndexThread;
+	bool m_IndexThreadDone;
+	CIndexStats m_IndexStats;
 	
 	CStorage()
 	{
@@ -28,6 +92,22 @@ public:
 		m_NumPaths = 0;
 		m_aDatadir[0] = 0;
 		m_aUserdir[0] = 0;
+
+		m_IndexLock = lock_create();
+		m_pIndex = new CIndex();
+		m_IndexDirty = false;
+		m_IndexBuildTime = 0;
+		m_pIndexThread = 0;
+		m_IndexThreadDone = false;
+		mem_zero(&m_IndexStats, sizeof(m_IndexStats));
+	}
+
+	~CStorage()
+	{
+		if(m_pIndexThread)
+			thread_wait(m_pIndexThread);
+		delete m_pIndex;
+		lock_destroy(m_IndexLock);
 	}
 	
 	int Init(const char *pApplicationName, int NumArgs, const char **ppArguments)
@@ -64,6 +144,8 @@ public:
 			fs_makedir(GetPath(TYPE_SAVE, "demos/auto", aPath, sizeof(aPath)));
 		}
 
+		RebuildIndex();
+
 		return m_NumPaths ? 0 : 1;
 	}
 
@@ -219,6 +301,172 @@ public:
 		dbg_msg("storage", "warning no data directory found");
 	}
 
+	// only plain relative names are indexed, everything else goes to the disk
+	static bool IsIndexable(const char *pPath)
+	{
+		int Depth = 1;
+		if(!pPath[0])
+			return false;
+		for(const char *p = pPath; *p; p++)
+		{
+			if(*p == '\\' || *p == ':')
+				return false;
+			if(p == pPath || p[-1] == '/')
+			{
+				// absolute, empty, relative or hidden parts
+				if(*p == '/' || *p == '.')
+					return false;
+			}
+			if(*p == '/' && (++Depth > MAX_INDEX_DEPTH || !p[1]))
+				return false;
+		}
+		return true;
+	}
+
+	struct CScanData
+	{
+		CStorage *m_pStorage;
+		CIndex *m_pIndex;
+		const char *m_pDir;
+		int m_Depth;
+		bool m_Complete;
+	};
+
+	static int ScanCallback(const char *pName, int IsDir, int Type, void *pUser)
+	{
+		CScanData *pData = static_cast<CScanData *>(pUser);
+		if(pName[0] == '.')
+			return 0;
+
+		char aPath[MAX_PATH_LENGTH];
+		if(pData->m_pDir[0])
+			str_format(aPath, sizeof(aPath), "%s/%s", pData->m_pDir, pName);
+		else
+			str_copy(aPath, pName, sizeof(aPath));
+
+		if(IsDir)
+		{
+			if(pData->m_Depth >= MAX_INDEX_DEPTH)
+				pData->m_pIndex->m_DeepMask |= 1<<Type;
+			else if(!pData->m_pStorage->ScanDirectory(pData->m_pIndex, Type, aPath, pData->m_Depth+1))
+				pData->m_Complete = false;
+		}
+		else if(!pData->m_pIndex->Add(aPath, Type))
+			pData->m_Complete = false;
+
+		return pData->m_Complete ? 0 : 1;
+	}
+
+	bool ScanDirectory(CIndex *pIndex, int Type, const char *pDir, int Depth)
+	{
+		char aBuffer[MAX_PATH_LENGTH];
+		GetPath(Type, pDir, aBuffer, sizeof(aBuffer));
+		if(!aBuffer[0])
+			str_copy(aBuffer, ".", sizeof(aBuffer));
+		if(!fs_is_dir(aBuffer))
+			return false;
+
+		if(pIndex->m_pWatch && fs_watch_add(pIndex->m_pWatch, aBuffer))
+		{
+			dbg_msg("storage", "can't watch '%s', changes on disk won't be noticed", aBuffer);
+			fs_watch_destroy(pIndex->m_pWatch);
+			pIndex->m_pWatch = 0;
+		}
+
+		CScanData Data;
+		Data.m_pStorage = this;
+		Data.m_pIndex = pIndex;
+		Data.m_pDir = pDir;
+		Data.m_Depth = Depth;
+		Data.m_Complete = true;
+		fs_listdir(aBuffer, ScanCallback, Type, &Data);
+		return Data.m_Complete;
+	}
+
+	// lists the search paths into a new index, doesn't need the lock.
+	// the watch is set up before a folder is listed so no change is lost
+	CIndex *BuildIndex()
+	{
+		int64 StartTime = time_get();
+		CIndex *pIndex = new CIndex();
+		for(int i = 0; i < m_NumPaths; i++)
+		{
+			if(ScanDirectory(pIndex, i, "", 1))
+				pIndex->m_IndexedMask |= 1<<i;
+		}
+
+		lock_wait(m_IndexLock);
+		CIndex *pOld = m_pIndex;
+		m_pIndex = pIndex;
+		m_IndexDirty = false;
+		m_IndexBuildTime = time_get();
+		m_IndexStats.m_NumRebuilds++;
+		m_IndexStats.m_BuildTime = (m_IndexBuildTime-StartTime)*1000.0f/time_freq();
+		lock_release(m_IndexLock);
+
+		dbg_msg("storage", "indexed %d files in %.2fms", pIndex->m_NumFiles, m_IndexStats.m_BuildTime);
+		return pOld;
+	}
+
+	static void IndexThread(void *pUser)
+	{
+		CStorage *pThis = static_cast<CStorage *>(pUser);
+		delete pThis->BuildIndex();
+
+		lock_wait(pThis->m_IndexLock);
+		pThis->m_IndexThreadDone = true;
+		lock_release(pThis->m_IndexLock);
+	}
+
+	// search paths whose misses can be trusted, has to be called with the
+	// index lock held. a rebuild is started on a thread if the disk changed
+	int TrustedMask()
+	{
+		if(m_pIndexThread && m_IndexThreadDone)
+		{
+			thread_wait(m_pIndexThread);
+			m_pIndexThread = 0;
+			m_IndexThreadDone = false;
+		}
+		if(m_pIndex->m_pWatch && fs_watch_changed(m_pIndex->m_pWatch))
+			m_IndexDirty = true;
+		if(m_IndexDirty && !m_pIndexThread && time_get() > m_IndexBuildTime+time_freq()*INDEX_REBUILD_DELAY)
+			m_pIndexThread = thread_create(IndexThread, this);
+		if(!m_pIndex->m_pWatch || m_IndexDirty)
+			return 0;
+		return m_pIndex->m_IndexedMask;
+	}
+
+	virtual void RebuildIndex()
+	{
+		delete BuildIndex();
+	}
+
+	virtual void GetIndexStats(CIndexStats *pStats)
+	{
+		lock_wait(m_IndexLock);
+		*pStats = m_IndexStats;
+		pStats->m_NumFiles = m_pIndex->m_NumFiles;
+		pStats->m_NumPaths = m_NumPaths;
+		pStats->m_NumIndexedPaths = 0;
+		for(int i = 0; i < m_NumPaths; i++)
+			if(m_pIndex->m_IndexedMask&(1<<i))
+				pStats->m_NumIndexedPaths++;
+		pStats->m_Watching = m_pIndex->m_pWatch && !m_IndexDirty;
+		lock_release(m_IndexLock);
+	}
+
+	virtual void ResetIndexStats()
+	{
+		lock_wait(m_IndexLock);
+		m_IndexStats.m_Hits = 0;
+		m_IndexStats.m_Misses = 0;
+		m_IndexStats.m_Probes = 0;
+		m_IndexStats.m_Skipped = 0;
+		m_IndexStats.m_Stale = 0;
+		lock_release(m_IndexLock);
+	}
+
 	virtual void ListDirectory(int Type, const char *pPath, FS_LISTDIR_CALLBACK pfnCallback, void *pUser)
 	{
 		char aBuffer[MAX_PATH_LENGTH];
@@ -252,29 +500,82 @@ public:
 		
 		if(Flags&IOFLAG_WRITE)
 		{
-			return io_open(GetPath(TYPE_SAVE, pFilename, pBuffer, BufferSize), Flags);
+			IOHANDLE Handle = io_open(GetPath(TYPE_SAVE, pFilename, pBuffer, BufferSize), Flags);
+			if(Handle && m_NumPaths && IsIndexable(pFilename))
+			{
+				lock_wait(m_IndexLock);
+				m_pIndex->Add(pFilename, TYPE_SAVE);
+				lock_release(m_IndexLock);
+			}
+			return Handle;
 		}
-		else
+		else if(Type == TYPE_ALL || (Type >= 0 && Type < m_NumPaths))
 		{
-			IOHANDLE Handle = 0;
+			// check all available directories or only the wanted one
+			int First = Type == TYPE_ALL ? 0 : Type;
+			int Last = Type == TYPE_ALL ? m_NumPaths-1 : Type;
+
+			// ask the index which paths have the file and which can't have it
+			bool Indexed = IsIndexable(pFilename);
+			int FoundMask = 0;
+			int TrustMask = 0;
+			if(Indexed)
+			{
+				lock_wait(m_IndexLock);
+				TrustMask = TrustedMask();
+				CIndexEntry *pEntry = m_pIndex->Find(pFilename);
+				if(pEntry)
+					FoundMask = pEntry->m_TypeMask;
+				lock_release(m_IndexLock);
+			}
 
-			if(Type == TYPE_ALL)
+			IOHANDLE Handle = 0;
+			int Probes = 0;
+			int Skipped = 0;
+			int StaleMask = 0;
+			int i;
+			for(i = First; i <= Last; ++i)
 			{
-				// check all available directories
-				for(int i = 0; i < m_NumPaths; ++i)
+				if(!(FoundMask&(1<<i)) && (TrustMask&(1<<i)))
 				{
-					Handle = io_open(GetPath(i, pFilename, pBuffer, BufferSize), Flags);
-					if(Handle)
-						return Handle;
+					Skipped++;
+					continue;
 				}
+
+				if(!(FoundMask&(1<<i)))
+					Probes++;
+				Handle = io_open(GetPath(i, pFilename, pBuffer, BufferSize), Flags);
+				if(Handle)
+					break;
+				StaleMask |= FoundMask&(1<<i);
 			}
-			else if(Type >= 0 && Type < m_NumPaths)
+
+			if(Indexed)
 			{
-				// check wanted directory
-				Handle = io_open(GetPath(Type, pFilename, pBuffer, BufferSize), Flags);
-				if(Handle)
-					return Handle;
+				lock_wait(m_IndexLock);
+				if(Handle && (FoundMask&(1<<i)))
+					m_IndexStats.m_Hits++;
+				else
+				{
+					m_IndexStats.m_Misses++;
+					if(Handle)
+						m_pIndex->Add(pFilename, i); // found on disk, remember it
+				}
+				m_IndexStats.m_Probes += Probes;
+				m_IndexStats.m_Skipped += Skipped;
+				for(int t = First; t <= Last; ++t)
+				{
+					if(StaleMask&(1<<t))
+					{
+						m_pIndex->Remove(pFilename, t);
+						m_IndexStats.m_Stale++;
+					}
+				}
+				lock_release(m_IndexLock);
 			}
+
+			if(Handle)
+				return Handle;
 		}
 		
 		pBuffer[0] = 0;
@@ -317,6 +618,39 @@ public:
 		return 0;
 	}
 
+	// looks for the file below the path in the index, returns -1 if the
+	// index doesn't know and the disk has to be searched
+	int FindIndexFile(const char *pFilename, const char *pPath, int Type, char *pBuffer, int BufferSize)
+	{
+		int PathLength = str_length(pPath);
+		unsigned Hash = str_quickhash(pFilename);
+		int Result = -1;
+
+		lock_wait(m_IndexLock);
+		int TrustMask = TrustedMask() & ~m_pIndex->m_DeepMask;
+		for(CIndexEntry *pEntry = m_pIndex->m_apNames[Hash%INDEX_HASH_SIZE]; pEntry; pEntry = pEntry->m_pNextName)
+		{
+			if((pEntry->m_TypeMask&(1<<Type)) && pEntry->m_NameHash == Hash && !str_comp(pEntry->m_pName, pFilename) &&
+				!str_comp_num(pEntry->m_pPath, pPath, PathLength) && pEntry->m_pPath[PathLength] == '/')
+			{
+				str_copy(pBuffer, pEntry->m_pPath, BufferSize);
+				Result = 1;
+				break;
+			}
+		}
+		if(Result == -1 && (TrustMask&(1<<Type)))
+			Result = 0;
+
+		if(Result == 1)
+			m_IndexStats.m_Hits++;
+		else if(Result == 0)
+			m_IndexStats.m_Skipped++;
+		else
+			m_IndexStats.m_Probes++;
+		lock_release(m_IndexLock);
+		return Result;
+	}
+
 	virtual bool FindFile(const char *pFilename, const char *pPath, int Type, char *pBuffer, int BufferSize)
 	{
 		if(BufferSize < 1)
@@ -331,22 +665,34 @@ public:
 		Data.pBuffer = pBuffer;
 		Data.BufferSize = BufferSize;
 
-		if(Type == TYPE_ALL)
+		// the index can answer for plain names below a plain path
+		bool Indexed = IsIndexable(pFilename) && !str_find(pFilename, "/") && IsIndexable(pPath);
+
+		if(Type == TYPE_ALL || (Type >= 0 && Type < m_NumPaths))
 		{
-			// search within all available directories
-			for(int i = 0; i < m_NumPaths; ++i)
+			// search within all available directories or only the wanted one
+			int First = Type == TYPE_ALL ? 0 : Type;
+			int Last = Type == TYPE_ALL ? m_NumPaths-1 : Type;
+			for(int i = First; i <= Last; ++i)
 			{
-				fs_listdir(GetPath(i, pPath, aBuf, sizeof(aBuf)), FindFileCallback, i, &Data);
-				if(pBuffer[0])
+				int Found = Indexed ? FindIndexFile(pFilename, pPath, i, pBuffer, BufferSize) : -1;
+				if(Found == 1)
 					return true;
+				else if(Found == -1)
+				{
+					fs_listdir(GetPath(i, pPath, aBuf, sizeof(aBuf)), FindFileCallback, i, &Data);
+					if(pBuffer[0])
+						break;
+				}
 			}
 		}
-		else if(Type >= 0 && Type < m_NumPaths)
+
+		if(Indexed)
 		{
-			// search within wanted directory
-			fs_listdir(GetPath(Type, pPath, aBuf, sizeof(aBuf)), FindFileCallback, Type, &Data);
+			lock_wait(m_IndexLock);
+			m_IndexStats.m_Misses++;
+			lock_release(m_IndexLock);
 		}
-
 		return pBuffer[0] != 0;
 	}
 
@@ -356,7 +702,13 @@ public:
 			return false;
 
 		char aBuffer[MAX_PATH_LENGTH];
-		return !fs_remove(GetPath(Type, pFilename, aBuffer, sizeof(aBuffer)));
+		if(fs_remove(GetPath(Type, pFilename, aBuffer, sizeof(aBuffer))))
+			return false;
+
+		lock_wait(m_IndexLock);
+		m_pIndex->Remove(pFilename, Type);
+		lock_release(m_IndexLock);
+		return true;
 	}
 
 	virtual bool RenameFile(const char* pOldFilename, const char* pNewFilename, int Type)
@@ -365,7 +717,15 @@ public:
 			return false;
 		char aOldBuffer[MAX_PATH_LENGTH];
 		char aNewBuffer[MAX_PATH_LENGTH];
-		return !fs_rename(GetPath(Type, pOldFilename, aOldBuffer, sizeof(aOldBuffer)), GetPath(Type, pNewFilename, aNewBuffer, sizeof (aNewBuffer)));
+		if(fs_rename(GetPath(Type, pOldFilename, aOldBuffer, sizeof(aOldBuffer)), GetPath(Type, pNewFilename, aNewBuffer, sizeof (aNewBuffer))))
+			return false;
+
+		lock_wait(m_IndexLock);
+		m_pIndex->Remove(pOldFilename, Type);
+		if(IsIndexable(pNewFilename))
+			m_pIndex->Add(pNewFilename, Type);
+		lock_release(m_IndexLock);
+		return true;
 	}
 
 	virtual bool CreateFolder(const char *pFoldername, int Type)
@@ -390,4 +750,51 @@ public:
 	}
 };
 
+CStorage::CIndexEntry *CStorage::CIndex::Find(const char *pPath)
+{
+	unsigned Hash = str_quickhash(pPath);
+	for(CIndexEntry *pEntry = m_apPaths[Hash%INDEX_HASH_SIZE]; pEntry; pEntry = pEntry->m_pNextPath)
+	{
+		if(pEntry->m_PathHash == Hash && !str_comp(pEntry->m_pPath, pPath))
+			return pEntry;
+	}
+	return 0;
+}
+
+bool CStorage::CIndex::Add(const char *pPath, int Type)
+{
+	CIndexEntry *pEntry = Find(pPath);
+	if(!pEntry)
+	{
+		if(m_NumFiles >= MAX_INDEX_FILES)
+			return false;
+
+		int Length = str_length(pPath)+1;
+		pEntry = (CIndexEntry *)m_Heap.Allocate(sizeof(CIndexEntry), sizeof(void*));
+		pEntry->m_pPath = (char *)m_Heap.Allocate(Length);
+		mem_copy(pEntry->m_pPath, pPath, Length);
+		pEntry->m_pName = pEntry->m_pPath;
+		for(const char *p = pPath; *p; p++)
+			if(*p == '/')
+				pEntry->m_pName = pEntry->m_pPath + (p-pPath) + 1;
+		pEntry->m_PathHash = str_quickhash(pEntry->m_pPath);
+		pEntry->m_NameHash = str_quickhash(pEntry->m_pName);
+		pEntry->m_TypeMask = 0;
+		pEntry->m_pNextPath = m_apPaths[pEntry->m_PathHash%INDEX_HASH_SIZE];
+		m_apPaths[pEntry->m_PathHash%INDEX_HASH_SIZE] = pEntry;
+		pEntry->m_pNextName = m_apNames[pEntry->m_NameHash%INDEX_HASH_SIZE];
+		m_apNames[pEntry->m_NameHash%INDEX_HASH_SIZE] = pEntry;
+		m_NumFiles++;
+	}
+	pEntry->m_TypeMask |= 1<<Type;
+	return true;
+}
+
+void CStorage::CIndex::Remove(const char *pPath, int Type)
+{
+	CIndexEntry *pEntry = Find(pPath);
+	if(pEntry)
+		pEntry->m_TypeMask &= ~(1<<Type);
+}
+
 IStorage *CreateStorage(const char *pApplicationName, int NumArgs, const char **ppArguments) { return CStorage::Create(pApplicationName, NumArgs, ppArguments); }
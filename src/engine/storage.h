@@ -14,6 +14,22 @@ public:
 		TYPE_SAVE = 0,
 		TYPE_ALL = -1
 	};
+
+	// counters of the file index, see RebuildIndex
+	struct CIndexStats
+	{
+		int m_NumFiles;
+		int m_NumPaths;
+		int m_NumIndexedPaths; // paths that were listed completely
+		bool m_Watching; // changes on disk are noticed
+		int m_NumRebuilds;
+		float m_BuildTime; // ms of the last rebuild
+		int m_Hits; // lookups that the index knew the file for
+		int m_Misses;
+		int m_Probes; // paths that had to be checked on disk
+		int m_Skipped; // paths that the index ruled out
+		int m_Stale; // indexed files that were gone
+	};
 	
 	virtual void ListDirectory(int Type, const char *pPath, FS_LISTDIR_CALLBACK pfnCallback, void *pUser) = 0;
 	virtual IOHANDLE OpenFile(const char *pFilename, int Flags, int Type, char *pBuffer = 0, int BufferSize = 0) = 0;
@@ -21,6 +37,17 @@ public:
 	virtual bool RemoveFile(const char *pFilename, int Type) = 0;
 	virtual bool RenameFile(const char* pOldFilename, const char* pNewFilename, int Type) = 0;
 	virtual bool CreateFolder(const char *pFoldername, int Type) = 0;
+
+	/*
+		Function: RebuildIndex
+			Lists all search paths again. The index maps relative
+			file names to the paths that have them, so OpenFile and
+			FindFile only touch the disk for paths that the index
+			can't rule out.
+	*/
+	virtual void RebuildIndex() = 0;
+	virtual void GetIndexStats(CIndexStats *pStats) = 0;
+	virtual void ResetIndexStats() = 0;
 };
 
 extern IStorage *CreateStorage(const char *pApplicationName, int NumArgs, const char **ppArguments);
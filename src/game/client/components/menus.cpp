@@ -15,6 +15,7 @@
 #include <engine/storage.h>
 #include <engine/textrender.h>
 #include <engine/shared/config.h>
+#include <engine/shared/demo.h>
 
 #include <game/version.h>
 #include <game/generated/protocol.h>
@@ -1117,6 +1118,10 @@ int CMenus::Render()
 					str_format(aBuf, sizeof(aBuf), "%s/%s", m_aCurrentDemoFolder, m_lDemos[m_DemolistSelectedIndex].m_aFilename);
 					if(Storage()->RemoveFile(aBuf, m_lDemos[m_DemolistSelectedIndex].m_StorageType))
 					{
+						// the seek index, if the demo has one
+						char aIndexFilename[512];
+						CDemoIndex::GetFilename(aBuf, aIndexFilename, sizeof(aIndexFilename));
+						Storage()->RemoveFile(aIndexFilename, m_lDemos[m_DemolistSelectedIndex].m_StorageType);
 						DemolistPopulate();
 						DemolistOnUpdate(false);
 					}
@@ -1159,6 +1164,11 @@ int CMenus::Render()
 						str_format(aBufNew, sizeof(aBufNew), "%s/%s", m_aCurrentDemoFolder, m_aCurrentDemoFile);
 					if(Storage()->RenameFile(aBufOld, aBufNew, m_lDemos[m_DemolistSelectedIndex].m_StorageType))
 					{
+						char aIndexOld[512];
+						char aIndexNew[512];
+						CDemoIndex::GetFilename(aBufOld, aIndexOld, sizeof(aIndexOld));
+						CDemoIndex::GetFilename(aBufNew, aIndexNew, sizeof(aIndexNew));
+						Storage()->RenameFile(aIndexOld, aIndexNew, m_lDemos[m_DemolistSelectedIndex].m_StorageType);
 						DemolistPopulate();
 						DemolistOnUpdate(false);
 					}
@@ -447,6 +447,7 @@ class CEditor : public IEditor
 	class IGraphics *m_pGraphics;
 	class ITextRender *m_pTextRender;
 	class IStorage *m_pStorage;
+	class IEngine *m_pEngine;
 	CRenderTools m_RenderTools;
 	CUI m_UI;
 public:
@@ -456,6 +457,7 @@ public:
 	class IGraphics *Graphics() { return m_pGraphics; };
 	class ITextRender *TextRender() { return m_pTextRender; };
 	class IStorage *Storage() { return m_pStorage; };
+	class IEngine *Engine() { return m_pEngine; };
 	CUI *UI() { return &m_UI; }
 	CRenderTools *RenderTools() { return &m_RenderTools; }
 
@@ -465,6 +467,7 @@ public:
 		m_pClient = 0;
 		m_pGraphics = 0;
 		m_pTextRender = 0;
+		m_pEngine = 0;
 
 		m_Mode = MODE_LAYERS;
 		m_Dialog = 0;
@@ -2,6 +2,7 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <engine/client.h>
 #include <engine/console.h>
+#include <engine/engine.h>
 #include <engine/graphics.h>
 #include <engine/serverbrowser.h>
 #include <engine/storage.h>
@@ -206,7 +207,8 @@ int CEditorMap::Save(class IStorage *pStorage, const char *pFileName)
 	str_format(aBuf, sizeof(aBuf), "saving to '%s'...", pFileName);
 	m_pEditor->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "editor", aBuf);
 	CDataFileWriter df;
-	if(!df.Open(pStorage, pFileName))
+	IEngine *pEngine = m_pEditor->Engine();
+	if(!df.Open(pStorage, pFileName, pEngine ? pEngine->JobPool() : 0))
 	{
 		str_format(aBuf, sizeof(aBuf), "failed to open file '%s'...", pFileName);
 		m_pEditor->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "editor", aBuf);
@@ -384,9 +386,11 @@ int CEditor::Load(const char *pFileName, int StorageType)
 
 int CEditorMap::Load(class IStorage *pStorage, const char *pFileName, int StorageType)
 {
+	int64 StartTime = time_get();
 	CDataFileReader DataFile;
 	//DATAFILE *df = datafile_load(filename);
-	if(!DataFile.Open(pStorage, pFileName, StorageType))
+	IEngine *pEngine = m_pEditor->Engine();
+	if(!DataFile.Open(pStorage, pFileName, StorageType, CDataFileReader::OPENFLAG_PRELOAD, pEngine ? pEngine->JobPool() : 0))
 		return 0;
 		
 	Clean();
@@ -581,6 +585,11 @@ int CEditorMap::Load(class IStorage *pStorage, const char *pFileName, int Storag
 			}
 		}
 	}
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "loaded '%s' in %.2fms, peak memory %d KiB", pFileName,
+		(time_get()-StartTime)*1000.0f/time_freq(), DataFile.PeakMemoryUsage()/1024);
+	m_pEditor->Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "editor", aBuf);
 	
 	return 1;
 }
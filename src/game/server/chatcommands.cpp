@@ -0,0 +1,132 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include "chatcommands.h"
+
+static unsigned NameHash(const char *pName, int Length)
+{
+	unsigned Hash = 5381;
+	for(int i = 0; i < Length; i++)
+		Hash = ((Hash << 5) + Hash) + pName[i];
+	return Hash;
+}
+
+static bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+const char *CChatCommands::CResult::Tokenize(const char *pLine)
+{
+	str_copy(m_aBuf, pLine, sizeof(m_aBuf));
+	m_NumArgs = 0;
+
+	// the first token is the name, the others are the arguments
+	char *pStr = m_aBuf;
+	const char *pName = 0;
+	while(*pStr)
+	{
+		while(IsSpace(*pStr))
+			pStr++;
+		if(!*pStr)
+			break;
+
+		if(!pName)
+			pName = pStr;
+		else if(m_NumArgs < MAX_ARGS)
+			m_apArgs[m_NumArgs++] = pStr;
+
+		while(*pStr && !IsSpace(*pStr))
+			pStr++;
+		if(*pStr)
+			*pStr++ = 0;
+	}
+	return pName ? pName : "";
+}
+
+const char *CChatCommands::CResult::GetString(unsigned Index)
+{
+	if(Index >= m_NumArgs)
+		return "";
+	return m_apArgs[Index];
+}
+
+int CChatCommands::CResult::GetInteger(unsigned Index)
+{
+	if(Index >= m_NumArgs)
+		return 0;
+	return str_toint(m_apArgs[Index]);
+}
+
+float CChatCommands::CResult::GetFloat(unsigned Index)
+{
+	if(Index >= m_NumArgs)
+		return 0.0f;
+	return str_tofloat(m_apArgs[Index]);
+}
+
+CChatCommands::CChatCommands()
+{
+	Reset();
+}
+
+void CChatCommands::Reset()
+{
+	m_NumCommands = 0;
+	mem_zero(m_apHash, sizeof(m_apHash));
+}
+
+void CChatCommands::Register(const char *pName, int IntervalMs, FCommandCallback pfnCallback, void *pUser, const char *pHelp)
+{
+	if(m_NumCommands == MAX_COMMANDS)
+	{
+		dbg_msg("chat", "too many chat commands, '%s' is not registered", pName);
+		return;
+	}
+
+	CCommand *pCommand = &m_aCommands[m_NumCommands++];
+	pCommand->m_pName = pName;
+	pCommand->m_pHelp = pHelp;
+	pCommand->m_pfnCallback = pfnCallback;
+	pCommand->m_pUserData = pUser;
+	pCommand->m_Interval = time_freq()*IntervalMs/1000;
+	mem_zero(pCommand->m_aNextUse, sizeof(pCommand->m_aNextUse));
+
+	unsigned Bucket = NameHash(pName, str_length(pName))%HASH_SIZE;
+	pCommand->m_pNextHash = m_apHash[Bucket];
+	m_apHash[Bucket] = pCommand;
+}
+
+int CChatCommands::Execute(int ClientID, const char *pLine)
+{
+	// look the first word up before anything is copied, most lines are normal chat
+	int Length = 0;
+	while(pLine[Length] && !IsSpace(pLine[Length]))
+		Length++;
+
+	CCommand *pCommand = m_apHash[NameHash(pLine, Length)%HASH_SIZE];
+	for(; pCommand; pCommand = pCommand->m_pNextHash)
+	{
+		if(str_comp_num(pCommand->m_pName, pLine, Length) == 0 && pCommand->m_pName[Length] == 0)
+			break;
+	}
+
+	if(!pCommand)
+		return (m_NumCommands && pLine[0] == '/') ? EXEC_UNKNOWN : EXEC_NONE;
+
+	int64 Now = time_get();
+	if(Now < pCommand->m_aNextUse[ClientID])
+		return EXEC_LIMITED;
+	pCommand->m_aNextUse[ClientID] = Now + pCommand->m_Interval;
+
+	CResult Result;
+	Result.Tokenize(pLine);
+	pCommand->m_pfnCallback(&Result, ClientID, pCommand->m_pUserData);
+	return EXEC_DONE;
+}
+
+void CChatCommands::OnClientDrop(int ClientID)
+{
+	for(int i = 0; i < m_NumCommands; i++)
+		m_aCommands[i].m_aNextUse[ClientID] = 0;
+}
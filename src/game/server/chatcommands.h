@@ -0,0 +1,107 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_SERVER_CHATCOMMANDS_H
+#define GAME_SERVER_CHATCOMMANDS_H
+
+#include <engine/console.h>
+#include <engine/shared/protocol.h>
+
+/*
+	Class: CChatCommands
+		Registry for commands that players type into the chat, like
+		"/race orc". The first word of a line is looked up in a hash
+		table and the rest is split into arguments. Every command has
+		its own minimum interval per player, so spamming a command is
+		dropped right after the lookup.
+*/
+class CChatCommands
+{
+public:
+	typedef void (*FCommandCallback)(IConsole::IResult *pResult, int ClientID, void *pUserData);
+
+	enum
+	{
+		MAX_COMMANDS=32,
+		MAX_ARGS=8,
+		MAX_LINE_LENGTH=256,
+
+		// results of Execute
+		EXEC_NONE=0, // normal chat
+		EXEC_DONE,
+		EXEC_LIMITED, // the player used the command too often
+		EXEC_UNKNOWN, // looks like a command but isn't registered
+	};
+
+private:
+	enum
+	{
+		HASH_SIZE=64,
+	};
+
+	class CCommand
+	{
+	public:
+		const char *m_pName;
+		const char *m_pHelp;
+		FCommandCallback m_pfnCallback;
+		void *m_pUserData;
+		int64 m_Interval;
+		int64 m_aNextUse[MAX_CLIENTS];
+		CCommand *m_pNextHash;
+	};
+
+	class CResult : public IConsole::IResult
+	{
+	public:
+		char m_aBuf[MAX_LINE_LENGTH];
+		const char *m_apArgs[MAX_ARGS];
+
+		const char *Tokenize(const char *pLine);
+
+		virtual const char *GetString(unsigned Index);
+		virtual int GetInteger(unsigned Index);
+		virtual float GetFloat(unsigned Index);
+	};
+
+	CCommand m_aCommands[MAX_COMMANDS];
+	int m_NumCommands;
+	CCommand *m_apHash[HASH_SIZE];
+
+public:
+	CChatCommands();
+
+	/*
+		Function: Register
+			Adds a command.
+
+		Arguments:
+			pName - Name including the prefix, e.g. "/stats". Has to
+				stay valid.
+			IntervalMs - How often a player may use the command.
+			pfnCallback - Called with the arguments after the name.
+			pUser - Passed to the callback.
+			pHelp - Line for the command list, can be 0.
+	*/
+	void Register(const char *pName, int IntervalMs, FCommandCallback pfnCallback, void *pUser, const char *pHelp);
+
+	// removes all commands, their user data is about to go away
+	void Reset();
+
+	/*
+		Function: Execute
+			Runs the command in a chat line.
+
+		Returns:
+			One of the EXEC_* values. Lines that start with '/' are
+			reported as EXEC_UNKNOWN when no command matches, as long
+			as any commands are registered.
+	*/
+	int Execute(int ClientID, const char *pLine);
+
+	void OnClientDrop(int ClientID);
+
+	int NumCommands() const { return m_NumCommands; }
+	const char *GetHelp(int Index) const { return m_aCommands[Index].m_pHelp; }
+};
+
+#endif
@@ -0,0 +1,256 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include "corephysics.h"
+
+void CCorePhysics::CHookDrag::Apply(CCharacterCore *pCore) const
+{
+	// same as the end of CCharacterCore::Tick
+	pCore->m_Vel.x = SaturatedAdd(-m_DragSpeed, m_DragSpeed, pCore->m_Vel.x, m_Accel.x);
+	pCore->m_Vel.y = SaturatedAdd(-m_DragSpeed, m_DragSpeed, pCore->m_Vel.y, m_Accel.y);
+}
+
+CCorePhysics::CCorePhysics()
+{
+	m_NumThreads = 1;
+	m_Shutdown = false;
+	m_Done = semaphore_create();
+	for(int i = 0; i < MAX_THREADS; i++)
+	{
+		m_aWorkers[i].m_pPhysics = this;
+		m_aWorkers[i].m_Index = i;
+		m_aWorkers[i].m_pThread = 0;
+		m_aWorkers[i].m_Start = 0;
+	}
+
+	m_pWorld = 0;
+	m_pCollision = 0;
+	m_NumTasks = 0;
+}
+
+CCorePhysics::~CCorePhysics()
+{
+	StopThreads();
+	semaphore_destroy(m_Done);
+}
+
+void CCorePhysics::SetThreads(int Num)
+{
+	Num = clamp(Num, 1, (int)MAX_THREADS);
+	if(Num == m_NumThreads)
+		return;
+
+	StopThreads();
+	m_NumThreads = Num;
+
+	// worker 0 is the calling thread
+	for(int i = 1; i < m_NumThreads; i++)
+	{
+		m_aWorkers[i].m_Start = semaphore_create();
+		m_aWorkers[i].m_pThread = thread_create(WorkerThread, &m_aWorkers[i]);
+	}
+}
+
+void CCorePhysics::StopThreads()
+{
+	m_Shutdown = true;
+	for(int i = 1; i < m_NumThreads; i++)
+		semaphore_signal(m_aWorkers[i].m_Start);
+	for(int i = 1; i < m_NumThreads; i++)
+	{
+		thread_wait(m_aWorkers[i].m_pThread);
+		semaphore_destroy(m_aWorkers[i].m_Start);
+		m_aWorkers[i].m_pThread = 0;
+		m_aWorkers[i].m_Start = 0;
+	}
+	m_Shutdown = false;
+	m_NumThreads = 1;
+}
+
+void CCorePhysics::WorkerThread(void *pUser)
+{
+	CWorker *pWorker = (CWorker *)pUser;
+	CCorePhysics *pThis = pWorker->m_pPhysics;
+
+	while(1)
+	{
+		semaphore_wait(pWorker->m_Start);
+		if(pThis->m_Shutdown)
+			break;
+		pThis->DoTasks(pWorker);
+		semaphore_signal(pThis->m_Done);
+	}
+}
+
+void CCorePhysics::RunTasks()
+{
+	for(int i = 1; i < m_NumThreads; i++)
+		semaphore_signal(m_aWorkers[i].m_Start);
+	DoTasks(&m_aWorkers[0]);
+	for(int i = 1; i < m_NumThreads; i++)
+		semaphore_wait(m_Done);
+}
+
+void CCorePhysics::DoTasks(CWorker *pWorker)
+{
+	float PhysSize = 28.0f;
+
+	// private copy of the world as it was before the tick
+	pWorker->m_World.m_Tuning = m_pWorld->m_Tuning;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if(m_pWorld->m_apCharacters[i])
+		{
+			pWorker->m_aCores[i] = m_aPrev[i];
+			pWorker->m_aCores[i].Init(&pWorker->m_World, m_pCollision);
+			pWorker->m_World.m_apCharacters[i] = &pWorker->m_aCores[i];
+		}
+		else
+			pWorker->m_World.m_apCharacters[i] = 0;
+	}
+
+	for(int t = pWorker->m_Index; t < m_NumTasks; t += m_NumThreads)
+	{
+		int i = m_aTasks[t];
+		int ID = m_aID[i];
+		CCharacterCore *pCore = &pWorker->m_aCores[ID];
+
+		// other cores only look at the positions of this copy, so
+		// it doesn't matter what earlier tasks did to the velocity
+		*pCore = m_aStart[i];
+		pCore->Init(&pWorker->m_World, m_pCollision);
+		pCore->Tick(true);
+		m_aResult[i] = *pCore;
+
+		// the tick pulled the copy of the hooked core, record the force
+		// so the commit can apply it to the real one
+		CHookDrag *pDrag = &m_aDrag[i];
+		pDrag->m_Target = -1;
+		int Hooked = pCore->m_HookedPlayer;
+		if(m_pWorld->m_Tuning.m_PlayerCollision && Hooked >= 0 && Hooked < MAX_CLIENTS && Hooked != ID &&
+			pWorker->m_World.m_apCharacters[Hooked])
+		{
+			CCharacterCore *pCharCore = pWorker->m_World.m_apCharacters[Hooked];
+			float Distance = distance(pCore->m_Pos, pCharCore->m_Pos);
+			vec2 Dir = normalize(pCore->m_Pos - pCharCore->m_Pos);
+			if(Distance > PhysSize*1.50f)
+			{
+				float Accel = m_pWorld->m_Tuning.m_HookDragAccel * (Distance/m_pWorld->m_Tuning.m_HookLength);
+				pDrag->m_Target = Hooked;
+				pDrag->m_Accel = vec2(Accel*Dir.x*1.5f, Accel*Dir.y*1.5f);
+				pDrag->m_DragSpeed = m_pWorld->m_Tuning.m_HookDragSpeed;
+			}
+		}
+	}
+}
+
+int CCorePhysics::Tick(CWorldCore *pWorld, CCollision *pCollision, CCharacterCore **apCores, int Num, bool CheckParity)
+{
+	dbg_assert(Num <= MAX_CLIENTS, "too many cores");
+
+	m_pWorld = pWorld;
+	m_pCollision = pCollision;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		m_aOrder[i] = -1;
+		if(pWorld->m_apCharacters[i])
+			m_aPrev[i] = *pWorld->m_apCharacters[i];
+	}
+
+	for(int i = 0; i < Num; i++)
+	{
+		m_aID[i] = -1;
+		for(int c = 0; c < MAX_CLIENTS; c++)
+			if(pWorld->m_apCharacters[c] == apCores[i])
+				m_aID[i] = c;
+		dbg_assert(m_aID[i] != -1, "core is not in the world");
+
+		m_aOrder[m_aID[i]] = i;
+		m_aStart[i] = *apCores[i];
+		m_aTasks[i] = i;
+	}
+
+	// reference result of the serial tick
+	if(CheckParity)
+	{
+		m_SerialWorld.m_Tuning = pWorld->m_Tuning;
+		for(int i = 0; i < MAX_CLIENTS; i++)
+		{
+			if(pWorld->m_apCharacters[i])
+			{
+				m_aSerial[i] = m_aPrev[i];
+				m_aSerial[i].Init(&m_SerialWorld, pCollision);
+				m_SerialWorld.m_apCharacters[i] = &m_aSerial[i];
+			}
+			else
+				m_SerialWorld.m_apCharacters[i] = 0;
+		}
+		for(int i = 0; i < Num; i++)
+			m_aSerial[m_aID[i]].Tick(true);
+	}
+
+	// phase one, every core against the old state
+	m_NumTasks = Num;
+	RunTasks();
+
+	// cores hooked by one that comes earlier in the order got pulled
+	// before their own tick, redo them with the right velocity
+	bool aPulled[MAX_CLIENTS] = {0};
+	for(int i = 0; i < Num; i++)
+	{
+		int Target = m_aDrag[i].m_Target;
+		if(Target == -1 || m_aOrder[Target] <= i)
+			continue;
+		m_aDrag[i].Apply(&m_aStart[m_aOrder[Target]]);
+		aPulled[m_aOrder[Target]] = true;
+	}
+
+	m_NumTasks = 0;
+	for(int i = 0; i < Num; i++)
+		if(aPulled[i])
+			m_aTasks[m_NumTasks++] = i;
+	if(m_NumTasks)
+		RunTasks();
+
+	// phase two, commit and pull the remaining hooked cores
+	for(int i = 0; i < Num; i++)
+	{
+		*apCores[i] = m_aResult[i];
+		apCores[i]->Init(pWorld, pCollision);
+	}
+
+	for(int i = 0; i < Num; i++)
+	{
+		int Target = m_aDrag[i].m_Target;
+		if(Target == -1 || m_aOrder[Target] > i)
+			continue;
+		m_aDrag[i].Apply(pWorld->m_apCharacters[Target]);
+	}
+
+	if(!CheckParity)
+		return 0;
+
+	int Mismatches = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+	{
+		const CCharacterCore *pCore = pWorld->m_apCharacters[i];
+		const CCharacterCore *pSerial = &m_aSerial[i];
+		if(!pCore)
+			continue;
+
+		if(pCore->m_Pos == pSerial->m_Pos && pCore->m_Vel == pSerial->m_Vel &&
+			pCore->m_HookPos == pSerial->m_HookPos && pCore->m_HookDir == pSerial->m_HookDir &&
+			pCore->m_HookTick == pSerial->m_HookTick && pCore->m_HookState == pSerial->m_HookState &&
+			pCore->m_HookedPlayer == pSerial->m_HookedPlayer && pCore->m_Jumped == pSerial->m_Jumped &&
+			pCore->m_Direction == pSerial->m_Direction && pCore->m_Angle == pSerial->m_Angle &&
+			pCore->m_TriggeredEvents == pSerial->m_TriggeredEvents)
+			continue;
+
+		dbg_msg("physics", "parity mismatch cid=%d vel=%f,%f/%f,%f hook=%d,%d/%d,%d",
+			i, pCore->m_Vel.x, pCore->m_Vel.y, pSerial->m_Vel.x, pSerial->m_Vel.y,
+			pCore->m_HookState, pCore->m_HookedPlayer, pSerial->m_HookState, pSerial->m_HookedPlayer);
+		Mismatches++;
+	}
+	return Mismatches;
+}
@@ -0,0 +1,112 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_SERVER_COREPHYSICS_H
+#define GAME_SERVER_COREPHYSICS_H
+
+#include <game/gamecore.h>
+
+/*
+	Class: CCorePhysics
+		Ticks the character cores of a world in two phases.
+
+		First every core computes its next state on a private copy of the
+		world as it was before the tick. This phase has no shared writes and
+		is spread over the worker threads. Then the results are committed
+		in order on the calling thread.
+
+		The only thing a core writes to another core is the drag of its
+		hook. That force only depends on positions and hook state, which
+		don't change during CCharacterCore::Tick, so it is recorded and
+		applied during the commit: before the tick of the hooked core if the
+		hooker comes first in the order, after it otherwise. Cores that got
+		pulled before their tick are ticked a second time with the right
+		velocity. The result is exactly the same as calling Tick(true) on
+		every core in order.
+*/
+class CCorePhysics
+{
+public:
+	enum
+	{
+		MAX_THREADS=8,
+	};
+
+	CCorePhysics();
+	~CCorePhysics();
+
+	/*
+		Function: SetThreads
+			Sets the number of threads to use, including the calling one.
+			Worker threads are started and stopped as needed.
+	*/
+	void SetThreads(int Num);
+
+	/*
+		Function: Tick
+			Ticks the cores in the given order. The inputs must already be set.
+
+		Arguments:
+			pWorld - World the cores belong to.
+			pCollision - Collision of the map.
+			apCores - Cores to tick. All of them must be in the world.
+			Num - Number of cores.
+			CheckParity - Also run the serial tick on a copy and compare.
+
+		Returns:
+			The number of cores that differ from the serial tick, always
+			0 without CheckParity.
+	*/
+	int Tick(CWorldCore *pWorld, CCollision *pCollision, CCharacterCore **apCores, int Num, bool CheckParity);
+
+private:
+	class CHookDrag
+	{
+	public:
+		int m_Target;
+		vec2 m_Accel;
+		float m_DragSpeed;
+
+		void Apply(CCharacterCore *pCore) const;
+	};
+
+	class CWorker
+	{
+	public:
+		CCorePhysics *m_pPhysics;
+		int m_Index;
+		void *m_pThread;
+		SEMAPHORE m_Start;
+
+		CWorldCore m_World;
+		CCharacterCore m_aCores[MAX_CLIENTS];
+	};
+
+	CWorker m_aWorkers[MAX_THREADS];
+	int m_NumThreads;
+	bool m_Shutdown;
+	SEMAPHORE m_Done;
+
+	// state of the running tick, read only while the workers run
+	CWorldCore *m_pWorld;
+	CCollision *m_pCollision;
+	CCharacterCore m_aPrev[MAX_CLIENTS];
+	int m_aOrder[MAX_CLIENTS];
+	int m_aTasks[MAX_CLIENTS];
+	int m_NumTasks;
+
+	// per core in tick order
+	int m_aID[MAX_CLIENTS];
+	CCharacterCore m_aStart[MAX_CLIENTS];
+	CCharacterCore m_aResult[MAX_CLIENTS];
+	CHookDrag m_aDrag[MAX_CLIENTS];
+
+	CWorldCore m_SerialWorld;
+	CCharacterCore m_aSerial[MAX_CLIENTS];
+
+	static void WorkerThread(void *pUser);
+	void RunTasks();
+	void DoTasks(CWorker *pWorker);
+	void StopThreads();
+};
+
+#endif
@@ -679,6 +679,13 @@ void CCharacter::OnDirectInput(CNetObj_PlayerInput *pNewInput)
 }
 
 void CCharacter::Tick()
+{
+	PrepareCoreTick();
+	m_Core.Tick(true);
+	TickGameplay();
+}
+
+CCharacterCore *CCharacter::PrepareCoreTick()
 {
 	if(m_pPlayer->m_ForceBalanced)
 	{
@@ -690,8 +697,11 @@ void CCharacter::Tick()
 	}
 
 	m_Core.m_Input = m_Input;
-	m_Core.Tick(true);
-	
+	return &m_Core;
+}
+
+void CCharacter::TickGameplay()
+{
 	// handle death-tiles and leaving gamelayer
 	if(GameServer()->Collision()->GetCollisionAt(m_Pos.x+m_ProximityRadius/3.f, m_Pos.y-m_ProximityRadius/3.f)&CCollision::COLFLAG_DEATH ||
 		GameServer()->Collision()->GetCollisionAt(m_Pos.x+m_ProximityRadius/3.f, m_Pos.y+m_ProximityRadius/3.f)&CCollision::COLFLAG_DEATH ||
@@ -728,7 +738,7 @@ void CCharacter::Tick()
 			//else
 				IncreaseArmor(1);
 			GameServer()->m_apPlayers[m_pPlayer->m_HotFrom]->m_Xp++;
-			GameServer()->CreateSound(GameServer()->m_apPlayers[m_pPlayer->m_HotFrom]->m_ViewPos, SOUND_PICKUP_HEALTH, m_pPlayer->m_HotFrom);
+			GameServer()->CreateSound(GameServer()->m_apPlayers[m_pPlayer->m_HotFrom]->m_ViewPos, SOUND_PICKUP_HEALTH, CmaskOne(m_pPlayer->m_HotFrom));
 			m_pPlayer->m_StartHot--;
 		}
 		if(m_pPlayer->m_StartHot <=0)
@@ -741,7 +751,7 @@ void CCharacter::Tick()
 			if(m_Health < 10)
 			{
 				GameServer()->CreateHammerHit(m_Pos);
-				GameServer()->CreateSound(GameServer()->m_apPlayers[m_pPlayer->m_HealFrom]->m_ViewPos, SOUND_PICKUP_HEALTH, m_pPlayer->m_HealFrom);
+				GameServer()->CreateSound(GameServer()->m_apPlayers[m_pPlayer->m_HealFrom]->m_ViewPos, SOUND_PICKUP_HEALTH, CmaskOne(m_pPlayer->m_HealFrom));
 			}
 			IncreaseHealth(2);
 		}
@@ -818,7 +828,7 @@ void CCharacter::TickDefered()
 	}
 
 	int Events = m_Core.m_TriggeredEvents;
-	int Mask = CmaskAllExceptOne(m_pPlayer->GetCID());
+	CClientMask Mask = CmaskAllExceptOne(m_pPlayer->GetCID());
 	
 	if(Events&COREEVENT_GROUND_JUMP) GameServer()->CreateSound(m_Pos, SOUND_PLAYER_JUMP, Mask);
 	
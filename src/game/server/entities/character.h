@@ -30,6 +30,10 @@ public:
 	virtual void Destroy();
 	virtual void Tick();
 	virtual void TickDefered();
+
+	// two phase tick, the world ticks all cores in between
+	CCharacterCore *PrepareCoreTick();
+	void TickGameplay();
 	virtual void Snap(int SnappingClient);
 		
 	bool IsGrounded();
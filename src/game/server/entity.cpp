@@ -4,6 +4,8 @@
 #include "entity.h"
 #include "gamecontext.h"
 
+CEntityPoolStats *CEntityPoolStats::ms_pFirst = 0;
+
 //////////////////////////////////////////////////
 // Entity
 //////////////////////////////////////////////////
@@ -49,6 +49,91 @@
 		ms_PoolUsed##POOLTYPE[id] = 0; \
 		mem_zero(ms_PoolData##POOLTYPE[id], sizeof(POOLTYPE)); \
 	}
+
+/*
+	Class: CEntityPoolStats
+		Usage counters of a pool created with MACRO_ALLOC_POOL_IMPL.
+		All pools are linked together so they can be listed.
+*/
+class CEntityPoolStats
+{
+public:
+	const char *m_pName;
+	int m_Size;
+	int m_Used;
+	int m_HighWater;
+	int m_Exhausted; // allocations that had to fall back to the heap
+	CEntityPoolStats *m_pNext;
+
+	static CEntityPoolStats *ms_pFirst;
+
+	CEntityPoolStats(const char *pName, int Size)
+	{
+		m_pName = pName;
+		m_Size = Size;
+		m_Used = 0;
+		m_HighWater = 0;
+		m_Exhausted = 0;
+		m_pNext = ms_pFirst;
+		ms_pFirst = this;
+	}
+};
+
+/*
+	pool for objects that don't have a natural id. free slots are kept
+	in an intrusive list, slots past ms_PoolTouched have never been used.
+	when the pool runs dry the heap is used instead and counted.
+*/
+#define MACRO_ALLOC_POOL() \
+	public: \
+	void *operator new(size_t Size); \
+	void operator delete(void *p); \
+	private:
+
+#define MACRO_ALLOC_POOL_IMPL(POOLTYPE, PoolSize) \
+	union CPoolSlot##POOLTYPE \
+	{ \
+		char m_aData[sizeof(POOLTYPE)]; \
+		CPoolSlot##POOLTYPE *m_pNextFree; \
+		double m_Align; \
+	}; \
+	static CPoolSlot##POOLTYPE ms_aPoolSlots##POOLTYPE[PoolSize]; \
+	static CPoolSlot##POOLTYPE *ms_pPoolFree##POOLTYPE = 0; \
+	static int ms_PoolTouched##POOLTYPE = 0; \
+	static CEntityPoolStats ms_PoolStats##POOLTYPE(#POOLTYPE, PoolSize); \
+	void *POOLTYPE::operator new(size_t Size) \
+	{ \
+		dbg_assert(sizeof(POOLTYPE) == Size, "size error"); \
+		void *p; \
+		if(ms_pPoolFree##POOLTYPE) \
+		{ \
+			p = ms_pPoolFree##POOLTYPE; \
+			ms_pPoolFree##POOLTYPE = ms_pPoolFree##POOLTYPE->m_pNextFree; \
+		} \
+		else if(ms_PoolTouched##POOLTYPE < PoolSize) \
+			p = &ms_aPoolSlots##POOLTYPE[ms_PoolTouched##POOLTYPE++]; \
+		else \
+		{ \
+			ms_PoolStats##POOLTYPE.m_Exhausted++; \
+			p = mem_alloc(Size, 1); \
+		} \
+		if(++ms_PoolStats##POOLTYPE.m_Used > ms_PoolStats##POOLTYPE.m_HighWater) \
+			ms_PoolStats##POOLTYPE.m_HighWater = ms_PoolStats##POOLTYPE.m_Used; \
+		mem_zero(p, Size); \
+		return p; \
+	} \
+	void POOLTYPE::operator delete(void *p) \
+	{ \
+		CPoolSlot##POOLTYPE *pSlot = (CPoolSlot##POOLTYPE *)p; \
+		ms_PoolStats##POOLTYPE.m_Used--; \
+		if(pSlot >= ms_aPoolSlots##POOLTYPE && pSlot < ms_aPoolSlots##POOLTYPE+PoolSize) \
+		{ \
+			pSlot->m_pNextFree = ms_pPoolFree##POOLTYPE; \
+			ms_pPoolFree##POOLTYPE = pSlot; \
+		} \
+		else \
+			mem_free(p); \
+	}
 	
 /*
 	Class: Entity
@@ -1,5 +1,6 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <engine/shared/memheap.h>
 #include "eventhandler.h"
 #include "gamecontext.h"
 
@@ -17,19 +18,18 @@ void CEventHandler::SetGameServer(CGameContext *pGameServer)
 	m_pGameServer = pGameServer;
 }
 
-void *CEventHandler::Create(int Type, int Size, int Mask)
+void *CEventHandler::Create(int Type, int Size, CClientMask Mask)
 {
 	if(m_NumEvents == MAX_EVENTS)
 		return 0;
-	if(m_CurrentOffset+Size >= MAX_DATASIZE)
-		return 0;
 
-	void *p = &m_aData[m_CurrentOffset];
-	m_aOffsets[m_NumEvents] = m_CurrentOffset;
+	void *p = GameServer()->Server()->FrameHeap()->Allocate(Size, sizeof(int));
+	if(!p)
+		return 0;
+	m_apData[m_NumEvents] = p;
 	m_aTypes[m_NumEvents] = Type;
 	m_aSizes[m_NumEvents] = Size;
 	m_aClientMasks[m_NumEvents] = Mask;
-	m_CurrentOffset += Size;
 	m_NumEvents++;
 	return p;
 }
@@ -37,7 +37,6 @@ void *CEventHandler::Create(int Type, int Size, int Mask)
 void CEventHandler::Clear()
 {
 	m_NumEvents = 0;
-	m_CurrentOffset = 0;
 }
 
 void CEventHandler::Snap(int SnappingClient)
@@ -46,12 +45,12 @@ void CEventHandler::Snap(int SnappingClient)
 	{
 		if(SnappingClient == -1 || CmaskIsSet(m_aClientMasks[i], SnappingClient))
 		{
-			NETEVENT_COMMON *ev = (NETEVENT_COMMON *)&m_aData[m_aOffsets[i]];
+			NETEVENT_COMMON *ev = (NETEVENT_COMMON *)m_apData[i];
 			if(SnappingClient == -1 || distance(GameServer()->m_apPlayers[SnappingClient]->m_ViewPos, vec2(ev->m_X, ev->m_Y)) < 1500.0f)
 			{
 				void *d = GameServer()->Server()->SnapNewItem(m_aTypes[i], i, m_aSizes[i]);
 				if(d)
-					mem_copy(d, &m_aData[m_aOffsets[i]], m_aSizes[i]);
+					mem_copy(d, m_apData[i], m_aSizes[i]);
 			}
 		}
 	}
@@ -3,28 +3,36 @@
 #ifndef GAME_SERVER_EVENTHANDLER_H
 #define GAME_SERVER_EVENTHANDLER_H
 
-//
+#include <base/tl/bitset.h>
+#include <engine/shared/protocol.h>
+
+// set of clients an event or message is meant for
+typedef bitset<MAX_CLIENTS> CClientMask;
+
+inline CClientMask CmaskAll() { CClientMask Mask; Mask.fill(); return Mask; }
+inline CClientMask CmaskOne(int ClientID) { CClientMask Mask; Mask.set(ClientID); return Mask; }
+inline CClientMask CmaskAllExceptOne(int ClientID) { CClientMask Mask = CmaskAll(); Mask.unset(ClientID); return Mask; }
+inline bool CmaskIsSet(const CClientMask &Mask, int ClientID) { return Mask.test(ClientID); }
+
+// the event data lives in the frame heap of the server until the events are snapped
 class CEventHandler
 {
 	static const int MAX_EVENTS = 128;
-	static const int MAX_DATASIZE = 128*64;
 
 	int m_aTypes[MAX_EVENTS];  // TODO: remove some of these arrays
-	int m_aOffsets[MAX_EVENTS];
+	void *m_apData[MAX_EVENTS];
 	int m_aSizes[MAX_EVENTS];
-	int m_aClientMasks[MAX_EVENTS];
-	char m_aData[MAX_DATASIZE];
+	CClientMask m_aClientMasks[MAX_EVENTS];
 	
 	class CGameContext *m_pGameServer;
 	
-	int m_CurrentOffset;
 	int m_NumEvents;
 public:
 	CGameContext *GameServer() const { return m_pGameServer; }
 	void SetGameServer(CGameContext *pGameServer);
 	
 	CEventHandler();
-	void *Create(int Type, int Size, int Mask = -1);
+	void *Create(int Type, int Size, CClientMask Mask = CmaskAll());
 	void Clear();
 	void Snap(int SnappingClient);
 };
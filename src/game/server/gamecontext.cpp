@@ -2,7 +2,9 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <new>
 #include <base/math.h>
+#include <base/perf.h>
 #include <engine/shared/config.h>
+#include <engine/shared/memheap.h>
 #include <engine/map.h>
 #include <engine/console.h>
 #include "gamecontext.h"
@@ -29,17 +31,16 @@ void CGameContext::Construct(int Resetting)
 	m_Resetting = 0;
 	m_pServer = 0;
 	
-	for(int i = 0; i < MAX_CLIENTS; i++)
-		m_apPlayers[i] = 0;
+	mem_zero(m_apPlayers, sizeof(m_apPlayers));
+	m_PlayerMask.clear();
 	
 	m_pController = 0;
 	m_VoteCloseTime = 0;
-	m_pVoteOptionFirst = 0;
-	m_pVoteOptionLast = 0;
-	m_NumVoteOptions = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		m_aVoteSyncPos[i] = -1;
 
 	if(Resetting==NO_RESET)
-		m_pVoteOptionHeap = new CHeap();
+		m_pVoteOptions = new CVoteOptions();
 }
 
 CGameContext::CGameContext(int Resetting)
@@ -54,18 +55,15 @@ CGameContext::CGameContext()
 
 CGameContext::~CGameContext()
 {
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = m_PlayerMask.first(); i >= 0; i = m_PlayerMask.next(i))
 		delete m_apPlayers[i];
 	if(!m_Resetting)
-		delete m_pVoteOptionHeap;
+		delete m_pVoteOptions;
 }
 
 void CGameContext::Clear()
 {
-	CHeap *pVoteOptionHeap = m_pVoteOptionHeap;
-	CVoteOptionServer *pVoteOptionFirst = m_pVoteOptionFirst;
-	CVoteOptionServer *pVoteOptionLast = m_pVoteOptionLast;
-	int NumVoteOptions = m_NumVoteOptions;
+	CVoteOptions *pVoteOptions = m_pVoteOptions;
 	CTuningParams Tuning = m_Tuning;
 
 	m_Resetting = true;
@@ -73,10 +71,7 @@ void CGameContext::Clear()
 	mem_zero(this, sizeof(*this));
 	new (this) CGameContext(RESET);
 
-	m_pVoteOptionHeap = pVoteOptionHeap;
-	m_pVoteOptionFirst = pVoteOptionFirst;
-	m_pVoteOptionLast = pVoteOptionLast;
-	m_NumVoteOptions = NumVoteOptions;
+	m_pVoteOptions = pVoteOptions;
 	m_Tuning = Tuning;
 }
 
@@ -204,7 +199,7 @@ void CGameContext::CreateDeath(vec2 Pos, int ClientID)
 	}
 }
 
-void CGameContext::CreateSound(vec2 Pos, int Sound, int Mask)
+void CGameContext::CreateSound(vec2 Pos, int Sound, CClientMask Mask)
 {
 	if (Sound < 0)
 		return;
@@ -268,7 +263,7 @@ void CGameContext::SendChat(int ChatterClientID, int Team, const char *pText)
 		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NOSEND, -1);
 
 		// send to the clients
-		for(int i = 0; i < MAX_CLIENTS; i++)
+		for(int i = m_PlayerMask.first(); i >= 0; i = m_PlayerMask.next(i))
 		{
 			if(m_apPlayers[i] && m_apPlayers[i]->GetTeam() == Team)
 				Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, i);
@@ -308,7 +303,7 @@ void CGameContext::StartVote(const char *pDesc, const char *pCommand, const char
 
 	// reset votes
 	m_VoteEnforce = VOTE_ENFORCE_UNKNOWN;
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = m_PlayerMask.first(); i >= 0; i = m_PlayerMask.next(i))
 	{
 		if(m_apPlayers[i])
 		{
@@ -363,6 +358,105 @@ void CGameContext::SendVoteStatus(int ClientID, int Total, int Yes, int No)
 	
 }
 
+void CGameContext::SendVoteOptions(int ClientID)
+{
+	const char *apDescriptions[VOTE_OPTIONS_PER_MSG];
+	int NumOptions = 0;
+	while(NumOptions < VOTE_OPTIONS_PER_MSG && m_aVoteSyncPos[ClientID] < m_pVoteOptions->Num())
+		apDescriptions[NumOptions++] = m_pVoteOptions->Get(m_aVoteSyncPos[ClientID]++)->m_aDescription;
+	for(int i = NumOptions; i < VOTE_OPTIONS_PER_MSG; i++)
+		apDescriptions[i] = "";
+
+	CNetMsg_Sv_VoteOptionListAdd OptionMsg;
+	OptionMsg.m_NumOptions = NumOptions;
+	OptionMsg.m_pDescription0 = apDescriptions[0];
+	OptionMsg.m_pDescription1 = apDescriptions[1];
+	OptionMsg.m_pDescription2 = apDescriptions[2];
+	OptionMsg.m_pDescription3 = apDescriptions[3];
+	OptionMsg.m_pDescription4 = apDescriptions[4];
+	OptionMsg.m_pDescription5 = apDescriptions[5];
+	OptionMsg.m_pDescription6 = apDescriptions[6];
+	OptionMsg.m_pDescription7 = apDescriptions[7];
+	OptionMsg.m_pDescription8 = apDescriptions[8];
+	OptionMsg.m_pDescription9 = apDescriptions[9];
+	OptionMsg.m_pDescription10 = apDescriptions[10];
+	OptionMsg.m_pDescription11 = apDescriptions[11];
+	OptionMsg.m_pDescription12 = apDescriptions[12];
+	OptionMsg.m_pDescription13 = apDescriptions[13];
+	OptionMsg.m_pDescription14 = apDescriptions[14];
+	Server()->SendPackMsg(&OptionMsg, MSGFLAG_VITAL, ClientID);
+}
+
+static unsigned AddrHash(const NETADDR *pAddr)
+{
+	unsigned Hash = 5381 + pAddr->type;
+	for(int i = 0; i < (int)sizeof(pAddr->ip); i++)
+		Hash = ((Hash << 5) + Hash) + pAddr->ip[i];
+	return Hash;
+}
+
+void CGameContext::CountVotes(int *pTotal, int *pYes, int *pNo)
+{
+	// players behind the same ip count once, with the vote that came first
+	enum { VOTER_HASH_SIZE=MAX_CLIENTS*2 };
+	struct CVoter
+	{
+		NETADDR m_Addr;
+		int m_Vote;
+		int m_VotePos;
+	};
+	CVoter aVoters[MAX_CLIENTS];
+	int NumVoters = 0;
+	int aHash[VOTER_HASH_SIZE];
+	for(int i = 0; i < VOTER_HASH_SIZE; i++)
+		aHash[i] = -1;
+
+	for(int i = m_PlayerMask.first(); i >= 0; i = m_PlayerMask.next(i))
+	{
+		CPlayer *pPlayer = m_apPlayers[i];
+		if(!pPlayer || pPlayer->GetTeam() == TEAM_SPECTATORS)	// don't count in votes by spectators
+			continue;
+
+		// players that aren't ingame yet share the empty address
+		NETADDR Addr;
+		if(!Server()->GetClientAddr(i, &Addr))
+			mem_zero(&Addr, sizeof(Addr));
+
+		int Slot = AddrHash(&Addr)%VOTER_HASH_SIZE;
+		while(aHash[Slot] >= 0 && net_addr_comp(&aVoters[aHash[Slot]].m_Addr, &Addr) != 0)
+			Slot = (Slot+1)%VOTER_HASH_SIZE;
+
+		if(aHash[Slot] < 0)
+		{
+			aHash[Slot] = NumVoters;
+			CVoter *pVoter = &aVoters[NumVoters++];
+			pVoter->m_Addr = Addr;
+			pVoter->m_Vote = pPlayer->m_Vote;
+			pVoter->m_VotePos = pPlayer->m_VotePos;
+		}
+		else
+		{
+			CVoter *pVoter = &aVoters[aHash[Slot]];
+			if(pPlayer->m_Vote && (!pVoter->m_Vote || pVoter->m_VotePos > pPlayer->m_VotePos))
+			{
+				pVoter->m_Vote = pPlayer->m_Vote;
+				pVoter->m_VotePos = pPlayer->m_VotePos;
+			}
+		}
+	}
+
+	*pTotal = NumVoters;
+	*pYes = 0;
+	*pNo = 0;
+	for(int i = 0; i < NumVoters; i++)
+	{
+		if(aVoters[i].m_Vote > 0)
+			(*pYes)++;
+		else if(aVoters[i].m_Vote < 0)
+			(*pNo)++;
+	}
+}
+
 void CGameContext::AbortVoteKickOnDisconnect(int ClientID)
 {
 	if(m_VoteCloseTime && !str_comp_num(m_aVoteCommand, "kick ", 5) && str_toint(&m_aVoteCommand[5]) == ClientID)
@@ -410,9 +504,13 @@ void CGameContext::OnTick()
 	m_World.Tick();
 
 	//if(world.paused) // make sure that the game object always updates
-	m_pController->Tick();
+	{
+		static int s_Zone = perf_zone("controller.tick");
+		CPerfScope Scope(s_Zone);
+		m_pController->Tick();
+	}
 		
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = m_PlayerMask.first(); i >= 0; i = m_PlayerMask.next(i))
 	{
 		if(m_apPlayers[i])
 		{
@@ -435,40 +533,7 @@ void CGameContext::OnTick()
 			int Total = 0, Yes = 0, No = 0;
 			if(m_VoteUpdate)
 			{
-				// count votes
-				char aaBuf[MAX_CLIENTS][NETADDR_MAXSTRSIZE] = {{0}};
-				for(int i = 0; i < MAX_CLIENTS; i++)
-					if(m_apPlayers[i])
-						Server()->GetClientAddr(i, aaBuf[i], NETADDR_MAXSTRSIZE);
-				bool aVoteChecked[MAX_CLIENTS] = {0};
-				for(int i = 0; i < MAX_CLIENTS; i++)
-				{
-					if(!m_apPlayers[i] || m_apPlayers[i]->GetTeam() == TEAM_SPECTATORS || aVoteChecked[i])	// don't count in votes by spectators
-						continue;
-					
-					int ActVote = m_apPlayers[i]->m_Vote;
-					int ActVotePos = m_apPlayers[i]->m_VotePos;
-					
-					// check for more players with the same ip (only use the vote of the one who voted first)
-					for(int j = i+1; j < MAX_CLIENTS; ++j)
-					{
-						if(!m_apPlayers[j] || aVoteChecked[j] || str_comp(aaBuf[j], aaBuf[i]))
-							continue;
-
-						aVoteChecked[j] = true;
-						if(m_apPlayers[j]->m_Vote && (!ActVote || ActVotePos > m_apPlayers[j]->m_VotePos))
-						{
-							ActVote = m_apPlayers[j]->m_Vote;
-							ActVotePos = m_apPlayers[j]->m_VotePos;
-						}
-					}
-
-					Total++;
-					if(ActVote > 0)
-						Yes++;
-					else if(ActVote < 0)
-						No++;
-				}
+				CountVotes(&Total, &Yes, &No);
 
 				if(Yes >= Total/2+1)
 					m_VoteEnforce = VOTE_ENFORCE_YES;
@@ -497,6 +562,14 @@ void CGameContext::OnTick()
 			}
 		}
 	}
+
+	// stream the vote options to the players that asked for them, one
+	// message per player and tick instead of the whole list at once
+	for(int i = m_PlayerMask.first(); i >= 0; i = m_PlayerMask.next(i))
+	{
+		if(m_aVoteSyncPos[i] >= 0 && m_aVoteSyncPos[i] < m_pVoteOptions->Num())
+			SendVoteOptions(i);
+	}
 	
 
 #ifdef CONF_DEBUG
@@ -549,6 +622,7 @@ void CGameContext::OnClientConnected(int ClientID)
 	const int StartTeam = g_Config.m_SvTournamentMode ? TEAM_SPECTATORS : m_pController->GetAutoTeam(ClientID);
 
 	m_apPlayers[ClientID] = new(ClientID) CPlayer(this, ClientID, StartTeam);
+	m_PlayerMask.set(ClientID);
 	//players[ClientID].init(ClientID);
 	//players[ClientID].ClientID = ClientID;
 	
@@ -575,15 +649,18 @@ void CGameContext::OnClientConnected(int ClientID)
 void CGameContext::OnClientDrop(int ClientID, const char *pReason)
 {
 	AbortVoteKickOnDisconnect(ClientID);
+	m_ChatCommands.OnClientDrop(ClientID);
 	m_apPlayers[ClientID]->OnDisconnect(pReason);
 	delete m_apPlayers[ClientID];
 	m_apPlayers[ClientID] = 0;
+	m_PlayerMask.unset(ClientID);
+	m_aVoteSyncPos[ClientID] = -1;
 	
 	(void)m_pController->CheckTeamBalance();
 	m_VoteUpdate = true;
 
 	// update spectator modes
-	for(int i = 0; i < MAX_CLIENTS; ++i)
+	for(int i = m_PlayerMask.first(); i >= 0; i = m_PlayerMask.next(i))
 	{
 		if(m_apPlayers[i] && m_apPlayers[i]->m_SpectatorID == ClientID)
 			m_apPlayers[i]->m_SpectatorID = SPEC_FREEVIEW;
@@ -613,275 +690,32 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 		else
 			Team = CGameContext::CHAT_ALL;
 		
+		// commands are limited per command, only chat counts for the spam protection
+		int Command = m_ChatCommands.Execute(ClientID, pMsg->m_pMessage);
+		if(Command == CChatCommands::EXEC_DONE || Command == CChatCommands::EXEC_LIMITED)
+			return;
+
 		if(g_Config.m_SvSpamprotection && pPlayer->m_LastChat && pPlayer->m_LastChat+Server()->TickSpeed() > Server()->Tick())
 			return;
-				//Disable spamming protection for special command
-		bool is_command=!strcmp(pMsg->m_pMessage, ".info") || !strcmp(pMsg->m_pMessage, "/stats") || !strcmp(pMsg->m_pMessage, "/lvl") ||
-			!strncmp(pMsg->m_pMessage,"/race",5) || !strcmp(pMsg->m_pMessage, "/ability") || !strcmp(pMsg->m_pMessage, "/otherlvl") ||
-			!strcmp(pMsg->m_pMessage, "/help");
-		if(g_Config.m_SvSpamprotection && pPlayer->m_LastChat && pPlayer->m_LastChat+Server()->TickSpeed() > Server()->Tick() && (m_pController->IsRpg() && !is_command || !m_pController->IsRpg()))
+		pPlayer->m_LastChat = Server()->Tick();
+
+		if(Command == CChatCommands::EXEC_UNKNOWN)
 		{
-			pPlayer->m_LastChat = Server()->Tick();
+			SendChatTarget(ClientID, "Wrong command.");
+			SendChatTarget(ClientID, "Say \"/cmdlist\" for list of command available.");
 			return;
 		}
-		else if(m_pController->IsRpg())
- 		{
-			//Special command stuff !!!!!
-			if(!strcmp(pMsg->m_pMessage, ".info"))
-			{
-				char buf[128];
-				str_format(buf, sizeof(buf), "War3 mod %s contact Rajh. (C)Rajh(%s)",WAR3_VERSION,Server()->ClientName(ClientID));
-				SendChat(-1,CHAT_ALL,buf);
-				pPlayer->m_LastChat = Server()->Tick();
-			}
-			else if(!strcmp(pMsg->m_pMessage, "/stats"))
-			{
-				char buf[128];
-				if(pPlayer->m_RaceName!=VIDE)
-				{
-					m_pController->DisplayStats(pPlayer,pPlayer);
-				}
-				else
-				{
-					str_format(buf, sizeof(buf), "Please choose a race\n say \"/race name\"");
-					SendBroadcast(buf, ClientID);
-				}
-			}
-			else if(!strcmp(pMsg->m_pMessage, "/lvl"))
-			{
-				char buf[128];
-				if(p->m_RaceName!=VIDE)
-				{
-					if(p->m_LevelMax)
-					{
-						str_format(buf, sizeof(buf), "Final Lvl\n%d points to spend(/stats)",p->m_Leveled);
-						SendBroadcast(buf, ClientID);
-					}
-					else
-					{
-						str_format(buf, sizeof(buf), "LVL: %d | %d/%d\n%d points to spend(/stats)", p->m_Lvl,p->m_Xp,p->m_NextLvl,p->m_Leveled);
-						SendBroadcast(buf, ClientID);
-					}
-				}
-				else
-				{
-					str_format(buf, sizeof(buf), "Please choose a race\n say \"/race name\"");
-					SendBroadcast(buf, ClientID);
-				}
-			}
-			else if(!strncmp(pMsg->m_pMessage,"/race",5) && p->GetTeam() != -1)
-			{
-				if(!strcmp(pMsg->m_pMessage, "/race orc"))
-				{
-					char buf[128];
-					str_format(buf, sizeof(buf), "Orc chosen");
-					SendBroadcast(buf, ClientID);
-					p->InitRpg();
-					p->m_RaceName=ORC;
-					if(p->GetCharacter() && p->GetCharacter()->IsAlive())
-					{
-						p->KillCharacter(-1);
-						p->m_Score++;
-					}
-				}
-				else if(!strcmp(pMsg->m_pMessage, "/race elf"))
-				{
-					char buf[128];
-					str_format(buf, sizeof(buf), "Elf chosen");
-					SendBroadcast(buf, ClientID);
-					p->InitRpg();
-					p->m_RaceName=ELF;
-					if(p->GetCharacter() && p->GetCharacter()->IsAlive())
-					{
-						p->KillCharacter(-1);
-						p->m_Score++;
-					}
-				}
-				else if(!strcmp(pMsg->m_pMessage, "/race undead"))
-				{
-					char buf[128];
-					str_format(buf, sizeof(buf), "Undead chosen");
-					SendBroadcast(buf, ClientID);
-					p->InitRpg();
-					p->m_RaceName=UNDEAD;
-					if(p->GetCharacter() && p->GetCharacter()->IsAlive())
-					{
-						p->KillCharacter(-1);
-						p->m_Score++;
-					}
-				}
-				else if(!strcmp(pMsg->m_pMessage, "/race human"))
-				{
-					char buf[128];
-					str_format(buf, sizeof(buf), "Human chosen");
-					SendBroadcast(buf, ClientID);
-					p->InitRpg();
-					p->m_RaceName=HUMAN;
-					if(p->GetCharacter() && p->GetCharacter()->IsAlive())
-					{
-						p->KillCharacter(-1);
-						p->m_Score++;
-					}
-				}
-				else if(!strcmp(pMsg->m_pMessage, "/race tauren"))
-				{
-					int count_tauren=0;
-					int i;
-					for(i=0;i < MAX_CLIENTS;i++)
-					{
-						if(m_apPlayers[i] && m_apPlayers[i]->GetCID() != -1 && m_apPlayers[i]->m_RaceName == TAUREN && m_apPlayers[i]->GetTeam() == p->GetTeam())
-							count_tauren++;
-					}
-					if(count_tauren  < g_Config.m_SvMaxTauren)
-					{
-						char buf[128];
-						str_format(buf, sizeof(buf), "Tauren chosen");
-						SendBroadcast(buf, ClientID);
-						p->InitRpg();
-						p->m_RaceName=TAUREN;
-						if(p->GetCharacter() && p->GetCharacter()->IsAlive())
-						{
-							p->KillCharacter(-1);
-							p->m_Score++;
-						}
-					}
-					else
-					{
-						char buf[128];
-						str_format(buf, sizeof(buf), "Too much tauren in your team");
-						SendBroadcast(buf, ClientID);
-					}
-				}
-				else
-				{
-					char buf[128];
-					str_format(buf, sizeof(buf), "Wrong race : orc/human/elf/undead/tauren");
-					SendBroadcast(buf, ClientID);
-				}
-				p->m_Check=true;
-			}
-			else if(!strcmp(pMsg->m_pMessage, "/1") && p->m_Leveled)
-			{
-				char buf[128];
-				if(p->ChooseAbility(1))
-					p->m_Leveled--;
-				else
-				{
-					str_format(buf, sizeof(buf), "Wrong number");
-					SendBroadcast(buf, ClientID);
-				}
-			}
-			else if(!strcmp(pMsg->m_pMessage, "/2") && p->m_Leveled)
-			{
-				char buf[128];
-				if(p->ChooseAbility(2))
-					p->m_Leveled--;
-				else
-				{
-					str_format(buf, sizeof(buf), "Wrong number");
-					SendBroadcast(buf, ClientID);
-				}
-			}
-			else if(!strcmp(pMsg->m_pMessage, "/3") && p->m_Leveled)
-			{
-				char buf[128];
-				if(p->ChooseAbility(3))
-					p->m_Leveled--;
-				else
-				{
-					str_format(buf, sizeof(buf), "Wrong number");
-					SendBroadcast(buf, ClientID);
-				}
-					
-			}
-			else if(!strcmp(pMsg->m_pMessage, "/ability"))
-			{
-				int res=p->UseSpecial();
-				char buf[128];
-				if(res==-1)
-				{
-					str_format(buf, sizeof(buf), "You don't have a special ability yet");
-					SendBroadcast(buf, ClientID);
-				}
-				else if(res==-2)
-				{
-					str_format(buf, sizeof(buf), "You are dead!");
-					SendBroadcast(buf, ClientID);
-				}
-				else if(res == -3)
-				{
-					str_format(buf, sizeof(buf), "Error ?");
-					SendBroadcast(buf, ClientID);
-				}
-				else if(res == -4)
-				{
-					str_format(buf, sizeof(buf), "Can't teleport");
-					SendBroadcast(buf, ClientID);
-				}
-			}
-			else if(!strcmp(pMsg->m_pMessage, "/otherlvl"))
-			{
-				if(!p->PrintOtherLvl())
-				{
-					char buf[128];
-					str_format(buf, sizeof(buf), "error");
-					SendBroadcast(buf, ClientID);
-				}
-			}
-			else if(!strcmp(pMsg->m_pMessage, "/help"))
-			{
-				if(!p->PrintHelp())
-				{
-					char buf[128];
-					str_format(buf, sizeof(buf), "Error (Do you have a race ?)");
-					SendBroadcast(buf, ClientID);
-				}
-			}
-			else if(!strcmp(pMsg->m_pMessage, "/cmdlist"))
-			{
-				SendChatTarget(ClientID,"---Command List---");
-				SendChatTarget(ClientID,"For special:");
-				SendChatTarget(ClientID,"bind key say /ability (Example : \"bind f say /ability\" in F1)");
-				SendChatTarget(ClientID,"\"/race x\" where x is undead or human or orc or elf or tauren");
-				SendChatTarget(ClientID,"\".info\" mod info");
-				SendChatTarget(ClientID,"\"/help\" ... help ? ");
-				SendChatTarget(ClientID,"\"/otherlvl\" print other lvls");
-				SendChatTarget(ClientID,"\"/lvl\" your lvl");
-				SendChatTarget(ClientID,"\"/stats\" to see powerups");
-				SendChatTarget(ClientID,"\"/reset\" to reset your stats (xp will NOT reset)");
-				SendChatTarget(ClientID,"\"/1\" or \"/2\" or \"/3\" to choose a powerup");
-			}
-			else if(!strcmp(pMsg->m_pMessage, "/reset"))
-			{
-				p->ResetAll();
-			}
-			else if(!strncmp(pMsg->m_pMessage, "/",1))
-			{
-				SendChatTarget(ClientID, "Wrong command.");
-				SendChatTarget(ClientID, "Say \"/cmdlist\" for list of command available.");
-			}
-			else
-			{
-				pPlayer->m_LastChat = Server()->Tick();
-				SendChat(ClientID, Team, pMsg->m_pMessage);
-			}
-		}
-		else
-		{
-			pPlayer->m_LastChat = Server()->Tick();
 
-			// check for invalid chars
-			unsigned char *pMessage = (unsigned char *)pMsg->m_pMessage;
-			while (*pMessage)
-			{
-				if(*pMessage < 32)
-					*pMessage = ' ';
-				pMessage++;
-			}
-			
-			SendChat(ClientID, Team, pMsg->m_pMessage);
+		// check for invalid chars
+		unsigned char *pMessage = (unsigned char *)pMsg->m_pMessage;
+		while (*pMessage)
+		{
+			if(*pMessage < 32)
+				*pMessage = ' ';
+			pMessage++;
 		}
-
+		
+		SendChat(ClientID, Team, pMsg->m_pMessage);
 	}
 	else if(MsgID == NETMSGTYPE_CL_CALLVOTE)
 	{
@@ -919,27 +753,18 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 
 		if(str_comp_nocase(pMsg->m_Type, "option") == 0)
 		{
-			CVoteOptionServer *pOption = m_pVoteOptionFirst;
-			while(pOption)
-			{
-				if(str_comp_nocase(pMsg->m_Value, pOption->m_aDescription) == 0)
-				{
-					str_format(aChatmsg, sizeof(aChatmsg), "'%s' called vote to change server option '%s' (%s)", Server()->ClientName(ClientID),
-								pOption->m_aDescription, pReason);
-					str_format(aDesc, sizeof(aDesc), "%s", pOption->m_aDescription);
-					str_format(aCmd, sizeof(aCmd), "%s", pOption->m_aCommand);
-					break;
-				}
-
-				pOption = pOption->m_pNext;
-			}
-			
+			CVoteOptionServer *pOption = m_pVoteOptions->Find(pMsg->m_Value);
 			if(!pOption)
 			{
 				str_format(aChatmsg, sizeof(aChatmsg), "'%s' isn't an option on this server", pMsg->m_Value);
 				SendChatTarget(ClientID, aChatmsg);
 				return;
 			}
+
+			str_format(aChatmsg, sizeof(aChatmsg), "'%s' called vote to change server option '%s' (%s)", Server()->ClientName(ClientID),
+						pOption->m_aDescription, pReason);
+			str_format(aDesc, sizeof(aDesc), "%s", pOption->m_aDescription);
+			str_format(aCmd, sizeof(aCmd), "%s", pOption->m_aCommand);
 		}
 		else if(str_comp_nocase(pMsg->m_Type, "kick") == 0)
 		{
@@ -952,7 +777,7 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 			if(g_Config.m_SvVoteKickMin)
 			{
 				int PlayerNum = 0;
-				for(int i = 0; i < MAX_CLIENTS; ++i)
+				for(int i = m_PlayerMask.first(); i >= 0; i = m_PlayerMask.next(i))
 					if(m_apPlayers[i] && m_apPlayers[i]->GetTeam() != TEAM_SPECTATORS)
 						++PlayerNum;
 
@@ -1130,77 +955,10 @@ void CGameContext::OnMessage(int MsgID, CUnpacker *pUnpacker, int ClientID)
 		pPlayer->m_TeeInfos.m_ColorFeet = pMsg->m_ColorFeet;
 		m_pController->OnPlayerInfoChange(pPlayer);
 
-		// send vote options
+		// send vote options, the list follows over the next ticks
 		CNetMsg_Sv_VoteClearOptions ClearMsg;
 		Server()->SendPackMsg(&ClearMsg, MSGFLAG_VITAL, ClientID);
-		
-		CNetMsg_Sv_VoteOptionListAdd OptionMsg;
-		int NumOptions = 0;
-		OptionMsg.m_pDescription0 = "";
-		OptionMsg.m_pDescription1 = "";
-		OptionMsg.m_pDescription2 = "";
-		OptionMsg.m_pDescription3 = "";
-		OptionMsg.m_pDescription4 = "";
-		OptionMsg.m_pDescription5 = "";
-		OptionMsg.m_pDescription6 = "";
-		OptionMsg.m_pDescription7 = "";
-		OptionMsg.m_pDescription8 = "";
-		OptionMsg.m_pDescription9 = "";
-		OptionMsg.m_pDescription10 = "";
-		OptionMsg.m_pDescription11 = "";
-		OptionMsg.m_pDescription12 = "";
-		OptionMsg.m_pDescription13 = "";
-		OptionMsg.m_pDescription14 = "";
-		CVoteOptionServer *pCurrent = m_pVoteOptionFirst;
-		while(pCurrent)
-		{
-			switch(NumOptions++)
-			{
-			case 0: OptionMsg.m_pDescription0 = pCurrent->m_aDescription; break;
-			case 1: OptionMsg.m_pDescription1 = pCurrent->m_aDescription; break;
-			case 2: OptionMsg.m_pDescription2 = pCurrent->m_aDescription; break;
-			case 3: OptionMsg.m_pDescription3 = pCurrent->m_aDescription; break;
-			case 4: OptionMsg.m_pDescription4 = pCurrent->m_aDescription; break;
-			case 5: OptionMsg.m_pDescription5 = pCurrent->m_aDescription; break;
-			case 6: OptionMsg.m_pDescription6 = pCurrent->m_aDescription; break;
-			case 7: OptionMsg.m_pDescription7 = pCurrent->m_aDescription; break;
-			case 8: OptionMsg.m_pDescription8 = pCurrent->m_aDescription; break;
-			case 9: OptionMsg.m_pDescription9 = pCurrent->m_aDescription; break;
-			case 10: OptionMsg.m_pDescription10 = pCurrent->m_aDescription; break;
-			case 11: OptionMsg.m_pDescription11 = pCurrent->m_aDescription; break;
-			case 12: OptionMsg.m_pDescription12 = pCurrent->m_aDescription; break;
-			case 13: OptionMsg.m_pDescription13 = pCurrent->m_aDescription; break;
-			case 14:
-				{
-					OptionMsg.m_pDescription14 = pCurrent->m_aDescription;
-					OptionMsg.m_NumOptions = NumOptions;
-					Server()->SendPackMsg(&OptionMsg, MSGFLAG_VITAL, ClientID);
-					OptionMsg = CNetMsg_Sv_VoteOptionListAdd();
-					NumOptions = 0;
-					OptionMsg.m_pDescription1 = "";
-					OptionMsg.m_pDescription2 = "";
-					OptionMsg.m_pDescription3 = "";
-					OptionMsg.m_pDescription4 = "";
-					OptionMsg.m_pDescription5 = "";
-					OptionMsg.m_pDescription6 = "";
-					OptionMsg.m_pDescription7 = "";
-					OptionMsg.m_pDescription8 = "";
-					OptionMsg.m_pDescription9 = "";
-					OptionMsg.m_pDescription10 = "";
-					OptionMsg.m_pDescription11 = "";
-					OptionMsg.m_pDescription12 = "";
-					OptionMsg.m_pDescription13 = "";
-					OptionMsg.m_pDescription14 = "";
-				}
-			}
-			pCurrent = pCurrent->m_pNext;
-		}
-		if(NumOptions > 0)
-		{
-			OptionMsg.m_NumOptions = NumOptions;
-			Server()->SendPackMsg(&OptionMsg, MSGFLAG_VITAL, ClientID);
-			NumOptions = 0;
-		}
+		m_aVoteSyncPos[ClientID] = 0;
 			
 		// send tuning parameters to client
 		SendTuningParams(ClientID);
@@ -1321,6 +1079,18 @@ void CGameContext::ConTuneDump(IConsole::IResult *pResult, void *pUserData)
 	}
 }
 
+void CGameContext::ConPoolStats(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameContext *pSelf = (CGameContext *)pUserData;
+	char aBuf[256];
+	for(CEntityPoolStats *pPool = CEntityPoolStats::ms_pFirst; pPool; pPool = pPool->m_pNext)
+	{
+		str_format(aBuf, sizeof(aBuf), "%s used=%d/%d highwater=%d exhausted=%d",
+			pPool->m_pName, pPool->m_Used, pPool->m_Size, pPool->m_HighWater, pPool->m_Exhausted);
+		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "pool", aBuf);
+	}
+}
+
 void CGameContext::ConChangeMap(IConsole::IResult *pResult, void *pUserData)
 {
 	CGameContext *pSelf = (CGameContext *)pUserData;
@@ -1374,7 +1144,7 @@ void CGameContext::ConSetTeamAll(IConsole::IResult *pResult, void *pUserData)
 	str_format(aBuf, sizeof(aBuf), "moved all clients to team %d", Team);
 	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 	
-	for(int i = 0; i < MAX_CLIENTS; ++i)
+	for(int i = pSelf->m_PlayerMask.first(); i >= 0; i = pSelf->m_PlayerMask.next(i))
 		if(pSelf->m_apPlayers[i])
 			pSelf->m_apPlayers[i]->SetTeam(Team);
 	
@@ -1387,7 +1157,7 @@ void CGameContext::ConAddVote(IConsole::IResult *pResult, void *pUserData)
 	const char *pDescription = pResult->GetString(0);
 	const char *pCommand = pResult->GetString(1);
 
-	if(pSelf->m_NumVoteOptions == MAX_VOTE_OPTIONS)
+	if(pSelf->m_pVoteOptions->Num() == MAX_VOTE_OPTIONS)
 	{
 		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "maximum number of vote options reached");
 		return;
@@ -1411,43 +1181,19 @@ void CGameContext::ConAddVote(IConsole::IResult *pResult, void *pUserData)
 		return;
 	}
 	
-	// check for duplicate entry
-	CVoteOptionServer *pOption = pSelf->m_pVoteOptionFirst;
-	while(pOption)
+	// add the option, the clients get it with the option sync
+	CVoteOptionServer *pOption = pSelf->m_pVoteOptions->Add(pDescription, pCommand);
+	if(!pOption)
 	{
-		if(str_comp_nocase(pDescription, pOption->m_aDescription) == 0)
-		{
-			char aBuf[256];
-			str_format(aBuf, sizeof(aBuf), "option '%s' already exists", pDescription);
-			pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-			return;
-		}
-		pOption = pOption->m_pNext;
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "option '%s' already exists", pDescription);
+		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+		return;
 	}
-	
-	// add the option
-	++pSelf->m_NumVoteOptions;
-	int Len = str_length(pCommand);
-	
-	pOption = (CVoteOptionServer *)pSelf->m_pVoteOptionHeap->Allocate(sizeof(CVoteOptionServer) + Len);
-	pOption->m_pNext = 0;
-	pOption->m_pPrev = pSelf->m_pVoteOptionLast;
-	if(pOption->m_pPrev)
-		pOption->m_pPrev->m_pNext = pOption;
-	pSelf->m_pVoteOptionLast = pOption;
-	if(!pSelf->m_pVoteOptionFirst)
-		pSelf->m_pVoteOptionFirst = pOption;
-	
-	str_copy(pOption->m_aDescription, pDescription, sizeof(pOption->m_aDescription));
-	mem_copy(pOption->m_aCommand, pCommand, Len+1);
+
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "added option '%s' '%s'", pOption->m_aDescription, pOption->m_aCommand);
 	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
-
-	// inform clients about added option
-	CNetMsg_Sv_VoteOptionAdd OptionMsg;
-	OptionMsg.m_pDescription = pOption->m_aDescription;
-	pSelf->Server()->SendPackMsg(&OptionMsg, MSGFLAG_VITAL, -1);
 }
 
 void CGameContext::ConRemoveVote(IConsole::IResult *pResult, void *pUserData)
@@ -1456,13 +1202,7 @@ void CGameContext::ConRemoveVote(IConsole::IResult *pResult, void *pUserData)
 	const char *pDescription = pResult->GetString(0);
 	
 	// check for valid option
-	CVoteOptionServer *pOption = pSelf->m_pVoteOptionFirst;
-	while(pOption)
-	{
-		if(str_comp_nocase(pDescription, pOption->m_aDescription) == 0)
-			break;
-		pOption = pOption->m_pNext;
-	}
+	CVoteOptionServer *pOption = pSelf->m_pVoteOptions->Find(pDescription);
 	if(!pOption)
 	{
 		char aBuf[256];
@@ -1471,48 +1211,26 @@ void CGameContext::ConRemoveVote(IConsole::IResult *pResult, void *pUserData)
 		return;
 	}
 
-	// inform clients about removed option
-	CNetMsg_Sv_VoteOptionRemove OptionMsg;
-	OptionMsg.m_pDescription = pOption->m_aDescription;
-	pSelf->Server()->SendPackMsg(&OptionMsg, MSGFLAG_VITAL, -1);
-	
-	// TODO: improve this
-	// remove the option
-	--pSelf->m_NumVoteOptions;
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "removed option '%s' '%s'", pOption->m_aDescription, pOption->m_aCommand);
 	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 
-	CHeap *pVoteOptionHeap = new CHeap();
-	CVoteOptionServer *pVoteOptionFirst = 0;
-	CVoteOptionServer *pVoteOptionLast = 0;
-	int NumVoteOptions = pSelf->m_NumVoteOptions;
-	for(CVoteOptionServer *pSrc = pSelf->m_pVoteOptionFirst; pSrc; pSrc = pSrc->m_pNext)
-	{
-		if(pSrc == pOption)
-			continue;
+	char aRemoved[VOTE_DESC_LENGTH];
+	str_copy(aRemoved, pOption->m_aDescription, sizeof(aRemoved));
+	int Index = pSelf->m_pVoteOptions->Remove(pOption);
 
-		// copy option
-		int Len = str_length(pSrc->m_aCommand);
-		CVoteOptionServer *pDst = (CVoteOptionServer *)pVoteOptionHeap->Allocate(sizeof(CVoteOptionServer) + Len);
-		pDst->m_pNext = 0;
-		pDst->m_pPrev = pVoteOptionLast;
-		if(pDst->m_pPrev)
-			pDst->m_pPrev->m_pNext = pDst;
-		pVoteOptionLast = pDst;
-		if(!pVoteOptionFirst)
-			pVoteOptionFirst = pDst;
-		
-		str_copy(pDst->m_aDescription, pSrc->m_aDescription, sizeof(pDst->m_aDescription));
-		mem_copy(pDst->m_aCommand, pSrc->m_aCommand, Len+1);
+	// inform the clients that have the option already, the others
+	// won't get it from the sync anymore
+	CNetMsg_Sv_VoteOptionRemove OptionMsg;
+	OptionMsg.m_pDescription = aRemoved;
+	for(int i = pSelf->m_PlayerMask.first(); i >= 0; i = pSelf->m_PlayerMask.next(i))
+	{
+		if(pSelf->m_aVoteSyncPos[i] > Index)
+		{
+			pSelf->Server()->SendPackMsg(&OptionMsg, MSGFLAG_VITAL, i);
+			pSelf->m_aVoteSyncPos[i]--;
+		}
 	}
-
-	// clean up
-	delete pSelf->m_pVoteOptionHeap;
-	pSelf->m_pVoteOptionHeap = pVoteOptionHeap;
-	pSelf->m_pVoteOptionFirst = pVoteOptionFirst;
-	pSelf->m_pVoteOptionLast = pVoteOptionLast;
-	pSelf->m_NumVoteOptions = NumVoteOptions;
 }
 
 void CGameContext::ConForceVote(IConsole::IResult *pResult, void *pUserData)
@@ -1525,26 +1243,17 @@ void CGameContext::ConForceVote(IConsole::IResult *pResult, void *pUserData)
 
 	if(str_comp_nocase(pType, "option") == 0)
 	{
-		CVoteOptionServer *pOption = pSelf->m_pVoteOptionFirst;
-		while(pOption)
-		{
-			if(str_comp_nocase(pValue, pOption->m_aDescription) == 0)
-			{
-				str_format(aBuf, sizeof(aBuf), "admin forced server option '%s' (%s)", pValue, pReason);
-				pSelf->SendChatTarget(-1, aBuf);
-				pSelf->Console()->ExecuteLine(pOption->m_aCommand);
-				break;
-			}
-
-			pOption = pOption->m_pNext;
-		}
-			
+		CVoteOptionServer *pOption = pSelf->m_pVoteOptions->Find(pValue);
 		if(!pOption)
 		{
 			str_format(aBuf, sizeof(aBuf), "'%s' isn't an option on this server", pValue);
 			pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 			return;
 		}
+
+		str_format(aBuf, sizeof(aBuf), "admin forced server option '%s' (%s)", pValue, pReason);
+		pSelf->SendChatTarget(-1, aBuf);
+		pSelf->Console()->ExecuteLine(pOption->m_aCommand);
 	}
 	else if(str_comp_nocase(pType, "kick") == 0)
 	{
@@ -1588,11 +1297,15 @@ void CGameContext::ConClearVotes(IConsole::IResult *pResult, void *pUserData)
 
 	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "cleared votes");
 	CNetMsg_Sv_VoteClearOptions VoteClearOptionsMsg;
-	pSelf->Server()->SendPackMsg(&VoteClearOptionsMsg, MSGFLAG_VITAL, -1);
-	pSelf->m_pVoteOptionHeap->Reset();
-	pSelf->m_pVoteOptionFirst = 0;
-	pSelf->m_pVoteOptionLast = 0;
-	pSelf->m_NumVoteOptions = 0;
+	for(int i = pSelf->m_PlayerMask.first(); i >= 0; i = pSelf->m_PlayerMask.next(i))
+	{
+		if(pSelf->m_aVoteSyncPos[i] > 0)
+		{
+			pSelf->Server()->SendPackMsg(&VoteClearOptionsMsg, MSGFLAG_VITAL, i);
+			pSelf->m_aVoteSyncPos[i] = 0;
+		}
+	}
+	pSelf->m_pVoteOptions->Clear();
 }
 
 void CGameContext::ConVote(IConsole::IResult *pResult, void *pUserData)
@@ -1615,7 +1328,7 @@ void CGameContext::ConchainSpecialMotdupdate(IConsole::IResult *pResult, void *p
 		CNetMsg_Sv_Motd Msg;
 		Msg.m_pMessage = g_Config.m_SvMotd;
 		CGameContext *pSelf = (CGameContext *)pUserData;
-		for(int i = 0; i < MAX_CLIENTS; ++i)
+		for(int i = pSelf->m_PlayerMask.first(); i >= 0; i = pSelf->m_PlayerMask.next(i))
 			if(pSelf->m_apPlayers[i])
 				pSelf->Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, i);
 	}
@@ -1719,6 +1432,7 @@ void CGameContext::OnConsoleInit()
 	Console()->Register("tune", "si", CFGFLAG_SERVER, ConTuneParam, this, "");
 	Console()->Register("tune_reset", "", CFGFLAG_SERVER, ConTuneReset, this, "");
 	Console()->Register("tune_dump", "", CFGFLAG_SERVER, ConTuneDump, this, "");
+	Console()->Register("pool_stats", "", CFGFLAG_SERVER, ConPoolStats, this, "");
 
 	Console()->Register("change_map", "?r", CFGFLAG_SERVER|CFGFLAG_STORE, ConChangeMap, this, "");
 	Console()->Register("restart", "?i", CFGFLAG_SERVER|CFGFLAG_STORE, ConRestart, this, "");
@@ -1823,7 +1537,7 @@ void CGameContext::OnSnap(int ClientID)
 	m_pController->Snap(ClientID);
 	m_Events.Snap(ClientID);
 	
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = m_PlayerMask.first(); i >= 0; i = m_PlayerMask.next(i))
 	{
 		if(m_apPlayers[i])
 			m_apPlayers[i]->Snap(ClientID);
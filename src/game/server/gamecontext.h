@@ -10,10 +10,12 @@
 #include <game/layers.h>
 #include <game/voting.h>
 
+#include "chatcommands.h"
 #include "eventhandler.h"
 #include "gamecontroller.h"
 #include "gameworld.h"
 #include "player.h"
+#include "voteoptions.h"
 
 /*
 	Tick
@@ -48,6 +50,7 @@ class CGameContext : public IGameServer
 	static void ConTuneParam(IConsole::IResult *pResult, void *pUserData);
 	static void ConTuneReset(IConsole::IResult *pResult, void *pUserData);
 	static void ConTuneDump(IConsole::IResult *pResult, void *pUserData);
+	static void ConPoolStats(IConsole::IResult *pResult, void *pUserData);
 	static void ConChangeMap(IConsole::IResult *pResult, void *pUserData);
 	static void ConRestart(IConsole::IResult *pResult, void *pUserData);
 	static void ConBroadcast(IConsole::IResult *pResult, void *pUserData);
@@ -85,7 +88,9 @@ public:
 	void Clear();
 	
 	CEventHandler m_Events;
+	CChatCommands m_ChatCommands; // registered by the controller
 	CPlayer *m_apPlayers[MAX_CLIENTS];
+	CClientMask m_PlayerMask; // slots with a player, walk it instead of all of m_apPlayers
 
 	IGameController *m_pController;
 	CGameWorld m_World;
@@ -98,6 +103,8 @@ public:
 	void EndVote();
 	void SendVoteSet(int ClientID);
 	void SendVoteStatus(int ClientID, int Total, int Yes, int No);
+	void SendVoteOptions(int ClientID);
+	void CountVotes(int *pTotal, int *pYes, int *pNo);
 	void AbortVoteKickOnDisconnect(int ClientID);
 	
 	int m_VoteCreator;
@@ -107,17 +114,17 @@ public:
 	char m_aVoteDescription[VOTE_DESC_LENGTH];
 	char m_aVoteCommand[VOTE_CMD_LENGTH];
 	char m_aVoteReason[VOTE_REASON_LENGTH];
-	int m_NumVoteOptions;
 	int m_VoteEnforce;
 	enum
 	{
 		VOTE_ENFORCE_UNKNOWN=0,
 		VOTE_ENFORCE_NO,
 		VOTE_ENFORCE_YES,
+
+		VOTE_OPTIONS_PER_MSG=15, // descriptions in a NETMSGTYPE_SV_VOTEOPTIONLISTADD
 	};
-	CHeap *m_pVoteOptionHeap;
-	CVoteOptionServer *m_pVoteOptionFirst;
-	CVoteOptionServer *m_pVoteOptionLast;
+	CVoteOptions *m_pVoteOptions; // survives Clear
+	int m_aVoteSyncPos[MAX_CLIENTS]; // options the client has been sent, -1 before it asked for them
 
 	// helper functions
 	void CreateDamageInd(vec2 Pos, float AngleMod, int Amount);
@@ -125,7 +132,7 @@ public:
 	void CreateHammerHit(vec2 Pos);
 	void CreatePlayerSpawn(vec2 Pos);
 	void CreateDeath(vec2 Pos, int Who);
-	void CreateSound(vec2 Pos, int Sound, int Mask=-1);
+	void CreateSound(vec2 Pos, int Sound, CClientMask Mask=CmaskAll());
 	void CreateSoundGlobal(int Sound, int Target=-1);	
 
 
@@ -175,11 +182,6 @@ public:
 	virtual const char *NetVersion();
 };
 
-inline int CmaskAll() { return -1; }
-inline int CmaskOne(int ClientID) { return 1<<ClientID; }
-inline int CmaskAllExceptOne(int ClientID) { return 0x7fffffff^CmaskOne(ClientID); }
-inline bool CmaskIsSet(int Mask, int ClientID) { return (Mask&CmaskOne(ClientID)) != 0; }
-
 //Enum for race
 enum {VIDE=0,HUMAN,ORC,UNDEAD,ELF,TAUREN,NBRACE};
 
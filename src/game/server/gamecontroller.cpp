@@ -271,6 +271,7 @@ void IGameController::EndRound()
 	GameServer()->m_World.m_Paused = true;
 	m_GameOverTick = Server()->Tick();
 	m_SuddenDeath = 0;
+	PreloadNextMap();
 }
 
 void IGameController::ResetGame()
@@ -312,6 +313,7 @@ void IGameController::StartRound()
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "start round type='%s' teamplay='%d'", m_pGameType, m_GameFlags&GAMEFLAG_TEAMS);
 	GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
+	PreloadNextMap();
 }
 
 void IGameController::ChangeMap(const char *pToMap)
@@ -338,6 +340,18 @@ void IGameController::CycleMap()
 	if(m_RoundCount < g_Config.m_SvRoundsPerMap-1)
 		return;
 		
+	char aBuf[512];
+	GetNextMap(aBuf, sizeof(aBuf));
+	m_RoundCount = 0;
+	
+	char aBufMsg[256];
+	str_format(aBufMsg, sizeof(aBufMsg), "rotating map to %s", aBuf);
+	GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBufMsg);
+	str_copy(g_Config.m_SvMap, aBuf, sizeof(g_Config.m_SvMap));
+}
+
+void IGameController::GetNextMap(char *pBuf, int BufSize)
+{
 	// handle maprotation
 	const char *pMapRotation = g_Config.m_SvMaprotation;
 	const char *pCurrentMap = g_Config.m_SvMap;
@@ -384,17 +398,25 @@ void IGameController::CycleMap()
 	while(IsSeparator(aBuf[i]))
 		i++;
 	
-	m_RoundCount = 0;
-	
-	char aBufMsg[256];
-	str_format(aBufMsg, sizeof(aBufMsg), "rotating map to %s", &aBuf[i]);
-	GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
-	str_copy(g_Config.m_SvMap, &aBuf[i], sizeof(g_Config.m_SvMap));
+	str_copy(pBuf, &aBuf[i], BufSize);
+}
+
+void IGameController::PreloadNextMap()
+{
+	// get the map that comes after this round ready in the background
+	if(m_aMapWish[0])
+		Server()->PreloadMap(m_aMapWish);
+	else if(str_length(g_Config.m_SvMaprotation) && m_RoundCount >= g_Config.m_SvRoundsPerMap-1)
+	{
+		char aBuf[512];
+		GetNextMap(aBuf, sizeof(aBuf));
+		Server()->PreloadMap(aBuf);
+	}
 }
 
 void IGameController::PostReset()
 {
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = GameServer()->m_PlayerMask.first(); i >= 0; i = GameServer()->m_PlayerMask.next(i))
 	{
 		if(GameServer()->m_apPlayers[i])
 		{
@@ -549,7 +571,7 @@ void IGameController::Tick()
 		int aT[2] = {0,0};
 		float aTScore[2] = {0,0};
 		float aPScore[MAX_CLIENTS] = {0.0f};
-		for(int i = 0; i < MAX_CLIENTS; i++)
+		for(int i = GameServer()->m_PlayerMask.first(); i >= 0; i = GameServer()->m_PlayerMask.next(i))
 		{
 			if(GameServer()->m_apPlayers[i] && GameServer()->m_apPlayers[i]->GetTeam() != TEAM_SPECTATORS)
 			{
@@ -570,7 +592,7 @@ void IGameController::Tick()
 			{
 				CPlayer *pP = 0;
 				float PD = aTScore[M];
-				for(int i = 0; i < MAX_CLIENTS; i++)
+				for(int i = GameServer()->m_PlayerMask.first(); i >= 0; i = GameServer()->m_PlayerMask.next(i))
 				{
 					if(!GameServer()->m_apPlayers[i] || !CanBeMovedOnBalance(i))
 						continue;
@@ -599,7 +621,7 @@ void IGameController::Tick()
 	// check for inactive players
 	if(g_Config.m_SvInactiveKickTime > 0)
 	{
-		for(int i = 0; i < MAX_CLIENTS; ++i)
+		for(int i = GameServer()->m_PlayerMask.first(); i >= 0; i = GameServer()->m_PlayerMask.next(i))
 		{
 			if(GameServer()->m_apPlayers[i] && GameServer()->m_apPlayers[i]->GetTeam() != TEAM_SPECTATORS && !Server()->IsAuthed(i))
 			{
@@ -617,7 +639,7 @@ void IGameController::Tick()
 						{
 							// move player to spectator if the reserved slots aren't filled yet, kick him otherwise
 							int Spectators = 0;
-							for(int j = 0; j < MAX_CLIENTS; ++j)
+							for(int j = GameServer()->m_PlayerMask.first(); j >= 0; j = GameServer()->m_PlayerMask.next(j))
 								if(GameServer()->m_apPlayers[j] && GameServer()->m_apPlayers[j]->GetTeam() == TEAM_SPECTATORS)
 									++Spectators;
 							if(Spectators >= g_Config.m_SvSpectatorSlots)
@@ -675,7 +697,7 @@ int IGameController::GetAutoTeam(int NotThisID)
 		return 0;
 	
 	int aNumplayers[2] = {0,0};
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = GameServer()->m_PlayerMask.first(); i >= 0; i = GameServer()->m_PlayerMask.next(i))
 	{
 		if(GameServer()->m_apPlayers[i] && i != NotThisID)
 		{
@@ -699,7 +721,7 @@ bool IGameController::CanJoinTeam(int Team, int NotThisID)
 		return true;
 
 	int aNumplayers[2] = {0,0};
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = GameServer()->m_PlayerMask.first(); i >= 0; i = GameServer()->m_PlayerMask.next(i))
 	{
 		if(GameServer()->m_apPlayers[i] && i != NotThisID)
 		{
@@ -717,7 +739,7 @@ bool IGameController::CheckTeamBalance()
 		return true;
 	
 	int aT[2] = {0, 0};
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = GameServer()->m_PlayerMask.first(); i >= 0; i = GameServer()->m_PlayerMask.next(i))
 	{
 		CPlayer *pP = GameServer()->m_apPlayers[i];
 		if(pP && pP->GetTeam() != TEAM_SPECTATORS)
@@ -749,7 +771,7 @@ bool IGameController::CanChangeTeam(CPlayer *pPlayer, int JoinTeam)
 	if (!IsTeamplay() || JoinTeam == TEAM_SPECTATORS || !g_Config.m_SvTeambalanceTime)
 		return true;
 	
-	for(int i = 0; i < MAX_CLIENTS; i++)
+	for(int i = GameServer()->m_PlayerMask.first(); i >= 0; i = GameServer()->m_PlayerMask.next(i))
 	{
 		CPlayer *pP = GameServer()->m_apPlayers[i];
 		if(pP && pP->GetTeam() != TEAM_SPECTATORS)
@@ -781,7 +803,7 @@ void IGameController::DoPlayerScoreWincheck()
 		// gather some stats
 		int Topscore = 0;
 		int TopscoreCount = 0;
-		for(int i = 0; i < MAX_CLIENTS; i++)
+		for(int i = GameServer()->m_PlayerMask.first(); i >= 0; i = GameServer()->m_PlayerMask.next(i))
 		{
 			if(GameServer()->m_apPlayers[i])
 			{
@@ -43,6 +43,8 @@ protected:
 	bool EvaluateSpawn(class CPlayer *pP, vec2 *pPos);
 
 	void CycleMap();
+	void GetNextMap(char *pBuf, int BufSize);
+	void PreloadNextMap();
 	void ResetGame();
 	
 	char m_aMapWish[128];
@@ -218,7 +218,7 @@ void CGameControllerCTF::Tick()
 						Server()->ClientName(F->m_pCarryingCharacter->GetPlayer()->GetCID()));
 					GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
 					
-					for(int c = 0; c < MAX_CLIENTS; c++)
+					for(int c = GameServer()->m_PlayerMask.first(); c >= 0; c = GameServer()->m_PlayerMask.next(c))
 					{
 						if(!GameServer()->m_apPlayers[c])
 							continue;
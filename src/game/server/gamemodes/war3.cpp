@@ -5,6 +5,7 @@
 #include <game/server/player.h>
 #include <game/server/gamecontext.h>
 #include <engine/shared/config.h>
+#include <game/version.h>
 #include "war3.h"
 #include "ctf.h"
 #include <string.h>
@@ -19,6 +20,190 @@ CGameControllerWAR::CGameControllerWAR(class CGameContext *pGameServer): IGameCo
 	m_LevelMax=g_Config.m_SvLevelMax;
 	DefaultLvlMap();
 	LoadXpTable();
+	RegisterChatCommands();
+}
+
+void CGameControllerWAR::RegisterChatCommands()
+{
+	CChatCommands *pCommands = &GameServer()->m_ChatCommands;
+
+	// in the order of the command list
+	pCommands->Register("/ability", 100, ChatAbility, this, "For special: bind key say /ability (Example : \"bind f say /ability\" in F1)");
+	pCommands->Register("/race", 1000, ChatRace, this, "\"/race x\" where x is undead or human or orc or elf or tauren");
+	pCommands->Register(".info", 3000, ChatInfo, this, "\".info\" mod info");
+	pCommands->Register("/help", 1000, ChatHelp, this, "\"/help\" ... help ? ");
+	pCommands->Register("/otherlvl", 1000, ChatOtherLvl, this, "\"/otherlvl\" print other lvls");
+	pCommands->Register("/lvl", 250, ChatLvl, this, "\"/lvl\" your lvl");
+	pCommands->Register("/stats", 250, ChatStats, this, "\"/stats\" to see powerups");
+	pCommands->Register("/reset", 1000, ChatReset, this, "\"/reset\" to reset your stats (xp will NOT reset)");
+	pCommands->Register("/1", 100, ChatChoose1, this, "\"/1\" or \"/2\" or \"/3\" to choose a powerup");
+	pCommands->Register("/2", 100, ChatChoose2, this, 0);
+	pCommands->Register("/3", 100, ChatChoose3, this, 0);
+	pCommands->Register("/cmdlist", 2000, ChatCmdList, this, 0);
+}
+
+void CGameControllerWAR::ChatInfo(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	CGameControllerWAR *pSelf = (CGameControllerWAR *)pUserData;
+	char aBuf[128];
+	str_format(aBuf, sizeof(aBuf), "War3 mod %s contact Rajh. (C)Rajh(%s)", WAR3_VERSION, pSelf->Server()->ClientName(ClientID));
+	pSelf->GameServer()->SendChat(-1, CGameContext::CHAT_ALL, aBuf);
+}
+
+void CGameControllerWAR::ChatStats(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	CGameControllerWAR *pSelf = (CGameControllerWAR *)pUserData;
+	CPlayer *pPlayer = pSelf->GameServer()->m_apPlayers[ClientID];
+	if(pPlayer->m_RaceName != VIDE)
+		pSelf->DisplayStats(pPlayer, pPlayer);
+	else
+		pSelf->GameServer()->SendBroadcast("Please choose a race\n say \"/race name\"", ClientID);
+}
+
+void CGameControllerWAR::ChatLvl(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	CGameControllerWAR *pSelf = (CGameControllerWAR *)pUserData;
+	CPlayer *p = pSelf->GameServer()->m_apPlayers[ClientID];
+	char aBuf[128];
+	if(p->m_RaceName == VIDE)
+		str_format(aBuf, sizeof(aBuf), "Please choose a race\n say \"/race name\"");
+	else if(p->m_LevelMax)
+		str_format(aBuf, sizeof(aBuf), "Final Lvl\n%d points to spend(/stats)", p->m_Leveled);
+	else
+		str_format(aBuf, sizeof(aBuf), "LVL: %d | %d/%d\n%d points to spend(/stats)", p->m_Lvl, p->m_Xp, p->m_NextLvl, p->m_Leveled);
+	pSelf->GameServer()->SendBroadcast(aBuf, ClientID);
+}
+
+void CGameControllerWAR::ChatRace(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	static const struct
+	{
+		const char *m_pName;
+		int m_Race;
+		const char *m_pChosen;
+	} s_aRaces[] = {
+		{"orc", ORC, "Orc chosen"},
+		{"elf", ELF, "Elf chosen"},
+		{"undead", UNDEAD, "Undead chosen"},
+		{"human", HUMAN, "Human chosen"},
+		{"tauren", TAUREN, "Tauren chosen"},
+	};
+
+	CGameControllerWAR *pSelf = (CGameControllerWAR *)pUserData;
+	CGameContext *pGameServer = pSelf->GameServer();
+	CPlayer *p = pGameServer->m_apPlayers[ClientID];
+	if(p->GetTeam() == TEAM_SPECTATORS)
+	{
+		pGameServer->SendBroadcast("Join a team to choose a race", ClientID);
+		return;
+	}
+
+	int Index = -1;
+	for(unsigned i = 0; i < sizeof(s_aRaces)/sizeof(s_aRaces[0]); i++)
+	{
+		if(str_comp(pResult->GetString(0), s_aRaces[i].m_pName) == 0)
+			Index = i;
+	}
+
+	if(Index == -1)
+		pGameServer->SendBroadcast("Wrong race : orc/human/elf/undead/tauren", ClientID);
+	else
+	{
+		int CountTauren = 0;
+		if(s_aRaces[Index].m_Race == TAUREN)
+		{
+			for(int i = pGameServer->m_PlayerMask.first(); i >= 0; i = pGameServer->m_PlayerMask.next(i))
+			{
+				if(pGameServer->m_apPlayers[i] && pGameServer->m_apPlayers[i]->m_RaceName == TAUREN && pGameServer->m_apPlayers[i]->GetTeam() == p->GetTeam())
+					CountTauren++;
+			}
+		}
+
+		if(s_aRaces[Index].m_Race == TAUREN && CountTauren >= g_Config.m_SvMaxTauren)
+			pGameServer->SendBroadcast("Too much tauren in your team", ClientID);
+		else
+		{
+			pGameServer->SendBroadcast(s_aRaces[Index].m_pChosen, ClientID);
+			p->InitRpg();
+			p->m_RaceName = s_aRaces[Index].m_Race;
+			if(p->GetCharacter() && p->GetCharacter()->IsAlive())
+			{
+				p->KillCharacter(-1);
+				p->m_Score++;
+			}
+		}
+	}
+	p->m_Check = true;
+}
+
+void CGameControllerWAR::ChooseAbility(int ClientID, int Choice)
+{
+	CPlayer *p = GameServer()->m_apPlayers[ClientID];
+	if(!p->m_Leveled)
+		GameServer()->SendBroadcast("No points to spend", ClientID);
+	else if(p->ChooseAbility(Choice))
+		p->m_Leveled--;
+	else
+		GameServer()->SendBroadcast("Wrong number", ClientID);
+}
+
+void CGameControllerWAR::ChatChoose1(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	((CGameControllerWAR *)pUserData)->ChooseAbility(ClientID, 1);
+}
+
+void CGameControllerWAR::ChatChoose2(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	((CGameControllerWAR *)pUserData)->ChooseAbility(ClientID, 2);
+}
+
+void CGameControllerWAR::ChatChoose3(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	((CGameControllerWAR *)pUserData)->ChooseAbility(ClientID, 3);
+}
+
+void CGameControllerWAR::ChatAbility(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	CGameControllerWAR *pSelf = (CGameControllerWAR *)pUserData;
+	int Res = pSelf->GameServer()->m_apPlayers[ClientID]->UseSpecial();
+	if(Res == -1)
+		pSelf->GameServer()->SendBroadcast("You don't have a special ability yet", ClientID);
+	else if(Res == -2)
+		pSelf->GameServer()->SendBroadcast("You are dead!", ClientID);
+	else if(Res == -3)
+		pSelf->GameServer()->SendBroadcast("Error ?", ClientID);
+	else if(Res == -4)
+		pSelf->GameServer()->SendBroadcast("Can't teleport", ClientID);
+}
+
+void CGameControllerWAR::ChatOtherLvl(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	CGameControllerWAR *pSelf = (CGameControllerWAR *)pUserData;
+	if(!pSelf->GameServer()->m_apPlayers[ClientID]->PrintOtherLvl())
+		pSelf->GameServer()->SendBroadcast("error", ClientID);
+}
+
+void CGameControllerWAR::ChatHelp(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	CGameControllerWAR *pSelf = (CGameControllerWAR *)pUserData;
+	if(!pSelf->GameServer()->m_apPlayers[ClientID]->PrintHelp())
+		pSelf->GameServer()->SendBroadcast("Error (Do you have a race ?)", ClientID);
+}
+
+void CGameControllerWAR::ChatCmdList(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	CGameContext *pGameServer = ((CGameControllerWAR *)pUserData)->GameServer();
+	pGameServer->SendChatTarget(ClientID, "---Command List---");
+	for(int i = 0; i < pGameServer->m_ChatCommands.NumCommands(); i++)
+	{
+		if(pGameServer->m_ChatCommands.GetHelp(i))
+			pGameServer->SendChatTarget(ClientID, pGameServer->m_ChatCommands.GetHelp(i));
+	}
+}
+
+void CGameControllerWAR::ChatReset(IConsole::IResult *pResult, int ClientID, void *pUserData)
+{
+	((CGameControllerWAR *)pUserData)->GameServer()->m_apPlayers[ClientID]->ResetAll();
 }
 
 
@@ -256,7 +441,7 @@ void CGameControllerWAR::Tick()
 						f->m_pCarryingCharacter->GetPlayer()->GetCID(),
 						Server()->ClientName(f->m_pCarryingCharacter->GetPlayer()->GetCID()));
 					
-					for(int c = 0; c < MAX_CLIENTS; c++)
+					for(int c = GameServer()->m_PlayerMask.first(); c >= 0; c = GameServer()->m_PlayerMask.next(c))
 					{
 						if(!GameServer()->m_apPlayers[c])
 							continue;
@@ -1,6 +1,7 @@
 /* copyright (c) 2007 rajh */
 #ifndef GAME_SERVER_GAMEMODES_WAR_H
 #define GAME_SERVER_GAMEMODES_WAR_H
+#include <engine/console.h>
 #include <game/server/gamecontroller.h>
 #include <game/server/entity.h>
 
@@ -8,6 +9,23 @@
 
 class CGameControllerWAR : public IGameController
 {
+	// chat commands
+	static void ChatInfo(IConsole::IResult *pResult, int ClientID, void *pUserData);
+	static void ChatStats(IConsole::IResult *pResult, int ClientID, void *pUserData);
+	static void ChatLvl(IConsole::IResult *pResult, int ClientID, void *pUserData);
+	static void ChatRace(IConsole::IResult *pResult, int ClientID, void *pUserData);
+	static void ChatChoose1(IConsole::IResult *pResult, int ClientID, void *pUserData);
+	static void ChatChoose2(IConsole::IResult *pResult, int ClientID, void *pUserData);
+	static void ChatChoose3(IConsole::IResult *pResult, int ClientID, void *pUserData);
+	static void ChatAbility(IConsole::IResult *pResult, int ClientID, void *pUserData);
+	static void ChatOtherLvl(IConsole::IResult *pResult, int ClientID, void *pUserData);
+	static void ChatHelp(IConsole::IResult *pResult, int ClientID, void *pUserData);
+	static void ChatCmdList(IConsole::IResult *pResult, int ClientID, void *pUserData);
+	static void ChatReset(IConsole::IResult *pResult, int ClientID, void *pUserData);
+
+	void ChooseAbility(int ClientID, int Choice);
+	void RegisterChatCommands();
+
 public:
 	class CFlag *m_pFlags[2];
 	int m_apLvlMap[LVLMAX];
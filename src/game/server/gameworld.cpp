@@ -1,6 +1,9 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 
+#include <base/perf.h>
+#include <engine/shared/config.h>
+
 #include "gameworld.h"
 #include "entity.h"
 #include "gamecontext.h"
@@ -15,6 +18,7 @@ CGameWorld::CGameWorld()
 	
 	m_Paused = false;
 	m_ResetRequested = false;
+	m_ParityMismatches = 0;
 	for(int i = 0; i < NUM_ENTTYPES; i++)
 		m_apFirstEntityTypes[i] = 0;
 }
@@ -149,22 +153,50 @@ void CGameWorld::RemoveEntities()
 
 void CGameWorld::Tick()
 {
+	static const char *s_apZoneNames[NUM_ENTTYPES] = {
+		"world.projectile", "world.laser", "world.pickup", "world.flag", "world.character"
+	};
+	static int s_aTickZones[NUM_ENTTYPES];
+	static int s_DeferedZone = -1;
+	static int s_RemoveZone = -1;
+	if(s_DeferedZone == -1)
+	{
+		for(int i = 0; i < NUM_ENTTYPES; i++)
+			s_aTickZones[i] = perf_zone(s_apZoneNames[i]);
+		s_DeferedZone = perf_zone("world.defered");
+		s_RemoveZone = perf_zone("world.remove");
+	}
+
 	if(m_ResetRequested)
 		Reset();
 
+	// don't keep the workers around after going back to the classic tick
+	if(!g_Config.m_SvPhysicsThreads)
+		m_CorePhysics.SetThreads(1);
+
 	if(!m_Paused)
 	{
 		if(GameServer()->m_pController->IsForceBalanced())
 			GameServer()->SendChat(-1, CGameContext::CHAT_ALL, "Teams have been balanced");
 		// update all objects
 		for(int i = 0; i < NUM_ENTTYPES; i++)
+		{
+			CPerfScope Scope(s_aTickZones[i]);
+			if(i == ENTTYPE_CHARACTER && g_Config.m_SvPhysicsThreads)
+			{
+				TickCharacters();
+				continue;
+			}
+
 			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
 			{
 				m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
 				pEnt->Tick();
 				pEnt = m_pNextTraverseEntity;
 			}
+		}
 		
+		CPerfScope Scope(s_DeferedZone);
 		for(int i = 0; i < NUM_ENTTYPES; i++)
 			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
 			{
@@ -174,9 +206,39 @@ void CGameWorld::Tick()
 			}
 	}
 
+	CPerfScope Scope(s_RemoveZone);
 	RemoveEntities();
 }
 
+void CGameWorld::TickCharacters()
+{
+	static int s_CoreZone = perf_zone("world.character.core");
+
+	// move all cores at once, then do the rest of the character
+	// ticks in the usual order
+	CCharacterCore *apCores[MAX_CLIENTS];
+	int NumCores = 0;
+	for(CEntity *pEnt = m_apFirstEntityTypes[ENTTYPE_CHARACTER]; pEnt && NumCores < MAX_CLIENTS; pEnt = pEnt->m_pNextTypeEntity)
+		apCores[NumCores++] = ((CCharacter *)pEnt)->PrepareCoreTick();
+
+	{
+		CPerfScope Scope(s_CoreZone);
+		m_CorePhysics.SetThreads(g_Config.m_SvPhysicsThreads);
+		int Mismatches = m_CorePhysics.Tick(&m_Core, GameServer()->Collision(), apCores, NumCores, g_Config.m_DbgPhysicsParity);
+		if(Mismatches)
+		{
+			m_ParityMismatches += Mismatches;
+			dbg_msg("physics", "tick %d: %d cores differ from the serial tick (%d total)", Server()->Tick(), Mismatches, m_ParityMismatches);
+		}
+	}
+
+	for(CEntity *pEnt = m_apFirstEntityTypes[ENTTYPE_CHARACTER]; pEnt; )
+	{
+		m_pNextTraverseEntity = pEnt->m_pNextTypeEntity;
+		((CCharacter *)pEnt)->TickGameplay();
+		pEnt = m_pNextTraverseEntity;
+	}
+}
 
 // TODO: should be more general
 CCharacter *CGameWorld::IntersectCharacter(vec2 Pos0, vec2 Pos1, float Radius, vec2& NewPos, CEntity *pNotThis)
@@ -5,6 +5,8 @@
 
 #include <game/gamecore.h>
 
+#include "corephysics.h"
+
 class CEntity;
 class CCharacter;
 
@@ -29,6 +31,7 @@ public:
 private:
 	void Reset();
 	void RemoveEntities();
+	void TickCharacters();
 
 	CEntity *m_pNextTraverseEntity;
 	CEntity *m_apFirstEntityTypes[NUM_ENTTYPES];
@@ -36,6 +39,9 @@ private:
 	class CGameContext *m_pGameServer;
 	class IServer *m_pServer;
 
+	CCorePhysics m_CorePhysics;
+	int m_ParityMismatches;
+
 public:
 	class CGameContext *GameServer() { return m_pGameServer; }
 	class IServer *Server() { return m_pServer; }
@@ -0,0 +1,93 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include "voteoptions.h"
+
+static unsigned DescriptionHash(const char *pDescription)
+{
+	unsigned Hash = 5381;
+	for(; *pDescription; pDescription++)
+	{
+		char c = *pDescription;
+		if(c >= 'A' && c <= 'Z')
+			c += 'a'-'A';
+		Hash = ((Hash << 5) + Hash) + c;
+	}
+	return Hash;
+}
+
+CVoteOptions::CVoteOptions()
+{
+	m_pHeap = new CHeap();
+	m_NumOptions = 0;
+	mem_zero(m_apHash, sizeof(m_apHash));
+}
+
+CVoteOptions::~CVoteOptions()
+{
+	delete m_pHeap;
+}
+
+CVoteOptionServer *CVoteOptions::Insert(const char *pDescription, const char *pCommand)
+{
+	int Len = str_length(pCommand);
+	CVoteOptionServer *pOption = (CVoteOptionServer *)m_pHeap->Allocate(sizeof(CVoteOptionServer) + Len, sizeof(void *));
+	str_copy(pOption->m_aDescription, pDescription, sizeof(pOption->m_aDescription));
+	mem_copy(pOption->m_aCommand, pCommand, Len+1);
+
+	CVoteOptionServer **ppBucket = &m_apHash[DescriptionHash(pOption->m_aDescription)%HASH_SIZE];
+	pOption->m_pNextHash = *ppBucket;
+	*ppBucket = pOption;
+	m_apOptions[m_NumOptions++] = pOption;
+	return pOption;
+}
+
+CVoteOptionServer *CVoteOptions::Add(const char *pDescription, const char *pCommand)
+{
+	if(m_NumOptions == MAX_VOTE_OPTIONS || Find(pDescription))
+		return 0;
+	return Insert(pDescription, pCommand);
+}
+
+int CVoteOptions::Remove(const CVoteOptionServer *pOption)
+{
+	int Index = 0;
+	while(m_apOptions[Index] != pOption)
+		Index++;
+
+	// copy the others to a new heap so that removing doesn't leak
+	CHeap *pOldHeap = m_pHeap;
+	CVoteOptionServer *apOld[MAX_VOTE_OPTIONS];
+	int NumOld = m_NumOptions;
+	mem_copy(apOld, m_apOptions, sizeof(apOld[0])*NumOld);
+
+	m_pHeap = new CHeap();
+	m_NumOptions = 0;
+	mem_zero(m_apHash, sizeof(m_apHash));
+	for(int i = 0; i < NumOld; i++)
+	{
+		if(i != Index)
+			Insert(apOld[i]->m_aDescription, apOld[i]->m_aCommand);
+	}
+
+	delete pOldHeap;
+	return Index;
+}
+
+void CVoteOptions::Clear()
+{
+	m_pHeap->Reset();
+	m_NumOptions = 0;
+	mem_zero(m_apHash, sizeof(m_apHash));
+}
+
+CVoteOptionServer *CVoteOptions::Find(const char *pDescription) const
+{
+	CVoteOptionServer *pOption = m_apHash[DescriptionHash(pDescription)%HASH_SIZE];
+	for(; pOption; pOption = pOption->m_pNextHash)
+	{
+		if(str_comp_nocase(pOption->m_aDescription, pDescription) == 0)
+			break;
+	}
+	return pOption;
+}
@@ -0,0 +1,60 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef GAME_SERVER_VOTEOPTIONS_H
+#define GAME_SERVER_VOTEOPTIONS_H
+
+#include <engine/shared/memheap.h>
+#include <game/voting.h>
+
+/*
+	Class: CVoteOptions
+		The vote options of the server in the order they were added.
+		Options are found by their description through a hash table
+		that ignores the case, like the callvote messages do, and by
+		their index, which the option sync to the clients walks.
+*/
+class CVoteOptions
+{
+	enum
+	{
+		HASH_SIZE=256,
+	};
+
+	CHeap *m_pHeap;
+	CVoteOptionServer *m_apOptions[MAX_VOTE_OPTIONS];
+	int m_NumOptions;
+	CVoteOptionServer *m_apHash[HASH_SIZE];
+
+	CVoteOptionServer *Insert(const char *pDescription, const char *pCommand);
+
+public:
+	CVoteOptions();
+	~CVoteOptions();
+
+	/*
+		Function: Add
+			Appends an option.
+
+		Returns:
+			The new option, 0 when the table is full or an option with
+			the same description exists.
+	*/
+	CVoteOptionServer *Add(const char *pDescription, const char *pCommand);
+
+	/*
+		Function: Remove
+			Removes an option, the options after it move down by one.
+
+		Returns:
+			The index the option had.
+	*/
+	int Remove(const CVoteOptionServer *pOption);
+
+	void Clear();
+	CVoteOptionServer *Find(const char *pDescription) const;
+
+	int Num() const { return m_NumOptions; }
+	CVoteOptionServer *Get(int Index) const { return m_apOptions[Index]; }
+};
+
+#endif
@@ -9,7 +9,7 @@ enum
 	VOTE_CMD_LENGTH=512,
 	VOTE_REASON_LENGTH=16,
 
-	MAX_VOTE_OPTIONS=128,
+	MAX_VOTE_OPTIONS=512,
 };
 
 struct CVoteOptionClient
@@ -21,8 +21,7 @@ struct CVoteOptionClient
 
 struct CVoteOptionServer
 {
-	CVoteOptionServer *m_pNext;
-	CVoteOptionServer *m_pPrev;
+	CVoteOptionServer *m_pNextHash;
 	char m_aDescription[VOTE_DESC_LENGTH];
 	char m_aCommand[1];
 };
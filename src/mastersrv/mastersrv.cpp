@@ -1,5 +1,6 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include <engine/shared/network.h>
 #include <engine/shared/config.h>
@@ -11,38 +12,157 @@
 
 enum {
 	MTU = 1400,
-	MAX_SERVERS_PER_PACKET=77,
+	MAX_SERVERS_PER_PACKET=75, // a list packet has to stay below NET_MAX_PAYLOAD
 	MAX_PACKETS=16,
 	MAX_SERVERS=MAX_SERVERS_PER_PACKET*MAX_PACKETS,
 	MAX_BANS=128,
-	EXPIRE_TIME = 90
+	EXPIRE_TIME = 90,
+	CHECK_TRIES = 10,
+	CHECK_INTERVAL = 1, // seconds between two firewall checks
+	HASH_SIZE = 4096, // power of two
+	MAX_RECV_BATCH = 256, // packets read from a socket before the timers run
+	STATS_TIME = 10
 };
 
+/*
+	Class: CTimerHeap
+		Binary min heap of slot numbers ordered by a time. Each slot can
+		be queued once, setting the time of a queued slot moves it.
+*/
+class CTimerHeap
+{
+	struct CItem
+	{
+		int64 m_Time;
+		int m_Slot;
+	};
+
+	CItem m_aItems[MAX_SERVERS];
+	int m_aPos[MAX_SERVERS]; // position of each slot in the heap, -1 if not queued
+	int m_Num;
+
+	void Place(int Pos, const CItem &Item)
+	{
+		m_aItems[Pos] = Item;
+		m_aPos[Item.m_Slot] = Pos;
+	}
+
+	void SiftUp(int Pos)
+	{
+		CItem Item = m_aItems[Pos];
+		while(Pos > 0 && Item.m_Time < m_aItems[(Pos-1)/2].m_Time)
+		{
+			Place(Pos, m_aItems[(Pos-1)/2]);
+			Pos = (Pos-1)/2;
+		}
+		Place(Pos, Item);
+	}
+
+	void SiftDown(int Pos)
+	{
+		CItem Item = m_aItems[Pos];
+		while(Pos*2+1 < m_Num)
+		{
+			int Child = Pos*2+1;
+			if(Child+1 < m_Num && m_aItems[Child+1].m_Time < m_aItems[Child].m_Time)
+				Child++;
+			if(Item.m_Time <= m_aItems[Child].m_Time)
+				break;
+			Place(Pos, m_aItems[Child]);
+			Pos = Child;
+		}
+		Place(Pos, Item);
+	}
+
+public:
+	CTimerHeap()
+	{
+		m_Num = 0;
+		for(int i = 0; i < MAX_SERVERS; i++)
+			m_aPos[i] = -1;
+	}
+
+	void Set(int Slot, int64 Time)
+	{
+		int Pos = m_aPos[Slot];
+		if(Pos < 0)
+		{
+			Pos = m_Num++;
+			m_aItems[Pos].m_Slot = Slot;
+			m_aItems[Pos].m_Time = Time;
+			m_aPos[Slot] = Pos;
+			SiftUp(Pos);
+		}
+		else if(Time < m_aItems[Pos].m_Time)
+		{
+			m_aItems[Pos].m_Time = Time;
+			SiftUp(Pos);
+		}
+		else
+		{
+			m_aItems[Pos].m_Time = Time;
+			SiftDown(Pos);
+		}
+	}
+
+	void Remove(int Slot)
+	{
+		int Pos = m_aPos[Slot];
+		if(Pos < 0)
+			return;
+		m_aPos[Slot] = -1;
+		if(Pos == --m_Num)
+			return;
+
+		// fill the hole with the last item, it can go either way
+		Place(Pos, m_aItems[m_Num]);
+		SiftUp(Pos);
+		SiftDown(m_aPos[m_aItems[m_Num].m_Slot]);
+	}
+
+	bool Empty() const { return m_Num == 0; }
+	int64 FirstTime() const { return m_aItems[0].m_Time; }
+	int FirstSlot() const { return m_aItems[0].m_Slot; }
+};
+
+// servers that sent a heartbeat and wait for the firewall check
 struct CCheckServer
 {
 	enum ServerType m_Type;
 	NETADDR m_Address;
 	NETADDR m_AltAddress;
 	int m_TryCount;
-	int64 m_TryTime;
+	int m_aNextHash[2]; // links for the address and the alt address, see CheckLink
 };
 
 static CCheckServer m_aCheckServers[MAX_SERVERS];
+static int m_aCheckFree[MAX_SERVERS];
 static int m_NumCheckServers = 0;
+static int m_aCheckHash[HASH_SIZE];
+static CTimerHeap m_CheckTimers;
 
 struct CServerEntry
 {
 	enum ServerType m_Type;
 	NETADDR m_Address;
-	int64 m_Expire;
+	int m_NextHash;
+	int m_ListIndex; // position in the list packets of its type
 };
 
 static CServerEntry m_aServers[MAX_SERVERS];
+static int m_aServerFree[MAX_SERVERS];
 static int m_NumServers = 0;
-
+static int m_aServerHash[HASH_SIZE];
+static CTimerHeap m_ExpireTimers;
+
+/*
+	The list packets are kept up to date while servers come and go,
+	they are never rebuilt. Entry n of a type is server n%75 of
+	packet n/75, a removed server is replaced by the last one of its
+	type so that the packets stay packed.
+*/
 struct CPacketData
 {
-	int m_Size;
 	struct {
 		unsigned char m_aHeader[sizeof(SERVERBROWSE_LIST)];
 		CMastersrvAddr m_aServers[MAX_SERVERS_PER_PACKET];
@@ -50,12 +170,10 @@ struct CPacketData
 };
 
 CPacketData m_aPackets[MAX_PACKETS];
-static int m_NumPackets = 0;
 
 // legacy code
 struct CPacketDataLegacy
 {
-	int m_Size;
 	struct {
 		unsigned char m_aHeader[sizeof(SERVERBROWSE_LIST_LEGACY)];
 		CMastersrvAddrLegacy m_aServers[MAX_SERVERS_PER_PACKET];
@@ -63,7 +181,9 @@ struct CPacketDataLegacy
 };
 
 CPacketDataLegacy m_aPacketsLegacy[MAX_PACKETS];
-static int m_NumPacketsLegacy = 0;
+
+static int m_aNumListed[2] = {0}; // per server type
+static int m_aaListSlots[2][MAX_SERVERS]; // server slot of each list entry
 
 
 struct CCountPacketData
@@ -89,86 +209,136 @@ static int m_NumBans = 0;
 static CNetClient m_NetChecker; // NAT/FW checker
 static CNetClient m_NetOp; // main
 
+static int m_NumRequests = 0; // since the last stats
+
 IConsole *m_pConsole;
 
-void BuildPackets()
+static unsigned AddrHash(const NETADDR *pAddr)
 {
-	CServerEntry *pCurrent = &m_aServers[0];
-	int ServersLeft = m_NumServers;
-	m_NumPackets = 0;
-	m_NumPacketsLegacy = 0;
-	int PacketIndex = 0;
-	int PacketIndexLegacy = 0;
-	while(ServersLeft-- && (m_NumPackets + m_NumPacketsLegacy) < MAX_PACKETS)
-	{
-		if(pCurrent->m_Type == SERVERTYPE_NORMAL)
-		{
-			if(PacketIndex % MAX_SERVERS_PER_PACKET == 0)
-			{
-				PacketIndex = 0;
-				m_NumPackets++;
-			}
-
-			// copy header	
-			mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aHeader, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST));
-
-			// copy server addresses
-			if(pCurrent->m_Address.type == NETTYPE_IPV6)
-			{
-				mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp, pCurrent->m_Address.ip,
-					sizeof(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp));
-			}
-			else
-			{
-				static char IPV4Mapping[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF };
+	unsigned Hash = 5381 + pAddr->type;
+	for(int i = 0; i < (int)sizeof(pAddr->ip); i++)
+		Hash = ((Hash << 5) + Hash) + pAddr->ip[i];
+	Hash = ((Hash << 5) + Hash) + pAddr->port;
+	return Hash&(HASH_SIZE-1);
+}
 
-				mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp, IPV4Mapping, sizeof(IPV4Mapping));
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[12] = pCurrent->m_Address.ip[0];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[13] = pCurrent->m_Address.ip[1];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[14] = pCurrent->m_Address.ip[2];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[15] = pCurrent->m_Address.ip[3];
-			}
+void InitRegistry()
+{
+	for(int i = 0; i < HASH_SIZE; i++)
+	{
+		m_aCheckHash[i] = -1;
+		m_aServerHash[i] = -1;
+	}
 
-			m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aPort[0] = (pCurrent->m_Address.port>>8)&0xff;
-			m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aPort[1] = pCurrent->m_Address.port&0xff;
+	// the free slots are the ones behind the used count
+	for(int i = 0; i < MAX_SERVERS; i++)
+	{
+		m_aCheckFree[i] = i;
+		m_aServerFree[i] = i;
+	}
 
-			PacketIndex++;
+	for(int i = 0; i < MAX_PACKETS; i++)
+	{
+		mem_copy(m_aPackets[i].m_Data.m_aHeader, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST));
+		mem_copy(m_aPacketsLegacy[i].m_Data.m_aHeader, SERVERBROWSE_LIST_LEGACY, sizeof(SERVERBROWSE_LIST_LEGACY));
+	}
+}
 
-			m_aPackets[m_NumPackets-1].m_Size = sizeof(SERVERBROWSE_LIST) + sizeof(CMastersrvAddr)*PacketIndex;
+// a check server is in two chains, a link holds the slot and which of its addresses the chain is for
+static int CheckLink(int Slot, int Alt) { return (Slot<<1)|Alt; }
+static const NETADDR *CheckLinkAddr(int Link) { return (Link&1) ? &m_aCheckServers[Link>>1].m_AltAddress : &m_aCheckServers[Link>>1].m_Address; }
+static int *CheckLinkNext(int Link) { return &m_aCheckServers[Link>>1].m_aNextHash[Link&1]; }
 
-			pCurrent++;
-		}
-		else if(pCurrent->m_Type == SERVERTYPE_LEGACY)
-		{
-			if(PacketIndexLegacy % MAX_SERVERS_PER_PACKET == 0)
-			{
-				PacketIndexLegacy = 0;
-				m_NumPacketsLegacy++;
-			}
-
-			// copy header	
-			mem_copy(m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Data.m_aHeader, SERVERBROWSE_LIST_LEGACY, sizeof(SERVERBROWSE_LIST_LEGACY));
-			
-			// copy server addresses
-			mem_copy(m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Data.m_aServers[PacketIndexLegacy].m_aIp, pCurrent->m_Address.ip,
-				sizeof(m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Data.m_aServers[PacketIndexLegacy].m_aIp));
-			// 0.5 has the port in little endian on the network
-			m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Data.m_aServers[PacketIndexLegacy].m_aPort[0] = pCurrent->m_Address.port&0xff;
-			m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Data.m_aServers[PacketIndexLegacy].m_aPort[1] = (pCurrent->m_Address.port>>8)&0xff;
-
-			PacketIndexLegacy++;
-
-			m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Size = sizeof(SERVERBROWSE_LIST_LEGACY) + sizeof(CMastersrvAddrLegacy)*PacketIndexLegacy;
-
-			pCurrent++;
-		}
+// finds the check server that has the address as address or alt address
+int FindCheckServer(const NETADDR *pAddr)
+{
+	for(int Link = m_aCheckHash[AddrHash(pAddr)]; Link >= 0; Link = *CheckLinkNext(Link))
+	{
+		if(net_addr_comp(CheckLinkAddr(Link), pAddr) == 0)
+			return Link>>1;
+	}
+	return -1;
+}
+
+void RemoveCheckServer(int Slot)
+{
+	for(int Alt = 0; Alt < 2; Alt++)
+	{
+		int Link = CheckLink(Slot, Alt);
+		int *pLink = &m_aCheckHash[AddrHash(CheckLinkAddr(Link))];
+		while(*pLink != Link)
+			pLink = CheckLinkNext(*pLink);
+		*pLink = *CheckLinkNext(Link);
+	}
+
+	m_CheckTimers.Remove(Slot);
+	m_aCheckFree[--m_NumCheckServers] = Slot;
+}
+
+int FindServer(const NETADDR *pAddr)
+{
+	for(int Slot = m_aServerHash[AddrHash(pAddr)]; Slot >= 0; Slot = m_aServers[Slot].m_NextHash)
+	{
+		if(net_addr_comp(&m_aServers[Slot].m_Address, pAddr) == 0)
+			return Slot;
+	}
+	return -1;
+}
+
+// writes the address of a server into its list entry
+void WriteListEntry(int Type, int Index, const NETADDR *pAddr)
+{
+	if(Type == SERVERTYPE_NORMAL)
+	{
+		CMastersrvAddr *pEntry = &m_aPackets[Index/MAX_SERVERS_PER_PACKET].m_Data.m_aServers[Index%MAX_SERVERS_PER_PACKET];
+		if(pAddr->type == NETTYPE_IPV6)
+			mem_copy(pEntry->m_aIp, pAddr->ip, sizeof(pEntry->m_aIp));
 		else
 		{
-			*pCurrent = m_aServers[m_NumServers-1];
-			m_NumServers--;
-			dbg_msg("mastersrv", "error: server of invalid type, dropping it");
+			static char IPV4Mapping[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF };
+
+			mem_copy(pEntry->m_aIp, IPV4Mapping, sizeof(IPV4Mapping));
+			pEntry->m_aIp[12] = pAddr->ip[0];
+			pEntry->m_aIp[13] = pAddr->ip[1];
+			pEntry->m_aIp[14] = pAddr->ip[2];
+			pEntry->m_aIp[15] = pAddr->ip[3];
 		}
+
+		pEntry->m_aPort[0] = (pAddr->port>>8)&0xff;
+		pEntry->m_aPort[1] = pAddr->port&0xff;
 	}
+	else
+	{
+		CMastersrvAddrLegacy *pEntry = &m_aPacketsLegacy[Index/MAX_SERVERS_PER_PACKET].m_Data.m_aServers[Index%MAX_SERVERS_PER_PACKET];
+		mem_copy(pEntry->m_aIp, pAddr->ip, sizeof(pEntry->m_aIp));
+		// 0.5 has the port in little endian on the network
+		pEntry->m_aPort[0] = pAddr->port&0xff;
+		pEntry->m_aPort[1] = (pAddr->port>>8)&0xff;
+	}
+}
+
+void RemoveServer(int Slot)
+{
+	CServerEntry *pServer = &m_aServers[Slot];
+
+	// move the last entry of the type into the hole
+	int Type = pServer->m_Type;
+	int Last = --m_aNumListed[Type];
+	if(pServer->m_ListIndex != Last)
+	{
+		int Moved = m_aaListSlots[Type][Last];
+		m_aaListSlots[Type][pServer->m_ListIndex] = Moved;
+		m_aServers[Moved].m_ListIndex = pServer->m_ListIndex;
+		WriteListEntry(Type, pServer->m_ListIndex, &m_aServers[Moved].m_Address);
+	}
+
+	int *pLink = &m_aServerHash[AddrHash(&pServer->m_Address)];
+	while(*pLink != Slot)
+		pLink = &m_aServers[*pLink].m_NextHash;
+	*pLink = pServer->m_NextHash;
+
+	m_ExpireTimers.Remove(Slot);
+	m_aServerFree[--m_NumServers] = Slot;
 }
 
 void SendOk(NETADDR *pAddr)
@@ -209,39 +379,51 @@ void SendCheck(NETADDR *pAddr)
 
 void AddCheckserver(NETADDR *pInfo, NETADDR *pAlt, ServerType Type)
 {
-	// add server
+	// the server is checked already, its next heartbeat comes soon enough
+	if(FindCheckServer(pInfo) >= 0)
+		return;
+
 	if(m_NumCheckServers == MAX_SERVERS)
 	{
 		dbg_msg("mastersrv", "error: mastersrv is full");
 		return;
 	}
-	
-	char aAddrStr[NETADDR_MAXSTRSIZE];
-	net_addr_str(pInfo, aAddrStr, sizeof(aAddrStr));
-	char aAltAddrStr[NETADDR_MAXSTRSIZE];
-	net_addr_str(pAlt, aAltAddrStr, sizeof(aAltAddrStr));
-	dbg_msg("mastersrv", "checking: %s (%s)", aAddrStr, aAltAddrStr);
-	m_aCheckServers[m_NumCheckServers].m_Address = *pInfo;
-	m_aCheckServers[m_NumCheckServers].m_AltAddress = *pAlt;
-	m_aCheckServers[m_NumCheckServers].m_TryCount = 0;
-	m_aCheckServers[m_NumCheckServers].m_TryTime = 0;
-	m_aCheckServers[m_NumCheckServers].m_Type = Type;
-	m_NumCheckServers++;
+
+	int Slot = m_aCheckFree[m_NumCheckServers++];
+	CCheckServer *pCheck = &m_aCheckServers[Slot];
+	pCheck->m_Address = *pInfo;
+	pCheck->m_AltAddress = *pAlt;
+	pCheck->m_TryCount = 0;
+	pCheck->m_Type = Type;
+
+	for(int Alt = 0; Alt < 2; Alt++)
+	{
+		int Link = CheckLink(Slot, Alt);
+		int *pHead = &m_aCheckHash[AddrHash(CheckLinkAddr(Link))];
+		*CheckLinkNext(Link) = *pHead;
+		*pHead = Link;
+	}
+
+	// the first check goes out with the next timers
+	m_CheckTimers.Set(Slot, time_get());
 }
 
 void AddServer(NETADDR *pInfo, ServerType Type)
 {
+	int64 Expire = time_get()+time_freq()*EXPIRE_TIME;
+
 	// see if server already exists in list
-	for(int i = 0; i < m_NumServers; i++)
+	int Slot = FindServer(pInfo);
+	if(Slot >= 0)
 	{
-		if(net_addr_comp(&m_aServers[i].m_Address, pInfo) == 0)
+		if(m_aServers[Slot].m_Type == Type)
 		{
-			char aAddrStr[NETADDR_MAXSTRSIZE];
-			net_addr_str(pInfo, aAddrStr, sizeof(aAddrStr));
-			dbg_msg("mastersrv", "updated: %s", aAddrStr);
-			m_aServers[i].m_Expire = time_get()+time_freq()*EXPIRE_TIME;
+			m_ExpireTimers.Set(Slot, Expire);
 			return;
 		}
+
+		// it changed its version, list it with the other type
+		RemoveServer(Slot);
 	}
 	
 	// add server
@@ -254,65 +436,71 @@ void AddServer(NETADDR *pInfo, ServerType Type)
 	char aAddrStr[NETADDR_MAXSTRSIZE];
 	net_addr_str(pInfo, aAddrStr, sizeof(aAddrStr));
 	dbg_msg("mastersrv", "added: %s", aAddrStr);
-	m_aServers[m_NumServers].m_Address = *pInfo;
-	m_aServers[m_NumServers].m_Expire = time_get()+time_freq()*EXPIRE_TIME;
-	m_aServers[m_NumServers].m_Type = Type;
-	m_NumServers++;
+
+	Slot = m_aServerFree[m_NumServers++];
+	CServerEntry *pServer = &m_aServers[Slot];
+	pServer->m_Address = *pInfo;
+	pServer->m_Type = Type;
+
+	int *pHead = &m_aServerHash[AddrHash(pInfo)];
+	pServer->m_NextHash = *pHead;
+	*pHead = Slot;
+
+	pServer->m_ListIndex = m_aNumListed[Type]++;
+	m_aaListSlots[Type][pServer->m_ListIndex] = Slot;
+	WriteListEntry(Type, pServer->m_ListIndex, pInfo);
+
+	m_ExpireTimers.Set(Slot, Expire);
 }
 
-void UpdateServers()
+// runs the checks and expiries that are due, returns when the next one is
+int64 UpdateTimers()
 {
 	int64 Now = time_get();
 	int64 Freq = time_freq();
-	for(int i = 0; i < m_NumCheckServers; i++)
+
+	while(!m_CheckTimers.Empty() && m_CheckTimers.FirstTime() <= Now)
 	{
-		if(Now > m_aCheckServers[i].m_TryTime+Freq)
+		int Slot = m_CheckTimers.FirstSlot();
+		CCheckServer *pCheck = &m_aCheckServers[Slot];
+		if(pCheck->m_TryCount == CHECK_TRIES)
 		{
-			if(m_aCheckServers[i].m_TryCount == 10)
-			{
-				char aAddrStr[NETADDR_MAXSTRSIZE];
-				net_addr_str(&m_aCheckServers[i].m_Address, aAddrStr, sizeof(aAddrStr));
-				char aAltAddrStr[NETADDR_MAXSTRSIZE];
-				net_addr_str(&m_aCheckServers[i].m_AltAddress, aAltAddrStr, sizeof(aAltAddrStr));
-				dbg_msg("mastersrv", "check failed: %s (%s)", aAddrStr, aAltAddrStr);
-					
-				// FAIL!!
-				SendError(&m_aCheckServers[i].m_Address);
-				m_aCheckServers[i] = m_aCheckServers[m_NumCheckServers-1];
-				m_NumCheckServers--;
-				i--;
-			}
+			char aAddrStr[NETADDR_MAXSTRSIZE];
+			net_addr_str(&pCheck->m_Address, aAddrStr, sizeof(aAddrStr));
+			char aAltAddrStr[NETADDR_MAXSTRSIZE];
+			net_addr_str(&pCheck->m_AltAddress, aAltAddrStr, sizeof(aAltAddrStr));
+			dbg_msg("mastersrv", "check failed: %s (%s)", aAddrStr, aAltAddrStr);
+
+			// FAIL!!
+			SendError(&pCheck->m_Address);
+			RemoveCheckServer(Slot);
+		}
+		else
+		{
+			pCheck->m_TryCount++;
+			if(pCheck->m_TryCount&1)
+				SendCheck(&pCheck->m_Address);
 			else
-			{
-				m_aCheckServers[i].m_TryCount++;
-				m_aCheckServers[i].m_TryTime = Now;
-				if(m_aCheckServers[i].m_TryCount&1)
-					SendCheck(&m_aCheckServers[i].m_Address);
-				else
-					SendCheck(&m_aCheckServers[i].m_AltAddress);
-			}
+				SendCheck(&pCheck->m_AltAddress);
+			m_CheckTimers.Set(Slot, Now+Freq*CHECK_INTERVAL);
 		}
 	}
-}
 
-void PurgeServers()
-{
-	int64 Now = time_get();
-	int i = 0;
-	while(i < m_NumServers)
+	while(!m_ExpireTimers.Empty() && m_ExpireTimers.FirstTime() <= Now)
 	{
-		if(m_aServers[i].m_Expire < Now)
-		{
-			// remove server
-			char aAddrStr[NETADDR_MAXSTRSIZE];
-			net_addr_str(&m_aServers[i].m_Address, aAddrStr, sizeof(aAddrStr));
-			dbg_msg("mastersrv", "expired: %s", aAddrStr);
-			m_aServers[i] = m_aServers[m_NumServers-1];
-			m_NumServers--;
-		}
-		else
-			i++;
+		int Slot = m_ExpireTimers.FirstSlot();
+		char aAddrStr[NETADDR_MAXSTRSIZE];
+		net_addr_str(&m_aServers[Slot].m_Address, aAddrStr, sizeof(aAddrStr));
+		dbg_msg("mastersrv", "expired: %s", aAddrStr);
+		RemoveServer(Slot);
 	}
+
+	int64 Next = Now+Freq;
+	if(!m_CheckTimers.Empty() && m_CheckTimers.FirstTime() < Next)
+		Next = m_CheckTimers.FirstTime();
+	if(!m_ExpireTimers.Empty() && m_ExpireTimers.FirstTime() < Next)
+		Next = m_ExpireTimers.FirstTime();
+	return Next;
 }
 
 bool CheckBan(NETADDR Addr)
@@ -365,10 +553,118 @@ void ReloadBans()
 	m_pConsole->ExecuteFile("master.cfg");
 }
 
+void ProcessOpPacket(CNetChunk *pPacket)
+{
+	if(pPacket->m_DataSize == sizeof(SERVERBROWSE_HEARTBEAT)+2 &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_HEARTBEAT, sizeof(SERVERBROWSE_HEARTBEAT)) == 0)
+	{
+		NETADDR Alt;
+		unsigned char *d = (unsigned char *)pPacket->m_pData;
+		Alt = pPacket->m_Address;
+		Alt.port =
+			(d[sizeof(SERVERBROWSE_HEARTBEAT)]<<8) |
+			d[sizeof(SERVERBROWSE_HEARTBEAT)+1];
+
+		// add it
+		AddCheckserver(&pPacket->m_Address, &Alt, SERVERTYPE_NORMAL);
+	}
+	else if(pPacket->m_DataSize == sizeof(SERVERBROWSE_HEARTBEAT_LEGACY)+2 &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_HEARTBEAT_LEGACY, sizeof(SERVERBROWSE_HEARTBEAT_LEGACY)) == 0)
+	{
+		NETADDR Alt;
+		unsigned char *d = (unsigned char *)pPacket->m_pData;
+		Alt = pPacket->m_Address;
+		Alt.port =
+			(d[sizeof(SERVERBROWSE_HEARTBEAT)]<<8) |
+			d[sizeof(SERVERBROWSE_HEARTBEAT)+1];
+		
+		// add it
+		AddCheckserver(&pPacket->m_Address, &Alt, SERVERTYPE_LEGACY);
+	}
+
+	else if(pPacket->m_DataSize == sizeof(SERVERBROWSE_GETCOUNT) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_GETCOUNT, sizeof(SERVERBROWSE_GETCOUNT)) == 0)
+	{
+		CNetChunk p;
+		p.m_ClientID = -1;
+		p.m_Address = pPacket->m_Address;
+		p.m_Flags = NETSENDFLAG_CONNLESS;
+		p.m_DataSize = sizeof(m_CountData);
+		p.m_pData = &m_CountData;
+		m_CountData.m_High = (m_NumServers>>8)&0xff;
+		m_CountData.m_Low = m_NumServers&0xff;
+		m_NetOp.Send(&p);
+	}
+	else if(pPacket->m_DataSize == sizeof(SERVERBROWSE_GETCOUNT_LEGACY) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_GETCOUNT_LEGACY, sizeof(SERVERBROWSE_GETCOUNT_LEGACY)) == 0)
+	{
+		CNetChunk p;
+		p.m_ClientID = -1;
+		p.m_Address = pPacket->m_Address;
+		p.m_Flags = NETSENDFLAG_CONNLESS;
+		p.m_DataSize = sizeof(m_CountData);
+		p.m_pData = &m_CountDataLegacy;
+		m_CountDataLegacy.m_High = (m_NumServers>>8)&0xff;
+		m_CountDataLegacy.m_Low = m_NumServers&0xff;
+		m_NetOp.Send(&p);
+	}
+	else if(pPacket->m_DataSize == sizeof(SERVERBROWSE_GETLIST) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_GETLIST, sizeof(SERVERBROWSE_GETLIST)) == 0)
+	{
+		// someone requested the list, the packets are always up to date
+		CNetChunk p;
+		p.m_ClientID = -1;
+		p.m_Address = pPacket->m_Address;
+		p.m_Flags = NETSENDFLAG_CONNLESS;
+
+		for(int Index = 0; Index < m_aNumListed[SERVERTYPE_NORMAL]; Index += MAX_SERVERS_PER_PACKET)
+		{
+			int Num = min((int)MAX_SERVERS_PER_PACKET, m_aNumListed[SERVERTYPE_NORMAL]-Index);
+			p.m_DataSize = sizeof(SERVERBROWSE_LIST) + sizeof(CMastersrvAddr)*Num;
+			p.m_pData = &m_aPackets[Index/MAX_SERVERS_PER_PACKET].m_Data;
+			m_NetOp.Send(&p);
+		}
+	}
+	else if(pPacket->m_DataSize == sizeof(SERVERBROWSE_GETLIST_LEGACY) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_GETLIST_LEGACY, sizeof(SERVERBROWSE_GETLIST_LEGACY)) == 0)
+	{
+		CNetChunk p;
+		p.m_ClientID = -1;
+		p.m_Address = pPacket->m_Address;
+		p.m_Flags = NETSENDFLAG_CONNLESS;
+		
+		for(int Index = 0; Index < m_aNumListed[SERVERTYPE_LEGACY]; Index += MAX_SERVERS_PER_PACKET)
+		{
+			int Num = min((int)MAX_SERVERS_PER_PACKET, m_aNumListed[SERVERTYPE_LEGACY]-Index);
+			p.m_DataSize = sizeof(SERVERBROWSE_LIST_LEGACY) + sizeof(CMastersrvAddrLegacy)*Num;
+			p.m_pData = &m_aPacketsLegacy[Index/MAX_SERVERS_PER_PACKET].m_Data;
+			m_NetOp.Send(&p);
+		}
+	}
+}
+
+void ProcessCheckerPacket(CNetChunk *pPacket)
+{
+	if(pPacket->m_DataSize == sizeof(SERVERBROWSE_FWRESPONSE) &&
+		mem_comp(pPacket->m_pData, SERVERBROWSE_FWRESPONSE, sizeof(SERVERBROWSE_FWRESPONSE)) == 0)
+	{
+		// drops servers that were not in the CheckServers list
+		int Slot = FindCheckServer(&pPacket->m_Address);
+		if(Slot < 0)
+			return;
+
+		// remove it from checking
+		ServerType Type = m_aCheckServers[Slot].m_Type;
+		RemoveCheckServer(Slot);
+
+		AddServer(&pPacket->m_Address, Type);
+		SendOk(&pPacket->m_Address);
+	}
+}
+
 int main(int argc, const char **argv) // ignore_convention
 {
-	int64 LastBuild = 0, LastBanReload = 0;
-	ServerType Type = SERVERTYPE_INVALID;
+	int64 LastBanReload = 0, LastStats = 0;
 	NETADDR BindAddr;
 
 	dbg_logger_stdout();
@@ -393,6 +689,7 @@ int main(int argc, const char **argv) // ignore_convention
 	
 	mem_copy(m_CountData.m_Header, SERVERBROWSE_COUNT, sizeof(SERVERBROWSE_COUNT));
 	mem_copy(m_CountDataLegacy.m_Header, SERVERBROWSE_COUNT_LEGACY, sizeof(SERVERBROWSE_COUNT_LEGACY));
+	InitRegistry();
 
 	IKernel *pKernel = IKernel::Create();
 	IStorage *pStorage = CreateStorage("Teeworlds", argc, argv);
@@ -413,139 +710,30 @@ int main(int argc, const char **argv) // ignore_convention
 		m_NetOp.Update();
 		m_NetChecker.Update();
 		
-		// process m_aPackets
+		// read the sockets in batches, so that the checks and
+		// expiries still run when the packets keep coming
 		CNetChunk Packet;
-		while(m_NetOp.Recv(&Packet))
+		int NumPackets = 0;
+		while(NumPackets < MAX_RECV_BATCH && m_NetOp.Recv(&Packet))
 		{
+			NumPackets++;
+
 			// check if the server is banned
-			if(CheckBan(Packet.m_Address)) continue;
-
-			if(Packet.m_DataSize == sizeof(SERVERBROWSE_HEARTBEAT)+2 &&
-				mem_comp(Packet.m_pData, SERVERBROWSE_HEARTBEAT, sizeof(SERVERBROWSE_HEARTBEAT)) == 0)
-			{
-				NETADDR Alt;
-				unsigned char *d = (unsigned char *)Packet.m_pData;
-				Alt = Packet.m_Address;
-				Alt.port =
-					(d[sizeof(SERVERBROWSE_HEARTBEAT)]<<8) |
-					d[sizeof(SERVERBROWSE_HEARTBEAT)+1];
-
-				// add it
-				AddCheckserver(&Packet.m_Address, &Alt, SERVERTYPE_NORMAL);
-			}
-			else if(Packet.m_DataSize == sizeof(SERVERBROWSE_HEARTBEAT_LEGACY)+2 &&
-				mem_comp(Packet.m_pData, SERVERBROWSE_HEARTBEAT_LEGACY, sizeof(SERVERBROWSE_HEARTBEAT_LEGACY)) == 0)
-			{
-				NETADDR Alt;
-				unsigned char *d = (unsigned char *)Packet.m_pData;
-				Alt = Packet.m_Address;
-				Alt.port =
-					(d[sizeof(SERVERBROWSE_HEARTBEAT)]<<8) |
-					d[sizeof(SERVERBROWSE_HEARTBEAT)+1];
-				
-				// add it
-				AddCheckserver(&Packet.m_Address, &Alt, SERVERTYPE_LEGACY);
-			}
-
-			else if(Packet.m_DataSize == sizeof(SERVERBROWSE_GETCOUNT) &&
-				mem_comp(Packet.m_pData, SERVERBROWSE_GETCOUNT, sizeof(SERVERBROWSE_GETCOUNT)) == 0)
-			{
-				dbg_msg("mastersrv", "count requested, responding with %d", m_NumServers);
-
-				CNetChunk p;
-				p.m_ClientID = -1;
-				p.m_Address = Packet.m_Address;
-				p.m_Flags = NETSENDFLAG_CONNLESS;
-				p.m_DataSize = sizeof(m_CountData);
-				p.m_pData = &m_CountData;
-				m_CountData.m_High = (m_NumServers>>8)&0xff;
-				m_CountData.m_Low = m_NumServers&0xff;
-				m_NetOp.Send(&p);
-			}
-			else if(Packet.m_DataSize == sizeof(SERVERBROWSE_GETCOUNT_LEGACY) &&
-				mem_comp(Packet.m_pData, SERVERBROWSE_GETCOUNT_LEGACY, sizeof(SERVERBROWSE_GETCOUNT_LEGACY)) == 0)
-			{
-				dbg_msg("mastersrv", "count requested, responding with %d", m_NumServers);
-				
-				CNetChunk p;
-				p.m_ClientID = -1;
-				p.m_Address = Packet.m_Address;
-				p.m_Flags = NETSENDFLAG_CONNLESS;
-				p.m_DataSize = sizeof(m_CountData);
-				p.m_pData = &m_CountDataLegacy;
-				m_CountDataLegacy.m_High = (m_NumServers>>8)&0xff;
-				m_CountDataLegacy.m_Low = m_NumServers&0xff;
-				m_NetOp.Send(&p);
-			}
-			else if(Packet.m_DataSize == sizeof(SERVERBROWSE_GETLIST) &&
-				mem_comp(Packet.m_pData, SERVERBROWSE_GETLIST, sizeof(SERVERBROWSE_GETLIST)) == 0)
-			{
-				// someone requested the list
-				dbg_msg("mastersrv", "requested, responding with %d m_aServers", m_NumServers);
-
-				CNetChunk p;
-				p.m_ClientID = -1;
-				p.m_Address = Packet.m_Address;
-				p.m_Flags = NETSENDFLAG_CONNLESS;
-
-				for(int i = 0; i < m_NumPackets; i++)
-				{
-					p.m_DataSize = m_aPackets[i].m_Size;
-					p.m_pData = &m_aPackets[i].m_Data;
-					m_NetOp.Send(&p);
-				}
-			}
-			else if(Packet.m_DataSize == sizeof(SERVERBROWSE_GETLIST_LEGACY) &&
-				mem_comp(Packet.m_pData, SERVERBROWSE_GETLIST_LEGACY, sizeof(SERVERBROWSE_GETLIST_LEGACY)) == 0)
-			{
-				// someone requested the list
-				dbg_msg("mastersrv", "requested, responding with %d m_aServers", m_NumServers);
-				
-				CNetChunk p;
-				p.m_ClientID = -1;
-				p.m_Address = Packet.m_Address;
-				p.m_Flags = NETSENDFLAG_CONNLESS;
-				
-				for(int i = 0; i < m_NumPacketsLegacy; i++)
-				{
-					p.m_DataSize = m_aPacketsLegacy[i].m_Size;
-					p.m_pData = &m_aPacketsLegacy[i].m_Data;
-					m_NetOp.Send(&p);
-				}
-			}
+			if(!CheckBan(Packet.m_Address))
+				ProcessOpPacket(&Packet);
 		}
 
-		// process m_aPackets
-		while(m_NetChecker.Recv(&Packet))
+		for(int i = 0; i < MAX_RECV_BATCH && m_NetChecker.Recv(&Packet); i++)
 		{
+			NumPackets++;
+
 			// check if the server is banned
-			if(CheckBan(Packet.m_Address)) continue;
-			
-			if(Packet.m_DataSize == sizeof(SERVERBROWSE_FWRESPONSE) &&
-				mem_comp(Packet.m_pData, SERVERBROWSE_FWRESPONSE, sizeof(SERVERBROWSE_FWRESPONSE)) == 0)
-			{
-				Type = SERVERTYPE_INVALID;
-				// remove it from checking
-				for(int i = 0; i < m_NumCheckServers; i++)
-				{
-					if(net_addr_comp(&m_aCheckServers[i].m_Address, &Packet.m_Address) == 0 ||
-						net_addr_comp(&m_aCheckServers[i].m_AltAddress, &Packet.m_Address) == 0)
-					{
-						Type = m_aCheckServers[i].m_Type;
-						m_NumCheckServers--;
-						m_aCheckServers[i] = m_aCheckServers[m_NumCheckServers];
-						break;
-					}
-				}
-
-				// drops servers that were not in the CheckServers list
-				if(Type == SERVERTYPE_INVALID)
-					continue;
-
-				AddServer(&Packet.m_Address, Type);
-				SendOk(&Packet.m_Address);
-			}
+			if(!CheckBan(Packet.m_Address))
+				ProcessCheckerPacket(&Packet);
 		}
+		m_NumRequests += NumPackets;
+
+		int64 NextTimer = UpdateTimers();
 		
 		if(time_get()-LastBanReload > time_freq()*300)
 		{
@@ -554,17 +742,22 @@ int main(int argc, const char **argv) // ignore_convention
 			ReloadBans();
 		}
 
-		if(time_get()-LastBuild > time_freq()*5)
+		if(time_get()-LastStats > time_freq()*STATS_TIME)
 		{
-			LastBuild = time_get();
-			
-			PurgeServers();
-			UpdateServers();
-			BuildPackets();
+			if(m_NumRequests)
+				dbg_msg("mastersrv", "%d servers, %d checking, %d requests/s",
+					m_NumServers, m_NumCheckServers, m_NumRequests/STATS_TIME);
+			LastStats = time_get();
+			m_NumRequests = 0;
 		}
 		
-		// be nice to the CPU
-		thread_sleep(1);
+		// sleep until a packet arrives or a timer is due, the replies
+		// to the checker come in a few ms late at worst
+		if(!NumPackets)
+		{
+			int WaitMs = (int)((NextTimer-time_get())*1000/time_freq());
+			net_socket_read_wait(m_NetOp.Socket(), clamp(WaitMs, 0, 5));
+		}
 	}
 	
 	return 0;
@@ -0,0 +1,618 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+#include <base/tl/array.h>
+#include <engine/console.h>
+#include <engine/storage.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/network.h>
+#include <engine/shared/packer.h>
+#include <engine/shared/snapshot.h>
+#include <game/generated/protocol.h>
+#include <game/gamecore.h>
+
+/*
+	Batch demo analyzer. Plays demos as fast as possible on all
+	processors, one demo per worker at a time. Every worker starts with
+	its own share of the demos and steals from the others once it runs
+	out, so a few long demos don't leave the other workers idle.
+
+	For every player of every demo kills, deaths, flag events and a
+	heatmap of the positions are collected. The stats are written as
+	csv, the binary output also holds the heatmaps:
+
+		CStatsFileHeader
+		for every player:
+			CStatsPlayer
+			m_NumCells * CStatsCell
+
+	All values are native endian.
+*/
+
+enum
+{
+	MAX_WORKERS=64,
+	CELL_SIZE=64,
+
+	// same as in the server
+	WEAPON_GAME=-3,
+};
+
+struct CStatsFileHeader
+{
+	char m_aMarker[8];
+	int m_Version;
+	int m_CellSize;
+};
+
+struct CStatsPlayer
+{
+	char m_aDemo[128];
+	char m_aName[16];
+	int m_ClientID;
+	int m_Team;
+	int m_Score;
+	int m_Kills;
+	int m_Deaths;
+	int m_Suicides;
+	int m_FlagGrabs;
+	int m_FlagCaptures;
+	int m_FlagDrops;
+	int m_FirstTick;
+	int m_LastTick;
+	int m_Samples;
+	int m_NumCells;
+};
+
+struct CStatsCell
+{
+	int m_X;
+	int m_Y;
+	int m_Count;
+};
+
+static const char s_aStatsMarker[8] = "TWDSTAT";
+static const int s_StatsVersion = 1;
+
+/*
+	open addressing hash of the visited cells, only the cells a player
+	has been in are stored
+*/
+class CHeatmap
+{
+	CStatsCell *m_pCells;
+	int m_Capacity;
+	int m_Num;
+
+	static unsigned Hash(int x, int y) { return (unsigned)x*73856093u ^ (unsigned)y*19349663u; }
+
+	void Grow()
+	{
+		CStatsCell *pOld = m_pCells;
+		int OldCapacity = m_Capacity;
+		m_Capacity = m_Capacity ? m_Capacity*2 : 256;
+		m_pCells = (CStatsCell *)mem_alloc(m_Capacity*sizeof(CStatsCell), 1);
+		for(int i = 0; i < m_Capacity; i++)
+			m_pCells[i].m_Count = 0;
+		m_Num = 0;
+		for(int i = 0; i < OldCapacity; i++)
+			if(pOld[i].m_Count)
+				Insert(pOld[i].m_X, pOld[i].m_Y)->m_Count = pOld[i].m_Count;
+		mem_free(pOld);
+	}
+
+	CStatsCell *Insert(int x, int y)
+	{
+		if((m_Num+1)*2 > m_Capacity)
+			Grow();
+
+		unsigned Mask = m_Capacity-1;
+		for(unsigned i = Hash(x, y)&Mask; ; i = (i+1)&Mask)
+		{
+			CStatsCell *pCell = &m_pCells[i];
+			if(!pCell->m_Count)
+			{
+				pCell->m_X = x;
+				pCell->m_Y = y;
+				m_Num++;
+				return pCell;
+			}
+			if(pCell->m_X == x && pCell->m_Y == y)
+				return pCell;
+		}
+	}
+
+public:
+	CHeatmap() : m_pCells(0), m_Capacity(0), m_Num(0) {}
+	~CHeatmap() { mem_free(m_pCells); }
+
+	void Add(int PosX, int PosY)
+	{
+		CStatsCell *pCell = Insert(PosX/CELL_SIZE, PosY/CELL_SIZE);
+		pCell->m_Count++;
+	}
+
+	int Num() const { return m_Num; }
+
+	void Write(IOHANDLE File) const
+	{
+		for(int i = 0; i < m_Capacity; i++)
+			if(m_pCells[i].m_Count)
+				io_write(File, &m_pCells[i], sizeof(CStatsCell));
+	}
+};
+
+class CPlayer
+{
+public:
+	CStatsPlayer m_Stats;
+	CHeatmap m_Heatmap;
+};
+
+class CAnalyzer : public CDemoPlayer::IListner
+{
+	CDemoPlayer *m_pPlayer;
+	CNetObjHandler m_NetObjHandler;
+
+	array<CPlayer *> m_lpPlayers;
+	int m_aSlots[MAX_CLIENTS];
+	bool m_GotGameData;
+	int m_aFlagCarriers[2];
+	int m_NumTicks;
+	char m_aDemo[128];
+
+	CPlayer *GetPlayer(int ClientID)
+	{
+		if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aSlots[ClientID] == -1)
+			return 0;
+		return m_lpPlayers[m_aSlots[ClientID]];
+	}
+
+	void OnFlag(int Prev, int Cur)
+	{
+		if(Cur >= 0 && Cur != Prev && GetPlayer(Cur))
+			GetPlayer(Cur)->m_Stats.m_FlagGrabs++;
+		if(Prev >= 0 && Cur != Prev && GetPlayer(Prev))
+		{
+			// the flag goes back to the stand on a capture and lies
+			// around if the carrier died
+			if(Cur == FLAG_ATSTAND)
+				GetPlayer(Prev)->m_Stats.m_FlagCaptures++;
+			else if(Cur == FLAG_TAKEN)
+				GetPlayer(Prev)->m_Stats.m_FlagDrops++;
+		}
+	}
+
+public:
+	CAnalyzer(CDemoPlayer *pPlayer) : m_pPlayer(pPlayer) { Reset(""); }
+	~CAnalyzer() { Reset(""); }
+
+	void Reset(const char *pDemo)
+	{
+		for(int i = 0; i < m_lpPlayers.size(); i++)
+			delete m_lpPlayers[i];
+		m_lpPlayers.clear();
+		for(int i = 0; i < MAX_CLIENTS; i++)
+			m_aSlots[i] = -1;
+		m_GotGameData = false;
+		m_NumTicks = 0;
+		str_copy(m_aDemo, pDemo, sizeof(m_aDemo));
+	}
+
+	int NumTicks() const { return m_NumTicks; }
+
+	virtual void OnDemoPlayerSnapshot(void *pData, int Size)
+	{
+		CSnapshot *pSnap = (CSnapshot *)pData;
+		int Tick = m_pPlayer->BaseInfo()->m_CurrentTick;
+		bool aSeen[MAX_CLIENTS] = {0};
+		m_NumTicks++;
+
+		// players first, the other items refer to them
+		for(int i = 0; i < pSnap->NumItems(); i++)
+		{
+			CSnapshotItem *pItem = pSnap->GetItem(i);
+			int ID = pItem->ID();
+			if(pItem->Type() != NETOBJTYPE_CLIENTINFO || ID < 0 || ID >= MAX_CLIENTS ||
+				pSnap->GetItemSize(i) < (int)sizeof(CNetObj_ClientInfo))
+				continue;
+
+			char aName[16];
+			IntsToStr(&((const CNetObj_ClientInfo *)pItem->Data())->m_Name0, 4, aName);
+			aSeen[ID] = true;
+
+			// a slot that was empty is someone new, the name changes
+			// with the race so it isn't used to tell players apart
+			if(m_aSlots[ID] == -1)
+			{
+				CPlayer *pPlayer = new CPlayer;
+				mem_zero(&pPlayer->m_Stats, sizeof(pPlayer->m_Stats));
+				str_copy(pPlayer->m_Stats.m_aDemo, m_aDemo, sizeof(pPlayer->m_Stats.m_aDemo));
+				pPlayer->m_Stats.m_ClientID = ID;
+				pPlayer->m_Stats.m_FirstTick = Tick;
+				m_aSlots[ID] = m_lpPlayers.add(pPlayer);
+			}
+			CStatsPlayer *pStats = &m_lpPlayers[m_aSlots[ID]]->m_Stats;
+			str_copy(pStats->m_aName, aName, sizeof(pStats->m_aName));
+			pStats->m_LastTick = Tick;
+		}
+		for(int i = 0; i < MAX_CLIENTS; i++)
+			if(!aSeen[i])
+				m_aSlots[i] = -1;
+
+		for(int i = 0; i < pSnap->NumItems(); i++)
+		{
+			CSnapshotItem *pItem = pSnap->GetItem(i);
+			int Size = pSnap->GetItemSize(i);
+			if(pItem->Type() == NETOBJTYPE_CHARACTER && Size >= (int)sizeof(CNetObj_Character))
+			{
+				const CNetObj_Character *pChar = (const CNetObj_Character *)pItem->Data();
+				CPlayer *pPlayer = GetPlayer(pItem->ID());
+				if(pPlayer)
+				{
+					pPlayer->m_Heatmap.Add(pChar->m_X, pChar->m_Y);
+					pPlayer->m_Stats.m_Samples++;
+				}
+			}
+			else if(pItem->Type() == NETOBJTYPE_PLAYERINFO && Size >= (int)sizeof(CNetObj_PlayerInfo))
+			{
+				const CNetObj_PlayerInfo *pInfo = (const CNetObj_PlayerInfo *)pItem->Data();
+				CPlayer *pPlayer = GetPlayer(pInfo->m_ClientID);
+				if(pPlayer)
+				{
+					pPlayer->m_Stats.m_Team = pInfo->m_Team;
+					pPlayer->m_Stats.m_Score = pInfo->m_Score;
+				}
+			}
+			else if(pItem->Type() == NETOBJTYPE_GAMEDATA && Size >= (int)sizeof(CNetObj_GameData))
+			{
+				const CNetObj_GameData *pData = (const CNetObj_GameData *)pItem->Data();
+				if(m_GotGameData)
+				{
+					OnFlag(m_aFlagCarriers[0], pData->m_FlagCarrierRed);
+					OnFlag(m_aFlagCarriers[1], pData->m_FlagCarrierBlue);
+				}
+				m_aFlagCarriers[0] = pData->m_FlagCarrierRed;
+				m_aFlagCarriers[1] = pData->m_FlagCarrierBlue;
+				m_GotGameData = true;
+			}
+		}
+	}
+
+	virtual void OnDemoPlayerMessage(void *pData, int Size)
+	{
+		CUnpacker Unpacker;
+		Unpacker.Reset(pData, Size);
+
+		// unpack msgid and system flag
+		int Msg = Unpacker.GetInt();
+		int Sys = Msg&1;
+		Msg >>= 1;
+
+		if(Unpacker.Error() || Sys || Msg != NETMSGTYPE_SV_KILLMSG)
+			return;
+
+		CNetMsg_Sv_KillMsg *pMsg = (CNetMsg_Sv_KillMsg *)m_NetObjHandler.SecureUnpackMsg(Msg, &Unpacker);
+		if(!pMsg || pMsg->m_Weapon == WEAPON_GAME)
+			return;
+
+		CPlayer *pVictim = GetPlayer(pMsg->m_Victim);
+		if(pVictim)
+			pVictim->m_Stats.m_Deaths++;
+		if(pMsg->m_Killer == pMsg->m_Victim)
+		{
+			if(pVictim)
+				pVictim->m_Stats.m_Suicides++;
+		}
+		else if(GetPlayer(pMsg->m_Killer))
+			GetPlayer(pMsg->m_Killer)->m_Stats.m_Kills++;
+	}
+
+	void Write(IOHANDLE CsvFile, IOHANDLE BinFile)
+	{
+		for(int i = 0; i < m_lpPlayers.size(); i++)
+		{
+			CStatsPlayer *pStats = &m_lpPlayers[i]->m_Stats;
+			if(CsvFile)
+			{
+				// names can contain anything, quote them
+				char aName[64];
+				int Len = 0;
+				aName[Len++] = '"';
+				for(const char *p = pStats->m_aName; *p && Len < (int)sizeof(aName)-3; p++)
+				{
+					if(*p == '"')
+						aName[Len++] = '"';
+					aName[Len++] = *p;
+				}
+				aName[Len++] = '"';
+				aName[Len] = 0;
+
+				char aBuf[512];
+				str_format(aBuf, sizeof(aBuf), "%s,%d,%s,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d\n",
+					pStats->m_aDemo, pStats->m_ClientID, aName, pStats->m_Team, pStats->m_Score,
+					pStats->m_Kills, pStats->m_Deaths, pStats->m_Suicides,
+					pStats->m_FlagGrabs, pStats->m_FlagCaptures, pStats->m_FlagDrops,
+					pStats->m_FirstTick, pStats->m_LastTick, pStats->m_Samples);
+				io_write(CsvFile, aBuf, str_length(aBuf));
+			}
+			if(BinFile)
+			{
+				pStats->m_NumCells = m_lpPlayers[i]->m_Heatmap.Num();
+				io_write(BinFile, pStats, sizeof(*pStats));
+				m_lpPlayers[i]->m_Heatmap.Write(BinFile);
+			}
+		}
+	}
+};
+
+static IStorage *s_pStorage = 0;
+static IConsole *s_pConsole = 0;
+
+// the player reports every demo on the console, that's only shown with -v
+static bool s_Logging = false;
+
+static void StartLogging()
+{
+	if(!s_Logging)
+		dbg_logger_stdout();
+	s_Logging = true;
+}
+
+// demos to process
+struct CJob
+{
+	char m_aFilename[128];
+	int m_StorageType;
+};
+static array<CJob> s_lJobs;
+
+// output, shared by all workers
+static LOCK s_OutputLock = 0;
+static IOHANDLE s_CsvFile = 0;
+static IOHANDLE s_BinFile = 0;
+
+class CWorker
+{
+public:
+	int m_Index;
+	void *m_pThread;
+
+	// own share of the jobs, taken from the front and stolen from the back
+	LOCK m_Lock;
+	int m_Head;
+	int m_Tail;
+
+	int m_NumDemos;
+	int m_NumStolen;
+	int m_NumFailed;
+	int m_NumTicks;
+};
+
+static CWorker s_aWorkers[MAX_WORKERS];
+static int s_NumWorkers = 0;
+
+static int TakeJob(CWorker *pWorker)
+{
+	int Job = -1;
+	lock_wait(pWorker->m_Lock);
+	if(pWorker->m_Head < pWorker->m_Tail)
+		Job = pWorker->m_Head++;
+	lock_release(pWorker->m_Lock);
+	if(Job != -1)
+		return Job;
+
+	// steal from the others, starting with the next one
+	for(int i = 1; i < s_NumWorkers && Job == -1; i++)
+	{
+		CWorker *pVictim = &s_aWorkers[(pWorker->m_Index+i)%s_NumWorkers];
+		lock_wait(pVictim->m_Lock);
+		if(pVictim->m_Head < pVictim->m_Tail)
+			Job = --pVictim->m_Tail;
+		lock_release(pVictim->m_Lock);
+	}
+	if(Job != -1)
+		pWorker->m_NumStolen++;
+	return Job;
+}
+
+static void WorkerThread(void *pUser)
+{
+	CWorker *pWorker = (CWorker *)pUser;
+
+	// everything that gets written during decoding is per worker
+	CSnapshotDelta *pDelta = new CSnapshotDelta;
+	CNetObjHandler NetObjHandler;
+	for(int i = 0; i < NUM_NETOBJTYPES; i++)
+		pDelta->SetStaticsize(i, NetObjHandler.GetObjSize(i));
+
+	CDemoPlayer *pPlayer = new CDemoPlayer(pDelta);
+	CAnalyzer *pAnalyzer = new CAnalyzer(pPlayer);
+	pPlayer->SetListner(pAnalyzer);
+	pPlayer->SetBuildIndex(false);
+
+	for(int Job = TakeJob(pWorker); Job != -1; Job = TakeJob(pWorker))
+	{
+		const CJob *pJob = &s_lJobs[Job];
+		pAnalyzer->Reset(pJob->m_aFilename);
+		if(pPlayer->Load(s_pStorage, s_pConsole, pJob->m_aFilename, pJob->m_StorageType))
+		{
+			pWorker->m_NumFailed++;
+			continue;
+		}
+
+		while(pPlayer->IsPlaying() && !pPlayer->BaseInfo()->m_Paused)
+			pPlayer->NextFrame();
+		pPlayer->Stop();
+
+		lock_wait(s_OutputLock);
+		pAnalyzer->Write(s_CsvFile, s_BinFile);
+		lock_release(s_OutputLock);
+
+		pWorker->m_NumDemos++;
+		pWorker->m_NumTicks += pAnalyzer->NumTicks();
+	}
+
+	delete pAnalyzer;
+	delete pPlayer;
+	delete pDelta;
+}
+
+static int AddJob(const char *pFilename, int StorageType)
+{
+	CJob Job;
+	str_copy(Job.m_aFilename, pFilename, sizeof(Job.m_aFilename));
+	Job.m_StorageType = StorageType;
+	s_lJobs.add(Job);
+	return 0;
+}
+
+static int DemolistCallback(const char *pName, int IsDir, int StorageType, void *pUser)
+{
+	int Length = str_length(pName);
+	if(IsDir || Length < 5 || str_comp(pName+Length-5, ".demo") != 0)
+		return 0;
+
+	char aFilename[128];
+	str_format(aFilename, sizeof(aFilename), "%s/%s", (const char *)pUser, pName);
+	return AddJob(aFilename, StorageType);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	const char *pCsvFilename = 0;
+	const char *pBinFilename = 0;
+	int NumWorkers = thread_num_cpus();
+	bool Verbose = false;
+	array<const char *> lpPaths;
+
+	CNetBase::Init();
+	s_pStorage = CreateStorage("Teeworlds", argc, argv);
+	s_pConsole = CreateConsole(0);
+	if(!s_pStorage)
+		return -1;
+
+	argc--; argv++;
+	while(argc)
+	{
+		if(argc > 1 && str_comp(*argv, "-j") == 0)
+		{
+			argc--; argv++;
+			NumWorkers = str_toint(*argv);
+		}
+		else if(argc > 1 && str_comp(*argv, "-o") == 0)
+		{
+			argc--; argv++;
+			pCsvFilename = *argv;
+		}
+		else if(argc > 1 && str_comp(*argv, "-b") == 0)
+		{
+			argc--; argv++;
+			pBinFilename = *argv;
+		}
+		else if(str_comp(*argv, "-v") == 0)
+			Verbose = true;
+		else if(**argv == '-')
+		{
+			StartLogging();
+			dbg_msg("demo_analyze", "usage: demo_analyze [-j workers] [-o stats.csv] [-b stats.bin] [-v] [demo or directory...]");
+			return -1;
+		}
+		else
+			lpPaths.add(*argv);
+		argc--; argv++;
+	}
+	NumWorkers = clamp(NumWorkers, 1, (int)MAX_WORKERS);
+	if(Verbose)
+		StartLogging();
+
+	// directories are relative to the storage paths, demos is the default
+	if(!lpPaths.size())
+		lpPaths.add("demos");
+	for(int i = 0; i < lpPaths.size(); i++)
+	{
+		int Length = str_length(lpPaths[i]);
+		if(Length >= 5 && str_comp(lpPaths[i]+Length-5, ".demo") == 0)
+			AddJob(lpPaths[i], IStorage::TYPE_ALL);
+		else
+			s_pStorage->ListDirectory(IStorage::TYPE_ALL, lpPaths[i], DemolistCallback, (void *)lpPaths[i]);
+	}
+
+	if(!s_lJobs.size())
+	{
+		StartLogging();
+		dbg_msg("demo_analyze", "no demos found");
+		return -1;
+	}
+
+	if(pCsvFilename)
+	{
+		s_CsvFile = io_open(pCsvFilename, IOFLAG_WRITE);
+		if(!s_CsvFile)
+		{
+			StartLogging();
+			dbg_msg("demo_analyze", "couldn't open '%s'", pCsvFilename);
+			return -1;
+		}
+		const char *pHeader = "demo,client_id,name,team,score,kills,deaths,suicides,flag_grabs,flag_captures,flag_drops,first_tick,last_tick,samples\n";
+		io_write(s_CsvFile, pHeader, str_length(pHeader));
+	}
+	if(pBinFilename)
+	{
+		s_BinFile = io_open(pBinFilename, IOFLAG_WRITE);
+		if(!s_BinFile)
+		{
+			StartLogging();
+			dbg_msg("demo_analyze", "couldn't open '%s'", pBinFilename);
+			return -1;
+		}
+		CStatsFileHeader Header;
+		mem_copy(Header.m_aMarker, s_aStatsMarker, sizeof(Header.m_aMarker));
+		Header.m_Version = s_StatsVersion;
+		Header.m_CellSize = CELL_SIZE;
+		io_write(s_BinFile, &Header, sizeof(Header));
+	}
+
+	// hand out the demos in contiguous shares
+	int64 StartTime = time_get();
+	s_OutputLock = lock_create();
+	s_NumWorkers = min(NumWorkers, s_lJobs.size());
+	for(int i = 0; i < s_NumWorkers; i++)
+	{
+		CWorker *pWorker = &s_aWorkers[i];
+		mem_zero(pWorker, sizeof(*pWorker));
+		pWorker->m_Index = i;
+		pWorker->m_Lock = lock_create();
+		pWorker->m_Head = s_lJobs.size()*i/s_NumWorkers;
+		pWorker->m_Tail = s_lJobs.size()*(i+1)/s_NumWorkers;
+	}
+	for(int i = 0; i < s_NumWorkers; i++)
+		s_aWorkers[i].m_pThread = thread_create(WorkerThread, &s_aWorkers[i]);
+	for(int i = 0; i < s_NumWorkers; i++)
+		thread_wait(s_aWorkers[i].m_pThread);
+	float Duration = (time_get()-StartTime)/(float)time_freq();
+
+	StartLogging();
+	int NumDemos = 0, NumFailed = 0, NumTicks = 0;
+	for(int i = 0; i < s_NumWorkers; i++)
+	{
+		CWorker *pWorker = &s_aWorkers[i];
+		dbg_msg("demo_analyze", "worker %d: demos=%d stolen=%d failed=%d ticks=%d", i,
+			pWorker->m_NumDemos, pWorker->m_NumStolen, pWorker->m_NumFailed, pWorker->m_NumTicks);
+		NumDemos += pWorker->m_NumDemos;
+		NumFailed += pWorker->m_NumFailed;
+		NumTicks += pWorker->m_NumTicks;
+		lock_destroy(pWorker->m_Lock);
+	}
+	lock_destroy(s_OutputLock);
+
+	dbg_msg("demo_analyze", "%d demos (%d failed) in %.2fs with %d workers, %.1f demos/s, %.0f ticks/s",
+		NumDemos, NumFailed, Duration, s_NumWorkers, NumDemos/max(Duration, 0.001f), NumTicks/max(Duration, 0.001f));
+
+	if(s_CsvFile)
+		io_close(s_CsvFile);
+	if(s_BinFile)
+		io_close(s_BinFile);
+	return 0;
+}
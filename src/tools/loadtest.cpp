@@ -0,0 +1,933 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <math.h>
+#include <stdlib.h> //rand
+#include <base/math.h>
+#include <base/system.h>
+#include <engine/message.h>
+#include <engine/shared/compression.h>
+#include <engine/shared/network.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+#include <game/generated/protocol.h>
+#include <game/version.h>
+
+#include <zlib.h>
+
+/*
+	Headless load generator. Connects a number of scripted bots to a
+	server using the real protocol. The bots pick a race, run around,
+	hook, shoot and use their ability, the tool reports snapshot sizes
+	and bandwidth per bot. With an rcon password the 'perf' output of
+	the server is polled and printed as well.
+
+	Latency and loss can be added crapnet style, the bots then connect
+	through an internal relay.
+
+	With -m the bots download the map like a real client before they
+	join, asking for windows of the given number of chunks (0 for one
+	chunk per request). The download times are reported, run it with
+	different -l values to see how the download scales with the RTT.
+*/
+
+enum
+{
+	TICK_SPEED=50,
+	MAX_BOTS=1024,
+};
+
+static const char *s_apRaces[] = {"orc", "elf", "undead", "human", "tauren"};
+
+static CSnapshotDelta s_SnapshotDelta;
+
+// statistics
+static int s_aSnapSizes[CSnapshot::MAX_SIZE+1] = {0};
+static int s_NumSnaps = 0;
+static int s_NumEmptySnaps = 0;
+static int s_NumDeltaErrors = 0;
+static int s_NumDisconnects = 0;
+
+// map download, -1 skips it
+static int s_MapWindow = -1;
+static int s_NumDownloads = 0;
+static int s_NumBadDownloads = 0;
+static int64 s_DownloadTime = 0;
+static int64 s_MaxDownloadTime = 0;
+
+static int SnapSizePercentile(int Percent)
+{
+	int Target = (s_NumSnaps*Percent+99)/100;
+	int Seen = 0;
+	for(int i = 0; i <= CSnapshot::MAX_SIZE; i++)
+	{
+		Seen += s_aSnapSizes[i];
+		if(Seen >= Target && Seen)
+			return i;
+	}
+	return 0;
+}
+
+/*
+	the relay sits between the bots and the server and delays or drops
+	packets. every bot gets its own upstream socket so the server still
+	sees them as different clients.
+*/
+class CRelay
+{
+	struct CPacket
+	{
+		CPacket *m_pNext;
+		int m_Link; // -1 when going to a bot
+		NETADDR m_To;
+		int64 m_Timestamp;
+		int m_DataSize;
+		char m_aData[1];
+	};
+
+	struct CLink
+	{
+		NETADDR m_Bot;
+		NETSOCKET m_Upstream;
+	};
+
+	NETSOCKET m_Socket;
+	NETADDR m_ServerAddr;
+	CLink m_aLinks[MAX_BOTS];
+	int m_NumLinks;
+	short m_aPortLink[65536];
+
+	CPacket *m_pFirst;
+	CPacket *m_pLast;
+
+	int m_Latency;
+	int m_Jitter;
+	int m_Loss;
+
+	void Queue(int Link, const NETADDR *pTo, const void *pData, int Size)
+	{
+		if((rand()%100) < m_Loss)
+			return;
+
+		CPacket *p = (CPacket *)mem_alloc(sizeof(CPacket)+Size, 1);
+		p->m_pNext = 0;
+		p->m_Link = Link;
+		p->m_To = *pTo;
+		p->m_Timestamp = time_get() + time_freq()*(m_Latency + (m_Jitter ? rand()%m_Jitter : 0))/1000;
+		p->m_DataSize = Size;
+		mem_copy(p->m_aData, pData, Size);
+
+		if(m_pLast)
+			m_pLast->m_pNext = p;
+		else
+			m_pFirst = p;
+		m_pLast = p;
+	}
+
+public:
+	bool Open(NETADDR ServerAddr, int Port, int Latency, int Jitter, int Loss)
+	{
+		NETADDR BindAddr = {NETTYPE_IPV4, {0}, 0};
+		BindAddr.port = Port;
+		m_Socket = net_udp_create(BindAddr);
+		if(!m_Socket.type)
+			return false;
+
+		m_ServerAddr = ServerAddr;
+		m_NumLinks = 0;
+		for(int i = 0; i < 65536; i++)
+			m_aPortLink[i] = -1;
+		m_pFirst = 0;
+		m_pLast = 0;
+		m_Latency = Latency;
+		m_Jitter = Jitter;
+		m_Loss = Loss;
+		return true;
+	}
+
+	void Update()
+	{
+		char aBuffer[NET_MAX_PACKETSIZE];
+		NETADDR From;
+		int Bytes;
+
+		// bots -> server
+		while((Bytes = net_udp_recv(m_Socket, &From, aBuffer, sizeof(aBuffer))) > 0)
+		{
+			int Link = m_aPortLink[From.port];
+			if(Link == -1)
+			{
+				if(m_NumLinks == MAX_BOTS)
+					continue;
+				NETADDR BindAddr = {NETTYPE_IPV4, {0}, 0};
+				Link = m_NumLinks++;
+				m_aLinks[Link].m_Bot = From;
+				m_aLinks[Link].m_Upstream = net_udp_create(BindAddr);
+				m_aPortLink[From.port] = Link;
+			}
+			Queue(Link, &m_ServerAddr, aBuffer, Bytes);
+		}
+
+		// server -> bots
+		for(int i = 0; i < m_NumLinks; i++)
+		{
+			while((Bytes = net_udp_recv(m_aLinks[i].m_Upstream, &From, aBuffer, sizeof(aBuffer))) > 0)
+				Queue(-1, &m_aLinks[i].m_Bot, aBuffer, Bytes);
+		}
+
+		// send everything that is due
+		int64 Now = time_get();
+		CPacket *pPrev = 0;
+		for(CPacket *p = m_pFirst; p; )
+		{
+			CPacket *pNext = p->m_pNext;
+			if(p->m_Timestamp <= Now)
+			{
+				if(p->m_Link == -1)
+					net_udp_send(m_Socket, &p->m_To, p->m_aData, p->m_DataSize);
+				else
+					net_udp_send(m_aLinks[p->m_Link].m_Upstream, &p->m_To, p->m_aData, p->m_DataSize);
+
+				if(pPrev)
+					pPrev->m_pNext = pNext;
+				else
+					m_pFirst = pNext;
+				if(m_pLast == p)
+					m_pLast = pPrev;
+				mem_free(p);
+			}
+			else
+				pPrev = p;
+			p = pNext;
+		}
+	}
+};
+
+class CBot
+{
+public:
+	enum
+	{
+		STATE_OFFLINE=0,
+		STATE_CONNECTING,
+		STATE_LOADING,
+		STATE_INGAME,
+	};
+
+	int m_ID;
+	int m_State;
+	CNetClient m_Net;
+
+	// snapshot handling
+	CSnapshotStorage m_SnapshotStorage;
+	char m_aSnapshotIncommingData[CSnapshot::MAX_SIZE];
+	unsigned m_SnapshotParts;
+	int m_CurrentRecvTick;
+	int m_AckGameTick;
+
+	// behaviour
+	CNetObj_PlayerInput m_Input;
+	int64 m_NextDecision;
+	int64 m_NextChat;
+	bool m_RaceChosen;
+	float m_Angle;
+
+	// map download
+	unsigned char *m_pMapData;
+	int m_MapSize;
+	unsigned m_MapCrc;
+	int m_MapWindow;
+	int m_MapChunk;
+	int m_MapRequested;
+	int m_MapResync;
+	int64 m_MapStartTime;
+
+	// rcon
+	const char *m_pRconPassword;
+	bool m_RconAuthed;
+
+	// statistics
+	int64 m_SentBytes;
+	int64 m_RecvBytes;
+	bool m_InfoSent;
+
+	void SendMsgEx(CMsgPacker *pMsg, int Flags, bool System)
+	{
+		CNetChunk Packet;
+		mem_zero(&Packet, sizeof(CNetChunk));
+		Packet.m_ClientID = 0;
+		Packet.m_pData = pMsg->Data();
+		Packet.m_DataSize = pMsg->Size();
+
+		// modify the message id in the packet and store the system flag
+		*((unsigned char*)Packet.m_pData) <<= 1;
+		if(System)
+			*((unsigned char*)Packet.m_pData) |= 1;
+
+		if(Flags&MSGFLAG_VITAL)
+			Packet.m_Flags |= NETSENDFLAG_VITAL;
+		if(Flags&MSGFLAG_FLUSH)
+			Packet.m_Flags |= NETSENDFLAG_FLUSH;
+
+		m_SentBytes += Packet.m_DataSize;
+		m_Net.Send(&Packet);
+	}
+
+	void SendChat(const char *pText)
+	{
+		CNetMsg_Cl_Say Msg;
+		Msg.m_Team = 0;
+		Msg.m_pMessage = pText;
+		CMsgPacker Packer(Msg.MsgID());
+		Msg.Pack(&Packer);
+		SendMsgEx(&Packer, MSGFLAG_VITAL, false);
+	}
+
+	void SendStartInfo()
+	{
+		char aName[16];
+		str_format(aName, sizeof(aName), "bot%d", m_ID);
+
+		CNetMsg_Cl_StartInfo Msg;
+		Msg.m_pName = aName;
+		Msg.m_pClan = "loadtest";
+		Msg.m_Country = -1;
+		Msg.m_pSkin = "default";
+		Msg.m_UseCustomColor = 0;
+		Msg.m_ColorBody = 0;
+		Msg.m_ColorFeet = 0;
+		CMsgPacker Packer(Msg.MsgID());
+		Msg.Pack(&Packer);
+		SendMsgEx(&Packer, MSGFLAG_VITAL|MSGFLAG_FLUSH, false);
+	}
+
+	void RequestMapData()
+	{
+		// same as the client, the window is filled up again once half of it arrived
+		int Chunk = m_MapChunk;
+		int Window = 0;
+		if(m_MapWindow)
+		{
+			int NumChunks = (m_MapSize+MAP_CHUNK_SIZE-1)/MAP_CHUNK_SIZE;
+			if(m_MapRequested >= NumChunks || m_MapRequested-m_MapChunk > m_MapWindow/2)
+				return;
+			Chunk = m_MapRequested;
+			Window = m_MapChunk+m_MapWindow-Chunk;
+			m_MapRequested = min(Chunk+Window, NumChunks);
+		}
+
+		CMsgPacker Msg(NETMSG_REQUEST_MAP_DATA);
+		Msg.AddInt(Chunk);
+		if(Window)
+			Msg.AddInt(Window);
+		SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, true);
+	}
+
+	void SendReady()
+	{
+		CMsgPacker Msg(NETMSG_READY);
+		SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, true);
+		m_State = STATE_LOADING;
+	}
+
+	void OnMapChange(CUnpacker *pUnpacker)
+	{
+		pUnpacker->GetString();
+		int MapCrc = pUnpacker->GetInt();
+		int MapSize = pUnpacker->GetInt();
+		if(pUnpacker->Error() || MapSize <= 0)
+			return;
+		int ServerWindow = pUnpacker->GetInt();
+		if(pUnpacker->Error())
+			ServerWindow = 0;
+
+		// the bots don't need the map, act as if it was loaded
+		if(s_MapWindow < 0)
+		{
+			SendReady();
+			return;
+		}
+
+		mem_free(m_pMapData);
+		m_pMapData = (unsigned char *)mem_alloc(MapSize, 1);
+		m_MapSize = MapSize;
+		m_MapCrc = MapCrc;
+		m_MapWindow = min(s_MapWindow, ServerWindow);
+		m_MapChunk = 0;
+		m_MapRequested = 0;
+		m_MapResync = -1;
+		m_MapStartTime = time_get();
+		RequestMapData();
+	}
+
+	void OnMapData(CUnpacker *pUnpacker)
+	{
+		int Last = pUnpacker->GetInt();
+		unsigned MapCrc = pUnpacker->GetInt();
+		int Chunk = pUnpacker->GetInt();
+		int Size = pUnpacker->GetInt();
+		const unsigned char *pData = pUnpacker->GetRaw(Size);
+		if(pUnpacker->Error() || Size <= 0 || !m_pMapData || MapCrc != m_MapCrc)
+			return;
+
+		if(Chunk != m_MapChunk)
+		{
+			if(m_MapWindow && Chunk > m_MapChunk && m_MapResync != m_MapChunk)
+			{
+				m_MapResync = m_MapChunk;
+				m_MapRequested = m_MapChunk;
+				RequestMapData();
+			}
+			return;
+		}
+
+		int Offset = Chunk*MAP_CHUNK_SIZE;
+		if(Offset+Size > m_MapSize)
+			return;
+		mem_copy(m_pMapData+Offset, pData, Size);
+
+		if(!Last)
+		{
+			m_MapChunk++;
+			RequestMapData();
+			return;
+		}
+
+		int64 Time = time_get()-m_MapStartTime;
+		if(crc32(0, m_pMapData, Offset+Size) != m_MapCrc || Offset+Size != m_MapSize)
+		{
+			dbg_msg("loadtest", "bot%d downloaded a broken map", m_ID);
+			s_NumBadDownloads++;
+		}
+		s_NumDownloads++;
+		s_DownloadTime += Time;
+		s_MaxDownloadTime = max(s_MaxDownloadTime, Time);
+
+		mem_free(m_pMapData);
+		m_pMapData = 0;
+		SendReady();
+	}
+
+	void OnSnapshot(int Msg, CUnpacker *pUnpacker)
+	{
+		int NumParts = 1;
+		int Part = 0;
+		int GameTick = pUnpacker->GetInt();
+		int DeltaTick = GameTick-pUnpacker->GetInt();
+		int PartSize = 0;
+		int Crc = 0;
+
+		if(Msg == NETMSG_SNAP)
+		{
+			NumParts = pUnpacker->GetInt();
+			Part = pUnpacker->GetInt();
+		}
+
+		if(Msg != NETMSG_SNAPEMPTY)
+		{
+			Crc = pUnpacker->GetInt();
+			PartSize = pUnpacker->GetInt();
+		}
+
+		// the parts are copied into a fixed buffer, don't trust the sizes
+		if(Part < 0 || Part >= NumParts || NumParts > CSnapshot::MAX_PARTS || PartSize < 0 || PartSize > MAX_SNAPSHOT_PACKSIZE)
+			return;
+
+		const char *pData = (const char *)pUnpacker->GetRaw(PartSize);
+		if(pUnpacker->Error())
+			return;
+
+		if(GameTick < m_CurrentRecvTick)
+			return;
+
+		if(GameTick != m_CurrentRecvTick)
+		{
+			m_SnapshotParts = 0;
+			m_CurrentRecvTick = GameTick;
+		}
+
+		mem_copy(m_aSnapshotIncommingData + Part*MAX_SNAPSHOT_PACKSIZE, pData, PartSize);
+		m_SnapshotParts |= 1u<<Part;
+
+		if(m_SnapshotParts != (NumParts == CSnapshot::MAX_PARTS ? 0xffffffffu : (1u<<NumParts)-1))
+			return;
+
+		static CSnapshot Emptysnap;
+		CSnapshot *pDeltaShot = &Emptysnap;
+		unsigned char aTmpBuffer2[CSnapshot::MAX_SIZE];
+		unsigned char aTmpBuffer3[CSnapshot::MAX_SIZE];
+		CSnapshot *pTmpBuffer3 = (CSnapshot*)aTmpBuffer3;
+		int CompleteSize = (NumParts-1) * MAX_SNAPSHOT_PACKSIZE + PartSize;
+
+		m_SnapshotParts = 0;
+		Emptysnap.Clear();
+
+		if(DeltaTick >= 0 && m_SnapshotStorage.Get(DeltaTick, 0, &pDeltaShot, 0) < 0)
+		{
+			// the server used a snapshot we don't have, force a resync
+			s_NumDeltaErrors++;
+			m_AckGameTick = -1;
+			return;
+		}
+
+		void *pDeltaData = s_SnapshotDelta.EmptyDelta();
+		int DeltaSize = sizeof(int)*3;
+		if(CompleteSize)
+		{
+			int IntSize = CVariableInt::Decompress(m_aSnapshotIncommingData, CompleteSize, aTmpBuffer2);
+			if(IntSize < 0)
+				return;
+			pDeltaData = aTmpBuffer2;
+			DeltaSize = IntSize;
+		}
+
+		int SnapSize = s_SnapshotDelta.UnpackDelta(pDeltaShot, pTmpBuffer3, pDeltaData, DeltaSize);
+		if(SnapSize < 0 || (Msg != NETMSG_SNAPEMPTY && pTmpBuffer3->Crc() != Crc))
+		{
+			s_NumDeltaErrors++;
+			m_AckGameTick = -1;
+			return;
+		}
+
+		s_aSnapSizes[CompleteSize]++;
+		s_NumSnaps++;
+		if(Msg == NETMSG_SNAPEMPTY)
+			s_NumEmptySnaps++;
+
+		// keep the last second around to unpack the next deltas
+		m_SnapshotStorage.PurgeUntil(GameTick-TICK_SPEED);
+		m_SnapshotStorage.Add(GameTick, time_get(), SnapSize, pTmpBuffer3, 0);
+		m_AckGameTick = GameTick;
+	}
+
+	void OnPacket(CNetChunk *pPacket)
+	{
+		CUnpacker Unpacker;
+		Unpacker.Reset(pPacket->m_pData, pPacket->m_DataSize);
+		m_RecvBytes += pPacket->m_DataSize;
+
+		int Msg = Unpacker.GetInt();
+		int Sys = Msg&1;
+		Msg >>= 1;
+
+		if(Unpacker.Error() || !Sys)
+			return;
+
+		if(Msg == NETMSG_MAP_CHANGE)
+			OnMapChange(&Unpacker);
+		else if(Msg == NETMSG_MAP_DATA)
+			OnMapData(&Unpacker);
+		else if(Msg == NETMSG_CON_READY)
+		{
+			SendStartInfo();
+			CMsgPacker Msg(NETMSG_ENTERGAME);
+			SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, true);
+			m_State = STATE_INGAME;
+			m_NextChat = time_get() + time_freq()*(1+rand()%3);
+		}
+		else if(Msg == NETMSG_PING)
+		{
+			CMsgPacker Msg(NETMSG_PING_REPLY);
+			SendMsgEx(&Msg, 0, true);
+		}
+		else if(Msg == NETMSG_RCON_AUTH_STATUS)
+		{
+			int Result = Unpacker.GetInt();
+			if(Unpacker.Error() == 0)
+				m_RconAuthed = Result != 0;
+		}
+		else if(Msg == NETMSG_RCON_LINE)
+		{
+			const char *pLine = Unpacker.GetString();
+			if(Unpacker.Error() == 0 && str_find(pLine, "[perf]"))
+				dbg_msg("server", "%s", pLine);
+		}
+		else if(Msg == NETMSG_SNAP || Msg == NETMSG_SNAPSINGLE || Msg == NETMSG_SNAPEMPTY)
+		{
+			if(m_State == STATE_INGAME)
+				OnSnapshot(Msg, &Unpacker);
+		}
+	}
+
+	void Think()
+	{
+		int64 Now = time_get();
+
+		// change what we are doing every now and then
+		if(Now > m_NextDecision)
+		{
+			m_Input.m_Direction = rand()%3-1;
+			m_Input.m_Jump = (rand()%4) == 0;
+			m_Input.m_Hook = (rand()%3) == 0;
+			if((rand()%2) == 0)
+				m_Input.m_Fire++; // press or release
+			if((rand()%5) == 0)
+				m_Input.m_WantedWeapon = rand()%NUM_WEAPONS + 1;
+			m_NextDecision = Now + time_freq()*(100+rand()%900)/1000;
+		}
+
+		m_Angle += 0.05f;
+		m_Input.m_TargetX = (int)(cosf(m_Angle)*100.0f);
+		m_Input.m_TargetY = (int)(sinf(m_Angle)*100.0f);
+		m_Input.m_PlayerFlags = PLAYERFLAG_PLAYING;
+
+		if(Now > m_NextChat)
+		{
+			if(!m_RaceChosen)
+			{
+				char aBuf[32];
+				str_format(aBuf, sizeof(aBuf), "/race %s", s_apRaces[rand()%5]);
+				SendChat(aBuf);
+				m_RaceChosen = true;
+			}
+			else if(rand()%2)
+				SendChat("/ability");
+			else
+			{
+				char aBuf[8];
+				str_format(aBuf, sizeof(aBuf), "/%d", 1+rand()%3);
+				SendChat(aBuf);
+			}
+			m_NextChat = Now + time_freq()*(5+rand()%20);
+		}
+	}
+
+	void SendInput()
+	{
+		if(m_CurrentRecvTick <= 0)
+			return;
+
+		CMsgPacker Msg(NETMSG_INPUT);
+		Msg.AddInt(m_AckGameTick);
+		Msg.AddInt(m_CurrentRecvTick+2); // roughly where a real client would predict to
+		Msg.AddInt(sizeof(m_Input));
+		int *pData = (int *)&m_Input;
+		for(unsigned i = 0; i < sizeof(m_Input)/4; i++)
+			Msg.AddInt(pData[i]);
+		SendMsgEx(&Msg, MSGFLAG_FLUSH, true);
+	}
+
+	bool Connect(int ID, NETADDR *pAddr, const char *pRconPassword)
+	{
+		NETADDR BindAddr = {NETTYPE_IPV4, {0}, 0};
+		if(!m_Net.Open(BindAddr, 0))
+			return false;
+
+		m_ID = ID;
+		m_State = STATE_CONNECTING;
+		m_SnapshotStorage.Init();
+		m_SnapshotParts = 0;
+		m_CurrentRecvTick = 0;
+		m_AckGameTick = -1;
+		mem_zero(&m_Input, sizeof(m_Input));
+		m_NextDecision = 0;
+		m_NextChat = 0;
+		m_RaceChosen = false;
+		m_Angle = (rand()%628)/100.0f;
+		m_pRconPassword = pRconPassword;
+		m_RconAuthed = false;
+		m_SentBytes = 0;
+		m_RecvBytes = 0;
+		m_InfoSent = false;
+		m_pMapData = 0;
+		m_MapSize = 0;
+
+		m_Net.Connect(pAddr);
+		return true;
+	}
+
+	void Update()
+	{
+		if(m_State == STATE_OFFLINE)
+			return;
+
+		m_Net.Update();
+
+		int NetState = m_Net.State();
+		if(NetState == NETSTATE_OFFLINE)
+		{
+			dbg_msg("loadtest", "bot%d disconnected: %s", m_ID, m_Net.ErrorString());
+			m_State = STATE_OFFLINE;
+			m_SnapshotStorage.PurgeAll();
+			m_Net.Close();
+			s_NumDisconnects++;
+			return;
+		}
+
+		if(m_State == STATE_CONNECTING && NetState == NETSTATE_ONLINE && !m_InfoSent)
+		{
+			CMsgPacker Msg(NETMSG_INFO);
+			Msg.AddString(GAME_NETVERSION, 128);
+			Msg.AddString("", 128);
+			SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, true);
+
+			if(m_pRconPassword)
+			{
+				CMsgPacker Msg(NETMSG_RCON_AUTH);
+				Msg.AddString("", 32);
+				Msg.AddString(m_pRconPassword, 32);
+				SendMsgEx(&Msg, MSGFLAG_VITAL, true);
+			}
+			m_InfoSent = true;
+		}
+
+		CNetChunk Packet;
+		while(m_Net.Recv(&Packet))
+		{
+			if(Packet.m_ClientID != -1)
+				OnPacket(&Packet);
+		}
+	}
+
+	void Tick()
+	{
+		if(m_State != STATE_INGAME)
+			return;
+		Think();
+		SendInput();
+	}
+
+	void Rcon(const char *pCmd)
+	{
+		if(!m_RconAuthed)
+			return;
+		CMsgPacker Msg(NETMSG_RCON_CMD);
+		Msg.AddString(pCmd, 256);
+		SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, true);
+	}
+
+	void Disconnect()
+	{
+		mem_free(m_pMapData);
+		m_pMapData = 0;
+		if(m_State == STATE_OFFLINE)
+			return;
+		m_Net.Disconnect("load test done");
+		m_Net.Update();
+		m_Net.Close();
+		m_SnapshotStorage.PurgeAll();
+		m_State = STATE_OFFLINE;
+	}
+};
+
+static CBot *s_apBots[MAX_BOTS] = {0};
+static int s_NumBots = 0;
+
+static void Report(int64 Interval)
+{
+	int NumIngame = 0;
+	int64 Sent = 0;
+	int64 Recv = 0;
+	for(int i = 0; i < s_NumBots; i++)
+	{
+		if(s_apBots[i]->m_State == CBot::STATE_INGAME)
+			NumIngame++;
+		Sent += s_apBots[i]->m_SentBytes;
+		Recv += s_apBots[i]->m_RecvBytes;
+		s_apBots[i]->m_SentBytes = 0;
+		s_apBots[i]->m_RecvBytes = 0;
+	}
+
+	float Seconds = Interval/(float)time_freq();
+	int PerBot = NumIngame ? NumIngame : 1;
+	dbg_msg("loadtest", "bots=%d/%d ingame disconnects=%d", NumIngame, s_NumBots, s_NumDisconnects);
+	dbg_msg("loadtest", "per bot: recv=%.2fkB/s send=%.2fkB/s (payload)",
+		Recv/Seconds/1024.0f/PerBot, Sent/Seconds/1024.0f/PerBot);
+	if(s_NumSnaps)
+		dbg_msg("loadtest", "snapshots=%d empty=%d delta_errors=%d size p50=%d p90=%d p99=%d max=%d bytes",
+			s_NumSnaps, s_NumEmptySnaps, s_NumDeltaErrors,
+			SnapSizePercentile(50), SnapSizePercentile(90), SnapSizePercentile(99), SnapSizePercentile(100));
+	if(s_NumDownloads)
+		dbg_msg("loadtest", "map downloads=%d broken=%d time avg=%.2fs max=%.2fs",
+			s_NumDownloads, s_NumBadDownloads, s_DownloadTime/(float)time_freq()/s_NumDownloads, s_MaxDownloadTime/(float)time_freq());
+
+	mem_zero(s_aSnapSizes, sizeof(s_aSnapSizes));
+	s_NumSnaps = 0;
+	s_NumEmptySnaps = 0;
+	s_NumDeltaErrors = 0;
+	s_NumDownloads = 0;
+	s_NumBadDownloads = 0;
+	s_DownloadTime = 0;
+	s_MaxDownloadTime = 0;
+}
+
+static int Run(NETADDR ServerAddr, int NumBots, int ConnectRate, int Duration, int ReportInterval, const char *pRconPassword, CRelay *pRelay)
+{
+	int64 Start = time_get();
+	int64 NextConnect = Start;
+	int64 NextTick = Start;
+	int64 LastReport = Start;
+	int64 NextReport = Start + time_freq()*ReportInterval;
+
+	while(Duration == 0 || time_get() < Start + time_freq()*Duration)
+	{
+		int64 Now = time_get();
+
+		// ramp up
+		if(s_NumBots < NumBots && Now >= NextConnect)
+		{
+			CBot *pBot = new CBot;
+			// the first bot does the rcon polling
+			if(!pBot->Connect(s_NumBots, &ServerAddr, s_NumBots == 0 ? pRconPassword : 0))
+			{
+				dbg_msg("loadtest", "couldn't open socket for bot%d", s_NumBots);
+				delete pBot;
+				break;
+			}
+			s_apBots[s_NumBots++] = pBot;
+			NextConnect = Now + time_freq()/ConnectRate;
+		}
+
+		if(pRelay)
+			pRelay->Update();
+
+		for(int i = 0; i < s_NumBots; i++)
+			s_apBots[i]->Update();
+
+		if(Now >= NextTick)
+		{
+			for(int i = 0; i < s_NumBots; i++)
+				s_apBots[i]->Tick();
+			NextTick += time_freq()/TICK_SPEED;
+			if(NextTick < Now)
+				NextTick = Now;
+		}
+
+		if(Now >= NextReport)
+		{
+			Report(Now-LastReport);
+			if(s_NumBots)
+				s_apBots[0]->Rcon("perf");
+			LastReport = Now;
+			NextReport = Now + time_freq()*ReportInterval;
+		}
+
+		thread_sleep(1);
+	}
+
+	Report(time_get()-LastReport);
+	for(int i = 0; i < s_NumBots; i++)
+	{
+		s_apBots[i]->Disconnect();
+		delete s_apBots[i];
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *pServer = "127.0.0.1:8303";
+	const char *pRconPassword = 0;
+	int NumBots = 16;
+	int ConnectRate = 10;
+	int Duration = 60;
+	int ReportInterval = 5;
+	int Latency = 0;
+	int Jitter = 0;
+	int Loss = 0;
+	int RelayPort = 8310;
+
+	dbg_logger_stdout();
+	net_init();
+	CNetBase::Init();
+
+	argc--; argv++;
+	while(argc > 0)
+	{
+		if(argc > 1 && str_comp(*argv, "-s") == 0)
+		{
+			argc--; argv++;
+			pServer = *argv;
+		}
+		else if(argc > 1 && str_comp(*argv, "-n") == 0)
+		{
+			argc--; argv++;
+			NumBots = clamp(str_toint(*argv), 1, (int)MAX_BOTS);
+		}
+		else if(argc > 1 && str_comp(*argv, "-c") == 0)
+		{
+			argc--; argv++;
+			ConnectRate = max(str_toint(*argv), 1);
+		}
+		else if(argc > 1 && str_comp(*argv, "-t") == 0)
+		{
+			argc--; argv++;
+			Duration = max(str_toint(*argv), 0);
+		}
+		else if(argc > 1 && str_comp(*argv, "-i") == 0)
+		{
+			argc--; argv++;
+			ReportInterval = max(str_toint(*argv), 1);
+		}
+		else if(argc > 1 && str_comp(*argv, "-r") == 0)
+		{
+			argc--; argv++;
+			pRconPassword = *argv;
+		}
+		else if(argc > 1 && str_comp(*argv, "-l") == 0)
+		{
+			argc--; argv++;
+			Latency = max(str_toint(*argv), 0);
+		}
+		else if(argc > 1 && str_comp(*argv, "-j") == 0)
+		{
+			argc--; argv++;
+			Jitter = max(str_toint(*argv), 0);
+		}
+		else if(argc > 1 && str_comp(*argv, "-p") == 0)
+		{
+			argc--; argv++;
+			RelayPort = str_toint(*argv);
+		}
+		else if(argc > 1 && str_comp(*argv, "-d") == 0)
+		{
+			argc--; argv++;
+			Loss = clamp(str_toint(*argv), 0, 100);
+		}
+		else if(argc > 1 && str_comp(*argv, "-m") == 0)
+		{
+			argc--; argv++;
+			s_MapWindow = clamp(str_toint(*argv), 0, (int)MAP_MAX_WINDOW);
+		}
+		else
+		{
+			dbg_msg("loadtest", "usage: loadtest [-s address] [-n bots] [-c connects/s] [-t seconds] [-i report seconds] [-r rcon password] [-l latency ms] [-j jitter ms] [-d loss %%] [-p relay port] [-m map window]");
+			return -1;
+		}
+		argc--; argv++;
+	}
+
+	NETADDR ServerAddr;
+	if(net_host_lookup(pServer, &ServerAddr, NETTYPE_IPV4) != 0)
+	{
+		dbg_msg("loadtest", "couldn't resolve '%s'", pServer);
+		return -1;
+	}
+	if(ServerAddr.port == 0)
+		ServerAddr.port = 8303;
+
+	CNetObjHandler NetObjHandler;
+	for(int i = 0; i < NUM_NETOBJTYPES; i++)
+		s_SnapshotDelta.SetStaticsize(i, NetObjHandler.GetObjSize(i));
+
+	// all bots come from the same address, the server needs a high enough sv_max_clients_per_ip
+	dbg_msg("loadtest", "starting %d bots against %s", NumBots, pServer);
+
+	CRelay *pRelay = 0;
+	NETADDR ConnectAddr = ServerAddr;
+	if(Latency || Jitter || Loss)
+	{
+		pRelay = new CRelay;
+		if(!pRelay->Open(ServerAddr, RelayPort, Latency, Jitter, Loss))
+		{
+			dbg_msg("loadtest", "couldn't open relay socket on port %d", RelayPort);
+			return -1;
+		}
+		net_host_lookup("127.0.0.1", &ConnectAddr, NETTYPE_IPV4);
+		ConnectAddr.port = RelayPort;
+		dbg_msg("loadtest", "relaying with latency=%dms jitter=%dms loss=%d%%", Latency, Jitter, Loss);
+	}
+
+	int Result = Run(ConnectAddr, NumBots, ConnectRate, Duration, ReportInterval, pRconPassword, pRelay);
+	delete pRelay;
+	return Result;
+}
@@ -0,0 +1,364 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+#include <base/tl/array.h>
+#include <base/tl/sorted_array.h>
+#include <engine/storage.h>
+#include <engine/shared/datafile.h>
+#include <engine/shared/jobs.h>
+#include <engine/shared/mapchecker.h>
+#include <engine/shared/mapmanifest.h>
+#include <game/mapitems.h>
+
+/*
+	Batch map pipeline. Runs every map of a folder through the release
+	checks on a job pool, one map per job:
+
+		- the map is opened and its CRC and size are taken
+		- the version, groups, layers and tile data are checked and
+		standard maps are compared against the map version list
+		- with -r the map is resaved into another folder
+
+	A resaved map has the same items and data as the original, but the
+	writer computes the size and swaplen of the header from what it
+	writes. Maps whose header holds stale values, like dm7 which is 56
+	bytes short in both, differ in these two fields and so in the CRC.
+
+	The results end up in a manifest the server can load with
+	sv_map_manifest. With -l the map version list is written as well,
+	in the format of the map_version tool.
+*/
+
+enum
+{
+	MAX_WORKERS=64,
+};
+
+class CMapJob
+{
+public:
+	CJob m_Job;
+	char m_aName[128];
+	int m_StorageType;
+
+	// results
+	bool m_Opened;
+	bool m_Valid;
+	char m_aError[128];
+	unsigned m_Crc;
+	unsigned m_Size;
+	float m_LoadTime;
+	float m_ResaveTime;
+
+	bool operator<(const CMapJob &Other) const { return str_comp(m_aName, Other.m_aName) < 0; }
+};
+
+static IStorage *s_pStorage = 0;
+static CMapChecker s_MapChecker;
+static const char *s_pPath = "maps";
+static const char *s_pResavePath = 0;
+static bool s_Logging = false;
+
+static void StartLogging()
+{
+	if(!s_Logging)
+		dbg_logger_stdout();
+	s_Logging = true;
+}
+
+static bool ValidateMap(CDataFileReader *pMap, char *pError, int ErrorSize)
+{
+	CMapItemVersion *pVersion = (CMapItemVersion *)pMap->FindItem(MAPITEMTYPE_VERSION, 0);
+	if(!pVersion || pVersion->m_Version != 1)
+	{
+		str_copy(pError, "unknown map version", ErrorSize);
+		return false;
+	}
+
+	int GroupsStart, GroupsNum, LayersStart, LayersNum;
+	pMap->GetType(MAPITEMTYPE_GROUP, &GroupsStart, &GroupsNum);
+	pMap->GetType(MAPITEMTYPE_LAYER, &LayersStart, &LayersNum);
+
+	int NumGameLayers = 0;
+	for(int g = 0; g < GroupsNum; g++)
+	{
+		CMapItemGroup *pGroup = (CMapItemGroup *)pMap->GetItem(GroupsStart+g, 0, 0);
+		if(pGroup->m_StartLayer < 0 || pGroup->m_NumLayers < 0 || pGroup->m_StartLayer+pGroup->m_NumLayers > LayersNum)
+		{
+			str_format(pError, ErrorSize, "group %d has layers out of range", g);
+			return false;
+		}
+
+		for(int l = 0; l < pGroup->m_NumLayers; l++)
+		{
+			CMapItemLayer *pLayer = (CMapItemLayer *)pMap->GetItem(LayersStart+pGroup->m_StartLayer+l, 0, 0);
+			if(pLayer->m_Type != LAYERTYPE_TILES)
+				continue;
+
+			// the tile data has to cover the whole layer
+			CMapItemLayerTilemap *pTilemap = (CMapItemLayerTilemap *)pLayer;
+			int Index = pGroup->m_StartLayer+l;
+			if(pTilemap->m_Width <= 0 || pTilemap->m_Height <= 0 || pTilemap->m_Data < 0 || pTilemap->m_Data >= pMap->NumData())
+			{
+				str_format(pError, ErrorSize, "layer %d is broken", Index);
+				return false;
+			}
+			int Expected = pTilemap->m_Width*pTilemap->m_Height*sizeof(CTile);
+			if(pMap->GetUncompressedDataSize(pTilemap->m_Data) != Expected || !pMap->GetData(pTilemap->m_Data))
+			{
+				str_format(pError, ErrorSize, "layer %d has %d bytes of tiles, expected %d", Index, pMap->GetUncompressedDataSize(pTilemap->m_Data), Expected);
+				return false;
+			}
+
+			// same flag CLayers looks for
+			if(pTilemap->m_Flags&1)
+				NumGameLayers++;
+		}
+	}
+
+	if(NumGameLayers != 1)
+	{
+		str_format(pError, ErrorSize, "%d game layers", NumGameLayers);
+		return false;
+	}
+	return true;
+}
+
+static bool ResaveMap(CDataFileReader *pMap, const char *pFilename)
+{
+	// too big for the stack of a worker
+	CDataFileWriter *pWriter = new CDataFileWriter;
+	if(!pWriter->Open(s_pStorage, pFilename))
+	{
+		delete pWriter;
+		return false;
+	}
+
+	for(int i = 0; i < pMap->NumItems(); i++)
+	{
+		int Type, ID;
+		void *pItem = pMap->GetItem(i, &Type, &ID);
+		pWriter->AddItem(Type, ID, pMap->GetItemSize(i), pItem);
+	}
+	for(int i = 0; i < pMap->NumData(); i++)
+		pWriter->AddData(pMap->GetUncompressedDataSize(i), pMap->GetData(i));
+
+	pWriter->Finish();
+	delete pWriter;
+	return true;
+}
+
+static int ProcessMap(void *pUser)
+{
+	CMapJob *pJob = (CMapJob *)pUser;
+
+	char aFilename[256];
+	str_format(aFilename, sizeof(aFilename), "%s/%s.map", s_pPath, pJob->m_aName);
+
+	// everything gets looked at, so unpack it all right away
+	int64 StartTime = time_get();
+	CDataFileReader Map;
+	pJob->m_Opened = Map.Open(s_pStorage, aFilename, pJob->m_StorageType, CDataFileReader::OPENFLAG_PRELOAD);
+	if(!pJob->m_Opened)
+	{
+		str_copy(pJob->m_aError, "couldn't open the map", sizeof(pJob->m_aError));
+		return -1;
+	}
+
+	pJob->m_Crc = Map.Crc();
+	pJob->m_Size = Map.FileSize();
+	pJob->m_Valid = ValidateMap(&Map, pJob->m_aError, sizeof(pJob->m_aError));
+	if(pJob->m_Valid && !s_MapChecker.IsMapFileValid(aFilename, pJob->m_Crc, pJob->m_Size))
+	{
+		str_copy(pJob->m_aError, "differs from the standard map", sizeof(pJob->m_aError));
+		pJob->m_Valid = false;
+	}
+	pJob->m_LoadTime = (time_get()-StartTime)*1000.0f/time_freq();
+
+	if(s_pResavePath)
+	{
+		// the manifest describes the resaved map then
+		StartTime = time_get();
+		str_format(aFilename, sizeof(aFilename), "%s/%s.map", s_pResavePath, pJob->m_aName);
+		CDataFileReader Resaved;
+		if(!ResaveMap(&Map, aFilename) || !Resaved.Open(s_pStorage, aFilename, IStorage::TYPE_SAVE))
+		{
+			str_copy(pJob->m_aError, "couldn't resave the map", sizeof(pJob->m_aError));
+			pJob->m_Valid = false;
+		}
+		else
+		{
+			pJob->m_Crc = Resaved.Crc();
+			pJob->m_Size = Resaved.FileSize();
+		}
+		pJob->m_ResaveTime = (time_get()-StartTime)*1000.0f/time_freq();
+	}
+	return 0;
+}
+
+static sorted_array<CMapJob> s_lJobs;
+
+static int MaplistCallback(const char *pName, int IsDir, int StorageType, void *pUser)
+{
+	int Length = str_length(pName);
+	if(IsDir || Length < 5 || str_comp(pName+Length-4, ".map") != 0)
+		return 0;
+
+	CMapJob Job;
+	mem_zero(&Job, sizeof(Job));
+	str_copy(Job.m_aName, pName, min((int)sizeof(Job.m_aName), Length-3));
+	Job.m_StorageType = StorageType;
+
+	// the same map can be in several storage paths, the first one wins
+	for(int i = 0; i < s_lJobs.size(); i++)
+	{
+		if(str_comp(s_lJobs[i].m_aName, Job.m_aName) == 0)
+			return 0;
+	}
+	s_lJobs.add(Job);
+	return 0;
+}
+
+static void WriteVersionList(const char *pFilename)
+{
+	IOHANDLE File = s_pStorage->OpenFile(pFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+	{
+		dbg_msg("map_batch", "couldn't open '%s'", pFilename);
+		return;
+	}
+
+	char aBuf[256];
+	str_copy(aBuf, "static CMapVersion s_aMapVersionList[] = {\n", sizeof(aBuf));
+	io_write(File, aBuf, str_length(aBuf));
+	for(int i = 0; i < s_lJobs.size(); i++)
+	{
+		const CMapJob *pJob = &s_lJobs[i];
+		if(!pJob->m_Opened)
+			continue;
+
+		char aMapName[8];
+		str_copy(aMapName, pJob->m_aName, sizeof(aMapName));
+		unsigned Crc = pJob->m_Crc, Size = pJob->m_Size;
+		str_format(aBuf, sizeof(aBuf), "\t{\"%s\", {0x%02x, 0x%02x, 0x%02x, 0x%02x}, {0x%02x, 0x%02x, 0x%02x, 0x%02x}},\n", aMapName,
+			(Crc>>24)&0xff, (Crc>>16)&0xff, (Crc>>8)&0xff, Crc&0xff,
+			(Size>>24)&0xff, (Size>>16)&0xff, (Size>>8)&0xff, Size&0xff);
+		io_write(File, aBuf, str_length(aBuf));
+	}
+	str_copy(aBuf, "};\n", sizeof(aBuf));
+	io_write(File, aBuf, str_length(aBuf));
+	io_close(File);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	const char *pManifestFilename = 0;
+	const char *pVersionFilename = 0;
+	int NumWorkers = thread_num_cpus()-1;
+	char aManifestFilename[256];
+
+	s_pStorage = CreateStorage("Teeworlds", argc, argv);
+	if(!s_pStorage)
+		return -1;
+
+	argc--; argv++;
+	while(argc)
+	{
+		if(argc > 1 && str_comp(*argv, "-j") == 0)
+		{
+			argc--; argv++;
+			NumWorkers = str_toint(*argv);
+		}
+		else if(argc > 1 && str_comp(*argv, "-o") == 0)
+		{
+			argc--; argv++;
+			pManifestFilename = *argv;
+		}
+		else if(argc > 1 && str_comp(*argv, "-r") == 0)
+		{
+			argc--; argv++;
+			s_pResavePath = *argv;
+		}
+		else if(argc > 1 && str_comp(*argv, "-l") == 0)
+		{
+			argc--; argv++;
+			pVersionFilename = *argv;
+		}
+		else if(str_comp(*argv, "-v") == 0)
+			StartLogging();
+		else if(**argv == '-')
+		{
+			StartLogging();
+			dbg_msg("map_batch", "usage: map_batch [-j workers] [-r resave folder] [-o manifest] [-l map version list] [-v] [folder]");
+			return -1;
+		}
+		else
+			s_pPath = *argv;
+		argc--; argv++;
+	}
+
+	// the manifest goes next to the maps it describes
+	if(!pManifestFilename)
+	{
+		str_format(aManifestFilename, sizeof(aManifestFilename), "%s/manifest.txt", s_pResavePath ? s_pResavePath : s_pPath);
+		pManifestFilename = aManifestFilename;
+	}
+	if(s_pResavePath)
+		s_pStorage->CreateFolder(s_pResavePath, IStorage::TYPE_SAVE);
+
+	s_pStorage->ListDirectory(IStorage::TYPE_ALL, s_pPath, MaplistCallback, 0);
+	if(!s_lJobs.size())
+	{
+		StartLogging();
+		dbg_msg("map_batch", "no maps found in '%s'", s_pPath);
+		return -1;
+	}
+
+	// this thread works on the maps as well
+	int64 StartTime = time_get();
+	CJobPool JobPool;
+	JobPool.Init(clamp(NumWorkers, 1, (int)MAX_WORKERS));
+	for(int i = 0; i < s_lJobs.size(); i++)
+		JobPool.Add(&s_lJobs[i].m_Job, ProcessMap, &s_lJobs[i]);
+	for(int i = 0; i < s_lJobs.size(); i++)
+		JobPool.Wait(&s_lJobs[i].m_Job);
+	float Duration = (time_get()-StartTime)/(float)time_freq();
+
+	StartLogging();
+	CMapManifest Manifest;
+	int NumInvalid = 0;
+	for(int i = 0; i < s_lJobs.size(); i++)
+	{
+		const CMapJob *pJob = &s_lJobs[i];
+		if(!pJob->m_Opened)
+		{
+			dbg_msg("map_batch", "%s: %s", pJob->m_aName, pJob->m_aError);
+			NumInvalid++;
+			continue;
+		}
+
+		if(s_pResavePath)
+			dbg_msg("map_batch", "%s: crc=%08x size=%d load=%.2fms resave=%.2fms %s", pJob->m_aName, pJob->m_Crc, pJob->m_Size,
+				pJob->m_LoadTime, pJob->m_ResaveTime, pJob->m_Valid ? "valid" : pJob->m_aError);
+		else
+			dbg_msg("map_batch", "%s: crc=%08x size=%d load=%.2fms %s", pJob->m_aName, pJob->m_Crc, pJob->m_Size,
+				pJob->m_LoadTime, pJob->m_Valid ? "valid" : pJob->m_aError);
+		Manifest.Add(pJob->m_aName, pJob->m_Crc, pJob->m_Size, pJob->m_Valid);
+		if(!pJob->m_Valid)
+			NumInvalid++;
+	}
+
+	dbg_msg("map_batch", "%d maps (%d invalid) in %.2fs with %d workers", s_lJobs.size(), NumInvalid, Duration, JobPool.NumThreads()+1);
+
+	if(!Manifest.Save(s_pStorage, pManifestFilename))
+	{
+		dbg_msg("map_batch", "couldn't write '%s'", pManifestFilename);
+		return -1;
+	}
+	dbg_msg("map_batch", "wrote '%s'", pManifestFilename);
+
+	if(pVersionFilename)
+		WriteVersionList(pVersionFilename);
+	return NumInvalid ? 1 : 0;
+}
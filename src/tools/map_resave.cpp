@@ -1,7 +1,9 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include <engine/shared/datafile.h>
+#include <engine/shared/jobs.h>
 #include <engine/storage.h>
 
 int main(int argc, const char **argv)
@@ -12,15 +14,18 @@ int main(int argc, const char **argv)
 	char aFileName[1024];
 	CDataFileReader DataFile;
 	CDataFileWriter df;
+	CJobPool JobPool;
 
 	if(!pStorage || argc != 3)
 		return -1;
 
+	JobPool.Init(max(thread_num_cpus()-1, 1));
+
 	str_format(aFileName, sizeof(aFileName), "maps/%s", argv[2]);
 
 	if(!DataFile.Open(pStorage, argv[1], IStorage::TYPE_ALL))
 		return -1;
-	if(!df.Open(pStorage, aFileName))
+	if(!df.Open(pStorage, aFileName, &JobPool))
 		return -1;
 
 	// add all items
@@ -35,7 +40,7 @@ int main(int argc, const char **argv)
 	for(Index = 0; Index < DataFile.NumData(); Index++)
 	{
 		pPtr = DataFile.GetData(Index);
-		Size = DataFile.GetDataSize(Index);
+		Size = DataFile.GetUncompressedDataSize(Index);
 		df.AddData(Size, pPtr);
 	}
 
@@ -0,0 +1,298 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include <engine/shared/network.h>
+#include <mastersrv/mastersrv.h>
+
+/*
+	Load generator for the master server. A number of fake servers,
+	each with its own socket, send heartbeats and answer the firewall
+	checks like fake_server does. The heartbeats go out in windows
+	that end with a count request, the count reply tells that the
+	master got through the window, so the rate the master keeps up
+	with can be measured without flooding the socket buffers.
+
+	Afterwards the list is requested a number of times and checked
+	against the servers that were registered.
+*/
+
+enum
+{
+	MAX_FAKE_SERVERS=4096,
+	WINDOW_SIZE=64, // heartbeats per count request
+	MAX_WINDOWS=4, // windows in flight
+	CONNLESS_HEADER=6,
+};
+
+static NETSOCKET s_aSockets[MAX_FAKE_SERVERS];
+static bool s_aRegistered[MAX_FAKE_SERVERS];
+static int s_NumServers = 1000;
+static int s_NumRegistered = 0;
+static int s_NumChecks = 0;
+static int s_NumErrors = 0;
+
+static NETSOCKET s_ClientSocket; // count and list requests
+static NETADDR s_MasterAddr;
+
+static void SendConnless(NETSOCKET Socket, NETADDR *pAddr, const void *pData, int DataSize)
+{
+	unsigned char aBuffer[NET_MAX_PACKETSIZE];
+	for(int i = 0; i < CONNLESS_HEADER; i++)
+		aBuffer[i] = 0xff;
+	mem_copy(&aBuffer[CONNLESS_HEADER], pData, DataSize);
+	net_udp_send(Socket, pAddr, aBuffer, CONNLESS_HEADER+DataSize);
+}
+
+// returns the size of the connless payload or -1
+static int RecvConnless(NETSOCKET Socket, NETADDR *pAddr, unsigned char **ppData)
+{
+	static unsigned char s_aBuffer[NET_MAX_PACKETSIZE];
+	int Bytes = net_udp_recv(Socket, pAddr, s_aBuffer, sizeof(s_aBuffer));
+	if(Bytes < CONNLESS_HEADER)
+		return -1;
+	*ppData = &s_aBuffer[CONNLESS_HEADER];
+	return Bytes-CONNLESS_HEADER;
+}
+
+static bool IsPacket(const unsigned char *pData, int Size, const unsigned char *pHeader, int HeaderSize)
+{
+	return Size >= HeaderSize && mem_comp(pData, pHeader, HeaderSize) == 0;
+}
+
+static void SendHeartbeat(int Server)
+{
+	unsigned char aData[sizeof(SERVERBROWSE_HEARTBEAT) + 2];
+	mem_copy(aData, SERVERBROWSE_HEARTBEAT, sizeof(SERVERBROWSE_HEARTBEAT));
+
+	// no alternative port, the checks all go to the socket itself
+	aData[sizeof(SERVERBROWSE_HEARTBEAT)] = 0;
+	aData[sizeof(SERVERBROWSE_HEARTBEAT)+1] = 0;
+	SendConnless(s_aSockets[Server], &s_MasterAddr, aData, sizeof(aData));
+}
+
+// answers the firewall checks and notes the servers that made it
+static void PumpServers()
+{
+	for(int i = 0; i < s_NumServers; i++)
+	{
+		NETADDR Addr;
+		unsigned char *pData;
+		int Size;
+		while((Size = RecvConnless(s_aSockets[i], &Addr, &pData)) >= 0)
+		{
+			if(IsPacket(pData, Size, SERVERBROWSE_FWCHECK, sizeof(SERVERBROWSE_FWCHECK)))
+			{
+				s_NumChecks++;
+				SendConnless(s_aSockets[i], &Addr, SERVERBROWSE_FWRESPONSE, sizeof(SERVERBROWSE_FWRESPONSE));
+			}
+			else if(IsPacket(pData, Size, SERVERBROWSE_FWOK, sizeof(SERVERBROWSE_FWOK)))
+			{
+				if(!s_aRegistered[i])
+					s_NumRegistered++;
+				s_aRegistered[i] = true;
+			}
+			else if(IsPacket(pData, Size, SERVERBROWSE_FWERROR, sizeof(SERVERBROWSE_FWERROR)))
+				s_NumErrors++;
+		}
+	}
+}
+
+static bool RunHeartbeats(int NumHeartbeats, int TimeoutSecs)
+{
+	int NumWindows = (NumHeartbeats+WINDOW_SIZE-1)/WINDOW_SIZE;
+	int Sent = 0; // windows
+	int Acked = 0;
+	int Lost = 0;
+	int NextServer = 0;
+	int64 LastAck = time_get();
+	int64 StartTime = time_get();
+
+	while(Acked < NumWindows)
+	{
+		// keep a few windows in flight
+		while(Sent < NumWindows && Sent-Acked < MAX_WINDOWS)
+		{
+			for(int i = 0; i < WINDOW_SIZE; i++)
+			{
+				SendHeartbeat(NextServer);
+				NextServer = (NextServer+1)%s_NumServers;
+			}
+			SendConnless(s_ClientSocket, &s_MasterAddr, SERVERBROWSE_GETCOUNT, sizeof(SERVERBROWSE_GETCOUNT));
+			Sent++;
+		}
+
+		NETADDR Addr;
+		unsigned char *pData;
+		int Size;
+		while((Size = RecvConnless(s_ClientSocket, &Addr, &pData)) >= 0)
+		{
+			if(IsPacket(pData, Size, SERVERBROWSE_COUNT, sizeof(SERVERBROWSE_COUNT)))
+			{
+				Acked++;
+				LastAck = time_get();
+			}
+		}
+
+		PumpServers();
+
+		// a dropped count request would stall the run, count the window as lost
+		if(time_get()-LastAck > time_freq()/2)
+		{
+			if(time_get()-StartTime > time_freq()*TimeoutSecs)
+			{
+				dbg_msg("master_loadtest", "timed out after %d of %d windows, is the master running?", Acked, NumWindows);
+				return false;
+			}
+			Lost += Sent-Acked;
+			Acked = Sent;
+			LastAck = time_get();
+		}
+	}
+
+	float Time = (time_get()-StartTime)/(float)time_freq();
+	int Requests = NumWindows*(WINDOW_SIZE+1);
+	dbg_msg("master_loadtest", "%d heartbeats from %d servers in %.2fs, %.0f requests/s, %d windows lost",
+		NumWindows*WINDOW_SIZE, s_NumServers, Time, Requests/Time, Lost);
+	return true;
+}
+
+static bool WaitRegistered(int TimeoutSecs)
+{
+	int64 StartTime = time_get();
+	while(s_NumRegistered < s_NumServers && time_get()-StartTime < time_freq()*TimeoutSecs)
+	{
+		PumpServers();
+		thread_sleep(1);
+	}
+
+	dbg_msg("master_loadtest", "%d of %d servers registered, %d checks answered, %d failed checks",
+		s_NumRegistered, s_NumServers, s_NumChecks, s_NumErrors);
+	return s_NumRegistered == s_NumServers;
+}
+
+// requests the list and checks that all registered servers are in it
+static bool RunLists(int NumLists, int TimeoutSecs)
+{
+	int64 StartTime = time_get();
+	int NumPackets = 0;
+	int NumEntries = 0;
+	for(int l = 0; l < NumLists; l++)
+	{
+		SendConnless(s_ClientSocket, &s_MasterAddr, SERVERBROWSE_GETLIST, sizeof(SERVERBROWSE_GETLIST));
+
+		// wait until the list is complete or nothing comes for a while
+		int64 LastPacket = time_get();
+		int ListEntries = 0;
+		while(ListEntries < s_NumRegistered && time_get()-LastPacket < time_freq()/4)
+		{
+			NETADDR Addr;
+			unsigned char *pData;
+			int Size = RecvConnless(s_ClientSocket, &Addr, &pData);
+			if(Size < 0)
+			{
+				if(time_get()-StartTime > time_freq()*TimeoutSecs)
+				{
+					dbg_msg("master_loadtest", "timed out after %d of %d lists", l, NumLists);
+					return false;
+				}
+				continue;
+			}
+			if(!IsPacket(pData, Size, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST)))
+				continue;
+
+			int Num = (Size-sizeof(SERVERBROWSE_LIST))/sizeof(CMastersrvAddr);
+			NumPackets++;
+			ListEntries += Num;
+			LastPacket = time_get();
+		}
+		NumEntries += ListEntries;
+	}
+
+	float Time = (time_get()-StartTime)/(float)time_freq();
+	dbg_msg("master_loadtest", "%d lists in %.2fs, %.0f lists/s, %d packets, %d entries per list",
+		NumLists, Time, NumLists/Time, NumPackets, NumLists ? NumEntries/NumLists : 0);
+	return NumEntries >= NumLists*s_NumRegistered;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	int NumHeartbeats = 50000;
+	int NumLists = 200;
+	int TimeoutSecs = 30;
+	const char *pMaster = "127.0.0.1";
+
+	dbg_logger_stdout();
+	net_init();
+
+	argc--; argv++;
+	while(argc)
+	{
+		if(argc > 1 && str_comp(*argv, "-s") == 0)
+		{
+			argc--; argv++;
+			s_NumServers = str_toint(*argv);
+		}
+		else if(argc > 1 && str_comp(*argv, "-n") == 0)
+		{
+			argc--; argv++;
+			NumHeartbeats = str_toint(*argv);
+		}
+		else if(argc > 1 && str_comp(*argv, "-l") == 0)
+		{
+			argc--; argv++;
+			NumLists = str_toint(*argv);
+		}
+		else if(argc > 1 && str_comp(*argv, "-m") == 0)
+		{
+			argc--; argv++;
+			pMaster = *argv;
+		}
+		else if(argc > 1 && str_comp(*argv, "-t") == 0)
+		{
+			argc--; argv++;
+			TimeoutSecs = str_toint(*argv);
+		}
+		else
+		{
+			dbg_msg("master_loadtest", "usage: master_loadtest [-s servers] [-n heartbeats] [-l list requests] [-m master ip] [-t timeout]");
+			return -1;
+		}
+		argc--; argv++;
+	}
+
+	if(s_NumServers < 1 || s_NumServers > MAX_FAKE_SERVERS)
+	{
+		dbg_msg("master_loadtest", "servers have to be in 1-%d", (int)MAX_FAKE_SERVERS);
+		return -1;
+	}
+
+	if(net_addr_from_str(&s_MasterAddr, pMaster) != 0)
+	{
+		dbg_msg("master_loadtest", "invalid master address '%s'", pMaster);
+		return -1;
+	}
+	s_MasterAddr.port = MASTERSERVER_PORT;
+
+	NETADDR BindAddr;
+	mem_zero(&BindAddr, sizeof(BindAddr));
+	BindAddr.type = s_MasterAddr.type;
+	for(int i = 0; i < s_NumServers; i++)
+	{
+		s_aSockets[i] = net_udp_create(BindAddr);
+		if(!s_aSockets[i].type)
+		{
+			dbg_msg("master_loadtest", "couldn't open socket %d, raise the file limit or use less servers", i);
+			return -1;
+		}
+	}
+	s_ClientSocket = net_udp_create(BindAddr);
+
+	bool Ok = RunHeartbeats(NumHeartbeats, TimeoutSecs);
+	Ok = Ok && WaitRegistered(TimeoutSecs);
+	Ok = Ok && RunLists(NumLists, TimeoutSecs);
+
+	for(int i = 0; i < s_NumServers; i++)
+		net_udp_close(s_aSockets[i]);
+	net_udp_close(s_ClientSocket);
+	return Ok ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+#include <base/atomic.h>
+#include <base/tl/spsc_ring.h>
+#include <base/tl/mpmc_queue.h>
+
+/*
+	Stress test and benchmark for the lock free queues in base/tl.
+
+	Every producer pushes a run of numbers tagged with its id. The
+	consumers check that each producer's numbers arrive in order and
+	that every number arrives exactly once, then the throughput is
+	compared against a ring that takes a lock per item. Build the tool
+	with -fsanitize=thread to have the same runs checked for races.
+*/
+
+enum
+{
+	QUEUE_SIZE=1024,
+	MAX_THREADS=16,
+	PRODUCER_SHIFT=24,
+};
+
+// the queue under test
+class IQueue
+{
+public:
+	virtual ~IQueue() {}
+	virtual const char *Name() const = 0;
+	virtual bool Push(int Item) = 0;
+	virtual bool Pop(int *pItem) = 0;
+};
+
+class CLockedRing : public IQueue
+{
+	LOCK m_Lock;
+	int m_aItems[QUEUE_SIZE];
+	int m_Read;
+	int m_Used;
+public:
+	CLockedRing() { m_Lock = lock_create(); m_Read = 0; m_Used = 0; }
+	~CLockedRing() { lock_destroy(m_Lock); }
+	const char *Name() const { return "locked"; }
+
+	bool Push(int Item)
+	{
+		lock_wait(m_Lock);
+		bool Pushed = m_Used < QUEUE_SIZE;
+		if(Pushed)
+			m_aItems[(m_Read+m_Used++)%QUEUE_SIZE] = Item;
+		lock_release(m_Lock);
+		return Pushed;
+	}
+
+	bool Pop(int *pItem)
+	{
+		lock_wait(m_Lock);
+		bool Popped = m_Used > 0;
+		if(Popped)
+		{
+			*pItem = m_aItems[m_Read];
+			m_Read = (m_Read+1)%QUEUE_SIZE;
+			m_Used--;
+		}
+		lock_release(m_Lock);
+		return Popped;
+	}
+};
+
+class CSpscRing : public IQueue
+{
+	spsc_ring<int, QUEUE_SIZE> m_Ring;
+public:
+	const char *Name() const { return "spsc"; }
+	bool Push(int Item) { return m_Ring.push(Item); }
+	bool Pop(int *pItem) { return m_Ring.pop(pItem); }
+};
+
+class CMpmcQueue : public IQueue
+{
+	mpmc_queue<int, QUEUE_SIZE> m_Queue;
+public:
+	const char *Name() const { return "mpmc"; }
+	bool Push(int Item) { return m_Queue.push(Item); }
+	bool Pop(int *pItem) { return m_Queue.pop(pItem); }
+};
+
+struct CRun
+{
+	IQueue *m_pQueue;
+	int m_NumItems; // per producer
+	int m_NumProducers;
+	ATOMIC_INT m_Consumed;
+	ATOMIC_INT m_Errors;
+	unsigned char *m_pSeen; // one byte per item and producer
+};
+
+struct CThread
+{
+	CRun *m_pRun;
+	int m_Index;
+	void *m_pThread;
+};
+
+static void ProducerThread(void *pUser)
+{
+	CThread *pThread = (CThread *)pUser;
+	CRun *pRun = pThread->m_pRun;
+
+	for(int i = 0; i < pRun->m_NumItems; i++)
+	{
+		while(!pRun->m_pQueue->Push((pThread->m_Index<<PRODUCER_SHIFT)|i))
+			thread_yield();
+	}
+}
+
+static void ConsumerThread(void *pUser)
+{
+	CThread *pThread = (CThread *)pUser;
+	CRun *pRun = pThread->m_pRun;
+	int Total = pRun->m_NumItems*pRun->m_NumProducers;
+	int aLast[MAX_THREADS];
+	for(int i = 0; i < MAX_THREADS; i++)
+		aLast[i] = -1;
+
+	while(atomic_int_load(&pRun->m_Consumed, ATOMIC_RELAXED) < Total)
+	{
+		int Item;
+		if(!pRun->m_pQueue->Pop(&Item))
+		{
+			thread_yield();
+			continue;
+		}
+
+		// a consumer sees the items of each producer in order
+		int Producer = Item>>PRODUCER_SHIFT;
+		int Number = Item&((1<<PRODUCER_SHIFT)-1);
+		if(Producer >= pRun->m_NumProducers || Number <= aLast[Producer] ||
+			pRun->m_pSeen[Producer*pRun->m_NumItems+Number]++)
+			atomic_int_fetch_add(&pRun->m_Errors, 1, ATOMIC_RELAXED);
+		else
+			aLast[Producer] = Number;
+		atomic_int_fetch_add(&pRun->m_Consumed, 1, ATOMIC_RELAXED);
+	}
+}
+
+static bool Run(IQueue *pQueue, int NumProducers, int NumConsumers, int NumItems)
+{
+	CRun Run;
+	Run.m_pQueue = pQueue;
+	Run.m_NumItems = NumItems;
+	Run.m_NumProducers = NumProducers;
+	atomic_int_store(&Run.m_Consumed, 0, ATOMIC_RELAXED);
+	atomic_int_store(&Run.m_Errors, 0, ATOMIC_RELAXED);
+	Run.m_pSeen = (unsigned char *)mem_alloc(NumItems*NumProducers, 1);
+	mem_zero(Run.m_pSeen, NumItems*NumProducers);
+
+	CThread aThreads[MAX_THREADS*2];
+	int64 StartTime = time_get();
+	for(int i = 0; i < NumConsumers; i++)
+	{
+		aThreads[i].m_pRun = &Run;
+		aThreads[i].m_Index = i;
+		aThreads[i].m_pThread = thread_create(ConsumerThread, &aThreads[i]);
+	}
+	for(int i = 0; i < NumProducers; i++)
+	{
+		aThreads[NumConsumers+i].m_pRun = &Run;
+		aThreads[NumConsumers+i].m_Index = i;
+		aThreads[NumConsumers+i].m_pThread = thread_create(ProducerThread, &aThreads[NumConsumers+i]);
+	}
+	for(int i = 0; i < NumConsumers+NumProducers; i++)
+		thread_wait(aThreads[i].m_pThread);
+	float Time = (time_get()-StartTime)/(float)time_freq();
+
+	// every item must have arrived exactly once
+	int Errors = atomic_int_load(&Run.m_Errors, ATOMIC_RELAXED);
+	for(int i = 0; i < NumItems*NumProducers; i++)
+		if(Run.m_pSeen[i] != 1)
+			Errors++;
+	mem_free(Run.m_pSeen);
+
+	int Total = NumItems*NumProducers;
+	dbg_msg("queue_bench", "%-6s %dp/%dc: %d items in %.2fms, %.2f M items/s, %s",
+		pQueue->Name(), NumProducers, NumConsumers, Total, Time*1000.0f, Total/Time/1000000.0f,
+		Errors ? "FAILED" : "ok");
+	if(Errors)
+		dbg_msg("queue_bench", "%d items were lost, duplicated or out of order", Errors);
+	return Errors == 0;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	int NumItems = 1000000;
+	int NumThreads = 4;
+
+	dbg_logger_stdout();
+
+	argc--; argv++;
+	while(argc)
+	{
+		if(argc > 1 && str_comp(*argv, "-n") == 0)
+		{
+			argc--; argv++;
+			NumItems = str_toint(*argv);
+		}
+		else if(argc > 1 && str_comp(*argv, "-t") == 0)
+		{
+			argc--; argv++;
+			NumThreads = str_toint(*argv);
+		}
+		else
+		{
+			dbg_msg("queue_bench", "usage: queue_bench [-n items per producer] [-t max producers and consumers]");
+			return -1;
+		}
+		argc--; argv++;
+	}
+
+	if(NumItems < 1 || NumItems >= (1<<PRODUCER_SHIFT) || NumThreads < 1 || NumThreads > MAX_THREADS)
+	{
+		dbg_msg("queue_bench", "items have to be in 1-%d and threads in 1-%d", (1<<PRODUCER_SHIFT)-1, (int)MAX_THREADS);
+		return -1;
+	}
+
+	dbg_msg("queue_bench", "%d cpus, queues of %d items", thread_num_cpus(), (int)QUEUE_SIZE);
+
+	bool Ok = true;
+	CLockedRing *pLocked = new CLockedRing;
+	CSpscRing *pSpsc = new CSpscRing;
+	CMpmcQueue *pMpmc = new CMpmcQueue;
+
+	// one producer and one consumer
+	Ok &= Run(pLocked, 1, 1, NumItems);
+	Ok &= Run(pSpsc, 1, 1, NumItems);
+	Ok &= Run(pMpmc, 1, 1, NumItems);
+
+	// contended
+	for(int Threads = 2; Threads <= NumThreads; Threads *= 2)
+	{
+		Ok &= Run(pLocked, Threads, Threads, NumItems/Threads);
+		Ok &= Run(pMpmc, Threads, Threads, NumItems/Threads);
+	}
+
+	delete pLocked;
+	delete pSpsc;
+	delete pMpmc;
+	return Ok ? 0 : 1;
+}